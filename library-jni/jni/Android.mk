@@ -21,6 +21,8 @@ include $(CLEAR_VARS)
 FEATURE_NEON:=
 LIBRARY_PROFILER:=
 MODULE_ENCRYPT:=
+FEATURE_AES_NI:=
+FEATURE_AES_ARMV8:=
 
 #settings
 
@@ -32,10 +34,21 @@ MODULE_ENCRYPT:=yes
 ifeq ($(TARGET_ARCH_ABI), armeabi-v7a)
 	# add neon optimization code (only armeabi-v7a)
 	FEATURE_NEON:=yes
+	# add armv8 crypto extensions aes backend, used only if cpu supports it
+	# (opt-in by "ndk-build AES_ARMV8=1", needs ndk r10+ with gcc 4.9,
+	# r8e toolchain and cpufeatures do not know armv8 crypto)
+	ifeq ($(AES_ARMV8),1)
+		FEATURE_AES_ARMV8:=yes
+	endif
 else
 
 endif
 
+ifeq ($(TARGET_ARCH_ABI), x86)
+	# add aes-ni aes backend, used only if cpu supports it
+	FEATURE_AES_NI:=yes
+endif
+
 #if armeabi or armeabi-v7a
 ifeq ($(TARGET_ARCH_ABI),$(filter $(TARGET_ARCH_ABI),armeabi armeabi-v7a))
 	# add profiler (only arm)
@@ -64,11 +77,33 @@ LOCAL_PRELINK_MODULE := true
 include $(PREBUILT_SHARED_LIBRARY)
 endif
 
+ifdef MODULE_ENCRYPT
+ifdef FEATURE_AES_NI
+include $(CLEAR_VARS)
+LOCAL_MODULE := aes-cipher-x86
+LOCAL_SRC_FILES := aes-cipher-x86.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/tropicssl/include
+LOCAL_CFLAGS := -O3 -msse2 -maes
+include $(BUILD_STATIC_LIBRARY)
+endif
+
+ifdef FEATURE_AES_ARMV8
+include $(CLEAR_VARS)
+LOCAL_MODULE := aes-cipher-armv8
+LOCAL_SRC_FILES := aes-cipher-armv8.c
+LOCAL_ARM_MODE := arm
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/tropicssl/include
+LOCAL_CFLAGS := -O3 -march=armv8-a -mfpu=crypto-neon-fp-armv8
+LOCAL_STATIC_LIBRARIES := cpufeatures
+include $(BUILD_STATIC_LIBRARY)
+endif
+endif
+
 #ffmpeg-jni library
 include $(CLEAR_VARS)
 LOCAL_ALLOW_UNDEFINED_SYMBOLS=false
 LOCAL_MODULE := ffmpeg-jni
-LOCAL_SRC_FILES := ffmpeg-jni.c player.c queue.c helpers.c jni-protocol.c blend.c convert.cpp
+LOCAL_SRC_FILES := ffmpeg-jni.c player.c queue.c helpers.c jni-protocol.c blend.c overlay.c convert.cpp render.c metrics.c trace.c checksum.c log.c executor.c governor.c frame_cache.c extract.c
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/ffmpeg-build/$(TARGET_ARCH_ABI)/include
 LOCAL_SHARED_LIBRARY := ffmpeg-prebuilt
 
@@ -79,6 +114,13 @@ LOCAL_STATIC_LIBRARIES += andprof
 LOCAL_REQUIRED_MODULES += andprof
 endif
 
+ifdef FEATURE_NEON
+# vectorized blend kernels, selected in runtime
+LOCAL_CFLAGS += -DFEATURE_NEON
+LOCAL_SRC_FILES += blend-neon.c.neon
+endif
+LOCAL_STATIC_LIBRARIES += cpufeatures
+
 LOCAL_CFLAGS += -DLIBYUV
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/libyuv/include
 LOCAL_CPP_INCLUDES += $(LOCAL_PATH)/libyuv/include
@@ -87,10 +129,18 @@ LOCAL_REQUIRED_MODULES += libyuv_static
 
 ifdef MODULE_ENCRYPT
 LOCAL_CFLAGS += -DMODULE_ENCRYPT
-LOCAL_SRC_FILES += aes-protocol.c
+LOCAL_SRC_FILES += aes-protocol.c aes-cipher.c aes-pool.c
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/tropicssl/include
 LOCAL_STATIC_LIBRARIES += tropicssl
 LOCAL_REQUIRED_MODULES += tropicssl
+ifdef FEATURE_AES_NI
+LOCAL_CFLAGS += -DFEATURE_AES_NI
+LOCAL_STATIC_LIBRARIES += aes-cipher-x86
+endif
+ifdef FEATURE_AES_ARMV8
+LOCAL_CFLAGS += -DFEATURE_AES_ARMV8
+LOCAL_STATIC_LIBRARIES += aes-cipher-armv8
+endif
 endif
 
 LOCAL_LDLIBS    += -landroid
@@ -102,7 +152,7 @@ ifdef FEATURE_NEON
 include $(CLEAR_VARS)
 LOCAL_ALLOW_UNDEFINED_SYMBOLS=false
 LOCAL_MODULE := ffmpeg-jni-neon
-LOCAL_SRC_FILES := ffmpeg-jni.c player.c queue.c helpers.c jni-protocol.c blend.c convert.cpp
+LOCAL_SRC_FILES := ffmpeg-jni.c player.c queue.c helpers.c jni-protocol.c blend.c overlay.c convert.cpp render.c metrics.c trace.c checksum.c log.c executor.c governor.c frame_cache.c extract.c
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/ffmpeg-build/$(TARGET_ARCH_ABI)/include
 LOCAL_SHARED_LIBRARY := ffmpeg-prebuilt-neon
 
@@ -113,6 +163,13 @@ LOCAL_STATIC_LIBRARIES += andprof
 LOCAL_REQUIRED_MODULES += andprof
 endif
 
+ifdef FEATURE_NEON
+# vectorized blend kernels, selected in runtime
+LOCAL_CFLAGS += -DFEATURE_NEON
+LOCAL_SRC_FILES += blend-neon.c.neon
+endif
+LOCAL_STATIC_LIBRARIES += cpufeatures
+
 LOCAL_CFLAGS += -DLIBYUV
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/libyuv/include
 LOCAL_CPP_INCLUDES += $(LOCAL_PATH)/libyuv/include
@@ -121,10 +178,18 @@ LOCAL_REQUIRED_MODULES += libyuv_static
 
 ifdef MODULE_ENCRYPT
 LOCAL_CFLAGS += -DMODULE_ENCRYPT
-LOCAL_SRC_FILES += aes-protocol.c
+LOCAL_SRC_FILES += aes-protocol.c aes-cipher.c aes-pool.c
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/tropicssl/include
 LOCAL_STATIC_LIBRARIES += tropicssl
 LOCAL_REQUIRED_MODULES += tropicssl
+ifdef FEATURE_AES_NI
+LOCAL_CFLAGS += -DFEATURE_AES_NI
+LOCAL_STATIC_LIBRARIES += aes-cipher-x86
+endif
+ifdef FEATURE_AES_ARMV8
+LOCAL_CFLAGS += -DFEATURE_AES_ARMV8
+LOCAL_STATIC_LIBRARIES += aes-cipher-armv8
+endif
 endif
 
 LOCAL_LDLIBS    += -landroid
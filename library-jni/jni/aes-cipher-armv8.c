@@ -0,0 +1,165 @@
+/*
+ * aes-cipher-armv8.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * ARMv8 Crypto Extensions backend, has to be compiled with crypto
+ * extensions enabled and called only when cpu reports aes support.
+ */
+
+#include <arm_neon.h>
+#include <cpu-features.h>
+
+#include "aes-cipher.h"
+
+#define ARMV8_BLOCKS 4
+
+#define BLOCKS_PER_SECTOR (AES_CIPHER_SECTOR_SIZE / AES_CIPHER_BLOCK_SIZE)
+
+static int aes_cipher_armv8_available() {
+	AndroidCpuFamily family = android_getCpuFamily();
+	uint64_t features = android_getCpuFeatures();
+	if (family == ANDROID_CPU_FAMILY_ARM)
+		return (features & ANDROID_CPU_ARM_FEATURE_AES) != 0;
+	if (family == ANDROID_CPU_FAMILY_ARM64)
+		return (features & ANDROID_CPU_ARM64_FEATURE_AES) != 0;
+	return 0;
+}
+
+static inline __attribute__((always_inline)) void aes_cipher_armv8_blocks(
+		const uint8x16_t *k, uint8x16_t *s, int n) {
+	int round, j;
+	for (round = 0; round < AES_CIPHER_ROUNDS_128 - 1; round++) {
+		for (j = 0; j < n; j++)
+			s[j] = vaesimcq_u8(vaesdq_u8(s[j], k[round]));
+	}
+	for (j = 0; j < n; j++) {
+		s[j] = vaesdq_u8(s[j], k[AES_CIPHER_ROUNDS_128 - 1]);
+		s[j] = veorq_u8(s[j], k[AES_CIPHER_ROUNDS_128]);
+	}
+}
+
+static inline __attribute__((always_inline)) void aes_cipher_armv8_enc_blocks(
+		const uint8x16_t *k, uint8x16_t *s, int n) {
+	int round, j;
+	for (round = 0; round < AES_CIPHER_ROUNDS_128 - 1; round++) {
+		for (j = 0; j < n; j++)
+			s[j] = vaesmcq_u8(vaeseq_u8(s[j], k[round]));
+	}
+	for (j = 0; j < n; j++) {
+		s[j] = vaeseq_u8(s[j], k[AES_CIPHER_ROUNDS_128 - 1]);
+		s[j] = veorq_u8(s[j], k[AES_CIPHER_ROUNDS_128]);
+	}
+}
+
+static void aes_cipher_armv8_decrypt_sectors(struct AesCipher *cipher,
+		int64_t position, unsigned char *data, int size) {
+	uint8x16_t k[AES_CIPHER_ROUNDS_128 + 1];
+	uint8x16_t c[ARMV8_BLOCKS], s[ARMV8_BLOCKS];
+	uint8x16_t last = vdupq_n_u8(0);
+	int blocks = (size + AES_CIPHER_BLOCK_SIZE - 1) / AES_CIPHER_BLOCK_SIZE;
+	int i, j;
+
+	for (i = 0; i <= AES_CIPHER_ROUNDS_128; i++)
+		k[i] = vld1q_u8(cipher->dec_keys[i]);
+
+	// cbc decryption does not depend on previous results, so blocks are
+	// decrypted in groups, also across sector boundaries
+	for (i = 0; i < blocks;) {
+		int n = blocks - i;
+		if (n > ARMV8_BLOCKS)
+			n = ARMV8_BLOCKS;
+		for (j = 0; j < n; j++) {
+			c[j] = vld1q_u8(&data[(i + j) * AES_CIPHER_BLOCK_SIZE]);
+			s[j] = c[j];
+		}
+		if (n == ARMV8_BLOCKS)
+			aes_cipher_armv8_blocks(k, s, ARMV8_BLOCKS);
+		else
+			aes_cipher_armv8_blocks(k, s, n);
+		for (j = 0; j < n; j++) {
+			int block = i + j;
+			uint8x16_t prev;
+			if (block % BLOCKS_PER_SECTOR == 0) {
+				int64_t offset = position
+						+ (int64_t) block * AES_CIPHER_BLOCK_SIZE;
+				prev = vreinterpretq_u8_u32(
+						vsetq_lane_u32((uint32_t) (offset >> 9),
+								vdupq_n_u32(0), 0));
+			} else {
+				prev = j == 0 ? last : c[j - 1];
+			}
+			vst1q_u8(&data[block * AES_CIPHER_BLOCK_SIZE],
+					veorq_u8(s[j], prev));
+		}
+		last = c[n - 1];
+		i += n;
+	}
+}
+
+static void aes_cipher_armv8_encrypt_sectors(struct AesCipher *cipher,
+		int64_t position, unsigned char *data, int size) {
+	uint8x16_t k[AES_CIPHER_ROUNDS_128 + 1];
+	uint8x16_t s[ARMV8_BLOCKS];
+	int sectors = (size + AES_CIPHER_SECTOR_SIZE - 1) / AES_CIPHER_SECTOR_SIZE;
+	int last_blocks = (size - (sectors - 1) * AES_CIPHER_SECTOR_SIZE
+			+ AES_CIPHER_BLOCK_SIZE - 1) / AES_CIPHER_BLOCK_SIZE;
+	int first, block, j;
+
+	for (j = 0; j <= AES_CIPHER_ROUNDS_128; j++)
+		k[j] = vld1q_u8(cipher->enc_keys[j]);
+
+	// cbc encryption is serial inside of sector, so same blocks of
+	// consecutive sectors are encrypted together
+	for (first = 0; first < sectors; first += ARMV8_BLOCKS) {
+		int n = sectors - first;
+		if (n > ARMV8_BLOCKS)
+			n = ARMV8_BLOCKS;
+		for (j = 0; j < n; j++) {
+			int64_t offset = position
+					+ (int64_t) (first + j) * AES_CIPHER_SECTOR_SIZE;
+			s[j] = vreinterpretq_u8_u32(
+					vsetq_lane_u32((uint32_t) (offset >> 9), vdupq_n_u32(0),
+							0));
+		}
+		for (block = 0; block < BLOCKS_PER_SECTOR; block++) {
+			unsigned char *sector = &data[first * AES_CIPHER_SECTOR_SIZE
+					+ block * AES_CIPHER_BLOCK_SIZE];
+			int m = n;
+			// only the last sector of data could be shorter
+			if (first + n == sectors && block >= last_blocks)
+				m = n - 1;
+			if (m == 0)
+				break;
+			for (j = 0; j < m; j++)
+				s[j] = veorq_u8(s[j], vld1q_u8(&sector[j * AES_CIPHER_SECTOR_SIZE]));
+			if (m == ARMV8_BLOCKS)
+				aes_cipher_armv8_enc_blocks(k, s, ARMV8_BLOCKS);
+			else
+				aes_cipher_armv8_enc_blocks(k, s, m);
+			for (j = 0; j < m; j++)
+				vst1q_u8(&sector[j * AES_CIPHER_SECTOR_SIZE], s[j]);
+		}
+	}
+}
+
+const struct AesCipherBackend aes_cipher_backend_armv8 = {
+	"armv8",
+	aes_cipher_armv8_available,
+	aes_cipher_armv8_decrypt_sectors,
+	aes_cipher_armv8_encrypt_sectors,
+};
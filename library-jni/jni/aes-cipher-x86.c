@@ -0,0 +1,168 @@
+/*
+ * aes-cipher-x86.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * AES-NI backend, has to be compiled with -maes and called only
+ * when cpuid reports aes support.
+ */
+
+#include <cpuid.h>
+#include <wmmintrin.h>
+#include <emmintrin.h>
+
+#include "aes-cipher.h"
+
+// blocks processed at once to hide aesdec/aesenc latency
+#ifdef __x86_64__
+#define AESNI_BLOCKS 8
+#else
+#define AESNI_BLOCKS 4
+#endif
+
+#define BLOCKS_PER_SECTOR (AES_CIPHER_SECTOR_SIZE / AES_CIPHER_BLOCK_SIZE)
+
+static int aes_cipher_aesni_available() {
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	return (ecx & bit_AES) != 0;
+}
+
+static inline __attribute__((always_inline)) void aes_cipher_aesni_blocks(
+		const __m128i *k, __m128i *s, int n) {
+	int round, j;
+	for (j = 0; j < n; j++)
+		s[j] = _mm_xor_si128(s[j], k[0]);
+	for (round = 1; round < AES_CIPHER_ROUNDS_128; round++) {
+		for (j = 0; j < n; j++)
+			s[j] = _mm_aesdec_si128(s[j], k[round]);
+	}
+	for (j = 0; j < n; j++)
+		s[j] = _mm_aesdeclast_si128(s[j], k[AES_CIPHER_ROUNDS_128]);
+}
+
+static inline __attribute__((always_inline)) void aes_cipher_aesni_enc_blocks(
+		const __m128i *k, __m128i *s, int n) {
+	int round, j;
+	for (j = 0; j < n; j++)
+		s[j] = _mm_xor_si128(s[j], k[0]);
+	for (round = 1; round < AES_CIPHER_ROUNDS_128; round++) {
+		for (j = 0; j < n; j++)
+			s[j] = _mm_aesenc_si128(s[j], k[round]);
+	}
+	for (j = 0; j < n; j++)
+		s[j] = _mm_aesenclast_si128(s[j], k[AES_CIPHER_ROUNDS_128]);
+}
+
+static void aes_cipher_aesni_decrypt_sectors(struct AesCipher *cipher,
+		int64_t position, unsigned char *data, int size) {
+	__m128i k[AES_CIPHER_ROUNDS_128 + 1];
+	__m128i c[AESNI_BLOCKS], s[AESNI_BLOCKS];
+	__m128i last = _mm_setzero_si128();
+	int blocks = (size + AES_CIPHER_BLOCK_SIZE - 1) / AES_CIPHER_BLOCK_SIZE;
+	int i, j;
+
+	for (i = 0; i <= AES_CIPHER_ROUNDS_128; i++)
+		k[i] = _mm_load_si128((const __m128i *) cipher->dec_keys[i]);
+
+	// cbc decryption does not depend on previous results, so blocks are
+	// decrypted in groups, also across sector boundaries
+	for (i = 0; i < blocks;) {
+		int n = blocks - i;
+		if (n > AESNI_BLOCKS)
+			n = AESNI_BLOCKS;
+		for (j = 0; j < n; j++) {
+			c[j] = _mm_loadu_si128(
+					(const __m128i *) &data[(i + j) * AES_CIPHER_BLOCK_SIZE]);
+			s[j] = c[j];
+		}
+		if (n == AESNI_BLOCKS)
+			aes_cipher_aesni_blocks(k, s, AESNI_BLOCKS);
+		else
+			aes_cipher_aesni_blocks(k, s, n);
+		for (j = 0; j < n; j++) {
+			int block = i + j;
+			__m128i prev;
+			if (block % BLOCKS_PER_SECTOR == 0) {
+				int64_t offset = position
+						+ (int64_t) block * AES_CIPHER_BLOCK_SIZE;
+				prev = _mm_cvtsi32_si128((int) (offset >> 9));
+			} else {
+				prev = j == 0 ? last : c[j - 1];
+			}
+			_mm_storeu_si128((__m128i *) &data[block * AES_CIPHER_BLOCK_SIZE],
+					_mm_xor_si128(s[j], prev));
+		}
+		last = c[n - 1];
+		i += n;
+	}
+}
+
+static void aes_cipher_aesni_encrypt_sectors(struct AesCipher *cipher,
+		int64_t position, unsigned char *data, int size) {
+	__m128i k[AES_CIPHER_ROUNDS_128 + 1];
+	__m128i s[AESNI_BLOCKS];
+	int sectors = (size + AES_CIPHER_SECTOR_SIZE - 1) / AES_CIPHER_SECTOR_SIZE;
+	int last_blocks = (size - (sectors - 1) * AES_CIPHER_SECTOR_SIZE
+			+ AES_CIPHER_BLOCK_SIZE - 1) / AES_CIPHER_BLOCK_SIZE;
+	int first, block, j;
+
+	for (j = 0; j <= AES_CIPHER_ROUNDS_128; j++)
+		k[j] = _mm_load_si128((const __m128i *) cipher->enc_keys[j]);
+
+	// cbc encryption is serial inside of sector, so same blocks of
+	// consecutive sectors are encrypted together
+	for (first = 0; first < sectors; first += AESNI_BLOCKS) {
+		int n = sectors - first;
+		if (n > AESNI_BLOCKS)
+			n = AESNI_BLOCKS;
+		for (j = 0; j < n; j++) {
+			int64_t offset = position
+					+ (int64_t) (first + j) * AES_CIPHER_SECTOR_SIZE;
+			s[j] = _mm_cvtsi32_si128((int) (offset >> 9));
+		}
+		for (block = 0; block < BLOCKS_PER_SECTOR; block++) {
+			unsigned char *sector = &data[first * AES_CIPHER_SECTOR_SIZE
+					+ block * AES_CIPHER_BLOCK_SIZE];
+			int m = n;
+			// only the last sector of data could be shorter
+			if (first + n == sectors && block >= last_blocks)
+				m = n - 1;
+			if (m == 0)
+				break;
+			for (j = 0; j < m; j++) {
+				s[j] = _mm_xor_si128(s[j], _mm_loadu_si128(
+						(const __m128i *) &sector[j * AES_CIPHER_SECTOR_SIZE]));
+			}
+			if (m == AESNI_BLOCKS)
+				aes_cipher_aesni_enc_blocks(k, s, AESNI_BLOCKS);
+			else
+				aes_cipher_aesni_enc_blocks(k, s, m);
+			for (j = 0; j < m; j++)
+				_mm_storeu_si128((__m128i *) &sector[j * AES_CIPHER_SECTOR_SIZE],
+						s[j]);
+		}
+	}
+}
+
+const struct AesCipherBackend aes_cipher_backend_aesni = {
+	"aesni",
+	aes_cipher_aesni_available,
+	aes_cipher_aesni_decrypt_sectors,
+	aes_cipher_aesni_encrypt_sectors,
+};
@@ -0,0 +1,216 @@
+/*
+ * aes-cipher.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <string.h>
+
+#include "aes-cipher.h"
+
+#define FALSE 0
+#define TRUE (!(FALSE))
+
+static const unsigned char aes_sbox[256] = {
+	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b,
+	0xfe, 0xd7, 0xab, 0x76, 0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0,
+	0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0, 0xb7, 0xfd, 0x93, 0x26,
+	0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+	0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2,
+	0xeb, 0x27, 0xb2, 0x75, 0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0,
+	0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84, 0x53, 0xd1, 0x00, 0xed,
+	0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+	0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f,
+	0x50, 0x3c, 0x9f, 0xa8, 0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5,
+	0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2, 0xcd, 0x0c, 0x13, 0xec,
+	0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+	0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14,
+	0xde, 0x5e, 0x0b, 0xdb, 0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c,
+	0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79, 0xe7, 0xc8, 0x37, 0x6d,
+	0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+	0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f,
+	0x4b, 0xbd, 0x8b, 0x8a, 0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e,
+	0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e, 0xe1, 0xf8, 0x98, 0x11,
+	0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+	0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f,
+	0xb0, 0x54, 0xbb, 0x16,
+};
+
+static unsigned char aes_xtime(unsigned char x) {
+	return (x << 1) ^ ((x & 0x80) ? 0x1b : 0x00);
+}
+
+static unsigned char aes_gf_mul(unsigned char x, unsigned char y) {
+	unsigned char r = 0;
+	while (y) {
+		if (y & 1)
+			r ^= x;
+		x = aes_xtime(x);
+		y >>= 1;
+	}
+	return r;
+}
+
+static void aes_inv_mix_column(unsigned char *c) {
+	unsigned char a0 = c[0], a1 = c[1], a2 = c[2], a3 = c[3];
+	c[0] = aes_gf_mul(a0, 14) ^ aes_gf_mul(a1, 11) ^ aes_gf_mul(a2, 13)
+			^ aes_gf_mul(a3, 9);
+	c[1] = aes_gf_mul(a0, 9) ^ aes_gf_mul(a1, 14) ^ aes_gf_mul(a2, 11)
+			^ aes_gf_mul(a3, 13);
+	c[2] = aes_gf_mul(a0, 13) ^ aes_gf_mul(a1, 9) ^ aes_gf_mul(a2, 14)
+			^ aes_gf_mul(a3, 11);
+	c[3] = aes_gf_mul(a0, 11) ^ aes_gf_mul(a1, 13) ^ aes_gf_mul(a2, 9)
+			^ aes_gf_mul(a3, 14);
+}
+
+static void aes_cipher_expand_enc_keys128(const unsigned char *key,
+		unsigned char enc_keys[][AES_CIPHER_BLOCK_SIZE]) {
+	unsigned char rcon = 0x01;
+	int round, i;
+
+	memcpy(enc_keys[0], key, AES_CIPHER_BLOCK_SIZE);
+	for (round = 1; round <= AES_CIPHER_ROUNDS_128; round++) {
+		const unsigned char *prev = enc_keys[round - 1];
+		unsigned char *rk = enc_keys[round];
+		rk[0] = prev[0] ^ aes_sbox[prev[13]] ^ rcon;
+		rk[1] = prev[1] ^ aes_sbox[prev[14]];
+		rk[2] = prev[2] ^ aes_sbox[prev[15]];
+		rk[3] = prev[3] ^ aes_sbox[prev[12]];
+		for (i = 4; i < AES_CIPHER_BLOCK_SIZE; i++)
+			rk[i] = prev[i] ^ rk[i - 4];
+		rcon = aes_xtime(rcon);
+	}
+}
+
+/*
+ * Round keys for equivalent inverse cipher (as used by aesdec and aesd
+ * instructions): reversed encryption keys with InvMixColumns applied to
+ * all but the first and the last one.
+ */
+static void aes_cipher_expand_dec_keys128(
+		unsigned char enc_keys[][AES_CIPHER_BLOCK_SIZE],
+		unsigned char dec_keys[][AES_CIPHER_BLOCK_SIZE]) {
+	int round, i;
+
+	for (round = 0; round <= AES_CIPHER_ROUNDS_128; round++) {
+		memcpy(dec_keys[round], enc_keys[AES_CIPHER_ROUNDS_128 - round],
+				AES_CIPHER_BLOCK_SIZE);
+		if (round == 0 || round == AES_CIPHER_ROUNDS_128)
+			continue;
+		for (i = 0; i < AES_CIPHER_BLOCK_SIZE; i += 4)
+			aes_inv_mix_column(&dec_keys[round][i]);
+	}
+}
+
+void aes_cipher_sector_iv(int64_t position,
+		unsigned char iv[AES_CIPHER_BLOCK_SIZE]) {
+	// Inflight magic trick - LOL
+	*(int *) &iv[0] = (int) (position >> 9);
+	memset(&iv[4], 0, AES_CIPHER_BLOCK_SIZE - 4);
+}
+
+static int aes_cipher_tropicssl_available() {
+	return TRUE;
+}
+
+static void aes_cipher_tropicssl_decrypt_sectors(struct AesCipher *cipher,
+		int64_t position, unsigned char *data, int size) {
+	unsigned char iv[AES_CIPHER_BLOCK_SIZE];
+	int offset;
+	for (offset = 0; offset < size; offset += AES_CIPHER_SECTOR_SIZE) {
+		int length = size - offset;
+		if (length > AES_CIPHER_SECTOR_SIZE)
+			length = AES_CIPHER_SECTOR_SIZE;
+		length = (length + AES_CIPHER_BLOCK_SIZE - 1)
+				& ~(AES_CIPHER_BLOCK_SIZE - 1);
+
+		aes_cipher_sector_iv(position + offset, iv);
+		aes_crypt_cbc(&cipher->aes, AES_DECRYPT, length, iv, &data[offset],
+				&data[offset]);
+	}
+}
+
+static void aes_cipher_tropicssl_encrypt_sectors(struct AesCipher *cipher,
+		int64_t position, unsigned char *data, int size) {
+	unsigned char iv[AES_CIPHER_BLOCK_SIZE];
+	int offset;
+	for (offset = 0; offset < size; offset += AES_CIPHER_SECTOR_SIZE) {
+		int length = size - offset;
+		if (length > AES_CIPHER_SECTOR_SIZE)
+			length = AES_CIPHER_SECTOR_SIZE;
+		length = (length + AES_CIPHER_BLOCK_SIZE - 1)
+				& ~(AES_CIPHER_BLOCK_SIZE - 1);
+
+		aes_cipher_sector_iv(position + offset, iv);
+		aes_crypt_cbc(&cipher->aes_enc, AES_ENCRYPT, length, iv, &data[offset],
+				&data[offset]);
+	}
+}
+
+static const struct AesCipherBackend aes_cipher_backend_tropicssl = {
+	"tropicssl",
+	aes_cipher_tropicssl_available,
+	aes_cipher_tropicssl_decrypt_sectors,
+	aes_cipher_tropicssl_encrypt_sectors,
+};
+
+static const struct AesCipherBackend *aes_cipher_backends[] = {
+#ifdef FEATURE_AES_ARMV8
+	&aes_cipher_backend_armv8,
+#endif // FEATURE_AES_ARMV8
+#ifdef FEATURE_AES_NI
+	&aes_cipher_backend_aesni,
+#endif // FEATURE_AES_NI
+	&aes_cipher_backend_tropicssl,
+};
+
+#define AES_CIPHER_BACKENDS \
+	(sizeof(aes_cipher_backends) / sizeof(aes_cipher_backends[0]))
+
+int aes_cipher_get_backends(const struct AesCipherBackend **backends,
+		int max_backends) {
+	int count = 0;
+	int i;
+	for (i = 0; i < AES_CIPHER_BACKENDS && count < max_backends; i++) {
+		if (aes_cipher_backends[i]->available())
+			backends[count++] = aes_cipher_backends[i];
+	}
+	return count;
+}
+
+int aes_cipher_setkey_dec(struct AesCipher *cipher,
+		const struct AesCipherBackend *backend, const unsigned char *key,
+		int keybits) {
+	if (keybits != 128)
+		return -1;
+	if (backend == NULL) {
+		if (aes_cipher_get_backends(&backend, 1) < 1)
+			return -1;
+	}
+	cipher->backend = backend;
+	aes_setkey_dec(&cipher->aes, key, keybits);
+	aes_cipher_expand_enc_keys128(key, cipher->enc_keys);
+	aes_cipher_expand_dec_keys128(cipher->enc_keys, cipher->dec_keys);
+	return 0;
+}
+
+int aes_cipher_setkey_enc(struct AesCipher *cipher,
+		const struct AesCipherBackend *backend, const unsigned char *key,
+		int keybits) {
+	if (aes_cipher_setkey_dec(cipher, backend, key, keybits) < 0)
+		return -1;
+	aes_setkey_enc(&cipher->aes_enc, key, keybits);
+	return 0;
+}
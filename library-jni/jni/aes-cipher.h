@@ -0,0 +1,109 @@
+/*
+ * aes-cipher.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef AES_CIPHER_H_
+#define AES_CIPHER_H_
+
+#include <stdint.h>
+#include <tropicssl/aes.h>
+
+// every sector is encrypted in cbc mode with its own iv
+#define AES_CIPHER_SECTOR_SIZE 512
+#define AES_CIPHER_BLOCK_SIZE 16
+#define AES_CIPHER_ROUNDS_128 10
+
+struct AesCipher;
+
+struct AesCipherBackend {
+	const char *name;
+	// returns TRUE if backend could be used on running cpu
+	int (*available)();
+	/*
+	 * Decrypts sectors in place. position has to be sector aligned.
+	 * Only the last sector could be shorter, it is then padded to whole
+	 * block so data has to have room for it.
+	 */
+	void (*decrypt_sectors)(struct AesCipher *cipher, int64_t position,
+			unsigned char *data, int size);
+	/*
+	 * Encrypts sectors in place with the same rules as decrypt_sectors.
+	 * Padding of the last block has to be filled by caller.
+	 */
+	void (*encrypt_sectors)(struct AesCipher *cipher, int64_t position,
+			unsigned char *data, int size);
+};
+
+struct AesCipher {
+	const struct AesCipherBackend *backend;
+	// used by tropicssl backend
+	aes_context aes;
+	aes_context aes_enc;
+	// used by hardware backends: round keys in order of use
+	unsigned char dec_keys[AES_CIPHER_ROUNDS_128 + 1][AES_CIPHER_BLOCK_SIZE]
+			__attribute__ ((aligned (16)));
+	unsigned char enc_keys[AES_CIPHER_ROUNDS_128 + 1][AES_CIPHER_BLOCK_SIZE]
+			__attribute__ ((aligned (16)));
+};
+
+/*
+ * iv of sector containing position
+ */
+void aes_cipher_sector_iv(int64_t position,
+		unsigned char iv[AES_CIPHER_BLOCK_SIZE]);
+
+/*
+ * Returns number of backends usable on this cpu, best first
+ */
+int aes_cipher_get_backends(const struct AesCipherBackend **backends,
+		int max_backends);
+
+/*
+ * Sets 128 bit decryption key using given backend or the best
+ * available one when backend is NULL. Returns 0 on success.
+ */
+int aes_cipher_setkey_dec(struct AesCipher *cipher,
+		const struct AesCipherBackend *backend, const unsigned char *key,
+		int keybits);
+
+/*
+ * Same as aes_cipher_setkey_dec but sets key for both encryption and
+ * decryption
+ */
+int aes_cipher_setkey_enc(struct AesCipher *cipher,
+		const struct AesCipherBackend *backend, const unsigned char *key,
+		int keybits);
+
+static inline void aes_cipher_decrypt_sectors(struct AesCipher *cipher,
+		int64_t position, unsigned char *data, int size) {
+	cipher->backend->decrypt_sectors(cipher, position, data, size);
+}
+
+static inline void aes_cipher_encrypt_sectors(struct AesCipher *cipher,
+		int64_t position, unsigned char *data, int size) {
+	cipher->backend->encrypt_sectors(cipher, position, data, size);
+}
+
+#ifdef FEATURE_AES_NI
+extern const struct AesCipherBackend aes_cipher_backend_aesni;
+#endif // FEATURE_AES_NI
+
+#ifdef FEATURE_AES_ARMV8
+extern const struct AesCipherBackend aes_cipher_backend_armv8;
+#endif // FEATURE_AES_ARMV8
+
+#endif /* AES_CIPHER_H_ */
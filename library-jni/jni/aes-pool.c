@@ -0,0 +1,126 @@
+/*
+ * aes-pool.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "aes-pool.h"
+#include "log.h"
+
+#include <android/log.h>
+#define LOG_SUBSYSTEM LOG_SUBSYSTEM_AES
+#define LOG_TAG "aes-pool.c"
+#define LOGI(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
+#define LOGE(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
+
+#define AES_POOL_MAX_WORKERS 8
+
+static pthread_once_t aes_pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t aes_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t aes_pool_cond = PTHREAD_COND_INITIALIZER;
+static struct AesPoolJob *aes_pool_head = NULL;
+static struct AesPoolJob *aes_pool_tail = NULL;
+static int aes_pool_workers = 0;
+
+static void aes_pool_run(struct AesPoolJob *job) {
+	if (job->encrypt)
+		aes_cipher_encrypt_sectors(job->cipher, job->position, job->data,
+				job->size);
+	else
+		aes_cipher_decrypt_sectors(job->cipher, job->position, job->data,
+				job->size);
+	job->done(job);
+}
+
+static void * aes_pool_worker(void *data) {
+	for (;;) {
+		struct AesPoolJob *job;
+		pthread_mutex_lock(&aes_pool_mutex);
+		while (aes_pool_head == NULL)
+			pthread_cond_wait(&aes_pool_cond, &aes_pool_mutex);
+		job = aes_pool_head;
+		aes_pool_head = job->next;
+		if (aes_pool_head == NULL)
+			aes_pool_tail = NULL;
+		pthread_mutex_unlock(&aes_pool_mutex);
+
+		aes_pool_run(job);
+	}
+	return NULL;
+}
+
+static void aes_pool_start() {
+	pthread_attr_t attr;
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int workers = cores < 1 ? 1 :
+			cores > AES_POOL_MAX_WORKERS ? AES_POOL_MAX_WORKERS : cores;
+	int i;
+
+	// workers live as long as the process, nobody joins them
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (i = 0; i < workers; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, &attr, aes_pool_worker, NULL)) {
+			LOGE(1, "aes_pool_start: could not create worker %d", i);
+			break;
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	pthread_mutex_lock(&aes_pool_mutex);
+	aes_pool_workers = i;
+	pthread_mutex_unlock(&aes_pool_mutex);
+	LOGI(3, "aes_pool_start: started %d workers", i);
+}
+
+int aes_pool_get_workers() {
+	int workers;
+	pthread_once(&aes_pool_once, aes_pool_start);
+	pthread_mutex_lock(&aes_pool_mutex);
+	workers = aes_pool_workers;
+	pthread_mutex_unlock(&aes_pool_mutex);
+	return workers;
+}
+
+void aes_pool_submit(struct AesPoolJob *jobs, int nb_jobs) {
+	int i;
+	if (nb_jobs <= 0)
+		return;
+	if (aes_pool_get_workers() == 0) {
+		for (i = 0; i < nb_jobs; i++)
+			aes_pool_run(&jobs[i]);
+		return;
+	}
+
+	for (i = 0; i < nb_jobs - 1; i++)
+		jobs[i].next = &jobs[i + 1];
+	jobs[nb_jobs - 1].next = NULL;
+
+	pthread_mutex_lock(&aes_pool_mutex);
+	if (aes_pool_tail == NULL)
+		aes_pool_head = jobs;
+	else
+		aes_pool_tail->next = jobs;
+	aes_pool_tail = &jobs[nb_jobs - 1];
+	if (nb_jobs == 1)
+		pthread_cond_signal(&aes_pool_cond);
+	else
+		pthread_cond_broadcast(&aes_pool_cond);
+	pthread_mutex_unlock(&aes_pool_mutex);
+}
@@ -0,0 +1,58 @@
+/*
+ * aes-pool.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef AES_POOL_H_
+#define AES_POOL_H_
+
+#include <stdint.h>
+
+#include "aes-cipher.h"
+
+struct AesPoolJob;
+
+typedef void (*aes_pool_done_func)(struct AesPoolJob *job);
+
+/*
+ * Decryption (or encryption) of sectors [position, position + size) in
+ * place, done by one of the pool workers. done is called from the worker
+ * thread.
+ */
+struct AesPoolJob {
+	struct AesCipher *cipher;
+	int encrypt;
+	int64_t position;
+	unsigned char *data;
+	int size;
+	aes_pool_done_func done;
+	void *opaque;
+	struct AesPoolJob *next;
+};
+
+/*
+ * Queues jobs on the process wide cipher pool, one thread per cpu core.
+ * Jobs memory has to stay valid until their done callback is called.
+ * If the pool could not be started jobs are done in calling thread.
+ */
+void aes_pool_submit(struct AesPoolJob *jobs, int nb_jobs);
+
+/*
+ * Number of workers in the pool, 0 if the pool could not be started
+ */
+int aes_pool_get_workers();
+
+#endif /* AES_POOL_H_ */
@@ -16,6 +16,8 @@
  *
  */
 
+#include <pthread.h>
+
 #include <libavutil/avstring.h>
 #include <libavformat/avformat.h>
 #include <libavutil/opt.h>
@@ -27,56 +29,181 @@
 #include <tropicssl/sha2.h>
 #include <tropicssl/aes.h>
 
+#include "aes-cipher.h"
+#include "aes-pool.h"
 #include "aes-protocol.h"
+#include "log.h"
 
 #define FALSE (0)
 #define TRUE (!FALSE)
 
 #include <android/log.h>
-#define LOG_LEVEL 2
+#define LOG_SUBSYSTEM LOG_SUBSYSTEM_AES
 #define LOG_TAG "aes-protocol.c"
-#define LOGI(level, ...) if (level <= LOG_LEVEL) {__android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
-#define LOGE(level, ...) if (level <= LOG_LEVEL) {__android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
+#define LOGI(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
+#define LOGE(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
 
 #define RAW_KEY_SIZE	    24
 #define BASE64_KEY_SIZE	    ((4 * RAW_KEY_SIZE) / 3)
 #define SHA256_KEY_SIZE		32
 #define AES_KEY_SIZE        16
+// every sector is encrypted separately with iv derived from its position
 #define BUFFER_SIZE			512
+#define DEFAULT_WINDOW_SIZE (64 * 1024)
+#define MAX_WINDOW_SIZE     (1024 * 1024)
+#define DEFAULT_READAHEAD   4
+#define MAX_READAHEAD       64
+#define DEFAULT_CACHE_SIZE  (2 * 1024 * 1024)
+#define MAX_CACHE_SIZE      (64 * 1024 * 1024)
+// part of block decrypted by one pool worker
+#define JOB_SIZE            (16 * BUFFER_SIZE)
+
+struct AesContext;
 
-typedef struct {
+enum AesBlockState {
+	AES_BLOCK_EMPTY,
+	AES_BLOCK_READING,
+	AES_BLOCK_DECRYPTING,
+	AES_BLOCK_READY,
+};
+
+/*
+ * Window aligned part of the stream. Blocks are read ahead of the reading
+ * position and stay as decrypted cache until they are least recently used.
+ */
+struct AesBlock {
+	struct AesContext *c;
+	enum AesBlockState state;
+	int64_t position;
+	// valid bytes when READY, shorter than window only at end of stream
+	int size;
+	int pending_jobs;
+	// use stamp for lru eviction
+	int64_t last_used;
+	unsigned char *data;
+	struct AesPoolJob *jobs;
+};
+
+typedef struct AesContext {
 	const AVClass *class;
 	URLContext *hd;
 	uint8_t *key;
-	aes_context aes;
-	unsigned char iv[AES_KEY_SIZE];
-	unsigned char read_buff[BUFFER_SIZE];
-	unsigned char decoded_buff[BUFFER_SIZE];
+	int window_size;
+	int readahead;
+	int cache_size;
+	struct AesCipher cipher;
+	// decrypted data of [read_start_point, read_end_point)
+	unsigned char *window_buff;
 	int64_t reading_position;
 	int64_t read_start_point;
 	int64_t read_end_point;
+	// position of nested stream, always sector aligned
+	int64_t hd_position;
 	int64_t stream_end;
+
+	// read ahead and cache, used when readahead > 0
+	struct AesBlock *blocks;
+	int nb_blocks;
+	unsigned char *blocks_data;
+	struct AesPoolJob *blocks_jobs;
+	pthread_t thread_readahead;
+	int thread_readahead_started;
+	// guards blocks, readahead state and write_pending
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	// guards hd, hd_position and stream_end
+	pthread_mutex_t mutex_hd;
+	// incremented on every restart of read ahead
+	int generation;
+	// windows [readahead_start, readahead_position) are read since restart
+	int64_t readahead_start;
+	int64_t readahead_position;
+	int readahead_eof;
+	int64_t readahead_end;
+	int readahead_error;
+	volatile int abort;
+	AVIOInterruptCB parent_interrupt_callback;
+
+	int64_t use_counter;
+	// window for which the last hit or miss was counted
+	int64_t counted_window;
+	struct AesCacheStats stats;
+
+	// encryption, used when opened for writing
+	int write_mode;
+	int64_t write_position;
+	// plain data of [write_start, write_start + write_size) in window_buff
+	int write_loaded;
+	int write_dirty;
+	int64_t write_start;
+	int write_size;
+	// plain size of data already written to nested stream
+	int64_t written_end;
+	struct AesPoolJob *write_jobs;
+	int write_pending;
 } AesContext;
 
 #define OFFSET(x) offsetof(AesContext, x)
 
-static const AVOption options[] = { { "aeskey", "AES decryption key",
-		OFFSET(key), AV_OPT_TYPE_STRING, .flags = AV_OPT_FLAG_DECODING_PARAM },
+static const AVOption options[] = { { "aeskey", "AES key",
+		OFFSET(key), AV_OPT_TYPE_STRING, .flags = AV_OPT_FLAG_DECODING_PARAM
+				| AV_OPT_FLAG_ENCODING_PARAM },
+		{ "aes_window_size", "Size of data read and decrypted or encrypted and written at once",
+		OFFSET(window_size), AV_OPT_TYPE_INT, { .i64 = DEFAULT_WINDOW_SIZE },
+		BUFFER_SIZE, MAX_WINDOW_SIZE, AV_OPT_FLAG_DECODING_PARAM
+				| AV_OPT_FLAG_ENCODING_PARAM },
+		{ "aes_readahead", "Number of windows read and decrypted ahead, 0 disables read ahead and cache",
+		OFFSET(readahead), AV_OPT_TYPE_INT, { .i64 = DEFAULT_READAHEAD },
+		0, MAX_READAHEAD, AV_OPT_FLAG_DECODING_PARAM },
+		{ "aes_cache_size", "Bytes of decrypted windows kept for seeking back, not used when aes_readahead is 0",
+		OFFSET(cache_size), AV_OPT_TYPE_INT, { .i64 = DEFAULT_CACHE_SIZE },
+		0, MAX_CACHE_SIZE, AV_OPT_FLAG_DECODING_PARAM },
 		{ NULL } };
 
+static pthread_mutex_t aes_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct AesCacheStats aes_stats;
+
+void aes_protocol_get_cache_stats(struct AesCacheStats *stats) {
+	pthread_mutex_lock(&aes_stats_mutex);
+	*stats = aes_stats;
+	pthread_mutex_unlock(&aes_stats_mutex);
+}
+
+static void aes_count_already_locked(AesContext *c, int hit) {
+	pthread_mutex_lock(&aes_stats_mutex);
+	if (hit) {
+		c->stats.hits++;
+		aes_stats.hits++;
+	} else {
+		c->stats.misses++;
+		aes_stats.misses++;
+	}
+	pthread_mutex_unlock(&aes_stats_mutex);
+}
+
+static void aes_count_eviction_already_locked(AesContext *c) {
+	pthread_mutex_lock(&aes_stats_mutex);
+	c->stats.evictions++;
+	aes_stats.evictions++;
+	pthread_mutex_unlock(&aes_stats_mutex);
+}
+
 static const AVClass aes_class = { .class_name = "aes", .item_name =
 		av_default_item_name, .option = options, .version =
 		LIBAVUTIL_VERSION_INT, };
 
 #define MAX_PRINT_LEN 2048
 
-#if LOG_LEVEL >= 10
+// dumps keys and data, so it has to be enabled explicitly with AES_LOG_HEX
+#if defined(AES_LOG_HEX) && LOG_MAX_LEVEL >= 10
 static char print_buff[MAX_PRINT_LEN * 2 + 1];
 #endif
 
 static void log_hex(char *log, char *data, int len) {
-#if LOG_LEVEL >= 10
+#if defined(AES_LOG_HEX) && LOG_MAX_LEVEL >= 10
 	int i;
+	if (!LOG_ENABLED(LOG_SUBSYSTEM, 10))
+		return;
 	if (len > MAX_PRINT_LEN) {
 		LOGI(1,
 				"log_hex: oversized log requested: %d, max size: %d", len, MAX_PRINT_LEN);
@@ -88,10 +215,18 @@ static void log_hex(char *log, char *data, int len) {
 #endif
 }
 
+static int aes_readahead_start(AesContext *c);
+
+static int aes_interrupt_cb(void *opaque) {
+	AesContext *c = opaque;
+	return c->abort || ff_check_interrupt(&c->parent_interrupt_callback);
+}
+
 static int aes_open(URLContext *h, const char *uri, int flags) {
 	const char *nested_url;
 	int ret = 0;
 	AesContext *c = h->priv_data;
+	AVIOInterruptCB interrupt_callback = { aes_interrupt_cb, c };
 	LOGI(3, "aes_open: opening data");
 
 	if (!av_strstart(uri, "aes+", &nested_url)
@@ -114,28 +249,69 @@ static int aes_open(URLContext *h, const char *uri, int flags) {
 		ret = AVERROR(EINVAL);
 		goto err;
 	}
-	if (flags & AVIO_FLAG_WRITE) {
-		av_log(h, AV_LOG_ERROR, "Only decryption is supported currently\n");
-		LOGE(1, "Only decryption is supported currently");
-		ret = AVERROR(ENOSYS);
-		goto err;
+	c->write_mode = (flags & AVIO_FLAG_WRITE) != 0;
+	if (c->write_mode) {
+		// writing is sequential, nothing to read ahead
+		c->readahead = 0;
 	}
-	if ((ret = ffurl_open(&c->hd, nested_url, AVIO_FLAG_READ,
-			&h->interrupt_callback, NULL)) < 0) {
-		av_log(h, AV_LOG_ERROR, "Unable to open input\n");
-		LOGE(1, "Unable to open input");
+	// window holds whole sectors only
+	c->window_size = FFMAX(c->window_size / BUFFER_SIZE, 1) * BUFFER_SIZE;
+	c->window_buff = av_malloc(c->window_size);
+	if (c->window_buff == NULL) {
+		LOGE(1, "Could not allocate window of size: %d", c->window_size);
+		ret = AVERROR(ENOMEM);
 		goto err;
 	}
+	// let avio ask for whole windows
+	h->max_packet_size = c->window_size;
+	LOGI(3, "aes_open: window size: %d", c->window_size);
+
+	pthread_mutex_init(&c->mutex, NULL);
+	pthread_cond_init(&c->cond, NULL);
+	pthread_mutex_init(&c->mutex_hd, NULL);
+
+	// read ahead thread has to be able to break nested reads on close
+	c->abort = FALSE;
+	c->parent_interrupt_callback = h->interrupt_callback;
+	if (c->write_mode) {
+		c->write_jobs = av_mallocz(
+				(c->window_size + JOB_SIZE - 1) / JOB_SIZE
+						* sizeof(struct AesPoolJob));
+		if (c->write_jobs == NULL) {
+			ret = AVERROR(ENOMEM);
+			goto destroy_mutexes;
+		}
+		// reading back is needed to rewrite part of written sector
+		ret = ffurl_open(&c->hd, nested_url, AVIO_FLAG_READ_WRITE,
+				&interrupt_callback, NULL);
+		if (ret < 0) {
+			LOGI(2, "aes_open: could not open output for reading back");
+			ret = ffurl_open(&c->hd, nested_url, AVIO_FLAG_WRITE,
+					&interrupt_callback, NULL);
+		}
+	} else {
+		ret = ffurl_open(&c->hd, nested_url, AVIO_FLAG_READ,
+				&interrupt_callback, NULL);
+	}
+	if (ret < 0) {
+		av_log(h, AV_LOG_ERROR, "Unable to open nested stream\n");
+		LOGE(1, "Unable to open nested stream");
+		goto free_write_jobs;
+	}
 	LOGI(3, "aes_open: opened data with key: %s", c->key);
 	log_hex("aes_open: raw_key[%d]: %s", c->key, RAW_KEY_SIZE);
 
-	memset(c->iv, 0, AES_KEY_SIZE);
-	memset(c->read_buff, 0, BUFFER_SIZE);
-	memset(c->decoded_buff, 0, BUFFER_SIZE);
 	c->reading_position = 0;
 	c->read_start_point = 0;
 	c->read_end_point = 0;
+	c->hd_position = 0;
 	c->stream_end = -1;
+	c->write_position = 0;
+	c->write_loaded = FALSE;
+	c->write_dirty = FALSE;
+	c->write_start = 0;
+	c->write_size = 0;
+	c->written_end = 0;
 
 	unsigned char sha256_key[SHA256_KEY_SIZE];
 	sha2_context ctx;
@@ -149,77 +325,540 @@ static int aes_open(URLContext *h, const char *uri, int flags) {
 
 	log_hex("aes_open: aes_key[%d]: %s", aes_key, AES_KEY_SIZE);
 
-	aes_setkey_dec(&c->aes, aes_key, AES_KEY_SIZE << 3);
+	if (c->write_mode)
+		ret = aes_cipher_setkey_enc(&c->cipher, NULL, aes_key,
+				AES_KEY_SIZE << 3);
+	else
+		ret = aes_cipher_setkey_dec(&c->cipher, NULL, aes_key,
+				AES_KEY_SIZE << 3);
+	if (ret < 0) {
+		LOGE(1, "aes_open: could not set key");
+		ret = AVERROR(EINVAL);
+		goto close_hd;
+	}
+	LOGI(3, "aes_open: using %s cipher", c->cipher.backend->name);
+
+	if (c->readahead > 0 && (ret = aes_readahead_start(c)) < 0) {
+		LOGE(1, "aes_open: could not start read ahead");
+		goto close_hd;
+	}
 
 //    h->is_streamed = 1; // disable seek
 	LOGI(3, "aes_open: finished opening");
+	return ret;
+
+	close_hd:
+	ffurl_close(c->hd);
+	c->hd = NULL;
+	free_write_jobs:
+	av_freep(&c->write_jobs);
+	destroy_mutexes:
+	pthread_mutex_destroy(&c->mutex_hd);
+	pthread_cond_destroy(&c->cond);
+	pthread_mutex_destroy(&c->mutex);
+	av_free(c->window_buff);
+	c->window_buff = NULL;
 	err: return ret;
 }
 
+static int aes_seek_nested(AesContext *c, int64_t position) {
+	if (c->hd_position == position)
+		return 0;
+	int64_t ret = ffurl_seek(c->hd, position, SEEK_SET);
+	LOGI(3, "aes_seek_nested: return: %"PRId64, ret);
+	if (ret < 0) {
+		LOGE(1,
+				"aes_seek_nested: seeking error: %"PRId64", trying to seek: %"PRId64, ret, position);
+		return ret;
+	}
+	if (ret != position) {
+		LOGE(1, "aes_seek_nested: seeking fatal error: unknown state");
+		return -2;
+	}
+	c->hd_position = position;
+	return 0;
+}
+
+static int64_t aes_measure_size(AesContext *c) {
+	int64_t size;
+	pthread_mutex_lock(&c->mutex_hd);
+	if (c->stream_end < 0)
+		c->stream_end = ffurl_seek(c->hd, 0, AVSEEK_SIZE);
+	size = c->stream_end;
+	pthread_mutex_unlock(&c->mutex_hd);
+	return size;
+}
+
+static int64_t aes_seek_write(AesContext *c, int64_t pos, int whence) {
+	int64_t end = c->written_end;
+	if (c->write_dirty)
+		end = FFMAX(end, c->write_start + c->write_size);
+	switch (whence) {
+	case SEEK_SET:
+		c->write_position = pos;
+		break;
+	case SEEK_CUR:
+		c->write_position += pos;
+		break;
+	case SEEK_END:
+		c->write_position = end + pos;
+		break;
+	case AVSEEK_SIZE:
+		return end;
+	default:
+		LOGE(1, "aes_seek_write: unknown whence: %d", whence);
+		return -1;
+	}
+	LOGI(3, "aes_seek_write: write_position: %"PRId64, c->write_position);
+	// window is flushed only when next write does not fit into it
+	return c->write_position;
+}
+
+static int aes_readahead_reaches(AesContext *c, int64_t position);
+static void aes_readahead_restart_already_locked(AesContext *c,
+		int64_t position);
+
 static int64_t aes_seek(URLContext *h, int64_t pos, int whence) {
 	AesContext *c = h->priv_data;
+	int64_t position;
+	int64_t size;
 	LOGI(3, "aes_seek: trying to seek");
+	if (c->write_mode)
+		return aes_seek_write(c, pos, whence);
 	switch (whence) {
 	case SEEK_SET:
 		LOGI(3, "aes_seek: pos: %"PRId64", SEEK_SET", pos);
 		// The offset is set to offset bytes.
-		c->reading_position = pos;
+		position = pos;
 		break;
 
 	case SEEK_CUR:
 		LOGI(3, "aes_seek: pos: %"PRId64", SEEK_CUR", pos);
 		// The offset is set to its current location plus offset bytes.
-		c->reading_position += pos;
+		position = c->reading_position + pos;
 		break;
 
 	case AVSEEK_SIZE:
 		// Measuring file size
 		LOGI(3, "aes_seek: AVSEEK_SIZE");
-		if (c->stream_end >= 0) {
-			LOGI(3, "aes_seek: already_measured_size: %"PRId64, c->stream_end);
-			return c->stream_end;
-		}
-		c->stream_end = ffurl_seek(c->hd, 0, AVSEEK_SIZE);
-		LOGI(3, "aes_seek: measured_size: %"PRId64, c->stream_end);
-		return c->stream_end;
+		size = aes_measure_size(c);
+		LOGI(3, "aes_seek: measured_size: %"PRId64, size);
+		return size;
 
 	case SEEK_END:
-		LOGI(3, "aes_seek: pos: %d, SEEK_END", pos);
+		LOGI(3, "aes_seek: pos: %"PRId64", SEEK_END", pos);
 		// The offset is set to the size of the file plus offset bytes.
-		if (c->stream_end < 0) {
-			c->stream_end = ffurl_seek(c->hd, 0, AVSEEK_SIZE);
-			if (c->stream_end < 0) {
-				LOGE(2,
-						"aes_seek: could not measure size, error: %"PRId64, c->stream_end);
-				return c->stream_end;
-			}
+		size = aes_measure_size(c);
+		if (size < 0) {
+			LOGE(2, "aes_seek: could not measure size, error: %"PRId64, size);
+			return size;
 		}
-		LOGI(3, "aes_seek: measured_size: %"PRId64, c->stream_end);
-		c->reading_position = c->stream_end - pos;
+		LOGI(3, "aes_seek: measured_size: %"PRId64, size);
+		position = size + pos;
 		break;
 	default:
 		LOGE(1, "aes_seek: unknown whence: %d", whence);
 		return -1;
 	}
-	LOGI(3, "aes_seek: reading_position: %" PRId64, c->reading_position);
+	LOGI(3, "aes_seek: reading_position: %" PRId64, position);
+
+	if (c->readahead > 0) {
+		pthread_mutex_lock(&c->mutex);
+		c->reading_position = position;
+		// start fetching new position before it is read
+		if (!aes_readahead_reaches(c, position))
+			aes_readahead_restart_already_locked(c, position);
+		else
+			// blocks before new position could be refilled
+			pthread_cond_broadcast(&c->cond);
+		pthread_mutex_unlock(&c->mutex);
+		return position;
+	}
+
+	c->reading_position = position;
 
-	c->read_start_point = (c->reading_position / (int64_t) BUFFER_SIZE)
+	if (c->reading_position >= c->read_start_point
+			&& c->reading_position < c->read_end_point) {
+		// still inside of decrypted window
+		LOGI(3, "aes_seek: inside window");
+		return c->reading_position;
+	}
+
+	int64_t sector_start = (c->reading_position / (int64_t) BUFFER_SIZE)
 			* (int64_t) BUFFER_SIZE;
-	c->read_end_point = c->read_start_point;
+	c->read_start_point = sector_start;
+	c->read_end_point = sector_start;
 	LOGI(3, "aes_seek: read_start_point: %" PRId64, c->read_start_point);
 
-	int64_t ret = ffurl_seek(c->hd, c->read_start_point, whence);
-	LOGI(3, "aes_seek: return: %"PRId64, ret);
-	if (ret < 0) {
-		LOGE(1,
-				"aes_seek: seeking error: %"PRId64", trying to seek: %"PRId64", whence: %d", ret, c->read_start_point, whence);
+	int ret = aes_seek_nested(c, sector_start);
+	if (ret < 0)
 		return ret;
+	return c->reading_position;
+}
+
+/*
+ * Reads up to size bytes of encrypted data from hd_position.
+ * Returns number of bytes read, 0 at end of stream or negative error.
+ */
+static int aes_read_nested(AesContext *c, unsigned char *data, int size) {
+	int read = 0;
+	while (read < size) {
+		int n = ffurl_read(c->hd, &data[read], size - read);
+		if (n < 0)
+			return n;
+		if (n == 0)
+			break;
+		read += n;
 	}
-	if (ret != c->read_start_point) {
-		LOGE(1, "aes_seek: seeking fatal error: unknown state");
-		return -2;
+	LOGI(3, "aes_read_nested position: %"PRId64", read: %d",
+			c->hd_position, read);
+	c->hd_position += read;
+	return read;
+}
+
+/*
+ * Reads up to size bytes (multiple of BUFFER_SIZE) of encrypted data from
+ * hd_position and decrypts them in place.
+ * Returns number of bytes read, 0 at end of stream or negative error.
+ */
+static int aes_read_sectors(AesContext *c, unsigned char *data, int size) {
+	int64_t position = c->hd_position;
+	int read = aes_read_nested(c, data, size);
+	if (read <= 0)
+		return read;
+	log_hex("aes_read enc: encoded[%d]: %s", data, read);
+	aes_cipher_decrypt_sectors(&c->cipher, position, data, read);
+	log_hex("aes_read enc: decoded[%d]: %s", data, read);
+	return read;
+}
+
+/*
+ * Returns not empty block containing position
+ */
+static struct AesBlock *aes_find_block(AesContext *c, int64_t position) {
+	int i;
+	for (i = 0; i < c->nb_blocks; i++) {
+		struct AesBlock *block = &c->blocks[i];
+		int64_t end;
+		if (block->state == AES_BLOCK_EMPTY)
+			continue;
+		end = block->position
+				+ (block->state == AES_BLOCK_READY ?
+						block->size : c->window_size);
+		if (position >= block->position && position < end)
+			return block;
 	}
-	return c->reading_position;
+	return NULL;
+}
+
+static int64_t aes_window_of(AesContext *c, int64_t position) {
+	return (position / c->window_size) * c->window_size;
+}
+
+/*
+ * TRUE if read ahead started from last restart will get to position
+ */
+static int aes_readahead_reaches(AesContext *c, int64_t position) {
+	int64_t window = aes_window_of(c, position);
+	if (c->readahead_eof && position >= c->readahead_end)
+		return TRUE;
+	return window >= c->readahead_start && window <= c->readahead_position;
+}
+
+/*
+ * Number of blocks read ahead and not yet reached by reading position
+ */
+static int aes_blocks_ahead(AesContext *c) {
+	int64_t window = aes_window_of(c, c->reading_position);
+	int ahead = 0;
+	int i;
+	for (i = 0; i < c->nb_blocks; i++) {
+		struct AesBlock *block = &c->blocks[i];
+		if (block->state != AES_BLOCK_EMPTY && block->position >= window
+				&& block->position < c->readahead_position)
+			ahead++;
+	}
+	return ahead;
+}
+
+/*
+ * Returns empty block or least recently used ready block which is not
+ * waiting to be read
+ */
+static struct AesBlock *aes_find_free_block(AesContext *c) {
+	int64_t window = aes_window_of(c, c->reading_position);
+	struct AesBlock *free_block = NULL;
+	int i;
+	for (i = 0; i < c->nb_blocks; i++) {
+		struct AesBlock *block = &c->blocks[i];
+		if (block->state == AES_BLOCK_EMPTY)
+			return block;
+		if (block->state != AES_BLOCK_READY)
+			continue;
+		if (block->position >= window
+				&& block->position < c->readahead_position)
+			continue;
+		if (free_block == NULL || block->last_used < free_block->last_used)
+			free_block = block;
+	}
+	return free_block;
+}
+
+/*
+ * Starts reading ahead from window containing position, blocks already
+ * read stay in cache
+ */
+static void aes_readahead_restart_already_locked(AesContext *c,
+		int64_t position) {
+	LOGI(3, "aes_readahead_restart: position: %"PRId64, position);
+	c->generation++;
+	c->readahead_start = aes_window_of(c, position);
+	c->readahead_position = c->readahead_start;
+	c->readahead_eof = FALSE;
+	c->readahead_end = 0;
+	c->readahead_error = 0;
+	pthread_cond_broadcast(&c->cond);
+}
+
+static void aes_block_decrypted(struct AesPoolJob *job) {
+	struct AesBlock *block = job->opaque;
+	AesContext *c = block->c;
+	pthread_mutex_lock(&c->mutex);
+	if (--block->pending_jobs == 0) {
+		block->state = AES_BLOCK_READY;
+		pthread_cond_broadcast(&c->cond);
+	}
+	pthread_mutex_unlock(&c->mutex);
+}
+
+static void * aes_readahead_thread(void *data) {
+	AesContext *c = data;
+	pthread_mutex_lock(&c->mutex);
+	while (!c->abort) {
+		struct AesBlock *block;
+		int generation;
+		int64_t position;
+		int nb_jobs;
+		int ret;
+		int i;
+
+		if (c->readahead_eof || c->readahead_error < 0) {
+			pthread_cond_wait(&c->cond, &c->mutex);
+			continue;
+		}
+		// skip windows which are cached or already being read
+		block = aes_find_block(c, c->readahead_position);
+		if (block != NULL) {
+			block->last_used = ++c->use_counter;
+			if (block->state == AES_BLOCK_READY
+					&& block->size < c->window_size) {
+				c->readahead_eof = TRUE;
+				c->readahead_end = block->position + block->size;
+			}
+			c->readahead_position += c->window_size;
+			pthread_cond_broadcast(&c->cond);
+			continue;
+		}
+		if (aes_blocks_ahead(c) >= c->readahead
+				|| (block = aes_find_free_block(c)) == NULL) {
+			pthread_cond_wait(&c->cond, &c->mutex);
+			continue;
+		}
+		if (block->state == AES_BLOCK_READY)
+			aes_count_eviction_already_locked(c);
+
+		generation = c->generation;
+		position = c->readahead_position;
+		c->readahead_position += c->window_size;
+		block->state = AES_BLOCK_READING;
+		block->position = position;
+		block->last_used = ++c->use_counter;
+		pthread_mutex_unlock(&c->mutex);
+
+		pthread_mutex_lock(&c->mutex_hd);
+		ret = aes_seek_nested(c, position);
+		if (ret >= 0)
+			ret = aes_read_nested(c, block->data, c->window_size);
+		pthread_mutex_unlock(&c->mutex_hd);
+
+		pthread_mutex_lock(&c->mutex);
+		if (ret <= 0) {
+			block->state = AES_BLOCK_EMPTY;
+			if (generation == c->generation) {
+				if (ret < 0) {
+					LOGE(1, "aes_readahead_thread: read error: %d", ret);
+					c->readahead_error = ret;
+					c->readahead_position = position;
+				} else {
+					c->readahead_eof = TRUE;
+					c->readahead_end = position;
+				}
+			}
+			pthread_cond_broadcast(&c->cond);
+			continue;
+		}
+		if (ret < c->window_size && generation == c->generation) {
+			c->readahead_eof = TRUE;
+			c->readahead_end = position + ret;
+		}
+		block->size = ret;
+		block->state = AES_BLOCK_DECRYPTING;
+		nb_jobs = (ret + JOB_SIZE - 1) / JOB_SIZE;
+		block->pending_jobs = nb_jobs;
+		for (i = 0; i < nb_jobs; i++) {
+			struct AesPoolJob *job = &block->jobs[i];
+			job->cipher = &c->cipher;
+			job->position = position + i * JOB_SIZE;
+			job->data = &block->data[i * JOB_SIZE];
+			job->size = FFMIN(JOB_SIZE, ret - i * JOB_SIZE);
+			job->done = aes_block_decrypted;
+			job->opaque = block;
+		}
+		pthread_mutex_unlock(&c->mutex);
+
+		aes_pool_submit(block->jobs, nb_jobs);
+
+		pthread_mutex_lock(&c->mutex);
+	}
+	pthread_mutex_unlock(&c->mutex);
+	return NULL;
+}
+
+static int aes_readahead_start(AesContext *c) {
+	int jobs_per_block = (c->window_size + JOB_SIZE - 1) / JOB_SIZE;
+	int ret = 0;
+	int i;
+
+	c->nb_blocks = c->readahead + c->cache_size / c->window_size;
+	c->blocks = av_mallocz(c->nb_blocks * sizeof(struct AesBlock));
+	c->blocks_data = av_malloc((size_t) c->nb_blocks * c->window_size);
+	c->blocks_jobs = av_mallocz(
+			c->nb_blocks * jobs_per_block * sizeof(struct AesPoolJob));
+	if (c->blocks == NULL || c->blocks_data == NULL
+			|| c->blocks_jobs == NULL) {
+		LOGE(1, "aes_readahead_start: could not allocate %d blocks",
+				c->nb_blocks);
+		ret = AVERROR(ENOMEM);
+		goto free_blocks;
+	}
+	for (i = 0; i < c->nb_blocks; i++) {
+		struct AesBlock *block = &c->blocks[i];
+		block->c = c;
+		block->state = AES_BLOCK_EMPTY;
+		block->data = &c->blocks_data[i * c->window_size];
+		block->jobs = &c->blocks_jobs[i * jobs_per_block];
+	}
+
+	c->generation = 0;
+	c->readahead_start = 0;
+	c->readahead_position = 0;
+	c->readahead_eof = FALSE;
+	c->readahead_end = 0;
+	c->readahead_error = 0;
+	c->use_counter = 0;
+	c->counted_window = -1;
+	memset(&c->stats, 0, sizeof(c->stats));
+
+	if (pthread_create(&c->thread_readahead, NULL, aes_readahead_thread, c)) {
+		LOGE(1, "aes_readahead_start: could not create thread");
+		ret = AVERROR(ENOMEM);
+		goto free_blocks;
+	}
+	c->thread_readahead_started = TRUE;
+	LOGI(3, "aes_readahead_start: %d blocks, %d ahead, %d pool workers",
+			c->nb_blocks, c->readahead, aes_pool_get_workers());
+	return 0;
+
+	free_blocks:
+	av_freep(&c->blocks_jobs);
+	av_freep(&c->blocks_data);
+	av_freep(&c->blocks);
+	return ret;
+}
+
+static void aes_readahead_stop(AesContext *c) {
+	int i;
+	if (!c->thread_readahead_started)
+		return;
+
+	pthread_mutex_lock(&c->mutex);
+	c->abort = TRUE;
+	pthread_cond_broadcast(&c->cond);
+	pthread_mutex_unlock(&c->mutex);
+	pthread_join(c->thread_readahead, NULL);
+	c->thread_readahead_started = FALSE;
+
+	// pool workers could still write to blocks
+	pthread_mutex_lock(&c->mutex);
+	for (i = 0; i < c->nb_blocks; i++) {
+		while (c->blocks[i].state == AES_BLOCK_DECRYPTING)
+			pthread_cond_wait(&c->cond, &c->mutex);
+	}
+	pthread_mutex_unlock(&c->mutex);
+
+	LOGI(2, "aes_readahead_stop: cache hits: %"PRId64", misses: %"PRId64", evictions: %"PRId64,
+			c->stats.hits, c->stats.misses, c->stats.evictions);
+
+	av_freep(&c->blocks_jobs);
+	av_freep(&c->blocks_data);
+	av_freep(&c->blocks);
+}
+
+/*
+ * aes_read used with read ahead, only copies data decrypted by pool
+ */
+static int aes_read_ahead(AesContext *c, uint8_t *buf, int size) {
+	int buf_position = 0;
+	int ret = 0;
+
+	pthread_mutex_lock(&c->mutex);
+	while (buf_position < size) {
+		struct AesBlock *block = aes_find_block(c, c->reading_position);
+		int64_t window = aes_window_of(c, c->reading_position);
+		int delta;
+		int copy_size;
+		if (window != c->counted_window) {
+			// window was decrypted before it was needed or not
+			c->counted_window = window;
+			aes_count_already_locked(c,
+					block != NULL && block->state == AES_BLOCK_READY);
+		}
+		if (block == NULL) {
+			if (c->readahead_eof && c->reading_position >= c->readahead_end)
+				break;
+			if (c->readahead_error < 0
+					&& c->reading_position >= c->readahead_position) {
+				ret = c->readahead_error;
+				break;
+			}
+			if (window == c->readahead_position)
+				pthread_cond_wait(&c->cond, &c->mutex);
+			else
+				aes_readahead_restart_already_locked(c, c->reading_position);
+			continue;
+		}
+		if (block->state != AES_BLOCK_READY) {
+			pthread_cond_wait(&c->cond, &c->mutex);
+			continue;
+		}
+
+		block->last_used = ++c->use_counter;
+		delta = c->reading_position - block->position;
+		copy_size = FFMIN(block->size - delta, size - buf_position);
+		memcpy(&buf[buf_position], &block->data[delta], copy_size);
+		buf_position += copy_size;
+		c->reading_position += copy_size;
+		if (delta + copy_size == block->size) {
+			// whole block read, it could be refilled
+			pthread_cond_broadcast(&c->cond);
+		}
+	}
+	pthread_mutex_unlock(&c->mutex);
+
+	LOGI(3, "aes_read_ahead read bytes: %d", buf_position);
+	if (buf_position == 0 && ret < 0)
+		return ret;
+	return buf_position;
 }
 
 static int aes_read(URLContext *h, uint8_t *buf, int size) {
@@ -228,8 +867,12 @@ static int aes_read(URLContext *h, uint8_t *buf, int size) {
 	int buf_position = 0;
 	int buf_left = size;
 	int end = FALSE;
+	int ret;
 	LOGI(3, "aes_read started");
 
+	if (c->readahead > 0)
+		return aes_read_ahead(c, buf, size);
+
 	while (buf_left > 0 && !end) {
 		LOGI(3,
 				"aes_read loop, read_position: %"PRId64", buf_left: %d", c->reading_position, buf_left);
@@ -238,51 +881,50 @@ static int aes_read(URLContext *h, uint8_t *buf, int size) {
 			return -1;
 		}
 
-		while (c->reading_position >= c->read_end_point && !end) {
-			LOGI(3,
-					"aes_read read loop: current read_end_point %"PRId64, c->read_end_point);
-			int64_t position = c->read_end_point;
-
-			int decode_buf_left = BUFFER_SIZE;
-			int encrypted_buffer_size = 0;
-			while (decode_buf_left > 0 && !end) {
-				int n = ffurl_read(c->hd,
-						&(c->read_buff[encrypted_buffer_size]),
-						decode_buf_left);
+		if (c->reading_position < c->read_end_point) {
+			int delta = c->reading_position - c->read_start_point;
+			int copy_size = c->read_end_point - c->reading_position;
+			if (copy_size > buf_left)
+				copy_size = buf_left;
 
-				if (n < 0)
-					return n;
+			LOGI(10, "aes_read delta: %d, copy_size: %d", delta, copy_size);
+			memcpy(&buf[buf_position], &c->window_buff[delta], copy_size);
+			c->reading_position += copy_size;
+			buf_left -= copy_size;
+			buf_position += copy_size;
+			continue;
+		}
 
-				if (n == 0)
-					end = TRUE;
+		int64_t sector_start = (c->reading_position / (int64_t) BUFFER_SIZE)
+				* (int64_t) BUFFER_SIZE;
+		if ((ret = aes_seek_nested(c, sector_start)) < 0)
+			return ret;
 
-				decode_buf_left -= n;
-				encrypted_buffer_size += n;
-			}
-			c->read_start_point = c->read_end_point;
-			c->read_end_point += encrypted_buffer_size;
-
-			// Inflight magic trick - LOL
-			*(int *) &c->iv[0] = (int) (c->read_start_point >> 9);
-			memset(&c->iv[4], 0, sizeof(c->iv) - 4);
-			aes_crypt_cbc(&c->aes, AES_DECRYPT, encrypted_buffer_size, c->iv,
-					c->read_buff, c->decoded_buff);
-			LOGI(3, "aes_read enc: position: %"PRId64, position);
-			log_hex("aes_read enc: encoded[%d]: %s", c->read_buff,
-					encrypted_buffer_size);
-			log_hex("aes_read enc: decoded[%d]: %s", c->decoded_buff,
-					encrypted_buffer_size);
+		if (sector_start == c->reading_position && buf_left >= BUFFER_SIZE) {
+			// aligned - decrypt directly into caller buffer
+			int direct_size = FFMIN(buf_left / BUFFER_SIZE * BUFFER_SIZE,
+					c->window_size);
+			ret = aes_read_sectors(c, &buf[buf_position], direct_size);
+			if (ret < 0)
+				return ret;
+			if (ret < direct_size)
+				end = TRUE;
+			c->reading_position += ret;
+			c->read_start_point = c->read_end_point = c->reading_position;
+			buf_left -= ret;
+			buf_position += ret;
+			continue;
 		}
-		int delta = c->reading_position - c->read_start_point;
-		int copy_size = c->read_end_point - c->reading_position;
-		if (copy_size > buf_left)
-			copy_size = buf_left;
 
-		LOGI(10, "aes_read delta: %d, copy_size: %d", delta, copy_size);
-		memcpy(&buf[buf_position], &c->decoded_buff[delta], copy_size);
-		c->reading_position += copy_size;
-		buf_left -= copy_size;
-		buf_position += copy_size;
+		ret = aes_read_sectors(c, c->window_buff, c->window_size);
+		if (ret < 0)
+			return ret;
+		c->read_start_point = sector_start;
+		c->read_end_point = sector_start + ret;
+		if (c->reading_position >= c->read_end_point) {
+			// end of stream
+			break;
+		}
 	}
 	LOGI(3, "aes_read read bytes: %d", buf_position);
 	log_hex("eas_read wrote to buffer[%d]: %s", buf, buf_position);
@@ -290,18 +932,166 @@ static int aes_read(URLContext *h, uint8_t *buf, int size) {
 	return buf_position;
 }
 
+static void aes_window_encrypted(struct AesPoolJob *job) {
+	AesContext *c = job->opaque;
+	pthread_mutex_lock(&c->mutex);
+	if (--c->write_pending == 0)
+		pthread_cond_broadcast(&c->cond);
+	pthread_mutex_unlock(&c->mutex);
+}
+
+/*
+ * Encrypts size bytes of window_buff on the pool and waits for them
+ */
+static void aes_encrypt_window(AesContext *c, int64_t position, int size) {
+	int nb_jobs = (size + JOB_SIZE - 1) / JOB_SIZE;
+	int i;
+	c->write_pending = nb_jobs;
+	for (i = 0; i < nb_jobs; i++) {
+		struct AesPoolJob *job = &c->write_jobs[i];
+		job->cipher = &c->cipher;
+		job->encrypt = TRUE;
+		job->position = position + i * JOB_SIZE;
+		job->data = &c->window_buff[i * JOB_SIZE];
+		job->size = FFMIN(JOB_SIZE, size - i * JOB_SIZE);
+		job->done = aes_window_encrypted;
+		job->opaque = c;
+	}
+	aes_pool_submit(c->write_jobs, nb_jobs);
+
+	pthread_mutex_lock(&c->mutex);
+	while (c->write_pending > 0)
+		pthread_cond_wait(&c->cond, &c->mutex);
+	pthread_mutex_unlock(&c->mutex);
+}
+
+/*
+ * Encrypts and writes window to nested stream, last block is padded
+ * with zeros
+ */
+static int aes_write_flush(AesContext *c) {
+	int padded;
+	int ret;
+	if (!c->write_dirty)
+		return 0;
+	padded = FFALIGN(c->write_size, AES_CIPHER_BLOCK_SIZE);
+	memset(&c->window_buff[c->write_size], 0, padded - c->write_size);
+	log_hex("aes_write_flush: decoded[%d]: %s", c->window_buff, padded);
+	aes_encrypt_window(c, c->write_start, padded);
+	log_hex("aes_write_flush: encoded[%d]: %s", c->window_buff, padded);
+	// window holds encrypted data from now
+	c->write_loaded = FALSE;
+	c->write_dirty = FALSE;
+
+	if ((ret = aes_seek_nested(c, c->write_start)) < 0)
+		return ret;
+	ret = ffurl_write(c->hd, c->window_buff, padded);
+	if (ret < 0) {
+		LOGE(1, "aes_write_flush: could not write: %d", ret);
+		return ret;
+	}
+	c->hd_position += padded;
+	c->written_end = FFMAX(c->written_end, c->write_start + c->write_size);
+	LOGI(3, "aes_write_flush: start: %"PRId64", size: %d",
+			c->write_start, c->write_size);
+	return 0;
+}
+
+/*
+ * Starts new window at sector containing position, data already written
+ * there is read back and decrypted so it could be partially rewritten
+ */
+static int aes_write_load(AesContext *c, int64_t position) {
+	int64_t sector_start = (position / (int64_t) BUFFER_SIZE)
+			* (int64_t) BUFFER_SIZE;
+	int ret;
+	c->write_start = sector_start;
+	c->write_size = 0;
+	if (sector_start < c->written_end) {
+		int size = FFMIN(c->written_end - sector_start, c->window_size);
+		int padded = FFALIGN(size, AES_CIPHER_BLOCK_SIZE);
+		if ((ret = aes_seek_nested(c, sector_start)) < 0)
+			return ret;
+		ret = aes_read_nested(c, c->window_buff, padded);
+		if (ret < padded) {
+			LOGE(1, "aes_write_load: could not read back written data: %d",
+					ret);
+			return ret < 0 ? ret : AVERROR(EIO);
+		}
+		aes_cipher_decrypt_sectors(&c->cipher, sector_start, c->window_buff,
+				padded);
+		c->write_size = size;
+	}
+	c->write_loaded = TRUE;
+	return 0;
+}
+
+static int aes_write(URLContext *h, const unsigned char *buf, int size) {
+	AesContext *c = h->priv_data;
+	int buf_position = 0;
+	int ret;
+	LOGI(3, "aes_write: position: %"PRId64", size: %d",
+			c->write_position, size);
+
+	while (buf_position < size) {
+		int delta;
+		int copy_size;
+		if (!c->write_loaded || c->write_position < c->write_start
+				|| c->write_position >= c->write_start + c->window_size) {
+			if ((ret = aes_write_flush(c)) < 0)
+				return ret;
+			if ((ret = aes_write_load(c, c->write_position)) < 0)
+				return ret;
+			continue;
+		}
+
+		delta = c->write_position - c->write_start;
+		if (delta > c->write_size) {
+			// seeked past end of stream, gap is filled with zeros
+			memset(&c->window_buff[c->write_size], 0, delta - c->write_size);
+		}
+		copy_size = FFMIN(size - buf_position, c->window_size - delta);
+		memcpy(&c->window_buff[delta], &buf[buf_position], copy_size);
+		c->write_size = FFMAX(c->write_size, delta + copy_size);
+		c->write_dirty = TRUE;
+		c->write_position += copy_size;
+		buf_position += copy_size;
+	}
+	return buf_position;
+}
+
 static int aes_close(URLContext *h) {
 	AesContext *c = h->priv_data;
+	int ret = 0;
+	if (c->write_mode)
+		ret = aes_write_flush(c);
+	aes_readahead_stop(c);
 	if (c->hd)
 		ffurl_close(c->hd);
-	return 0;
+	if (c->window_buff != NULL) {
+		av_free(c->window_buff);
+		c->window_buff = NULL;
+	}
+	av_freep(&c->write_jobs);
+	pthread_mutex_destroy(&c->mutex_hd);
+	pthread_cond_destroy(&c->cond);
+	pthread_mutex_destroy(&c->mutex);
+	return ret;
 }
 
 URLProtocol aes_protocol = { .name = "aes", .url_open = aes_open, .url_read =
-		aes_read, .url_close = aes_close, .url_seek = aes_seek,
+		aes_read, .url_write = aes_write, .url_close = aes_close,
+		.url_seek = aes_seek,
 		.priv_data_size = sizeof(AesContext), .priv_data_class = &aes_class,
 		.flags = URL_PROTOCOL_FLAG_NESTED_SCHEME, };
 
-void register_aes_protocol() {
+static pthread_once_t aes_protocol_once = PTHREAD_ONCE_INIT;
+
+static void aes_protocol_register_once() {
 	ffurl_register_protocol(&aes_protocol, sizeof(aes_protocol));
 }
+
+void register_aes_protocol() {
+	// protocol could be registered only once, ffmpeg keeps it in a list
+	pthread_once(&aes_protocol_once, aes_protocol_register_once);
+}
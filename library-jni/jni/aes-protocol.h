@@ -19,7 +19,23 @@
 #ifndef AES_PROTOCOL_H
 #define AES_PROTOCOL_H
 
+#include <stdint.h>
+
+struct AesCacheStats {
+	// windows already decrypted when they were needed
+	int64_t hits;
+	// windows that had to be waited for
+	int64_t misses;
+	// decrypted windows dropped from cache to read new ones
+	int64_t evictions;
+};
+
 void register_aes_protocol();
 
+/*
+ * Cache statistics of all aes streams opened since process start
+ */
+void aes_protocol_get_cache_stats(struct AesCacheStats *stats);
+
 #endif /* H_AES_PROTOCOL */
 
@@ -0,0 +1,99 @@
+/*
+ * blend-neon.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <arm_neon.h>
+
+#include "blend.h"
+
+/*
+ * Exact t / 255 for t in [0, 255 * 255]:
+ * (t + 1 + ((t + 1) >> 8)) >> 8
+ */
+static inline uint8x8_t blend_div255_neon(uint16x8_t t) {
+	t = vaddq_u16(t, vdupq_n_u16(1));
+	return vshrn_n_u16(vsraq_n_u16(t, t, 8), 8);
+}
+
+static inline uint8x8_t blend_lerp_neon(uint8x8_t d, uint8x8_t s,
+		uint8x8_t a) {
+	uint16x8_t t = vmull_u8(d, vmvn_u8(a));
+	t = vmlal_u8(t, s, a);
+	return blend_div255_neon(t);
+}
+
+void blend_row_rgba_neon(uint32_t *dst, const uint32_t *src, int width) {
+	int x = 0;
+	for (; x + 8 <= width; x += 8) {
+		uint8x8x4_t d = vld4_u8((uint8_t *) (dst + x));
+		uint8x8x4_t s = vld4_u8((const uint8_t *) (src + x));
+		uint8x8_t a = s.val[3];
+
+		// val[3] (destination alpha) is preserved
+		d.val[0] = blend_lerp_neon(d.val[0], s.val[0], a);
+		d.val[1] = blend_lerp_neon(d.val[1], s.val[1], a);
+		d.val[2] = blend_lerp_neon(d.val[2], s.val[2], a);
+		vst4_u8((uint8_t *) (dst + x), d);
+	}
+	blend_row_rgba_c(dst + x, src + x, width - x);
+}
+
+void blend_row_mask_neon(uint32_t *dst, const uint8_t *mask, int width,
+		uint32_t color, uint8_t alpha) {
+	const uint8x8_t color_b = vdup_n_u8(color & 0xff);
+	const uint8x8_t color_g = vdup_n_u8((color >> 8) & 0xff);
+	const uint8x8_t color_r = vdup_n_u8((color >> 16) & 0xff);
+	const uint8x8_t valpha = vdup_n_u8(alpha);
+	int x = 0;
+	for (; x + 8 <= width; x += 8) {
+		uint8x8_t m = vld1_u8(mask + x);
+		uint64x1_t any = vreinterpret_u64_u8(m);
+		if (vget_lane_u64(any, 0) == 0) {
+			// fully transparent - libass bitmaps are mostly empty
+			continue;
+		}
+		uint8x8x4_t d = vld4_u8((uint8_t *) (dst + x));
+		uint8x8_t a = vand_u8(m, valpha);
+
+		d.val[0] = blend_lerp_neon(d.val[0], vand_u8(m, color_b), a);
+		d.val[1] = blend_lerp_neon(d.val[1], vand_u8(m, color_g), a);
+		d.val[2] = blend_lerp_neon(d.val[2], vand_u8(m, color_r), a);
+		vst4_u8((uint8_t *) (dst + x), d);
+	}
+	blend_row_mask_c(dst + x, mask + x, width - x, color, alpha);
+}
+
+void blend_row_premul_neon(uint32_t *dst, const uint32_t *src, int width) {
+	int x = 0;
+	for (; x + 8 <= width; x += 8) {
+		uint8x8x4_t s = vld4_u8((const uint8_t *) (src + x));
+		uint64x1_t any = vreinterpret_u64_u8(s.val[3]);
+		if (vget_lane_u64(any, 0) == 0)
+			continue;
+		uint8x8x4_t d = vld4_u8((uint8_t *) (dst + x));
+		uint8x8_t ia = vmvn_u8(s.val[3]);
+
+		d.val[0] = vadd_u8(s.val[0],
+				blend_div255_neon(vmull_u8(d.val[0], ia)));
+		d.val[1] = vadd_u8(s.val[1],
+				blend_div255_neon(vmull_u8(d.val[1], ia)));
+		d.val[2] = vadd_u8(s.val[2],
+				blend_div255_neon(vmull_u8(d.val[2], ia)));
+		vst4_u8((uint8_t *) (dst + x), d);
+	}
+	blend_row_premul_c(dst + x, src + x, width - x);
+}
@@ -16,8 +16,28 @@
  *
  */
 
-#include "blend.h"
 #include <android/log.h>
+#include <pthread.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+
+#ifdef FEATURE_NEON
+#include <cpu-features.h>
+#endif // FEATURE_NEON
+
+#include "blend.h"
+#include "log.h"
+
+#define LOG_TAG "blend.c"
+#define LOG_SUBSYSTEM LOG_SUBSYSTEM_RENDER
+#define LOGI(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
+#define LOGE(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
+
+// width of palette expansion chunk in blend_subrect_rgba
+#define BLEND_CHUNK 256
 
 #define RGBA_IN(r, g, b, a, s)\
 {\
@@ -54,15 +74,242 @@
 #define AB(c)  (((c)>>8) &0xFF)
 #define AA(c)  ((0xFF-c) &0xFF)
 
-void blend_ass_image(AVPicture *dest, const ASS_Image *image, int imgw,
-		int imgh, enum PixelFormat pixel_format) {
-	uint8_t rgba_color[] = { AR(image->color), AG(image->color), AB(
-			image->color), AA(image->color) };
+void blend_row_rgba_c(uint32_t *dst, const uint32_t *src, int width) {
+	int rect_r, rect_g, rect_b, rect_a;
+	int dest_r, dest_g, dest_b, dest_a;
+	int x;
+	for (x = 0; x < width; x++) {
+		const uint32_t *rect_pixel = src++;
+		uint32_t *pixel = dst++;
+
+		RGBA_IN(rect_r, rect_g, rect_b, rect_a, rect_pixel);
+		RGBA_IN(dest_r, dest_g, dest_b, dest_a, pixel);
+
+		dest_r = ALPHA_BLEND_RGB(dest_r, rect_r, rect_a);
+		dest_g = ALPHA_BLEND_RGB(dest_g, rect_g, rect_a);
+		dest_b = ALPHA_BLEND_RGB(dest_b, rect_b, rect_a);
+
+		RGBA_OUT(pixel, dest_r, dest_g, dest_b, dest_a);
+	}
+}
+
+void blend_row_mask_c(uint32_t *dst, const uint8_t *mask, int width,
+		uint32_t color, uint8_t alpha) {
+	uint8_t color_r = (color >> 16) & 0xff;
+	uint8_t color_g = (color >> 8) & 0xff;
+	uint8_t color_b = color & 0xff;
 	uint8_t rect_r, rect_g, rect_b, rect_a;
 	int dest_r, dest_g, dest_b, dest_a;
-	int x, y;
-	uint32_t *dst2;
-	uint8_t *src, *src2;
+	int x;
+	for (x = 0; x < width; x++) {
+		uint8_t image_pixel = *(mask++);
+		uint32_t *pixel = dst++;
+
+		rect_r = image_pixel & color_r;
+		rect_g = image_pixel & color_g;
+		rect_b = image_pixel & color_b;
+		rect_a = image_pixel & alpha;
+
+		RGBA_IN(dest_r, dest_g, dest_b, dest_a, pixel);
+
+		// write subtitle on the image
+		dest_r = ALPHA_BLEND_RGB(dest_r, rect_r, rect_a);
+		dest_g = ALPHA_BLEND_RGB(dest_g, rect_g, rect_a);
+		dest_b = ALPHA_BLEND_RGB(dest_b, rect_b, rect_a);
+
+		RGBA_OUT(pixel, dest_r, dest_g, dest_b, dest_a);
+	}
+}
+
+void blend_row_premul_c(uint32_t *dst, const uint32_t *src, int width) {
+	int x;
+	for (x = 0; x < width; x++) {
+		uint32_t s = *(src++);
+		uint32_t *pixel = dst++;
+		if (s == 0)
+			continue;
+		int ia = 0xff - (s >> 24);
+		uint32_t d = *pixel;
+		uint32_t c0 = (s & 0xff) + blend_div255((d & 0xff) * ia);
+		uint32_t c1 = ((s >> 8) & 0xff) + blend_div255(((d >> 8) & 0xff) * ia);
+		uint32_t c2 = ((s >> 16) & 0xff)
+				+ blend_div255(((d >> 16) & 0xff) * ia);
+		*pixel = (d & 0xff000000) | (c2 << 16) | (c1 << 8) | c0;
+	}
+}
+
+#ifdef __SSE2__
+
+/*
+ * Exact t / 255 for t in [0, 255 * 255]:
+ * (t + 1 + ((t + 1) >> 8)) >> 8
+ */
+static inline __m128i blend_div255_sse2(__m128i t) {
+	t = _mm_add_epi16(t, _mm_set1_epi16(1));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static inline __m128i blend_lerp_sse2(__m128i d, __m128i s, __m128i a) {
+	__m128i ia = _mm_sub_epi16(_mm_set1_epi16(0xff), a);
+	return blend_div255_sse2(
+			_mm_add_epi16(_mm_mullo_epi16(d, ia), _mm_mullo_epi16(s, a)));
+}
+
+void blend_row_rgba_sse2(uint32_t *dst, const uint32_t *src, int width) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i keep = _mm_set1_epi32(0xff000000);
+	int x = 0;
+	for (; x + 4 <= width; x += 4) {
+		__m128i d = _mm_loadu_si128((const __m128i *) (dst + x));
+		__m128i s = _mm_loadu_si128((const __m128i *) (src + x));
+
+		__m128i slo = _mm_unpacklo_epi8(s, zero);
+		__m128i shi = _mm_unpackhi_epi8(s, zero);
+		__m128i alo = _mm_shufflehi_epi16(
+				_mm_shufflelo_epi16(slo, _MM_SHUFFLE(3, 3, 3, 3)),
+				_MM_SHUFFLE(3, 3, 3, 3));
+		__m128i ahi = _mm_shufflehi_epi16(
+				_mm_shufflelo_epi16(shi, _MM_SHUFFLE(3, 3, 3, 3)),
+				_MM_SHUFFLE(3, 3, 3, 3));
+
+		__m128i lo = blend_lerp_sse2(_mm_unpacklo_epi8(d, zero), slo, alo);
+		__m128i hi = blend_lerp_sse2(_mm_unpackhi_epi8(d, zero), shi, ahi);
+		__m128i r = _mm_packus_epi16(lo, hi);
+
+		// destination alpha is preserved
+		r = _mm_or_si128(_mm_andnot_si128(keep, r), _mm_and_si128(keep, d));
+		_mm_storeu_si128((__m128i *) (dst + x), r);
+	}
+	blend_row_rgba_c(dst + x, src + x, width - x);
+}
+
+void blend_row_mask_sse2(uint32_t *dst, const uint8_t *mask, int width,
+		uint32_t color, uint8_t alpha) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i keep = _mm_set1_epi32(0xff000000);
+	const __m128i vcolor = _mm_set1_epi32(color & 0x00ffffff);
+	const __m128i valpha = _mm_set1_epi8(alpha);
+	int x = 0;
+	for (; x + 4 <= width; x += 4) {
+		uint32_t m4;
+		memcpy(&m4, mask + x, sizeof(m4));
+		if (m4 == 0) {
+			// fully transparent - libass bitmaps are mostly empty
+			continue;
+		}
+		__m128i m = _mm_cvtsi32_si128(m4);
+		m = _mm_unpacklo_epi8(m, m);
+		m = _mm_unpacklo_epi16(m, m);
+
+		__m128i d = _mm_loadu_si128((const __m128i *) (dst + x));
+		__m128i s = _mm_and_si128(m, vcolor);
+		__m128i a = _mm_and_si128(m, valpha);
+
+		__m128i lo = blend_lerp_sse2(_mm_unpacklo_epi8(d, zero),
+				_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(a, zero));
+		__m128i hi = blend_lerp_sse2(_mm_unpackhi_epi8(d, zero),
+				_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(a, zero));
+		__m128i r = _mm_packus_epi16(lo, hi);
+
+		r = _mm_or_si128(_mm_andnot_si128(keep, r), _mm_and_si128(keep, d));
+		_mm_storeu_si128((__m128i *) (dst + x), r);
+	}
+	blend_row_mask_c(dst + x, mask + x, width - x, color, alpha);
+}
+
+void blend_row_premul_sse2(uint32_t *dst, const uint32_t *src, int width) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i keep = _mm_set1_epi32(0xff000000);
+	const __m128i ff = _mm_set1_epi16(0xff);
+	int x = 0;
+	for (; x + 4 <= width; x += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *) (src + x));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xffff)
+			continue;
+		__m128i d = _mm_loadu_si128((const __m128i *) (dst + x));
+
+		__m128i slo = _mm_unpacklo_epi8(s, zero);
+		__m128i shi = _mm_unpackhi_epi8(s, zero);
+		__m128i ialo = _mm_sub_epi16(ff, _mm_shufflehi_epi16(
+				_mm_shufflelo_epi16(slo, _MM_SHUFFLE(3, 3, 3, 3)),
+				_MM_SHUFFLE(3, 3, 3, 3)));
+		__m128i iahi = _mm_sub_epi16(ff, _mm_shufflehi_epi16(
+				_mm_shufflelo_epi16(shi, _MM_SHUFFLE(3, 3, 3, 3)),
+				_MM_SHUFFLE(3, 3, 3, 3)));
+
+		__m128i lo = _mm_add_epi16(slo, blend_div255_sse2(
+				_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ialo)));
+		__m128i hi = _mm_add_epi16(shi, blend_div255_sse2(
+				_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), iahi)));
+		__m128i r = _mm_packus_epi16(lo, hi);
+
+		r = _mm_or_si128(_mm_andnot_si128(keep, r), _mm_and_si128(keep, d));
+		_mm_storeu_si128((__m128i *) (dst + x), r);
+	}
+	blend_row_premul_c(dst + x, src + x, width - x);
+}
+
+#endif // __SSE2__
+
+static const struct BlendKernels blend_kernels_c = {
+	"c",
+	blend_row_rgba_c,
+	blend_row_mask_c,
+	blend_row_premul_c,
+};
+
+#ifdef __SSE2__
+static const struct BlendKernels blend_kernels_sse2 = {
+	"sse2",
+	blend_row_rgba_sse2,
+	blend_row_mask_sse2,
+	blend_row_premul_sse2,
+};
+#endif // __SSE2__
+
+#ifdef FEATURE_NEON
+static const struct BlendKernels blend_kernels_neon = {
+	"neon",
+	blend_row_rgba_neon,
+	blend_row_mask_neon,
+	blend_row_premul_neon,
+};
+#endif // FEATURE_NEON
+
+static pthread_once_t blend_kernels_once = PTHREAD_ONCE_INIT;
+static const struct BlendKernels *blend_kernels = &blend_kernels_c;
+
+static void blend_detect_kernels() {
+#ifdef FEATURE_NEON
+	if (android_getCpuFamily() == ANDROID_CPU_FAMILY_ARM
+			&& (android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON)) {
+		blend_kernels = &blend_kernels_neon;
+	}
+#endif // FEATURE_NEON
+#ifdef __SSE2__
+	// SSE2 is part of x86 abi
+	blend_kernels = &blend_kernels_sse2;
+#endif // __SSE2__
+	LOGI(3, "blend_detect_kernels: using %s kernels", blend_kernels->name);
+}
+
+const struct BlendKernels *blend_get_c_kernels() {
+	return &blend_kernels_c;
+}
+
+const struct BlendKernels *blend_get_kernels() {
+	pthread_once(&blend_kernels_once, blend_detect_kernels);
+	return blend_kernels;
+}
+
+void blend_ass_image(AVPicture *dest, const ASS_Image *image, int imgw,
+		int imgh, enum PixelFormat pixel_format) {
+	const struct BlendKernels *kernels = blend_get_kernels();
+	uint32_t color = (AR(image->color) << 16) | (AG(image->color) << 8)
+			| AB(image->color);
+	uint8_t alpha = AA(image->color);
+	int y;
+	uint8_t *src;
 	uint8_t *dst = dest->data[0];
 
 	if (pixel_format != PIX_FMT_RGBA)
@@ -71,26 +318,7 @@ void blend_ass_image(AVPicture *dest, const ASS_Image *image, int imgw,
 	dst += image->dst_y * dest->linesize[0] + image->dst_x * 4;
 	src = image->bitmap;
 	for (y = 0; y < image->h; y++) {
-		dst2 = (uint32_t *) dst;
-		src2 = src;
-		for (x = 0; x < image->w; x++) {
-			uint8_t image_pixel = *(src2++);
-			uint32_t *pixel = (dst2++);
-
-			rect_r = image_pixel & rgba_color[0];
-			rect_g = image_pixel & rgba_color[1];
-			rect_b = image_pixel & rgba_color[2];
-			rect_a = image_pixel & rgba_color[3];
-
-			RGBA_IN(dest_r, dest_g, dest_b, dest_a, pixel);
-
-			// write subtitle on the image
-			dest_r = ALPHA_BLEND_RGB(dest_r, rect_r, rect_a);
-			dest_g = ALPHA_BLEND_RGB(dest_g, rect_g, rect_a);
-			dest_b = ALPHA_BLEND_RGB(dest_b, rect_b, rect_a);
-
-			RGBA_OUT(pixel, dest_r, dest_g, dest_b, dest_a);
-		}
+		kernels->row_mask((uint32_t *) dst, src, image->w, color, alpha);
 		dst += dest->linesize[0];
 		src += image->stride;
 	}
@@ -98,12 +326,11 @@ void blend_ass_image(AVPicture *dest, const ASS_Image *image, int imgw,
 
 void blend_subrect_rgba(AVPicture *dest, const AVSubtitleRect *rect, int imgw,
 		int imgh, enum PixelFormat pixel_format) {
-	int rect_r, rect_g, rect_b, rect_a;
-	int dest_r, dest_g, dest_b, dest_a;
+	const struct BlendKernels *kernels = blend_get_kernels();
+	uint32_t line[BLEND_CHUNK];
 	uint32_t *pal;
-	uint32_t *dst2;
-	uint8_t *src, *src2;
-	int x, y;
+	uint8_t *src;
+	int x, y, i;
 	uint8_t *dst = dest->data[0];
 
 	if (pixel_format != PIX_FMT_RGBA)
@@ -114,26 +341,17 @@ void blend_subrect_rgba(AVPicture *dest, const AVSubtitleRect *rect, int imgw,
 	pal = (uint32_t *) rect->pict.data[1];
 
 	for (y = 0; y < rect->h; y++) {
-		dst2 = (uint32_t *) dst;
-		src2 = src;
-		for (x = 0; x < rect->w; x++) {
-			uint32_t *rect_pixel = &pal[*(src2++)];
-			uint32_t *pixel = (dst2++);
-
-			// read subtitle rgba8888
-			RGBA_IN(rect_r, rect_g, rect_b, rect_a, rect_pixel);
-
-			RGBA_IN(dest_r, dest_g, dest_b, dest_a, pixel);
-
-			// write subtitle on the image
-			dest_r = ALPHA_BLEND_RGB(dest_r, rect_r, rect_a);
-			dest_g = ALPHA_BLEND_RGB(dest_g, rect_g, rect_a);
-			dest_b = ALPHA_BLEND_RGB(dest_b, rect_b, rect_a);
-
-			RGBA_OUT(pixel, dest_r, dest_g, dest_b, dest_a);
+		uint32_t *dst2 = (uint32_t *) dst;
+		for (x = 0; x < rect->w; x += BLEND_CHUNK) {
+			int width = rect->w - x;
+			if (width > BLEND_CHUNK)
+				width = BLEND_CHUNK;
+			// palette lookup could not be vectorized - expand it first
+			for (i = 0; i < width; i++)
+				line[i] = pal[src[x + i]];
+			kernels->row_rgba(dst2 + x, line, width);
 		}
 		dst += dest->linesize[0];
 		src += rect->pict.linesize[0];
 	}
 }
-
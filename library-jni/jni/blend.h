@@ -22,6 +22,77 @@
 #include <libavcodec/avcodec.h>
 #include <ass/ass.h>
 
+/*
+ * Row kernels used by blend functions. Every kernel blends source color
+ * bytes 0..2 over the destination with per-pixel alpha and leaves the
+ * destination byte 3 untouched. Vectorized variants have to produce
+ * exactly the same output as the *_c reference kernels.
+ */
+
+/*
+ * src - already unpacked 0xAARRGGBB pixels (e.g. palette lookups)
+ */
+typedef void (*blend_row_rgba_func)(uint32_t *dst, const uint32_t *src,
+		int width);
+
+/*
+ * mask - libass coverage bitmap, color - source color bytes at destination
+ * byte positions, alpha - mask applied to coverage to get pixel alpha
+ */
+typedef void (*blend_row_mask_func)(uint32_t *dst, const uint8_t *mask,
+		int width, uint32_t color, uint8_t alpha);
+
+/*
+ * src - premultiplied pixels (color bytes at destination byte positions,
+ * alpha in byte 3), fully transparent pixels are zero
+ */
+typedef void (*blend_row_premul_func)(uint32_t *dst, const uint32_t *src,
+		int width);
+
+struct BlendKernels {
+	const char *name;
+	blend_row_rgba_func row_rgba;
+	blend_row_mask_func row_mask;
+	blend_row_premul_func row_premul;
+};
+
+/*
+ * Exact t / 255 for t in [0, 255 * 255]
+ */
+static inline int blend_div255(int t) {
+	t += 1;
+	return (t + (t >> 8)) >> 8;
+}
+
+void blend_row_rgba_c(uint32_t *dst, const uint32_t *src, int width);
+void blend_row_mask_c(uint32_t *dst, const uint8_t *mask, int width,
+		uint32_t color, uint8_t alpha);
+void blend_row_premul_c(uint32_t *dst, const uint32_t *src, int width);
+
+#ifdef __SSE2__
+void blend_row_rgba_sse2(uint32_t *dst, const uint32_t *src, int width);
+void blend_row_mask_sse2(uint32_t *dst, const uint8_t *mask, int width,
+		uint32_t color, uint8_t alpha);
+void blend_row_premul_sse2(uint32_t *dst, const uint32_t *src, int width);
+#endif // __SSE2__
+
+#ifdef FEATURE_NEON
+void blend_row_rgba_neon(uint32_t *dst, const uint32_t *src, int width);
+void blend_row_mask_neon(uint32_t *dst, const uint8_t *mask, int width,
+		uint32_t color, uint8_t alpha);
+void blend_row_premul_neon(uint32_t *dst, const uint32_t *src, int width);
+#endif // FEATURE_NEON
+
+/*
+ * Scalar reference kernels
+ */
+const struct BlendKernels *blend_get_c_kernels();
+
+/*
+ * Best kernels for the running cpu (detected once)
+ */
+const struct BlendKernels *blend_get_kernels();
+
 void blend_ass_image(AVPicture *dest, const ASS_Image *image, int imgw,
 		int imgh, enum PixelFormat pixel_format);
 void blend_subrect_rgba(AVPicture *dest, const AVSubtitleRect *rect, int imgw,
@@ -0,0 +1,176 @@
+/*
+ * checksum.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <libavutil/imgutils.h>
+
+#include "checksum.h"
+
+#define PRIME64_1 11400714785074694791ull
+#define PRIME64_2 14029467366897019727ull
+#define PRIME64_3 1609587929392839161ull
+#define PRIME64_4 9650029242287828579ull
+#define PRIME64_5 2870177450012600261ull
+
+static inline uint64_t checksum_rotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t checksum_read64(const uint8_t *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t checksum_read32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t checksum_round(uint64_t acc, uint64_t input) {
+	acc += input * PRIME64_2;
+	acc = checksum_rotl(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static inline uint64_t checksum_merge_round(uint64_t acc, uint64_t val) {
+	acc ^= checksum_round(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+void checksum_init(struct Checksum *checksum, uint64_t seed) {
+	memset(checksum, 0, sizeof(*checksum));
+	checksum->seed = seed;
+	checksum->v[0] = seed + PRIME64_1 + PRIME64_2;
+	checksum->v[1] = seed + PRIME64_2;
+	checksum->v[2] = seed;
+	checksum->v[3] = seed - PRIME64_1;
+}
+
+static inline void checksum_stripe(uint64_t *v, const uint8_t *p) {
+	v[0] = checksum_round(v[0], checksum_read64(p));
+	v[1] = checksum_round(v[1], checksum_read64(p + 8));
+	v[2] = checksum_round(v[2], checksum_read64(p + 16));
+	v[3] = checksum_round(v[3], checksum_read64(p + 24));
+}
+
+void checksum_update(struct Checksum *checksum, const void *data,
+		size_t size) {
+	const uint8_t *p = data;
+	const uint8_t *end = p + size;
+
+	checksum->total_len += size;
+	if (checksum->mem_size + size < 32) {
+		memcpy(checksum->mem + checksum->mem_size, p, size);
+		checksum->mem_size += size;
+		return;
+	}
+	if (checksum->mem_size > 0) {
+		int fill = 32 - checksum->mem_size;
+		memcpy(checksum->mem + checksum->mem_size, p, fill);
+		checksum_stripe(checksum->v, checksum->mem);
+		p += fill;
+		checksum->mem_size = 0;
+	}
+	for (; p + 32 <= end; p += 32)
+		checksum_stripe(checksum->v, p);
+	if (p < end) {
+		memcpy(checksum->mem, p, end - p);
+		checksum->mem_size = end - p;
+	}
+}
+
+uint64_t checksum_final(const struct Checksum *checksum) {
+	const uint8_t *p = checksum->mem;
+	const uint8_t *end = p + checksum->mem_size;
+	const uint64_t *v = checksum->v;
+	uint64_t h;
+
+	if (checksum->total_len >= 32) {
+		h = checksum_rotl(v[0], 1) + checksum_rotl(v[1], 7)
+				+ checksum_rotl(v[2], 12) + checksum_rotl(v[3], 18);
+		h = checksum_merge_round(h, v[0]);
+		h = checksum_merge_round(h, v[1]);
+		h = checksum_merge_round(h, v[2]);
+		h = checksum_merge_round(h, v[3]);
+	} else {
+		h = checksum->seed + PRIME64_5;
+	}
+	h += checksum->total_len;
+
+	for (; p + 8 <= end; p += 8) {
+		h ^= checksum_round(0, checksum_read64(p));
+		h = checksum_rotl(h, 27) * PRIME64_1 + PRIME64_4;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t) checksum_read32(p) * PRIME64_1;
+		h = checksum_rotl(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; ++p) {
+		h ^= (*p) * PRIME64_5;
+		h = checksum_rotl(h, 11) * PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t checksum_buffer(const void *data, size_t size, uint64_t seed) {
+	struct Checksum checksum;
+	checksum_init(&checksum, seed);
+	checksum_update(&checksum, data, size);
+	return checksum_final(&checksum);
+}
+
+uint64_t checksum_picture(const AVPicture *picture, enum PixelFormat pix_fmt,
+		int width, int height) {
+	struct Checksum checksum;
+	int linesizes[4];
+	int h_shift, v_shift;
+	int plane, y;
+
+	checksum_init(&checksum, 0);
+	if (av_image_fill_linesizes(linesizes, pix_fmt, width) < 0)
+		return 0;
+	avcodec_get_chroma_sub_sample(pix_fmt, &h_shift, &v_shift);
+	for (plane = 0; plane < 4 && picture->data[plane] != NULL; ++plane) {
+		int plane_height = height;
+		if (linesizes[plane] == 0)
+			break;
+		if (plane == 1 || plane == 2)
+			plane_height = -((-height) >> v_shift);
+		for (y = 0; y < plane_height; ++y)
+			checksum_update(&checksum,
+					picture->data[plane] + y * picture->linesize[plane],
+					linesizes[plane]);
+	}
+	return checksum_final(&checksum);
+}
+
+void checksum_log(FILE *file, const char *kind, int64_t pts_us,
+		uint64_t hash) {
+	fprintf(file, "%s %" PRId64 " %016" PRIx64 "\n", kind, pts_us, hash);
+}
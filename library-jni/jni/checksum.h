@@ -0,0 +1,60 @@
+/*
+ * checksum.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef CHECKSUM_H_
+#define CHECKSUM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <libavcodec/avcodec.h>
+
+/*
+ * Streaming xxHash64, used to fingerprint decoded and converted frames
+ * so outputs of two builds or two runs can be diffed
+ */
+struct Checksum {
+	uint64_t v[4];
+	uint64_t seed;
+	uint64_t total_len;
+	uint8_t mem[32];
+	int mem_size;
+};
+
+void checksum_init(struct Checksum *checksum, uint64_t seed);
+void checksum_update(struct Checksum *checksum, const void *data,
+		size_t size);
+uint64_t checksum_final(const struct Checksum *checksum);
+uint64_t checksum_buffer(const void *data, size_t size, uint64_t seed);
+
+/*
+ * Hashes visible bytes of every plane, line padding is skipped so result
+ * does not depend on allocation alignment
+ */
+uint64_t checksum_picture(const AVPicture *picture, enum PixelFormat pix_fmt,
+		int width, int height);
+
+/*
+ * Writes "<kind> <pts_us> <hash>" line, format shared by player checksum
+ * log, player_bench and gen_media sidecars so they could be diffed
+ */
+void checksum_log(FILE *file, const char *kind, int64_t pts_us,
+		uint64_t hash);
+
+#endif /* CHECKSUM_H_ */
@@ -65,6 +65,27 @@ extern "C" {
 		              filterMode);
 	}
 
+	int __I420Scale(const uint8* src_y, int src_stride_y,
+			const uint8* src_u, int src_stride_u,
+			const uint8* src_v, int src_stride_v,
+			int src_width, int src_height,
+			uint8* dst_y, int dst_stride_y,
+			uint8* dst_u, int dst_stride_u,
+			uint8* dst_v, int dst_stride_v,
+			int dst_width, int dst_height,
+			enum __FilterMode filtering) {
+		libyuv::FilterMode filterMode = static_cast<libyuv::FilterMode>(filtering);
+		return libyuv::I420Scale(src_y, src_stride_y,
+				src_u, src_stride_u,
+				src_v, src_stride_v,
+				src_width, src_height,
+				dst_y, dst_stride_y,
+				dst_u, dst_stride_u,
+				dst_v, dst_stride_v,
+				dst_width, dst_height,
+				filterMode);
+	}
+
 	int __ARGBToRGBA(const uint8* src_frame, int src_stride_frame,
             uint8* dst_argb, int dst_stride_argb,
             int width, int height) {
@@ -0,0 +1,558 @@
+/*
+ * executor.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "executor.h"
+#include "log.h"
+
+#include <android/log.h>
+#define LOG_SUBSYSTEM LOG_SUBSYSTEM_PLAYER
+#define LOG_TAG "executor.c"
+#define LOGI(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
+#define LOGE(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
+
+#define FALSE 0
+#define TRUE (!(FALSE))
+
+struct ExecutorWorker {
+	struct Executor *executor;
+	int index;
+	pthread_t thread;
+	int thread_created;
+
+	pthread_mutex_t mutex;
+	struct ExecutorTask *head[EXECUTOR_PRIORITIES];
+	struct ExecutorTask *tail[EXECUTOR_PRIORITIES];
+};
+
+struct Executor {
+	char name[32];
+	int nb_workers;
+	struct ExecutorWorker *workers;
+
+	executor_thread_func on_start;
+	executor_thread_func on_stop;
+	void *thread_data;
+
+	// worker running in current thread
+	pthread_key_t worker_key;
+
+	// tasks in all workers queues
+	volatile int queued;
+	volatile int next_worker;
+
+	// delayed tasks sorted by run_at
+	pthread_mutex_t mutex_timers;
+	struct ExecutorTask *timers;
+
+	// lock order: mutex_sleep, mutex_timers, worker mutex
+	pthread_mutex_t mutex_sleep;
+	pthread_cond_t cond_sleep;
+	// some task became idle
+	pthread_cond_t cond_idle;
+	int sleepers;
+	volatile int idle_waiters;
+	int stop;
+};
+
+static int64_t executor_now_us() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t) now.tv_sec * 1000000ll + now.tv_nsec / 1000;
+}
+
+static void executor_wake_sleeper(struct Executor *executor) {
+	pthread_mutex_lock(&executor->mutex_sleep);
+	if (executor->sleepers > 0)
+		pthread_cond_signal(&executor->cond_sleep);
+	pthread_mutex_unlock(&executor->mutex_sleep);
+}
+
+static void executor_notify_idle(struct Executor *executor) {
+	if (executor->idle_waiters == 0)
+		return;
+	pthread_mutex_lock(&executor->mutex_sleep);
+	pthread_cond_broadcast(&executor->cond_idle);
+	pthread_mutex_unlock(&executor->mutex_sleep);
+}
+
+/*
+ * Task has to be in QUEUED state. Tasks queued from a worker land in its
+ * own queue (they usually work on data that is still in its cache), others
+ * are spread round robin.
+ */
+static void executor_push(struct Executor *executor, struct ExecutorTask *task) {
+	struct ExecutorWorker *worker = pthread_getspecific(executor->worker_key);
+	int priority = task->priority;
+	if (worker == NULL) {
+		unsigned int next = __sync_fetch_and_add(&executor->next_worker, 1);
+		worker = &executor->workers[next % executor->nb_workers];
+	}
+
+	pthread_mutex_lock(&worker->mutex);
+	task->next = NULL;
+	if (worker->tail[priority] == NULL)
+		worker->head[priority] = task;
+	else
+		worker->tail[priority]->next = task;
+	worker->tail[priority] = task;
+	pthread_mutex_unlock(&worker->mutex);
+
+	__sync_fetch_and_add(&executor->queued, 1);
+	executor_wake_sleeper(executor);
+}
+
+static struct ExecutorTask *executor_pop_from(struct ExecutorWorker *worker,
+		int priority) {
+	struct ExecutorTask *task;
+	// unlocked peek, empty queues are skipped without locking
+	if (worker->head[priority] == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&worker->mutex);
+	task = worker->head[priority];
+	if (task != NULL) {
+		worker->head[priority] = task->next;
+		if (worker->head[priority] == NULL)
+			worker->tail[priority] = NULL;
+		task->next = NULL;
+	}
+	pthread_mutex_unlock(&worker->mutex);
+	if (task != NULL)
+		__sync_fetch_and_sub(&worker->executor->queued, 1);
+	return task;
+}
+
+/*
+ * Higher priority task stolen from another worker goes before lower
+ * priority task from own queue.
+ */
+static struct ExecutorTask *executor_pop(struct ExecutorWorker *worker) {
+	struct Executor *executor = worker->executor;
+	int priority;
+	int i;
+	for (priority = 0; priority < EXECUTOR_PRIORITIES; priority++) {
+		struct ExecutorTask *task = executor_pop_from(worker, priority);
+		if (task != NULL)
+			return task;
+		for (i = 1; i < executor->nb_workers; i++) {
+			struct ExecutorWorker *victim = &executor->workers[(worker->index
+					+ i) % executor->nb_workers];
+			task = executor_pop_from(victim, priority);
+			if (task != NULL)
+				return task;
+		}
+	}
+	return NULL;
+}
+
+static void executor_timer_insert_already_locked(struct Executor *executor,
+		struct ExecutorTask *task) {
+	struct ExecutorTask **place = &executor->timers;
+	while (*place != NULL && (*place)->run_at <= task->run_at)
+		place = &(*place)->next_timer;
+	task->next_timer = *place;
+	*place = task;
+}
+
+static void executor_timer_remove_already_locked(struct Executor *executor,
+		struct ExecutorTask *task) {
+	struct ExecutorTask **place = &executor->timers;
+	while (*place != NULL && *place != task)
+		place = &(*place)->next_timer;
+	if (*place != NULL)
+		*place = task->next_timer;
+	task->next_timer = NULL;
+}
+
+/*
+ * Queues delayed tasks which time has come, returns their number
+ */
+static int executor_fire_timers(struct Executor *executor) {
+	struct ExecutorTask *due = NULL;
+	struct ExecutorTask *task;
+	int64_t now;
+	int fired = 0;
+
+	if (executor->timers == NULL)
+		return 0;
+	now = executor_now_us();
+	pthread_mutex_lock(&executor->mutex_timers);
+	while (executor->timers != NULL && executor->timers->run_at <= now) {
+		task = executor->timers;
+		executor->timers = task->next_timer;
+		task->state = EXECUTOR_TASK_QUEUED;
+		task->next_timer = due;
+		due = task;
+	}
+	pthread_mutex_unlock(&executor->mutex_timers);
+
+	while (due != NULL) {
+		task = due;
+		due = task->next_timer;
+		task->next_timer = NULL;
+		executor_push(executor, task);
+		fired++;
+	}
+	return fired;
+}
+
+static void executor_task_finish(struct ExecutorTask *task) {
+	struct Executor *executor = task->executor;
+	for (;;) {
+		int state = task->state;
+		if (task->cancelled) {
+			if (__sync_bool_compare_and_swap(&task->state, state,
+					EXECUTOR_TASK_IDLE))
+				break;
+			continue;
+		}
+		if (state == EXECUTOR_TASK_RUNNING) {
+			if (__sync_bool_compare_and_swap(&task->state, state,
+					EXECUTOR_TASK_IDLE))
+				break;
+		} else if (state == EXECUTOR_TASK_RUNNING_RERUN) {
+			if (__sync_bool_compare_and_swap(&task->state, state,
+					EXECUTOR_TASK_QUEUED)) {
+				executor_push(executor, task);
+				return;
+			}
+		} else if (state == EXECUTOR_TASK_RUNNING_DELAYED) {
+			pthread_mutex_lock(&executor->mutex_timers);
+			if (__sync_bool_compare_and_swap(&task->state, state,
+					EXECUTOR_TASK_DELAYED)) {
+				executor_timer_insert_already_locked(executor, task);
+				pthread_mutex_unlock(&executor->mutex_timers);
+				executor_wake_sleeper(executor);
+				return;
+			}
+			pthread_mutex_unlock(&executor->mutex_timers);
+		} else {
+			LOGE(1, "executor_task_finish: unexpected state %d", state);
+			return;
+		}
+	}
+	executor_notify_idle(executor);
+}
+
+static void executor_run(struct ExecutorTask *task) {
+	__sync_bool_compare_and_swap(&task->state, EXECUTOR_TASK_QUEUED,
+			EXECUTOR_TASK_RUNNING);
+	if (!task->cancelled)
+		task->func(task->data);
+	executor_task_finish(task);
+}
+
+static void executor_sleep(struct Executor *executor) {
+	pthread_mutex_lock(&executor->mutex_sleep);
+	executor->sleepers += 1;
+	while (!executor->stop && executor->queued == 0) {
+		int64_t run_at = INT64_MAX;
+		int64_t now;
+		pthread_mutex_lock(&executor->mutex_timers);
+		if (executor->timers != NULL)
+			run_at = executor->timers->run_at;
+		pthread_mutex_unlock(&executor->mutex_timers);
+
+		if (run_at == INT64_MAX) {
+			pthread_cond_wait(&executor->cond_sleep, &executor->mutex_sleep);
+			continue;
+		}
+		now = executor_now_us();
+		if (run_at <= now)
+			break;
+		{
+			// cond clock is CLOCK_REALTIME
+			struct timeval tv;
+			struct timespec ts;
+			int64_t wake;
+			gettimeofday(&tv, NULL);
+			wake = (int64_t) tv.tv_sec * 1000000ll + tv.tv_usec
+					+ (run_at - now);
+			ts.tv_sec = wake / 1000000ll;
+			ts.tv_nsec = (wake % 1000000ll) * 1000;
+			pthread_cond_timedwait(&executor->cond_sleep,
+					&executor->mutex_sleep, &ts);
+		}
+	}
+	executor->sleepers -= 1;
+	pthread_mutex_unlock(&executor->mutex_sleep);
+}
+
+static void * executor_worker(void *data) {
+	struct ExecutorWorker *worker = data;
+	struct Executor *executor = worker->executor;
+
+	pthread_setspecific(executor->worker_key, worker);
+	if (executor->on_start != NULL)
+		executor->on_start(executor->thread_data);
+
+	for (;;) {
+		struct ExecutorTask *task;
+		// due timers are queued before every pop, busy pool would never
+		// get to them otherwise
+		executor_fire_timers(executor);
+		task = executor_pop(worker);
+		if (task != NULL) {
+			executor_run(task);
+			continue;
+		}
+		if (executor->stop)
+			break;
+		executor_sleep(executor);
+	}
+
+	if (executor->on_stop != NULL)
+		executor->on_stop(executor->thread_data);
+	return NULL;
+}
+
+struct Executor *executor_create(const char *name, int workers,
+		executor_thread_func on_start, executor_thread_func on_stop,
+		void *thread_data) {
+	struct Executor *executor;
+	int i;
+
+	if (workers < 1)
+		workers = 1;
+	executor = calloc(1, sizeof(struct Executor));
+	if (executor == NULL)
+		goto error_alloc;
+	executor->workers = calloc(workers, sizeof(struct ExecutorWorker));
+	if (executor->workers == NULL)
+		goto error_alloc_workers;
+	if (pthread_key_create(&executor->worker_key, NULL))
+		goto error_key;
+
+	strncpy(executor->name, name, sizeof(executor->name) - 1);
+	executor->nb_workers = workers;
+	executor->on_start = on_start;
+	executor->on_stop = on_stop;
+	executor->thread_data = thread_data;
+	pthread_mutex_init(&executor->mutex_timers, NULL);
+	pthread_mutex_init(&executor->mutex_sleep, NULL);
+	pthread_cond_init(&executor->cond_sleep, NULL);
+	pthread_cond_init(&executor->cond_idle, NULL);
+	for (i = 0; i < workers; i++) {
+		struct ExecutorWorker *worker = &executor->workers[i];
+		worker->executor = executor;
+		worker->index = i;
+		pthread_mutex_init(&worker->mutex, NULL);
+	}
+
+	for (i = 0; i < workers; i++) {
+		struct ExecutorWorker *worker = &executor->workers[i];
+		if (pthread_create(&worker->thread, NULL, executor_worker, worker)) {
+			LOGE(1, "executor_create: %s could not create worker %d",
+					executor->name, i);
+			executor_free(executor);
+			return NULL;
+		}
+		worker->thread_created = TRUE;
+	}
+	LOGI(3, "executor_create: %s started %d workers", executor->name, workers);
+	return executor;
+
+error_key:
+	free(executor->workers);
+error_alloc_workers:
+	free(executor);
+error_alloc:
+	LOGE(1, "executor_create: could not allocate %s", name);
+	return NULL;
+}
+
+void executor_free(struct Executor *executor) {
+	int i;
+	pthread_mutex_lock(&executor->mutex_sleep);
+	executor->stop = TRUE;
+	pthread_cond_broadcast(&executor->cond_sleep);
+	pthread_mutex_unlock(&executor->mutex_sleep);
+
+	for (i = 0; i < executor->nb_workers; i++) {
+		struct ExecutorWorker *worker = &executor->workers[i];
+		if (worker->thread_created)
+			pthread_join(worker->thread, NULL);
+		pthread_mutex_destroy(&worker->mutex);
+	}
+	if (executor->timers != NULL)
+		LOGE(1, "executor_free: %s freed with delayed tasks", executor->name);
+
+	pthread_cond_destroy(&executor->cond_idle);
+	pthread_cond_destroy(&executor->cond_sleep);
+	pthread_mutex_destroy(&executor->mutex_sleep);
+	pthread_mutex_destroy(&executor->mutex_timers);
+	pthread_key_delete(executor->worker_key);
+	free(executor->workers);
+	free(executor);
+}
+
+int executor_get_workers(struct Executor *executor) {
+	return executor->nb_workers;
+}
+
+void executor_task_init(struct ExecutorTask *task, struct Executor *executor,
+		executor_task_func func, void *data, enum ExecutorPriority priority) {
+	memset(task, 0, sizeof(struct ExecutorTask));
+	task->executor = executor;
+	task->func = func;
+	task->data = data;
+	task->priority = priority;
+	task->state = EXECUTOR_TASK_IDLE;
+	__sync_synchronize();
+}
+
+void executor_task_set_priority(struct ExecutorTask *task,
+		enum ExecutorPriority priority) {
+	if (priority < 0 || priority >= EXECUTOR_PRIORITIES)
+		return;
+	task->priority = priority;
+}
+
+/*
+ * Cancel could have seen task idle just before it was queued, so queuing
+ * is reverted when cancelled flag shows up.
+ */
+static int executor_task_revert_if_cancelled(struct ExecutorTask *task) {
+	if (!task->cancelled)
+		return FALSE;
+	__sync_bool_compare_and_swap(&task->state, EXECUTOR_TASK_QUEUED,
+			EXECUTOR_TASK_IDLE);
+	executor_notify_idle(task->executor);
+	return TRUE;
+}
+
+void executor_task_schedule(struct ExecutorTask *task) {
+	struct Executor *executor = task->executor;
+	// work published by caller has to be visible before state is read
+	__sync_synchronize();
+	for (;;) {
+		int state = task->state;
+		if (task->cancelled)
+			return;
+		switch (state) {
+		case EXECUTOR_TASK_IDLE:
+			if (__sync_bool_compare_and_swap(&task->state, state,
+					EXECUTOR_TASK_QUEUED)) {
+				if (!executor_task_revert_if_cancelled(task))
+					executor_push(executor, task);
+				return;
+			}
+			break;
+		case EXECUTOR_TASK_QUEUED:
+		case EXECUTOR_TASK_RUNNING_RERUN:
+			return;
+		case EXECUTOR_TASK_RUNNING:
+		case EXECUTOR_TASK_RUNNING_DELAYED:
+			if (__sync_bool_compare_and_swap(&task->state, state,
+					EXECUTOR_TASK_RUNNING_RERUN))
+				return;
+			break;
+		case EXECUTOR_TASK_DELAYED:
+			pthread_mutex_lock(&executor->mutex_timers);
+			if (task->state == EXECUTOR_TASK_DELAYED) {
+				executor_timer_remove_already_locked(executor, task);
+				task->state = EXECUTOR_TASK_QUEUED;
+				__sync_synchronize();
+				pthread_mutex_unlock(&executor->mutex_timers);
+				if (!executor_task_revert_if_cancelled(task))
+					executor_push(executor, task);
+				return;
+			}
+			pthread_mutex_unlock(&executor->mutex_timers);
+			break;
+		}
+	}
+}
+
+void executor_task_schedule_delayed(struct ExecutorTask *task,
+		int64_t delay_us) {
+	struct Executor *executor = task->executor;
+	int64_t run_at = executor_now_us() + delay_us;
+	int wake = FALSE;
+
+	if (delay_us <= 0) {
+		executor_task_schedule(task);
+		return;
+	}
+
+	pthread_mutex_lock(&executor->mutex_timers);
+	for (;;) {
+		int state = task->state;
+		if (task->cancelled)
+			break;
+		if (state == EXECUTOR_TASK_IDLE) {
+			if (__sync_bool_compare_and_swap(&task->state, state,
+					EXECUTOR_TASK_DELAYED)) {
+				task->run_at = run_at;
+				executor_timer_insert_already_locked(executor, task);
+				wake = executor->timers == task;
+				break;
+			}
+		} else if (state == EXECUTOR_TASK_RUNNING) {
+			if (__sync_bool_compare_and_swap(&task->state, state,
+					EXECUTOR_TASK_RUNNING_DELAYED)) {
+				task->run_at = run_at;
+				break;
+			}
+		} else if (state == EXECUTOR_TASK_RUNNING_DELAYED) {
+			// only running task changes run_at of RUNNING_DELAYED state
+			if (run_at < task->run_at)
+				task->run_at = run_at;
+			break;
+		} else if (state == EXECUTOR_TASK_DELAYED) {
+			if (run_at < task->run_at) {
+				executor_timer_remove_already_locked(executor, task);
+				task->run_at = run_at;
+				executor_timer_insert_already_locked(executor, task);
+				wake = executor->timers == task;
+			}
+			break;
+		} else {
+			// queued or will run again anyway
+			break;
+		}
+	}
+	pthread_mutex_unlock(&executor->mutex_timers);
+	if (wake)
+		executor_wake_sleeper(executor);
+}
+
+void executor_task_cancel(struct ExecutorTask *task) {
+	struct Executor *executor = task->executor;
+	__sync_fetch_and_or(&task->cancelled, 1);
+
+	pthread_mutex_lock(&executor->mutex_timers);
+	if (task->state == EXECUTOR_TASK_DELAYED) {
+		executor_timer_remove_already_locked(executor, task);
+		task->state = EXECUTOR_TASK_IDLE;
+	}
+	pthread_mutex_unlock(&executor->mutex_timers);
+
+	pthread_mutex_lock(&executor->mutex_sleep);
+	__sync_fetch_and_add(&executor->idle_waiters, 1);
+	while (task->state != EXECUTOR_TASK_IDLE)
+		pthread_cond_wait(&executor->cond_idle, &executor->mutex_sleep);
+	__sync_fetch_and_sub(&executor->idle_waiters, 1);
+	pthread_mutex_unlock(&executor->mutex_sleep);
+}
@@ -0,0 +1,118 @@
+/*
+ * executor.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EXECUTOR_H_
+#define EXECUTOR_H_
+
+#include <stdint.h>
+
+/*
+ * Pool of worker threads shared by many players. Every worker has its own
+ * queue per priority, idle workers steal tasks from queues of other
+ * workers. Tasks have to be short steps that never block for long, a task
+ * that has to wait reschedules itself (executor_task_schedule_delayed).
+ */
+
+enum ExecutorPriority {
+	EXECUTOR_PRIORITY_HIGH = 0,
+	EXECUTOR_PRIORITY_NORMAL = 1,
+	EXECUTOR_PRIORITY_LOW = 2,
+	EXECUTOR_PRIORITIES
+};
+
+enum ExecutorTaskState {
+	EXECUTOR_TASK_IDLE = 0,
+	EXECUTOR_TASK_QUEUED,
+	EXECUTOR_TASK_DELAYED,
+	EXECUTOR_TASK_RUNNING,
+	// scheduled again while running
+	EXECUTOR_TASK_RUNNING_RERUN,
+	// scheduled with delay while running
+	EXECUTOR_TASK_RUNNING_DELAYED,
+};
+
+struct Executor;
+
+typedef void (*executor_task_func)(void *data);
+typedef void (*executor_thread_func)(void *data);
+
+/*
+ * Persistent unit of work (one per player stage). Task is queued at most
+ * once and never runs concurrently with itself, scheduling a queued task
+ * does nothing and scheduling a running task runs it once more after it
+ * returns. Fields are private to executor.c.
+ */
+struct ExecutorTask {
+	struct Executor *executor;
+	executor_task_func func;
+	void *data;
+	volatile int priority;
+	volatile int state;
+	volatile int cancelled;
+	// when delayed task should run (monotonic us), guarded by timers mutex
+	int64_t run_at;
+	struct ExecutorTask *next;
+	struct ExecutorTask *next_timer;
+};
+
+/*
+ * Starts workers threads. on_start and on_stop are called in every
+ * worker thread (i.e. to attach thread to java vm) and can be NULL.
+ * Returns NULL on error.
+ */
+struct Executor *executor_create(const char *name, int workers,
+		executor_thread_func on_start, executor_thread_func on_stop,
+		void *thread_data);
+
+/*
+ * Stops and joins workers. All tasks have to be cancelled before.
+ */
+void executor_free(struct Executor *executor);
+
+int executor_get_workers(struct Executor *executor);
+
+void executor_task_init(struct ExecutorTask *task, struct Executor *executor,
+		executor_task_func func, void *data, enum ExecutorPriority priority);
+
+/*
+ * New priority is used next time task is queued
+ */
+void executor_task_set_priority(struct ExecutorTask *task,
+		enum ExecutorPriority priority);
+
+/*
+ * Run task as soon as possible, can be called from any thread (also from
+ * the task itself).
+ */
+void executor_task_schedule(struct ExecutorTask *task);
+
+/*
+ * Run task not earlier than after delay_us. If task is already queued
+ * it runs earlier, tasks should check by themselves if it is their time.
+ */
+void executor_task_schedule_delayed(struct ExecutorTask *task,
+		int64_t delay_us);
+
+/*
+ * Prevents task from running again and waits until it is not queued nor
+ * running. Must not be called from the task itself.
+ * After return task can be initialized again.
+ */
+void executor_task_cancel(struct ExecutorTask *task);
+
+#endif /* EXECUTOR_H_ */
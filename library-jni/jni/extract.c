@@ -0,0 +1,396 @@
+/*
+ * extract.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/mathematics.h>
+#include <libswscale/swscale.h>
+
+#include "extract.h"
+#include "log.h"
+
+#include <android/log.h>
+#define LOG_SUBSYSTEM LOG_SUBSYSTEM_PLAYER
+#define LOG_TAG "extract.c"
+#define LOGI(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
+#define LOGE(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, (level) - 10)) {log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
+
+#define FALSE 0
+#define TRUE (!(FALSE))
+
+// probing only needs to find the video codec parameters
+#define EXTRACT_PROBE_SIZE (256 * 1024)
+#define EXTRACT_ANALYZE_DURATION (AV_TIME_BASE / 2)
+// every run opens input, so it should get a few frames
+#define EXTRACT_MIN_RUN_FRAMES 4
+// packets read after key frame before the frame is given up
+#define EXTRACT_MAX_PACKETS 64
+
+struct ExtractOrder {
+	int64_t timestamp;
+	int index;
+};
+
+struct ExtractJob {
+	const char *url;
+	int width;
+	int height;
+	uint8_t *out;
+	int64_t *frame_times;
+	// timestamps in increasing order
+	struct ExtractOrder *order;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int pending;
+	int err;
+};
+
+struct ExtractInput {
+	AVFormatContext *format_ctx;
+	AVCodecContext *codec_ctx;
+	AVFrame *frame;
+	struct SwsContext *sws_context;
+	int stream_index;
+	// key frame extracted last time and where its picture is
+	int64_t last_key_pts;
+	int64_t last_time;
+	uint8_t *last_out;
+};
+
+struct ExtractRun {
+	struct ExtractJob *job;
+	struct ExecutorTask task;
+	int first;
+	int count;
+	// extraction state kept between steps
+	struct ExtractInput input;
+	int opened;
+	int err;
+	int next;
+};
+
+static void extract_close(struct ExtractInput *input) {
+	if (input->sws_context != NULL) {
+		sws_freeContext(input->sws_context);
+		input->sws_context = NULL;
+	}
+	if (input->frame != NULL)
+		avcodec_free_frame(&input->frame);
+	if (input->codec_ctx != NULL) {
+		avcodec_close(input->codec_ctx);
+		input->codec_ctx = NULL;
+	}
+	if (input->format_ctx != NULL)
+		avformat_close_input(&input->format_ctx);
+}
+
+static int extract_open(struct ExtractInput *input, const char *url) {
+	AVCodec *codec;
+	int err;
+
+	memset(input, 0, sizeof(*input));
+	input->last_key_pts = AV_NOPTS_VALUE;
+	input->format_ctx = avformat_alloc_context();
+	if (input->format_ctx == NULL)
+		return AVERROR(ENOMEM);
+	input->format_ctx->probesize = EXTRACT_PROBE_SIZE;
+	input->format_ctx->max_analyze_duration = EXTRACT_ANALYZE_DURATION;
+	if ((err = avformat_open_input(&input->format_ctx, url, NULL, NULL)) < 0) {
+		LOGE(1, "extract_open could not open: %s", url);
+		// context is freed by avformat_open_input
+		return err;
+	}
+	if ((err = avformat_find_stream_info(input->format_ctx, NULL)) < 0)
+		goto error;
+	err = av_find_best_stream(input->format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1,
+			&codec, 0);
+	if (err < 0) {
+		LOGE(1, "extract_open no video stream in: %s", url);
+		goto error;
+	}
+	input->stream_index = err;
+	input->codec_ctx = input->format_ctx->streams[err]->codec;
+	// runs are already parallel
+	input->codec_ctx->thread_count = 1;
+	if ((err = avcodec_open2(input->codec_ctx, codec, NULL)) < 0) {
+		input->codec_ctx = NULL;
+		goto error;
+	}
+	input->frame = avcodec_alloc_frame();
+	if (input->frame == NULL) {
+		err = AVERROR(ENOMEM);
+		goto error;
+	}
+	return 0;
+
+error:
+	extract_close(input);
+	return err;
+}
+
+static int extract_scale(struct ExtractInput *input, int width, int height,
+		uint8_t *out) {
+	AVCodecContext *ctx = input->codec_ctx;
+	uint8_t *dst_data[4] = { out, NULL, NULL, NULL };
+	int dst_linesize[4] = { width * 4, 0, 0, 0 };
+
+	input->sws_context = sws_getCachedContext(input->sws_context, ctx->width,
+			ctx->height, ctx->pix_fmt, width, height, PIX_FMT_RGBA,
+			SWS_BILINEAR, NULL, NULL, NULL);
+	if (input->sws_context == NULL) {
+		LOGE(1, "extract_scale could not convert from: %d", ctx->pix_fmt);
+		return -1;
+	}
+	sws_scale(input->sws_context, (const uint8_t * const *) input->frame->data,
+			input->frame->linesize, 0, ctx->height, dst_data, dst_linesize);
+	return 0;
+}
+
+/*
+ * Decodes packet (drains decoder when NULL). Returns time of decoded frame
+ * not earlier than key_time or AV_NOPTS_VALUE.
+ */
+static int64_t extract_decode(struct ExtractInput *input, AVPacket *packet,
+		int64_t key_time) {
+	AVStream *stream = input->format_ctx->streams[input->stream_index];
+	AVPacket drain;
+	int finished;
+	int64_t time;
+
+	if (packet == NULL) {
+		av_init_packet(&drain);
+		drain.data = NULL;
+		drain.size = 0;
+		packet = &drain;
+	}
+	if (avcodec_decode_video2(input->codec_ctx, input->frame, &finished,
+			packet) < 0 || !finished)
+		return AV_NOPTS_VALUE;
+	time = av_frame_get_best_effort_timestamp(input->frame);
+	if (time == AV_NOPTS_VALUE)
+		time = key_time != AV_NOPTS_VALUE ? key_time : 0;
+	// leading frames of open GOP reference previous one
+	if (key_time != AV_NOPTS_VALUE && time < key_time)
+		return AV_NOPTS_VALUE;
+	return av_rescale_q(time, stream->time_base, AV_TIME_BASE_Q);
+}
+
+/*
+ * Extracts key frame at or before timestamp into out, returns its time
+ * or -1
+ */
+static int64_t extract_frame(struct ExtractInput *input, int64_t timestamp,
+		int width, int height, uint8_t *out) {
+	AVStream *stream = input->format_ctx->streams[input->stream_index];
+	int64_t target = av_rescale_q(timestamp, AV_TIME_BASE_Q,
+			stream->time_base);
+	int64_t key_pts = AV_NOPTS_VALUE;
+	int64_t time = AV_NOPTS_VALUE;
+	int key_found = FALSE;
+	int packets = 0;
+	AVPacket packet;
+
+	if (av_seek_frame(input->format_ctx, input->stream_index, target,
+			AVSEEK_FLAG_BACKWARD) < 0
+			&& av_seek_frame(input->format_ctx, input->stream_index, target,
+					0) < 0) {
+		LOGI(3, "extract_frame could not seek to %f", timestamp / 1000000.0);
+		return -1;
+	}
+	avcodec_flush_buffers(input->codec_ctx);
+
+	while (time == AV_NOPTS_VALUE && packets < EXTRACT_MAX_PACKETS) {
+		if (av_read_frame(input->format_ctx, &packet) < 0) {
+			if (key_found)
+				time = extract_decode(input, NULL, key_pts);
+			break;
+		}
+		if (packet.stream_index != input->stream_index) {
+			av_free_packet(&packet);
+			continue;
+		}
+		if (!key_found) {
+			if (!(packet.flags & AV_PKT_FLAG_KEY)) {
+				av_free_packet(&packet);
+				continue;
+			}
+			key_found = TRUE;
+			key_pts = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+			if (input->last_out != NULL && key_pts != AV_NOPTS_VALUE
+					&& key_pts == input->last_key_pts) {
+				// nearest key frame was already extracted
+				av_free_packet(&packet);
+				memcpy(out, input->last_out, width * height * 4);
+				return input->last_time;
+			}
+		}
+		// decoders with frame delay need following packets
+		time = extract_decode(input, &packet, key_pts);
+		av_free_packet(&packet);
+		packets += 1;
+	}
+	if (time == AV_NOPTS_VALUE) {
+		LOGI(3, "extract_frame no frame at %f", timestamp / 1000000.0);
+		return -1;
+	}
+	if (extract_scale(input, width, height, out) < 0)
+		return -1;
+	input->last_key_pts = key_pts;
+	input->last_time = time;
+	input->last_out = out;
+	return time;
+}
+
+/*
+ * Opens input in first step, then extracts one frame per step. Returns
+ * TRUE while there are steps left, last one reports run to the job.
+ */
+static int extract_run_step(struct ExtractRun *run) {
+	struct ExtractJob *job = run->job;
+	size_t frame_size = (size_t) job->width * job->height * 4;
+	int end = run->first + run->count;
+	int index;
+
+	if (!run->opened) {
+		run->opened = TRUE;
+		run->next = run->first;
+		run->err = extract_open(&run->input, job->url);
+		if (run->err >= 0)
+			return TRUE;
+	} else {
+		index = job->order[run->next].index;
+		job->frame_times[index] = extract_frame(&run->input,
+				job->order[run->next].timestamp, job->width, job->height,
+				job->out + index * frame_size);
+		if (++run->next < end)
+			return TRUE;
+		extract_close(&run->input);
+	}
+	// input could not be opened
+	for (; run->next < end; ++run->next)
+		job->frame_times[job->order[run->next].index] = -1;
+
+	pthread_mutex_lock(&job->mutex);
+	if (run->err < 0)
+		job->err = run->err;
+	job->pending -= 1;
+	pthread_cond_broadcast(&job->cond);
+	pthread_mutex_unlock(&job->mutex);
+	return FALSE;
+}
+
+/*
+ * Executor tasks have to be short, so every step is a separate run of the
+ * task and tasks of players queued meanwhile go first
+ */
+static void extract_task(void *data) {
+	struct ExtractRun *run = data;
+	if (extract_run_step(run))
+		executor_task_schedule(&run->task);
+}
+
+static int extract_compare(const void *a, const void *b) {
+	int64_t ta = ((const struct ExtractOrder *) a)->timestamp;
+	int64_t tb = ((const struct ExtractOrder *) b)->timestamp;
+	return ta < tb ? -1 : ta > tb ? 1 : 0;
+}
+
+int extract_frames(struct Executor *executor, enum ExecutorPriority priority,
+		int parallel, const char *url, const int64_t *timestamps, int count,
+		int width, int height, uint8_t *out, int64_t *frame_times) {
+	struct ExtractJob job;
+	struct ExtractRun *runs = NULL;
+	int runs_nb;
+	int extracted = 0;
+	int i;
+
+	if (count <= 0)
+		return 0;
+	if (executor == NULL || parallel < 1)
+		parallel = 1;
+	runs_nb = (count + EXTRACT_MIN_RUN_FRAMES - 1) / EXTRACT_MIN_RUN_FRAMES;
+	if (runs_nb > parallel)
+		runs_nb = parallel;
+
+	memset(&job, 0, sizeof(job));
+	job.url = url;
+	job.width = width;
+	job.height = height;
+	job.out = out;
+	job.frame_times = frame_times;
+	job.order = malloc(count * sizeof(*job.order));
+	runs = malloc(runs_nb * sizeof(*runs));
+	if (job.order == NULL || runs == NULL) {
+		free(job.order);
+		free(runs);
+		return AVERROR(ENOMEM);
+	}
+	for (i = 0; i < count; ++i) {
+		job.order[i].timestamp = timestamps[i];
+		job.order[i].index = i;
+	}
+	// seeking forward only within a run
+	qsort(job.order, count, sizeof(*job.order), extract_compare);
+
+	pthread_mutex_init(&job.mutex, NULL);
+	pthread_cond_init(&job.cond, NULL);
+	job.pending = runs_nb;
+	LOGI(3, "extract_frames %d frames in %d runs from: %s", count, runs_nb,
+			url);
+
+	memset(runs, 0, runs_nb * sizeof(*runs));
+	for (i = 0; i < runs_nb; ++i) {
+		runs[i].job = &job;
+		runs[i].first = count * i / runs_nb;
+		runs[i].count = count * (i + 1) / runs_nb - runs[i].first;
+		if (i > 0) {
+			executor_task_init(&runs[i].task, executor, extract_task,
+					&runs[i], priority);
+			executor_task_schedule(&runs[i].task);
+		}
+	}
+	// calling thread could block, it does its run at once
+	while (extract_run_step(&runs[0]))
+		;
+
+	pthread_mutex_lock(&job.mutex);
+	while (job.pending > 0)
+		pthread_cond_wait(&job.cond, &job.mutex);
+	pthread_mutex_unlock(&job.mutex);
+	// worker could still be leaving the task
+	for (i = 1; i < runs_nb; ++i)
+		executor_task_cancel(&runs[i].task);
+
+	for (i = 0; i < count; ++i) {
+		if (frame_times[i] >= 0)
+			extracted += 1;
+	}
+	if (extracted == 0 && job.err < 0)
+		extracted = job.err;
+
+	pthread_cond_destroy(&job.cond);
+	pthread_mutex_destroy(&job.mutex);
+	free(runs);
+	free(job.order);
+	return extracted;
+}
@@ -0,0 +1,42 @@
+/*
+ * extract.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EXTRACT_H_
+#define EXTRACT_H_
+
+#include <stdint.h>
+
+#include "executor.h"
+
+/*
+ * Thumbnail extraction without a player. For every timestamp (us) the key
+ * frame at or before it is decoded and scaled to width x height RGBA into
+ * out, frame i at i * width * height * 4. frame_times gets time of every
+ * extracted frame, -1 when it could not be extracted.
+ * Timestamps are split into up to parallel sorted runs, each run opens its
+ * own input and runs as task of executor with given priority, one of them
+ * on the calling thread (all when executor is NULL). Tasks extract one
+ * frame per step, so they do not hold workers for long.
+ * Returns number of extracted frames or negative value when input could
+ * not be opened.
+ */
+int extract_frames(struct Executor *executor, enum ExecutorPriority priority,
+		int parallel, const char *url, const int64_t *timestamps, int count,
+		int width, int height, uint8_t *out, int64_t *frame_times);
+
+#endif /* EXTRACT_H_ */
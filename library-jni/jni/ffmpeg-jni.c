@@ -32,12 +32,13 @@
 
 #include "helpers.h"
 #include "player.h"
+#include "log.h"
 
 /*for android logs*/
 #define LOG_TAG "FFmpegTest"
-#define LOG_LEVEL 10
-#define LOGI(level, ...) if (level <= LOG_LEVEL) {__android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
-#define LOGE(level, ...) if (level <= LOG_LEVEL) {__android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
+#define LOG_SUBSYSTEM LOG_SUBSYSTEM_JNI
+#define LOGI(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
+#define LOGE(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
 
 #ifndef NELEM
 #define NELEM(x) ((int)(sizeof(x) / sizeof((x)[0])))
@@ -83,6 +84,11 @@ jint JNICALL JNI_OnLoad(JavaVM* vm, void* reserved)
 		goto bail;
 	}
 
+	// JniReader methods are resolved once here, not on every read
+	if (register_jni_protocol(vm) < 0) {
+		LOGE(1, "ERROR: Could not register jni protocol\n");
+	}
+
 	/* success -- return valid version number */
 	result = JNI_VERSION_1_4;
 
@@ -0,0 +1,224 @@
+/*
+ * frame_cache.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_cache.h"
+#include "log.h"
+
+#include <android/log.h>
+#define LOG_SUBSYSTEM LOG_SUBSYSTEM_RENDER
+#define LOG_TAG "frame_cache.c"
+#define LOGI(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
+#define LOGE(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, (level) - 10)) {log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
+
+void frame_cache_init(struct FrameCache *cache, size_t budget, int shift) {
+	memset(cache, 0, sizeof(*cache));
+	cache->budget = budget;
+	cache->shift = shift;
+	cache->pix_fmt = PIX_FMT_NONE;
+	cache->stride = 1;
+}
+
+static void frame_cache_free_frame(AVFrame *frame) {
+	avpicture_free((AVPicture *) frame);
+	avcodec_free_frame(&frame);
+}
+
+static void frame_cache_free_pool(struct FrameCache *cache) {
+	int i;
+	for (i = 0; i < cache->pool_count; ++i) {
+		frame_cache_free_frame(cache->pool[i]);
+		cache->bytes -= cache->frame_size;
+	}
+	cache->pool_count = 0;
+}
+
+static void frame_cache_release(struct FrameCache *cache, AVFrame *frame) {
+	// pool capacity is never smaller than number of allocated frames
+	cache->pool[cache->pool_count++] = frame;
+}
+
+void frame_cache_clear(struct FrameCache *cache) {
+	int i;
+	for (i = 0; i < cache->count; ++i)
+		frame_cache_release(cache, cache->entries[i].frame);
+	cache->count = 0;
+	cache->stride = 1;
+	cache->offered = 0;
+}
+
+void frame_cache_free(struct FrameCache *cache) {
+	frame_cache_clear(cache);
+	frame_cache_free_pool(cache);
+	if (cache->sws_context != NULL) {
+		sws_freeContext(cache->sws_context);
+		cache->sws_context = NULL;
+	}
+	free(cache->entries);
+	cache->entries = NULL;
+	cache->capacity = 0;
+	free(cache->pool);
+	cache->pool = NULL;
+	cache->pool_capacity = 0;
+}
+
+/*
+ * Keeps every second frame, their buffers go to the pool
+ */
+static void frame_cache_thin(struct FrameCache *cache) {
+	int i;
+	int kept = 0;
+	for (i = 0; i < cache->count; ++i) {
+		if (i & 1)
+			frame_cache_release(cache, cache->entries[i].frame);
+		else
+			cache->entries[kept++] = cache->entries[i];
+	}
+	cache->count = kept;
+	cache->stride *= 2;
+	LOGI(3, "frame_cache_thin budget reached, keeping every %d frame",
+			cache->stride);
+}
+
+static AVFrame *frame_cache_get_frame(struct FrameCache *cache) {
+	AVFrame *frame;
+	AVFrame **pool;
+	int capacity;
+
+	if (cache->pool_count == 0 && cache->bytes + cache->frame_size
+			> cache->budget && cache->count >= 2)
+		frame_cache_thin(cache);
+	if (cache->pool_count > 0)
+		return cache->pool[--cache->pool_count];
+	if (cache->bytes + cache->frame_size > cache->budget)
+		return NULL;
+
+	capacity = cache->count + 1;
+	if (capacity > cache->pool_capacity) {
+		capacity = capacity < 16 ? 16 : capacity * 2;
+		pool = realloc(cache->pool, capacity * sizeof(*pool));
+		if (pool == NULL)
+			return NULL;
+		cache->pool = pool;
+		cache->pool_capacity = capacity;
+	}
+	frame = avcodec_alloc_frame();
+	if (frame == NULL)
+		return NULL;
+	if (avpicture_alloc((AVPicture *) frame, cache->pix_fmt, cache->width,
+			cache->height) < 0) {
+		avcodec_free_frame(&frame);
+		return NULL;
+	}
+	cache->bytes += cache->frame_size;
+	return frame;
+}
+
+static int frame_cache_set_format(struct FrameCache *cache, int width,
+		int height, enum PixelFormat pix_fmt) {
+	int shifted_width = width >> cache->shift;
+	int shifted_height = height >> cache->shift;
+	if (shifted_width < 1)
+		shifted_width = 1;
+	if (shifted_height < 1)
+		shifted_height = 1;
+	if (shifted_width == cache->width && shifted_height == cache->height
+			&& pix_fmt == cache->pix_fmt)
+		return 0;
+
+	LOGI(3, "frame_cache_set_format %dx%d format: %d", shifted_width,
+			shifted_height, pix_fmt);
+	frame_cache_clear(cache);
+	frame_cache_free_pool(cache);
+	cache->width = shifted_width;
+	cache->height = shifted_height;
+	cache->pix_fmt = pix_fmt;
+	cache->frame_size = avpicture_get_size(pix_fmt, shifted_width,
+			shifted_height);
+	return cache->frame_size > 0 ? 0 : -1;
+}
+
+int frame_cache_add(struct FrameCache *cache, const AVFrame *frame,
+		int width, int height, enum PixelFormat pix_fmt, int64_t time) {
+	struct FrameCacheEntry *entries;
+	AVFrame *copy;
+	int capacity;
+	int index;
+
+	if (frame_cache_set_format(cache, width, height, pix_fmt) < 0)
+		return -1;
+	index = cache->offered++;
+	if (index % cache->stride)
+		return 0;
+
+	if (cache->count == cache->capacity) {
+		capacity = cache->capacity < 16 ? 16 : cache->capacity * 2;
+		entries = realloc(cache->entries, capacity * sizeof(*entries));
+		if (entries == NULL)
+			return -1;
+		cache->entries = entries;
+		cache->capacity = capacity;
+	}
+
+	copy = frame_cache_get_frame(cache);
+	if (copy == NULL) {
+		LOGI(3, "frame_cache_add no memory for frame: %" PRId64, time);
+		return 0;
+	}
+	if (index % cache->stride) {
+		// thinned while getting the buffer, this one is dropped too
+		frame_cache_release(cache, copy);
+		return 0;
+	}
+
+	if (cache->shift == 0) {
+		av_picture_copy((AVPicture *) copy, (const AVPicture *) frame,
+				pix_fmt, width, height);
+	} else {
+		cache->sws_context = sws_getCachedContext(cache->sws_context, width,
+				height, pix_fmt, cache->width, cache->height, pix_fmt,
+				SWS_FAST_BILINEAR, NULL, NULL, NULL);
+		if (cache->sws_context == NULL) {
+			LOGE(1, "frame_cache_add could not initialize scaling");
+			frame_cache_release(cache, copy);
+			return -1;
+		}
+		sws_scale(cache->sws_context, (const uint8_t * const *) frame->data,
+				frame->linesize, 0, height, copy->data, copy->linesize);
+	}
+	cache->entries[cache->count].time = time;
+	cache->entries[cache->count].frame = copy;
+	cache->count += 1;
+	return 1;
+}
+
+struct FrameCacheEntry *frame_cache_last(struct FrameCache *cache) {
+	if (cache->count == 0)
+		return NULL;
+	return &cache->entries[cache->count - 1];
+}
+
+void frame_cache_drop_last(struct FrameCache *cache) {
+	if (cache->count == 0)
+		return;
+	cache->count -= 1;
+	frame_cache_release(cache, cache->entries[cache->count].frame);
+}
@@ -0,0 +1,94 @@
+/*
+ * frame_cache.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef FRAME_CACHE_H_
+#define FRAME_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+
+/*
+ * Decoded frames of one GOP kept in presentation order, used by reverse
+ * playback which decodes GOP forward and presents it from its end.
+ * Memory of frame buffers (kept and pooled ones) is bounded by budget,
+ * when it is reached every second frame is dropped and from then on
+ * only every stride-th frame is kept. Frames are stored in decoder pixel
+ * format, downscaled by 2^shift.
+ */
+
+struct FrameCacheEntry {
+	int64_t time;
+	AVFrame *frame;
+};
+
+struct FrameCache {
+	size_t budget;
+	size_t bytes;
+	int shift;
+
+	// geometry of stored frames
+	int width;
+	int height;
+	enum PixelFormat pix_fmt;
+	size_t frame_size;
+	struct SwsContext *sws_context;
+
+	struct FrameCacheEntry *entries;
+	int count;
+	int capacity;
+
+	// allocated buffers not holding any frame
+	AVFrame **pool;
+	int pool_count;
+	int pool_capacity;
+
+	int stride;
+	// frames offered since clear
+	int offered;
+};
+
+void frame_cache_init(struct FrameCache *cache, size_t budget, int shift);
+void frame_cache_free(struct FrameCache *cache);
+
+/*
+ * Drops all frames keeping their buffers for reuse
+ */
+void frame_cache_clear(struct FrameCache *cache);
+
+/*
+ * Copies frame of width x height in pix_fmt, frames have to be added in
+ * presentation order. Returns 1 when stored, 0 when dropped because of
+ * budget, negative value on error.
+ */
+int frame_cache_add(struct FrameCache *cache, const AVFrame *frame,
+		int width, int height, enum PixelFormat pix_fmt, int64_t time);
+
+static inline int frame_cache_count(const struct FrameCache *cache) {
+	return cache->count;
+}
+
+/*
+ * Latest frame or NULL when empty
+ */
+struct FrameCacheEntry *frame_cache_last(struct FrameCache *cache);
+void frame_cache_drop_last(struct FrameCache *cache);
+
+#endif /* FRAME_CACHE_H_ */
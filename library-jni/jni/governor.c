@@ -0,0 +1,209 @@
+/*
+ * governor.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "governor.h"
+#include "log.h"
+#include "metrics.h"
+
+#include <android/log.h>
+#define LOG_SUBSYSTEM LOG_SUBSYSTEM_PLAYER
+#define LOG_TAG "governor.c"
+#define LOGI(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
+
+#define FALSE 0
+#define TRUE (!(FALSE))
+
+// decisions are made once per period and change one level at most
+#define GOVERNOR_PERIOD_US 500000ll
+// frame is late when shown later than that
+#define GOVERNOR_LATE_US 40000ll
+// player is late when more than 1/GOVERNOR_LATE_RATIO of its frames are
+#define GOVERNOR_LATE_RATIO 10
+// periods with everybody on time before one level is restored
+#define GOVERNOR_RECOVER_PERIODS 4
+// share of all cores decoding could use, percents
+#define GOVERNOR_BUDGET_PERCENT 90
+// below that share of budget levels are restored
+#define GOVERNOR_RECOVER_BUDGET_PERCENT 75
+
+static pthread_mutex_t governor_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct GovernorClient *governor_clients = NULL;
+static int64_t governor_next_evaluation = 0;
+static int governor_calm_periods = 0;
+// decode time of all players per period
+static int64_t governor_budget_us = 0;
+
+static int governor_is_late(struct GovernorClient *client) {
+	return client->period_frames > 0 && client->period_late_frames
+			* GOVERNOR_LATE_RATIO > client->period_frames;
+}
+
+/*
+ * Least important player first, the most expensive of them
+ */
+static struct GovernorClient *governor_find_degradable_already_locked(
+		int than_priority) {
+	struct GovernorClient *client;
+	struct GovernorClient *found = NULL;
+	for (client = governor_clients; client != NULL; client = client->next) {
+		if (client->priority <= than_priority
+				|| client->level >= GOVERNOR_LEVELS - 1)
+			continue;
+		if (found == NULL || client->priority > found->priority
+				|| (client->priority == found->priority
+						&& client->cost_us > found->cost_us))
+			found = client;
+	}
+	return found;
+}
+
+/*
+ * Most important player first, the most degraded of them
+ */
+static struct GovernorClient *governor_find_restorable_already_locked() {
+	struct GovernorClient *client;
+	struct GovernorClient *found = NULL;
+	for (client = governor_clients; client != NULL; client = client->next) {
+		if (client->level == GOVERNOR_LEVEL_NONE)
+			continue;
+		if (found == NULL || client->priority < found->priority
+				|| (client->priority == found->priority
+						&& client->level > found->level))
+			found = client;
+	}
+	return found;
+}
+
+static void governor_evaluate_already_locked() {
+	struct GovernorClient *client;
+	int late_priority = INT_MAX;
+	int top_priority = INT_MAX;
+	int64_t total_cost_us = 0;
+
+	for (client = governor_clients; client != NULL; client = client->next) {
+		if (client->period_frames > 0)
+			client->cost_us = (client->cost_us * 3
+					+ client->period_cost_us / client->period_frames) / 4;
+		total_cost_us += client->period_cost_us;
+		if (client->priority < top_priority)
+			top_priority = client->priority;
+		if (governor_is_late(client) && client->priority < late_priority)
+			late_priority = client->priority;
+	}
+	// when over budget everybody will be late soon, protect the top ones
+	if (total_cost_us > governor_budget_us)
+		late_priority = top_priority;
+
+	if (late_priority != INT_MAX) {
+		governor_calm_periods = 0;
+		client = governor_find_degradable_already_locked(late_priority);
+		if (client != NULL) {
+			client->level += 1;
+			LOGI(3, "governor: degrading %p (priority %d) to level %d, "
+					"decode %lld us of %lld us budget", client,
+					client->priority, client->level,
+					(long long) total_cost_us, (long long) governor_budget_us);
+		}
+	} else if (total_cost_us * 100 < governor_budget_us
+			* GOVERNOR_RECOVER_BUDGET_PERCENT
+			&& ++governor_calm_periods >= GOVERNOR_RECOVER_PERIODS) {
+		governor_calm_periods = 0;
+		client = governor_find_restorable_already_locked();
+		if (client != NULL) {
+			client->level -= 1;
+			LOGI(3, "governor: restoring %p (priority %d) to level %d",
+					client, client->priority, client->level);
+		}
+	}
+
+	for (client = governor_clients; client != NULL; client = client->next) {
+		client->period_cost_us = 0;
+		client->period_frames = 0;
+		client->period_late_frames = 0;
+	}
+}
+
+void governor_register(struct GovernorClient *client, int priority) {
+	pthread_mutex_lock(&governor_mutex);
+	if (governor_budget_us == 0) {
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		if (cores < 1)
+			cores = 1;
+		governor_budget_us = cores * GOVERNOR_PERIOD_US
+				* GOVERNOR_BUDGET_PERCENT / 100;
+	}
+	client->level = GOVERNOR_LEVEL_NONE;
+	client->priority = priority;
+	client->cost_us = 0;
+	client->period_cost_us = 0;
+	client->period_frames = 0;
+	client->period_late_frames = 0;
+	client->registered = TRUE;
+	client->next = governor_clients;
+	governor_clients = client;
+	pthread_mutex_unlock(&governor_mutex);
+}
+
+void governor_unregister(struct GovernorClient *client) {
+	struct GovernorClient **place;
+	pthread_mutex_lock(&governor_mutex);
+	if (client->registered) {
+		for (place = &governor_clients; *place != NULL;
+				place = &(*place)->next) {
+			if (*place == client) {
+				*place = client->next;
+				break;
+			}
+		}
+		client->registered = FALSE;
+		client->next = NULL;
+		client->level = GOVERNOR_LEVEL_NONE;
+	}
+	pthread_mutex_unlock(&governor_mutex);
+}
+
+void governor_set_priority(struct GovernorClient *client, int priority) {
+	pthread_mutex_lock(&governor_mutex);
+	// i.e. focused tile should get full quality right away
+	if (priority < client->priority)
+		client->level = GOVERNOR_LEVEL_NONE;
+	client->priority = priority;
+	pthread_mutex_unlock(&governor_mutex);
+}
+
+void governor_report_frame(struct GovernorClient *client, int64_t cost_us,
+		int64_t lateness_us) {
+	int64_t now = metrics_now_us();
+	pthread_mutex_lock(&governor_mutex);
+	if (client->registered) {
+		client->period_cost_us += cost_us;
+		client->period_frames += 1;
+		if (lateness_us > GOVERNOR_LATE_US)
+			client->period_late_frames += 1;
+	}
+	if (now >= governor_next_evaluation) {
+		if (governor_next_evaluation != 0)
+			governor_evaluate_already_locked();
+		governor_next_evaluation = now + GOVERNOR_PERIOD_US;
+	}
+	pthread_mutex_unlock(&governor_mutex);
+}
@@ -0,0 +1,75 @@
+/*
+ * governor.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef GOVERNOR_H_
+#define GOVERNOR_H_
+
+#include <stdint.h>
+
+/*
+ * Process wide decode governor. Players report cost of decoding and
+ * lateness of every video frame, periodically the governor degrades
+ * decoding of less important players when more important ones are late
+ * or all of them need more cpu than there is, and restores it when
+ * everybody is on time again.
+ */
+
+// every level includes degradations of lower levels
+enum GovernorLevel {
+	GOVERNOR_LEVEL_NONE = 0,
+	// skip_loop_filter
+	GOVERNOR_LEVEL_SKIP_LOOP_FILTER,
+	// non reference frames are not decoded, every second frame is dropped
+	GOVERNOR_LEVEL_DECIMATE,
+	// frames converted at half resolution
+	GOVERNOR_LEVEL_LOW_RESOLUTION,
+	// only key frames are decoded
+	GOVERNOR_LEVEL_KEYFRAMES,
+	GOVERNOR_LEVELS
+};
+
+/*
+ * Owned by player, fields other than level are private to governor.c.
+ * Lower priority value is more important (see ExecutorPriority),
+ * players with the most important priority are never degraded.
+ */
+struct GovernorClient {
+	volatile int level;
+	int priority;
+	int registered;
+	// averaged over evaluation periods
+	int64_t cost_us;
+	// sums of current period
+	int64_t period_cost_us;
+	int period_frames;
+	int period_late_frames;
+	struct GovernorClient *next;
+};
+
+void governor_register(struct GovernorClient *client, int priority);
+void governor_unregister(struct GovernorClient *client);
+void governor_set_priority(struct GovernorClient *client, int priority);
+
+/*
+ * Called for every shown video frame with its decode cost and how late
+ * (positive) or early (negative) it was when checked for presentation.
+ */
+void governor_report_frame(struct GovernorClient *client, int64_t cost_us,
+		int64_t lateness_us);
+
+#endif /* GOVERNOR_H_ */
@@ -0,0 +1,47 @@
+/*
+ * bitmap.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Replacement of NDK android/bitmap.h for host builds
+ * (tools/build_host.sh), player.c includes it but does not lock bitmaps.
+ */
+
+#ifndef HOST_ANDROID_BITMAP_H_
+#define HOST_ANDROID_BITMAP_H_
+
+#include <stdint.h>
+
+#define ANDROID_BITMAP_RESUT_SUCCESS 0
+
+enum AndroidBitmapFormat {
+	ANDROID_BITMAP_FORMAT_NONE = 0,
+	ANDROID_BITMAP_FORMAT_RGBA_8888 = 1,
+	ANDROID_BITMAP_FORMAT_RGB_565 = 4,
+	ANDROID_BITMAP_FORMAT_RGBA_4444 = 7,
+	ANDROID_BITMAP_FORMAT_A_8 = 8,
+};
+
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	int32_t format;
+	uint32_t flags;
+} AndroidBitmapInfo;
+
+#endif /* HOST_ANDROID_BITMAP_H_ */
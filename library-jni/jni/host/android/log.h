@@ -0,0 +1,75 @@
+/*
+ * log.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Replacement of NDK android/log.h for host builds (tools/build_host.sh),
+ * messages are written to stderr.
+ */
+
+#ifndef HOST_ANDROID_LOG_H_
+#define HOST_ANDROID_LOG_H_
+
+#include <stdarg.h>
+#include <stdio.h>
+
+typedef enum android_LogPriority {
+	ANDROID_LOG_UNKNOWN = 0,
+	ANDROID_LOG_DEFAULT,
+	ANDROID_LOG_VERBOSE,
+	ANDROID_LOG_DEBUG,
+	ANDROID_LOG_INFO,
+	ANDROID_LOG_WARN,
+	ANDROID_LOG_ERROR,
+	ANDROID_LOG_FATAL,
+	ANDROID_LOG_SILENT,
+} android_LogPriority;
+
+// messages with lower priority are dropped
+#ifndef HOST_LOG_PRIORITY
+#define HOST_LOG_PRIORITY ANDROID_LOG_WARN
+#endif
+
+static inline int __android_log_vprint(int prio, const char *tag,
+		const char *fmt, va_list ap) {
+	if (prio < HOST_LOG_PRIORITY)
+		return 0;
+	fprintf(stderr, "%s: ", tag);
+	vfprintf(stderr, fmt, ap);
+	fputc('\n', stderr);
+	return 0;
+}
+
+static inline int __android_log_write(int prio, const char *tag,
+		const char *text) {
+	if (prio < HOST_LOG_PRIORITY)
+		return 0;
+	fprintf(stderr, "%s: %s\n", tag, text);
+	return 0;
+}
+
+static inline int __android_log_print(int prio, const char *tag,
+		const char *fmt, ...) {
+	va_list ap;
+	int ret;
+	va_start(ap, fmt);
+	ret = __android_log_vprint(prio, tag, fmt, ap);
+	va_end(ap);
+	return ret;
+}
+
+#endif /* HOST_ANDROID_LOG_H_ */
@@ -0,0 +1,75 @@
+/*
+ * native_window.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Replacement of NDK android/native_window.h for host builds
+ * (tools/build_host.sh). Windows are memory buffers implemented by
+ * host/native-window.c, posted frames are only counted.
+ */
+
+#ifndef HOST_ANDROID_NATIVE_WINDOW_H_
+#define HOST_ANDROID_NATIVE_WINDOW_H_
+
+#include <stdint.h>
+
+enum {
+	WINDOW_FORMAT_RGBA_8888 = 1,
+	WINDOW_FORMAT_RGBX_8888 = 2,
+	WINDOW_FORMAT_RGB_565 = 4,
+};
+
+struct ANativeWindow;
+typedef struct ANativeWindow ANativeWindow;
+
+typedef struct ARect {
+	int32_t left;
+	int32_t top;
+	int32_t right;
+	int32_t bottom;
+} ARect;
+
+typedef struct ANativeWindow_Buffer {
+	int32_t width;
+	int32_t height;
+	// in pixels
+	int32_t stride;
+	int32_t format;
+	void *bits;
+	uint32_t reserved[6];
+} ANativeWindow_Buffer;
+
+void ANativeWindow_acquire(ANativeWindow *window);
+void ANativeWindow_release(ANativeWindow *window);
+int32_t ANativeWindow_getWidth(ANativeWindow *window);
+int32_t ANativeWindow_getHeight(ANativeWindow *window);
+int32_t ANativeWindow_getFormat(ANativeWindow *window);
+int32_t ANativeWindow_setBuffersGeometry(ANativeWindow *window, int32_t width,
+		int32_t height, int32_t format);
+int32_t ANativeWindow_lock(ANativeWindow *window,
+		ANativeWindow_Buffer *outBuffer, ARect *inOutDirtyBounds);
+int32_t ANativeWindow_unlockAndPost(ANativeWindow *window);
+
+/*
+ * Host only: creates window of width x height RGBA pixels with one
+ * reference, 0 x 0 windows get size from setBuffersGeometry
+ */
+ANativeWindow *host_window_new(int32_t width, int32_t height);
+// number of frames posted by ANativeWindow_unlockAndPost
+int64_t host_window_get_posted(ANativeWindow *window);
+
+#endif /* HOST_ANDROID_NATIVE_WINDOW_H_ */
@@ -0,0 +1,36 @@
+/*
+ * native_window_jni.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Replacement of NDK android/native_window_jni.h for host builds
+ * (tools/build_host.sh), surfaces are created by jni_host_new_surface.
+ */
+
+#ifndef HOST_ANDROID_NATIVE_WINDOW_JNI_H_
+#define HOST_ANDROID_NATIVE_WINDOW_JNI_H_
+
+#include <jni.h>
+
+#include <android/native_window.h>
+
+/*
+ * Returns window of the surface with a new reference
+ */
+ANativeWindow *ANativeWindow_fromSurface(JNIEnv *env, jobject surface);
+
+#endif /* HOST_ANDROID_NATIVE_WINDOW_JNI_H_ */
@@ -0,0 +1,1146 @@
+/*
+ * jni-host.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Minimal java vm for host builds (tools/build_host.sh). Only classes and
+ * methods used by player.c and jni-protocol.c exist, objects are
+ * reference counted and freed when their last local or global reference
+ * is deleted. Misuse of jni aborts like CheckJNI does.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <jni.h>
+#include <android/native_window_jni.h>
+
+#include "jni-host.h"
+
+#define FALSE 0
+#define TRUE (!(FALSE))
+
+enum JniHostKind {
+	// interfaces and classes created only by the host
+	JNI_HOST_KIND_NONE = 0,
+	JNI_HOST_KIND_OBJECT,
+	JNI_HOST_KIND_CLASS,
+	JNI_HOST_KIND_THROWABLE,
+	JNI_HOST_KIND_STRING,
+	JNI_HOST_KIND_BYTE_ARRAY,
+	JNI_HOST_KIND_LONG_ARRAY,
+	JNI_HOST_KIND_OBJECT_ARRAY,
+	JNI_HOST_KIND_MAP,
+	JNI_HOST_KIND_KEY_SET,
+	JNI_HOST_KIND_ITERATOR,
+	JNI_HOST_KIND_BYTE_BUFFER,
+	JNI_HOST_KIND_PLAYER,
+	JNI_HOST_KIND_AUDIO_TRACK,
+	JNI_HOST_KIND_STREAM_INFO,
+	JNI_HOST_KIND_SURFACE,
+};
+
+enum JniHostClassNo {
+	JNI_HOST_CLASS_OBJECT = 0,
+	JNI_HOST_CLASS_CLASS,
+	JNI_HOST_CLASS_STRING,
+	JNI_HOST_CLASS_THROWABLE,
+	JNI_HOST_CLASS_RUNTIME_EXCEPTION,
+	JNI_HOST_CLASS_INTERRUPTED_EXCEPTION,
+	JNI_HOST_CLASS_NOT_PLAYING_EXCEPTION,
+	JNI_HOST_CLASS_NULL_POINTER_EXCEPTION,
+	JNI_HOST_CLASS_INDEX_OUT_OF_BOUNDS_EXCEPTION,
+	JNI_HOST_CLASS_NEGATIVE_ARRAY_SIZE_EXCEPTION,
+	JNI_HOST_CLASS_INSTANTIATION_EXCEPTION,
+	JNI_HOST_CLASS_NO_CLASS_DEF_FOUND_ERROR,
+	JNI_HOST_CLASS_NO_SUCH_METHOD_ERROR,
+	JNI_HOST_CLASS_NO_SUCH_FIELD_ERROR,
+	JNI_HOST_CLASS_OUT_OF_MEMORY_ERROR,
+	JNI_HOST_CLASS_BYTE_ARRAY,
+	JNI_HOST_CLASS_LONG_ARRAY,
+	JNI_HOST_CLASS_OBJECT_ARRAY,
+	JNI_HOST_CLASS_BYTE_BUFFER,
+	JNI_HOST_CLASS_MAP,
+	JNI_HOST_CLASS_HASH_MAP,
+	JNI_HOST_CLASS_SET,
+	JNI_HOST_CLASS_ITERATOR,
+	JNI_HOST_CLASS_PLAYER,
+	JNI_HOST_CLASS_AUDIO_TRACK,
+	JNI_HOST_CLASS_STREAM_INFO,
+	JNI_HOST_CLASS_SURFACE,
+	JNI_HOST_CLASSES_NB,
+};
+
+/*
+ * Method implementation, arguments are read from args by signature:
+ * Z and I as promoted int, J as jlong, objects as jobject
+ */
+typedef void (*JniHostCall)(JNIEnv *env, jobject obj, va_list args,
+		jvalue *result);
+
+struct _jmethodID {
+	const char *name;
+	const char *signature;
+	JniHostCall call;
+};
+
+struct _jfieldID {
+	const char *name;
+	const char *signature;
+};
+
+struct JniHostClass {
+	const char *name;
+	// kind of objects created by NewObject or ThrowNew
+	enum JniHostKind kind;
+	// methods and fields are looked up in parent too
+	enum JniHostClassNo parent;
+	struct _jmethodID *methods;
+	struct _jfieldID *fields;
+};
+
+struct JniHostPlayer {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	jlong native_player;
+	struct JniHostPlayerState state;
+};
+
+struct _jobject {
+	const struct JniHostClass *clazz;
+	enum JniHostKind kind;
+	// classes are never freed
+	int immortal;
+	int refs;
+	union {
+		const struct JniHostClass *def;
+		// string or throwable message
+		char *chars;
+		struct {
+			jsize length;
+			void *elements;
+		} array;
+		// only strings are compared by value
+		struct {
+			jsize size;
+			jsize capacity;
+			jobject *keys;
+			jobject *values;
+		} map;
+		// key set and its iterator keep map
+		struct {
+			jobject map;
+			jsize next;
+		} iterator;
+		struct {
+			void *address;
+			jlong capacity;
+		} buffer;
+		struct JniHostPlayer player;
+		struct {
+			jobject player;
+			jint sample_rate;
+			jint channels;
+		} audio_track;
+		struct {
+			jint media_type;
+			jint stream_number;
+			jobject metadata;
+		} stream_info;
+		ANativeWindow *window;
+	} u;
+};
+
+static const struct JniHostClass jni_host_classes[JNI_HOST_CLASSES_NB];
+static struct _jobject jni_host_class_objects[JNI_HOST_CLASSES_NB];
+static pthread_once_t jni_host_once = PTHREAD_ONCE_INIT;
+
+static __thread int jni_host_attached = FALSE;
+// pending java exception of the thread
+static __thread jobject jni_host_exception = NULL;
+
+static void jni_host_fatal(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	fprintf(stderr, "jni-host: ");
+	vfprintf(stderr, fmt, ap);
+	fputc('\n', stderr);
+	va_end(ap);
+	abort();
+}
+
+static void jni_host_init() {
+	int i;
+	for (i = 0; i < JNI_HOST_CLASSES_NB; ++i) {
+		jobject obj = &jni_host_class_objects[i];
+		obj->clazz = &jni_host_classes[JNI_HOST_CLASS_CLASS];
+		obj->kind = JNI_HOST_KIND_CLASS;
+		obj->immortal = TRUE;
+		obj->u.def = &jni_host_classes[i];
+	}
+}
+
+static jobject jni_host_ref(jobject obj) {
+	if (obj != NULL && !obj->immortal)
+		__sync_add_and_fetch(&obj->refs, 1);
+	return obj;
+}
+
+static void jni_host_unref(jobject obj) {
+	jsize i;
+	if (obj == NULL || obj->immortal)
+		return;
+	if (__sync_sub_and_fetch(&obj->refs, 1) > 0)
+		return;
+
+	switch (obj->kind) {
+	case JNI_HOST_KIND_THROWABLE:
+	case JNI_HOST_KIND_STRING:
+		free(obj->u.chars);
+		break;
+	case JNI_HOST_KIND_BYTE_ARRAY:
+	case JNI_HOST_KIND_LONG_ARRAY:
+		free(obj->u.array.elements);
+		break;
+	case JNI_HOST_KIND_OBJECT_ARRAY:
+		for (i = 0; i < obj->u.array.length; ++i)
+			jni_host_unref(((jobject *) obj->u.array.elements)[i]);
+		free(obj->u.array.elements);
+		break;
+	case JNI_HOST_KIND_MAP:
+		for (i = 0; i < obj->u.map.size; ++i) {
+			jni_host_unref(obj->u.map.keys[i]);
+			jni_host_unref(obj->u.map.values[i]);
+		}
+		free(obj->u.map.keys);
+		free(obj->u.map.values);
+		break;
+	case JNI_HOST_KIND_KEY_SET:
+	case JNI_HOST_KIND_ITERATOR:
+		jni_host_unref(obj->u.iterator.map);
+		break;
+	case JNI_HOST_KIND_PLAYER:
+		pthread_cond_destroy(&obj->u.player.cond);
+		pthread_mutex_destroy(&obj->u.player.mutex);
+		break;
+	case JNI_HOST_KIND_AUDIO_TRACK:
+		jni_host_unref(obj->u.audio_track.player);
+		break;
+	case JNI_HOST_KIND_STREAM_INFO:
+		jni_host_unref(obj->u.stream_info.metadata);
+		break;
+	case JNI_HOST_KIND_SURFACE:
+		ANativeWindow_release(obj->u.window);
+		break;
+	default:
+		break;
+	}
+	free(obj);
+}
+
+static void jni_host_throw(enum JniHostClassNo class_no, const char *message);
+
+/*
+ * Returns local reference to a new object, NULL with pending
+ * OutOfMemoryError
+ */
+static jobject jni_host_alloc(enum JniHostClassNo class_no,
+		enum JniHostKind kind) {
+	jobject obj = calloc(1, sizeof(*obj));
+	if (obj == NULL) {
+		jni_host_throw(JNI_HOST_CLASS_OUT_OF_MEMORY_ERROR, NULL);
+		return NULL;
+	}
+	obj->clazz = &jni_host_classes[class_no];
+	obj->kind = kind;
+	obj->refs = 1;
+	return obj;
+}
+
+static void jni_host_set_exception(jobject exception) {
+	jni_host_unref(jni_host_exception);
+	jni_host_exception = exception;
+}
+
+static void jni_host_throw(enum JniHostClassNo class_no, const char *message) {
+	jobject exception = calloc(1, sizeof(*exception));
+	if (exception == NULL)
+		jni_host_fatal("could not throw %s", jni_host_classes[class_no].name);
+	exception->clazz = &jni_host_classes[class_no];
+	exception->kind = JNI_HOST_KIND_THROWABLE;
+	exception->refs = 1;
+	if (message != NULL)
+		exception->u.chars = strdup(message);
+	jni_host_set_exception(exception);
+}
+
+static void jni_host_check(jobject obj, enum JniHostKind kind,
+		const char *function) {
+	if (obj == NULL)
+		jni_host_fatal("%s: null object", function);
+	if (obj->kind != kind)
+		jni_host_fatal("%s: wrong object of %s", function, obj->clazz->name);
+}
+
+static int jni_host_check_region(jobject array, jsize start, jsize len) {
+	if (start < 0 || len < 0 || start > array->u.array.length - len) {
+		jni_host_throw(JNI_HOST_CLASS_INDEX_OUT_OF_BOUNDS_EXCEPTION, NULL);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void jni_host_nop(JNIEnv *env, jobject obj, va_list args,
+		jvalue *result) {
+}
+
+static int jni_host_equals(jobject a, jobject b) {
+	if (a == b)
+		return TRUE;
+	if (a == NULL || b == NULL || a->kind != JNI_HOST_KIND_STRING
+			|| b->kind != JNI_HOST_KIND_STRING)
+		return FALSE;
+	return strcmp(a->u.chars, b->u.chars) == 0;
+}
+
+static jsize jni_host_map_find(jobject map, jobject key) {
+	jsize i;
+	for (i = 0; i < map->u.map.size; ++i) {
+		if (jni_host_equals(map->u.map.keys[i], key))
+			return i;
+	}
+	return -1;
+}
+
+static void jni_host_map_key_set(JNIEnv *env, jobject obj, va_list args,
+		jvalue *result) {
+	jni_host_check(obj, JNI_HOST_KIND_MAP, "Map.keySet");
+	jobject set = jni_host_alloc(JNI_HOST_CLASS_SET, JNI_HOST_KIND_KEY_SET);
+	if (set != NULL)
+		set->u.iterator.map = jni_host_ref(obj);
+	result->l = set;
+}
+
+static void jni_host_map_get(JNIEnv *env, jobject obj, va_list args,
+		jvalue *result) {
+	jobject key = va_arg(args, jobject);
+	jni_host_check(obj, JNI_HOST_KIND_MAP, "Map.get");
+	jsize i = jni_host_map_find(obj, key);
+	result->l = i < 0 ? NULL : jni_host_ref(obj->u.map.values[i]);
+}
+
+static void jni_host_map_put(JNIEnv *env, jobject obj, va_list args,
+		jvalue *result) {
+	jobject key = va_arg(args, jobject);
+	jobject value = va_arg(args, jobject);
+	jni_host_check(obj, JNI_HOST_KIND_MAP, "Map.put");
+	jsize i = jni_host_map_find(obj, key);
+	if (i >= 0) {
+		// reference of the map is passed to the caller
+		result->l = obj->u.map.values[i];
+		obj->u.map.values[i] = jni_host_ref(value);
+		return;
+	}
+	if (obj->u.map.size == obj->u.map.capacity) {
+		jsize capacity = obj->u.map.capacity ? 2 * obj->u.map.capacity : 8;
+		jobject *keys = realloc(obj->u.map.keys, capacity * sizeof(*keys));
+		if (keys != NULL)
+			obj->u.map.keys = keys;
+		jobject *values = realloc(obj->u.map.values,
+				capacity * sizeof(*values));
+		if (values != NULL)
+			obj->u.map.values = values;
+		if (keys == NULL || values == NULL) {
+			jni_host_throw(JNI_HOST_CLASS_OUT_OF_MEMORY_ERROR, NULL);
+			return;
+		}
+		obj->u.map.capacity = capacity;
+	}
+	obj->u.map.keys[obj->u.map.size] = jni_host_ref(key);
+	obj->u.map.values[obj->u.map.size] = jni_host_ref(value);
+	obj->u.map.size += 1;
+}
+
+static void jni_host_set_iterator(JNIEnv *env, jobject obj, va_list args,
+		jvalue *result) {
+	jni_host_check(obj, JNI_HOST_KIND_KEY_SET, "Set.iterator");
+	jobject iterator = jni_host_alloc(JNI_HOST_CLASS_ITERATOR,
+			JNI_HOST_KIND_ITERATOR);
+	if (iterator != NULL)
+		iterator->u.iterator.map = jni_host_ref(obj->u.iterator.map);
+	result->l = iterator;
+}
+
+static void jni_host_iterator_has_next(JNIEnv *env, jobject obj,
+		va_list args, jvalue *result) {
+	jni_host_check(obj, JNI_HOST_KIND_ITERATOR, "Iterator.hasNext");
+	result->z = obj->u.iterator.next < obj->u.iterator.map->u.map.size;
+}
+
+static void jni_host_iterator_next(JNIEnv *env, jobject obj, va_list args,
+		jvalue *result) {
+	jni_host_check(obj, JNI_HOST_KIND_ITERATOR, "Iterator.next");
+	jobject map = obj->u.iterator.map;
+	if (obj->u.iterator.next >= map->u.map.size) {
+		jni_host_throw(JNI_HOST_CLASS_INDEX_OUT_OF_BOUNDS_EXCEPTION, NULL);
+		return;
+	}
+	result->l = jni_host_ref(map->u.map.keys[obj->u.iterator.next++]);
+}
+
+static void jni_host_player_on_update_time(JNIEnv *env, jobject obj,
+		va_list args, jvalue *result) {
+	jlong current_time = va_arg(args, jlong);
+	jlong duration = va_arg(args, jlong);
+	int is_finished = va_arg(args, int);
+	jni_host_check(obj, JNI_HOST_KIND_PLAYER, "FFmpegPlayer.onUpdateTime");
+	struct JniHostPlayer *player = &obj->u.player;
+
+	pthread_mutex_lock(&player->mutex);
+	player->state.current_time_us = current_time;
+	player->state.duration_us = duration;
+	if (is_finished)
+		player->state.finished += 1;
+	pthread_cond_broadcast(&player->cond);
+	pthread_mutex_unlock(&player->mutex);
+}
+
+static void jni_host_player_prepare_audio_track(JNIEnv *env, jobject obj,
+		va_list args, jvalue *result) {
+	int sample_rate = va_arg(args, int);
+	int channels = va_arg(args, int);
+	jni_host_check(obj, JNI_HOST_KIND_PLAYER,
+			"FFmpegPlayer.prepareAudioTrack");
+	struct JniHostPlayer *player = &obj->u.player;
+
+	// channel layouts supported by FFmpegPlayer.prepareAudioTrack
+	if (channels < 1 || channels == 7 || channels > 8)
+		channels = 2;
+	jobject track = jni_host_alloc(JNI_HOST_CLASS_AUDIO_TRACK,
+			JNI_HOST_KIND_AUDIO_TRACK);
+	if (track == NULL)
+		return;
+	track->u.audio_track.player = jni_host_ref(obj);
+	track->u.audio_track.sample_rate = sample_rate;
+	track->u.audio_track.channels = channels;
+
+	pthread_mutex_lock(&player->mutex);
+	player->state.audio_sample_rate = sample_rate;
+	player->state.audio_channels = channels;
+	pthread_mutex_unlock(&player->mutex);
+	result->l = track;
+}
+
+static void jni_host_player_set_streams_info(JNIEnv *env, jobject obj,
+		va_list args, jvalue *result) {
+	jobject streams = va_arg(args, jobject);
+	jni_host_check(obj, JNI_HOST_KIND_PLAYER, "FFmpegPlayer.setStreamsInfo");
+	if (streams != NULL)
+		jni_host_check(streams, JNI_HOST_KIND_OBJECT_ARRAY,
+				"FFmpegPlayer.setStreamsInfo");
+	struct JniHostPlayer *player = &obj->u.player;
+
+	pthread_mutex_lock(&player->mutex);
+	player->state.streams = streams != NULL ? streams->u.array.length : 0;
+	pthread_mutex_unlock(&player->mutex);
+}
+
+static void jni_host_audio_track_write(JNIEnv *env, jobject obj,
+		va_list args, jvalue *result) {
+	jobject data = va_arg(args, jobject);
+	int offset = va_arg(args, int);
+	int size = va_arg(args, int);
+	jni_host_check(obj, JNI_HOST_KIND_AUDIO_TRACK, "AudioTrack.write");
+	jni_host_check(data, JNI_HOST_KIND_BYTE_ARRAY, "AudioTrack.write");
+	struct JniHostPlayer *player = &obj->u.audio_track.player->u.player;
+
+	if (offset < 0 || size < 0 || offset > data->u.array.length - size) {
+		// AudioTrack.ERROR_BAD_VALUE
+		result->i = -2;
+		return;
+	}
+	pthread_mutex_lock(&player->mutex);
+	player->state.audio_bytes += size;
+	pthread_mutex_unlock(&player->mutex);
+	result->i = size;
+}
+
+static void jni_host_audio_track_get_channel_count(JNIEnv *env, jobject obj,
+		va_list args, jvalue *result) {
+	jni_host_check(obj, JNI_HOST_KIND_AUDIO_TRACK,
+			"AudioTrack.getChannelCount");
+	result->i = obj->u.audio_track.channels;
+}
+
+static void jni_host_audio_track_get_sample_rate(JNIEnv *env, jobject obj,
+		va_list args, jvalue *result) {
+	jni_host_check(obj, JNI_HOST_KIND_AUDIO_TRACK,
+			"AudioTrack.getSampleRate");
+	result->i = obj->u.audio_track.sample_rate;
+}
+
+static void jni_host_stream_info_set_metadata(JNIEnv *env, jobject obj,
+		va_list args, jvalue *result) {
+	jobject metadata = va_arg(args, jobject);
+	jni_host_check(obj, JNI_HOST_KIND_STREAM_INFO,
+			"FFmpegStreamInfo.setMetadata");
+	jni_host_unref(obj->u.stream_info.metadata);
+	obj->u.stream_info.metadata = jni_host_ref(metadata);
+}
+
+static void jni_host_stream_info_set_media_type(JNIEnv *env, jobject obj,
+		va_list args, jvalue *result) {
+	int media_type = va_arg(args, int);
+	jni_host_check(obj, JNI_HOST_KIND_STREAM_INFO,
+			"FFmpegStreamInfo.setMediaTypeInternal");
+	obj->u.stream_info.media_type = media_type;
+}
+
+static void jni_host_stream_info_set_stream_number(JNIEnv *env, jobject obj,
+		va_list args, jvalue *result) {
+	int stream_number = va_arg(args, int);
+	jni_host_check(obj, JNI_HOST_KIND_STREAM_INFO,
+			"FFmpegStreamInfo.setStreamNumber");
+	obj->u.stream_info.stream_number = stream_number;
+}
+
+static struct _jmethodID jni_host_object_methods[] = {
+	{ "<init>", "()V", jni_host_nop },
+	{ NULL },
+};
+
+static struct _jmethodID jni_host_map_methods[] = {
+	{ "keySet", "()Ljava/util/Set;", jni_host_map_key_set },
+	{ "get", "(Ljava/lang/Object;)Ljava/lang/Object;", jni_host_map_get },
+	{ "put", "(Ljava/lang/Object;Ljava/lang/Object;)Ljava/lang/Object;",
+			jni_host_map_put },
+	{ NULL },
+};
+
+static struct _jmethodID jni_host_set_methods[] = {
+	{ "iterator", "()Ljava/util/Iterator;", jni_host_set_iterator },
+	{ NULL },
+};
+
+static struct _jmethodID jni_host_iterator_methods[] = {
+	{ "hasNext", "()Z", jni_host_iterator_has_next },
+	{ "next", "()Ljava/lang/Object;", jni_host_iterator_next },
+	{ NULL },
+};
+
+static struct _jmethodID jni_host_player_methods[] = {
+	{ "onUpdateTime", "(JJZ)V", jni_host_player_on_update_time },
+	{ "prepareAudioTrack", "(II)Landroid/media/AudioTrack;",
+			jni_host_player_prepare_audio_track },
+	// player.c does not render into bitmaps, null is returned
+	{ "prepareFrame", "(II)Landroid/graphics/Bitmap;", jni_host_nop },
+	{ "setStreamsInfo", "([Lcom/appunite/ffmpeg/FFmpegStreamInfo;)V",
+			jni_host_player_set_streams_info },
+	{ NULL },
+};
+
+static struct _jfieldID jni_host_player_fields[] = {
+	{ "mNativePlayer", "J" },
+	{ NULL },
+};
+
+// null audio sink
+static struct _jmethodID jni_host_audio_track_methods[] = {
+	{ "write", "([BII)I", jni_host_audio_track_write },
+	{ "play", "()V", jni_host_nop },
+	{ "pause", "()V", jni_host_nop },
+	{ "flush", "()V", jni_host_nop },
+	{ "stop", "()V", jni_host_nop },
+	{ "getChannelCount", "()I", jni_host_audio_track_get_channel_count },
+	{ "getSampleRate", "()I", jni_host_audio_track_get_sample_rate },
+	{ NULL },
+};
+
+static struct _jmethodID jni_host_stream_info_methods[] = {
+	{ "setMetadata", "(Ljava/util/Map;)V", jni_host_stream_info_set_metadata },
+	{ "setMediaTypeInternal", "(I)V", jni_host_stream_info_set_media_type },
+	{ "setStreamNumber", "(I)V", jni_host_stream_info_set_stream_number },
+	{ NULL },
+};
+
+static const struct JniHostClass jni_host_classes[JNI_HOST_CLASSES_NB] = {
+	[JNI_HOST_CLASS_OBJECT] = { "java/lang/Object", JNI_HOST_KIND_OBJECT,
+			JNI_HOST_CLASS_OBJECT, jni_host_object_methods, NULL },
+	[JNI_HOST_CLASS_CLASS] = { "java/lang/Class", JNI_HOST_KIND_NONE },
+	[JNI_HOST_CLASS_STRING] = { "java/lang/String", JNI_HOST_KIND_NONE },
+	[JNI_HOST_CLASS_THROWABLE] = { "java/lang/Throwable",
+			JNI_HOST_KIND_THROWABLE },
+	[JNI_HOST_CLASS_RUNTIME_EXCEPTION] = { "java/lang/RuntimeException",
+			JNI_HOST_KIND_THROWABLE },
+	[JNI_HOST_CLASS_INTERRUPTED_EXCEPTION] = {
+			"java/lang/InterruptedException", JNI_HOST_KIND_THROWABLE },
+	[JNI_HOST_CLASS_NOT_PLAYING_EXCEPTION] = {
+			"com/appunite/ffmpeg/NotPlayingException",
+			JNI_HOST_KIND_THROWABLE },
+	[JNI_HOST_CLASS_NULL_POINTER_EXCEPTION] = {
+			"java/lang/NullPointerException", JNI_HOST_KIND_THROWABLE },
+	[JNI_HOST_CLASS_INDEX_OUT_OF_BOUNDS_EXCEPTION] = {
+			"java/lang/ArrayIndexOutOfBoundsException",
+			JNI_HOST_KIND_THROWABLE },
+	[JNI_HOST_CLASS_NEGATIVE_ARRAY_SIZE_EXCEPTION] = {
+			"java/lang/NegativeArraySizeException", JNI_HOST_KIND_THROWABLE },
+	[JNI_HOST_CLASS_INSTANTIATION_EXCEPTION] = {
+			"java/lang/InstantiationException", JNI_HOST_KIND_THROWABLE },
+	[JNI_HOST_CLASS_NO_CLASS_DEF_FOUND_ERROR] = {
+			"java/lang/NoClassDefFoundError", JNI_HOST_KIND_THROWABLE },
+	[JNI_HOST_CLASS_NO_SUCH_METHOD_ERROR] = { "java/lang/NoSuchMethodError",
+			JNI_HOST_KIND_THROWABLE },
+	[JNI_HOST_CLASS_NO_SUCH_FIELD_ERROR] = { "java/lang/NoSuchFieldError",
+			JNI_HOST_KIND_THROWABLE },
+	[JNI_HOST_CLASS_OUT_OF_MEMORY_ERROR] = { "java/lang/OutOfMemoryError",
+			JNI_HOST_KIND_THROWABLE },
+	[JNI_HOST_CLASS_BYTE_ARRAY] = { "[B", JNI_HOST_KIND_NONE },
+	[JNI_HOST_CLASS_LONG_ARRAY] = { "[J", JNI_HOST_KIND_NONE },
+	[JNI_HOST_CLASS_OBJECT_ARRAY] = { "[Ljava/lang/Object;",
+			JNI_HOST_KIND_NONE },
+	[JNI_HOST_CLASS_BYTE_BUFFER] = { "java/nio/ByteBuffer",
+			JNI_HOST_KIND_NONE },
+	[JNI_HOST_CLASS_MAP] = { "java/util/Map", JNI_HOST_KIND_NONE,
+			JNI_HOST_CLASS_OBJECT, jni_host_map_methods, NULL },
+	[JNI_HOST_CLASS_HASH_MAP] = { "java/util/HashMap", JNI_HOST_KIND_MAP,
+			JNI_HOST_CLASS_MAP, jni_host_object_methods, NULL },
+	[JNI_HOST_CLASS_SET] = { "java/util/Set", JNI_HOST_KIND_NONE,
+			JNI_HOST_CLASS_OBJECT, jni_host_set_methods, NULL },
+	[JNI_HOST_CLASS_ITERATOR] = { "java/util/Iterator", JNI_HOST_KIND_NONE,
+			JNI_HOST_CLASS_OBJECT, jni_host_iterator_methods, NULL },
+	[JNI_HOST_CLASS_PLAYER] = { "com/appunite/ffmpeg/FFmpegPlayer",
+			JNI_HOST_KIND_NONE, JNI_HOST_CLASS_OBJECT,
+			jni_host_player_methods, jni_host_player_fields },
+	[JNI_HOST_CLASS_AUDIO_TRACK] = { "android/media/AudioTrack",
+			JNI_HOST_KIND_NONE, JNI_HOST_CLASS_OBJECT,
+			jni_host_audio_track_methods, NULL },
+	[JNI_HOST_CLASS_STREAM_INFO] = { "com/appunite/ffmpeg/FFmpegStreamInfo",
+			JNI_HOST_KIND_STREAM_INFO, JNI_HOST_CLASS_OBJECT,
+			jni_host_stream_info_methods, NULL },
+	[JNI_HOST_CLASS_SURFACE] = { "android/view/Surface", JNI_HOST_KIND_NONE },
+};
+
+static const struct JniHostClass *jni_host_class_def(jclass clazz,
+		const char *function) {
+	jni_host_check(clazz, JNI_HOST_KIND_CLASS, function);
+	return clazz->u.def;
+}
+
+static jclass jni_host_find_class(JNIEnv *env, const char *name) {
+	int i;
+	pthread_once(&jni_host_once, jni_host_init);
+	for (i = 0; i < JNI_HOST_CLASSES_NB; ++i) {
+		if (strcmp(jni_host_classes[i].name, name) == 0)
+			return &jni_host_class_objects[i];
+	}
+	jni_host_throw(JNI_HOST_CLASS_NO_CLASS_DEF_FOUND_ERROR, name);
+	return NULL;
+}
+
+static jint jni_host_throw_new(JNIEnv *env, jclass clazz,
+		const char *message) {
+	const struct JniHostClass *def = jni_host_class_def(clazz, "ThrowNew");
+	if (def->kind != JNI_HOST_KIND_THROWABLE)
+		jni_host_fatal("ThrowNew: %s is not throwable", def->name);
+	jni_host_throw(def - jni_host_classes, message);
+	return JNI_OK;
+}
+
+static jthrowable jni_host_exception_occurred(JNIEnv *env) {
+	return jni_host_ref(jni_host_exception);
+}
+
+static void jni_host_exception_describe(JNIEnv *env) {
+	jobject exception = jni_host_exception;
+	if (exception == NULL)
+		return;
+	fprintf(stderr, "jni-host: exception %s: %s\n", exception->clazz->name,
+			exception->u.chars != NULL ? exception->u.chars : "");
+	jni_host_set_exception(NULL);
+}
+
+static void jni_host_exception_clear(JNIEnv *env) {
+	jni_host_set_exception(NULL);
+}
+
+static jboolean jni_host_exception_check(JNIEnv *env) {
+	return jni_host_exception != NULL;
+}
+
+static jobject jni_host_new_ref(JNIEnv *env, jobject obj) {
+	return jni_host_ref(obj);
+}
+
+static void jni_host_delete_ref(JNIEnv *env, jobject obj) {
+	jni_host_unref(obj);
+}
+
+static void jni_host_call(JNIEnv *env, jobject obj, jmethodID method,
+		va_list args, jvalue *result) {
+	memset(result, 0, sizeof(*result));
+	if (method == NULL)
+		jni_host_fatal("null method called");
+	if (obj == NULL) {
+		jni_host_throw(JNI_HOST_CLASS_NULL_POINTER_EXCEPTION, method->name);
+		return;
+	}
+	method->call(env, obj, args, result);
+}
+
+static jobject jni_host_new_object(JNIEnv *env, jclass clazz,
+		jmethodID constructor, ...) {
+	const struct JniHostClass *def = jni_host_class_def(clazz, "NewObject");
+	va_list args;
+	jvalue result;
+	jobject obj;
+
+	if (def->kind == JNI_HOST_KIND_NONE
+			|| def->kind == JNI_HOST_KIND_THROWABLE) {
+		jni_host_throw(JNI_HOST_CLASS_INSTANTIATION_EXCEPTION, def->name);
+		return NULL;
+	}
+	obj = jni_host_alloc(def - jni_host_classes, def->kind);
+	if (obj == NULL)
+		return NULL;
+	va_start(args, constructor);
+	jni_host_call(env, obj, constructor, args, &result);
+	va_end(args);
+	return obj;
+}
+
+static jmethodID jni_host_get_method_id(JNIEnv *env, jclass clazz,
+		const char *name, const char *signature) {
+	const struct JniHostClass *def = jni_host_class_def(clazz, "GetMethodID");
+	struct _jmethodID *method;
+
+	for (;;) {
+		for (method = def->methods; method != NULL && method->name != NULL;
+				++method) {
+			if (strcmp(method->name, name) == 0
+					&& strcmp(method->signature, signature) == 0)
+				return method;
+		}
+		if (def == &jni_host_classes[def->parent])
+			break;
+		def = &jni_host_classes[def->parent];
+	}
+	jni_host_throw(JNI_HOST_CLASS_NO_SUCH_METHOD_ERROR, name);
+	return NULL;
+}
+
+static jobject jni_host_call_object_method(JNIEnv *env, jobject obj,
+		jmethodID method, ...) {
+	va_list args;
+	jvalue result;
+	va_start(args, method);
+	jni_host_call(env, obj, method, args, &result);
+	va_end(args);
+	return result.l;
+}
+
+static jboolean jni_host_call_boolean_method(JNIEnv *env, jobject obj,
+		jmethodID method, ...) {
+	va_list args;
+	jvalue result;
+	va_start(args, method);
+	jni_host_call(env, obj, method, args, &result);
+	va_end(args);
+	return result.z;
+}
+
+static jint jni_host_call_int_method(JNIEnv *env, jobject obj,
+		jmethodID method, ...) {
+	va_list args;
+	jvalue result;
+	va_start(args, method);
+	jni_host_call(env, obj, method, args, &result);
+	va_end(args);
+	return result.i;
+}
+
+static jlong jni_host_call_long_method(JNIEnv *env, jobject obj,
+		jmethodID method, ...) {
+	va_list args;
+	jvalue result;
+	va_start(args, method);
+	jni_host_call(env, obj, method, args, &result);
+	va_end(args);
+	return result.j;
+}
+
+static void jni_host_call_void_method(JNIEnv *env, jobject obj,
+		jmethodID method, ...) {
+	va_list args;
+	jvalue result;
+	va_start(args, method);
+	jni_host_call(env, obj, method, args, &result);
+	va_end(args);
+}
+
+static jfieldID jni_host_get_field_id(JNIEnv *env, jclass clazz,
+		const char *name, const char *signature) {
+	const struct JniHostClass *def = jni_host_class_def(clazz, "GetFieldID");
+	struct _jfieldID *field;
+
+	for (field = def->fields; field != NULL && field->name != NULL;
+			++field) {
+		if (strcmp(field->name, name) == 0
+				&& strcmp(field->signature, signature) == 0)
+			return field;
+	}
+	jni_host_throw(JNI_HOST_CLASS_NO_SUCH_FIELD_ERROR, name);
+	return NULL;
+}
+
+// mNativePlayer is the only field
+static jlong jni_host_get_long_field(JNIEnv *env, jobject obj,
+		jfieldID field) {
+	jni_host_check(obj, JNI_HOST_KIND_PLAYER, "GetLongField");
+	return obj->u.player.native_player;
+}
+
+static void jni_host_set_long_field(JNIEnv *env, jobject obj, jfieldID field,
+		jlong value) {
+	jni_host_check(obj, JNI_HOST_KIND_PLAYER, "SetLongField");
+	obj->u.player.native_player = value;
+}
+
+static jstring jni_host_new_string_utf(JNIEnv *env, const char *chars) {
+	jobject string;
+	if (chars == NULL)
+		return NULL;
+	string = jni_host_alloc(JNI_HOST_CLASS_STRING, JNI_HOST_KIND_STRING);
+	if (string == NULL)
+		return NULL;
+	string->u.chars = strdup(chars);
+	if (string->u.chars == NULL) {
+		free(string);
+		jni_host_throw(JNI_HOST_CLASS_OUT_OF_MEMORY_ERROR, NULL);
+		return NULL;
+	}
+	return string;
+}
+
+static const char *jni_host_get_string_utf_chars(JNIEnv *env,
+		jstring string, jboolean *is_copy) {
+	jni_host_check(string, JNI_HOST_KIND_STRING, "GetStringUTFChars");
+	if (is_copy != NULL)
+		*is_copy = JNI_FALSE;
+	return string->u.chars;
+}
+
+static void jni_host_release_string_utf_chars(JNIEnv *env, jstring string,
+		const char *chars) {
+}
+
+static jsize jni_host_get_array_length(JNIEnv *env, jarray array) {
+	if (array == NULL || (array->kind != JNI_HOST_KIND_BYTE_ARRAY
+			&& array->kind != JNI_HOST_KIND_LONG_ARRAY
+			&& array->kind != JNI_HOST_KIND_OBJECT_ARRAY))
+		jni_host_fatal("GetArrayLength: not an array");
+	return array->u.array.length;
+}
+
+static jarray jni_host_new_array(enum JniHostClassNo class_no,
+		enum JniHostKind kind, jsize length, size_t element_size) {
+	jobject array;
+	if (length < 0) {
+		jni_host_throw(JNI_HOST_CLASS_NEGATIVE_ARRAY_SIZE_EXCEPTION, NULL);
+		return NULL;
+	}
+	array = jni_host_alloc(class_no, kind);
+	if (array == NULL)
+		return NULL;
+	// zero length arrays get a valid pointer too
+	array->u.array.elements = calloc(length ? length : 1, element_size);
+	if (array->u.array.elements == NULL) {
+		free(array);
+		jni_host_throw(JNI_HOST_CLASS_OUT_OF_MEMORY_ERROR, NULL);
+		return NULL;
+	}
+	array->u.array.length = length;
+	return array;
+}
+
+static jobjectArray jni_host_new_object_array(JNIEnv *env, jsize length,
+		jclass clazz, jobject initial) {
+	jsize i;
+	jni_host_class_def(clazz, "NewObjectArray");
+	jobject array = jni_host_new_array(JNI_HOST_CLASS_OBJECT_ARRAY,
+			JNI_HOST_KIND_OBJECT_ARRAY, length, sizeof(jobject));
+	if (array == NULL)
+		return NULL;
+	for (i = 0; i < length; ++i)
+		((jobject *) array->u.array.elements)[i] = jni_host_ref(initial);
+	return array;
+}
+
+static void jni_host_set_object_array_element(JNIEnv *env,
+		jobjectArray array, jsize index, jobject value) {
+	jni_host_check(array, JNI_HOST_KIND_OBJECT_ARRAY, "SetObjectArrayElement");
+	if (!jni_host_check_region(array, index, 1))
+		return;
+	jobject *elements = array->u.array.elements;
+	jni_host_ref(value);
+	jni_host_unref(elements[index]);
+	elements[index] = value;
+}
+
+static jbyteArray jni_host_new_byte_array(JNIEnv *env, jsize length) {
+	return jni_host_new_array(JNI_HOST_CLASS_BYTE_ARRAY,
+			JNI_HOST_KIND_BYTE_ARRAY, length, sizeof(jbyte));
+}
+
+static jlongArray jni_host_new_long_array(JNIEnv *env, jsize length) {
+	return jni_host_new_array(JNI_HOST_CLASS_LONG_ARRAY,
+			JNI_HOST_KIND_LONG_ARRAY, length, sizeof(jlong));
+}
+
+static jbyte *jni_host_get_byte_array_elements(JNIEnv *env,
+		jbyteArray array, jboolean *is_copy) {
+	jni_host_check(array, JNI_HOST_KIND_BYTE_ARRAY, "GetByteArrayElements");
+	if (is_copy != NULL)
+		*is_copy = JNI_FALSE;
+	return array->u.array.elements;
+}
+
+static void jni_host_release_byte_array_elements(JNIEnv *env,
+		jbyteArray array, jbyte *elements, jint mode) {
+}
+
+static jlong *jni_host_get_long_array_elements(JNIEnv *env,
+		jlongArray array, jboolean *is_copy) {
+	jni_host_check(array, JNI_HOST_KIND_LONG_ARRAY, "GetLongArrayElements");
+	if (is_copy != NULL)
+		*is_copy = JNI_FALSE;
+	return array->u.array.elements;
+}
+
+static void jni_host_release_long_array_elements(JNIEnv *env,
+		jlongArray array, jlong *elements, jint mode) {
+}
+
+static void jni_host_get_byte_array_region(JNIEnv *env, jbyteArray array,
+		jsize start, jsize len, jbyte *buf) {
+	jni_host_check(array, JNI_HOST_KIND_BYTE_ARRAY, "GetByteArrayRegion");
+	if (jni_host_check_region(array, start, len))
+		memcpy(buf, (jbyte *) array->u.array.elements + start, len);
+}
+
+static void jni_host_set_byte_array_region(JNIEnv *env, jbyteArray array,
+		jsize start, jsize len, const jbyte *buf) {
+	jni_host_check(array, JNI_HOST_KIND_BYTE_ARRAY, "SetByteArrayRegion");
+	if (jni_host_check_region(array, start, len))
+		memcpy((jbyte *) array->u.array.elements + start, buf, len);
+}
+
+static void jni_host_set_long_array_region(JNIEnv *env, jlongArray array,
+		jsize start, jsize len, const jlong *buf) {
+	jni_host_check(array, JNI_HOST_KIND_LONG_ARRAY, "SetLongArrayRegion");
+	if (jni_host_check_region(array, start, len))
+		memcpy((jlong *) array->u.array.elements + start, buf,
+				len * sizeof(jlong));
+}
+
+// natives are called directly on the host
+static jint jni_host_register_natives(JNIEnv *env, jclass clazz,
+		const JNINativeMethod *methods, jint methods_nb) {
+	jni_host_class_def(clazz, "RegisterNatives");
+	return JNI_OK;
+}
+
+static JavaVM jni_host_vm;
+
+static jint jni_host_get_java_vm(JNIEnv *env, JavaVM **vm) {
+	*vm = &jni_host_vm;
+	return JNI_OK;
+}
+
+static jobject jni_host_new_direct_byte_buffer(JNIEnv *env, void *address,
+		jlong capacity) {
+	jobject buffer = jni_host_alloc(JNI_HOST_CLASS_BYTE_BUFFER,
+			JNI_HOST_KIND_BYTE_BUFFER);
+	if (buffer == NULL)
+		return NULL;
+	buffer->u.buffer.address = address;
+	buffer->u.buffer.capacity = capacity;
+	return buffer;
+}
+
+static void *jni_host_get_direct_buffer_address(JNIEnv *env, jobject buffer) {
+	if (buffer == NULL || buffer->kind != JNI_HOST_KIND_BYTE_BUFFER)
+		return NULL;
+	return buffer->u.buffer.address;
+}
+
+static jlong jni_host_get_direct_buffer_capacity(JNIEnv *env,
+		jobject buffer) {
+	if (buffer == NULL || buffer->kind != JNI_HOST_KIND_BYTE_BUFFER)
+		return -1;
+	return buffer->u.buffer.capacity;
+}
+
+static const struct JNINativeInterface jni_host_interface = {
+	.FindClass = jni_host_find_class,
+	.ThrowNew = jni_host_throw_new,
+	.ExceptionOccurred = jni_host_exception_occurred,
+	.ExceptionDescribe = jni_host_exception_describe,
+	.ExceptionClear = jni_host_exception_clear,
+	.ExceptionCheck = jni_host_exception_check,
+	.NewGlobalRef = jni_host_new_ref,
+	.DeleteGlobalRef = jni_host_delete_ref,
+	.DeleteLocalRef = jni_host_delete_ref,
+	.NewObject = jni_host_new_object,
+	.GetMethodID = jni_host_get_method_id,
+	.CallObjectMethod = jni_host_call_object_method,
+	.CallBooleanMethod = jni_host_call_boolean_method,
+	.CallIntMethod = jni_host_call_int_method,
+	.CallLongMethod = jni_host_call_long_method,
+	.CallVoidMethod = jni_host_call_void_method,
+	.GetFieldID = jni_host_get_field_id,
+	.GetLongField = jni_host_get_long_field,
+	.SetLongField = jni_host_set_long_field,
+	.NewStringUTF = jni_host_new_string_utf,
+	.GetStringUTFChars = jni_host_get_string_utf_chars,
+	.ReleaseStringUTFChars = jni_host_release_string_utf_chars,
+	.GetArrayLength = jni_host_get_array_length,
+	.NewObjectArray = jni_host_new_object_array,
+	.SetObjectArrayElement = jni_host_set_object_array_element,
+	.NewByteArray = jni_host_new_byte_array,
+	.NewLongArray = jni_host_new_long_array,
+	.GetByteArrayElements = jni_host_get_byte_array_elements,
+	.ReleaseByteArrayElements = jni_host_release_byte_array_elements,
+	.GetLongArrayElements = jni_host_get_long_array_elements,
+	.ReleaseLongArrayElements = jni_host_release_long_array_elements,
+	.GetByteArrayRegion = jni_host_get_byte_array_region,
+	.SetByteArrayRegion = jni_host_set_byte_array_region,
+	.SetLongArrayRegion = jni_host_set_long_array_region,
+	.RegisterNatives = jni_host_register_natives,
+	.GetJavaVM = jni_host_get_java_vm,
+	.NewDirectByteBuffer = jni_host_new_direct_byte_buffer,
+	.GetDirectBufferAddress = jni_host_get_direct_buffer_address,
+	.GetDirectBufferCapacity = jni_host_get_direct_buffer_capacity,
+};
+
+// every thread uses the same function table
+static JNIEnv jni_host_env = &jni_host_interface;
+
+static jint jni_host_attach_current_thread(JavaVM *vm, JNIEnv **env,
+		void *args) {
+	pthread_once(&jni_host_once, jni_host_init);
+	jni_host_attached = TRUE;
+	*env = &jni_host_env;
+	return JNI_OK;
+}
+
+static jint jni_host_detach_current_thread(JavaVM *vm) {
+	jni_host_set_exception(NULL);
+	jni_host_attached = FALSE;
+	return JNI_OK;
+}
+
+static jint jni_host_get_env(JavaVM *vm, void **env, jint version) {
+	if (!jni_host_attached) {
+		*env = NULL;
+		return JNI_EDETACHED;
+	}
+	*env = &jni_host_env;
+	return JNI_OK;
+}
+
+static const struct JNIInvokeInterface jni_host_invoke_interface = {
+	.AttachCurrentThread = jni_host_attach_current_thread,
+	.DetachCurrentThread = jni_host_detach_current_thread,
+	.GetEnv = jni_host_get_env,
+};
+
+static JavaVM jni_host_vm = &jni_host_invoke_interface;
+
+JNIEnv *jni_host_attach() {
+	JNIEnv *env;
+	jni_host_attach_current_thread(&jni_host_vm, &env, NULL);
+	return env;
+}
+
+jobject jni_host_new_player(JNIEnv *env) {
+	jobject player = jni_host_alloc(JNI_HOST_CLASS_PLAYER,
+			JNI_HOST_KIND_PLAYER);
+	if (player == NULL)
+		return NULL;
+	pthread_mutex_init(&player->u.player.mutex, NULL);
+	pthread_cond_init(&player->u.player.cond, NULL);
+	return player;
+}
+
+int jni_host_player_wait_finished(jobject player, int streams,
+		int64_t timeout_us) {
+	struct JniHostPlayer *host_player;
+	struct timespec ts;
+	int finished;
+
+	jni_host_check(player, JNI_HOST_KIND_PLAYER,
+			"jni_host_player_wait_finished");
+	host_player = &player->u.player;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_us / 1000000;
+	ts.tv_nsec += (timeout_us % 1000000) * 1000;
+	if (ts.tv_nsec >= 1000000000l) {
+		ts.tv_sec += 1;
+		ts.tv_nsec -= 1000000000l;
+	}
+
+	pthread_mutex_lock(&host_player->mutex);
+	while (host_player->state.finished < streams) {
+		if (pthread_cond_timedwait(&host_player->cond, &host_player->mutex,
+				&ts) == ETIMEDOUT)
+			break;
+	}
+	finished = host_player->state.finished;
+	pthread_mutex_unlock(&host_player->mutex);
+	return finished;
+}
+
+void jni_host_player_get_state(jobject player,
+		struct JniHostPlayerState *state) {
+	jni_host_check(player, JNI_HOST_KIND_PLAYER, "jni_host_player_get_state");
+	pthread_mutex_lock(&player->u.player.mutex);
+	*state = player->u.player.state;
+	pthread_mutex_unlock(&player->u.player.mutex);
+}
+
+jobject jni_host_new_surface(JNIEnv *env, ANativeWindow *window) {
+	jobject surface = jni_host_alloc(JNI_HOST_CLASS_SURFACE,
+			JNI_HOST_KIND_SURFACE);
+	if (surface == NULL)
+		return NULL;
+	ANativeWindow_acquire(window);
+	surface->u.window = window;
+	return surface;
+}
+
+ANativeWindow *ANativeWindow_fromSurface(JNIEnv *env, jobject surface) {
+	if (surface == NULL)
+		return NULL;
+	jni_host_check(surface, JNI_HOST_KIND_SURFACE, "ANativeWindow_fromSurface");
+	ANativeWindow_acquire(surface->u.window);
+	return surface->u.window;
+}
@@ -0,0 +1,75 @@
+/*
+ * jni-host.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Java side of FFmpegPlayer for host builds (tools/build_host.sh): jni
+ * functions from host/jni.h, a null AudioTrack and Surfaces drawing into
+ * host windows. jni_player_* natives are called directly with the env
+ * and player object created here.
+ */
+
+#ifndef HOST_JNI_HOST_H_
+#define HOST_JNI_HOST_H_
+
+#include <stdint.h>
+
+#include <jni.h>
+#include <android/native_window.h>
+
+struct JniHostPlayerState {
+	// last onUpdateTime values
+	int64_t current_time_us;
+	int64_t duration_us;
+	// onUpdateTime calls with isFinished, every played stream reports it
+	int finished;
+	// length of array passed to setStreamsInfo
+	int streams;
+	// AudioTrack returned by prepareAudioTrack, written bytes are dropped
+	int audio_sample_rate;
+	int audio_channels;
+	int64_t audio_bytes;
+};
+
+/*
+ * Attaches calling thread to the host vm and returns its env
+ */
+JNIEnv *jni_host_attach();
+
+/*
+ * Returns local reference to a new FFmpegPlayer object, jni_player_init
+ * has to be called with it before other natives
+ */
+jobject jni_host_new_player(JNIEnv *env);
+
+/*
+ * Waits until streams finished streams were reported by onUpdateTime or
+ * timeout_us passed, returns number of finished streams
+ */
+int jni_host_player_wait_finished(jobject player, int streams,
+		int64_t timeout_us);
+
+void jni_host_player_get_state(jobject player,
+		struct JniHostPlayerState *state);
+
+/*
+ * Returns local reference to a new android.view.Surface drawing into the
+ * window, surface keeps its own reference of the window
+ */
+jobject jni_host_new_surface(JNIEnv *env, ANativeWindow *window);
+
+#endif /* HOST_JNI_HOST_H_ */
@@ -0,0 +1,159 @@
+/*
+ * jni.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Replacement of jni.h for host builds (tools/build_host.sh). Only source
+ * compatible: JNINativeInterface has just the functions used by player.c,
+ * helpers.c and jni-protocol.c, they are implemented by host/jni-host.c.
+ */
+
+#ifndef HOST_JNI_H_
+#define HOST_JNI_H_
+
+#include <stdarg.h>
+#include <stdint.h>
+
+typedef uint8_t jboolean;
+typedef int8_t jbyte;
+typedef uint16_t jchar;
+typedef int16_t jshort;
+typedef int32_t jint;
+typedef int64_t jlong;
+typedef float jfloat;
+typedef double jdouble;
+typedef jint jsize;
+
+struct _jobject;
+typedef struct _jobject *jobject;
+typedef jobject jclass;
+typedef jobject jstring;
+typedef jobject jarray;
+typedef jobject jthrowable;
+typedef jarray jobjectArray;
+typedef jarray jbyteArray;
+typedef jarray jlongArray;
+
+struct _jfieldID;
+typedef struct _jfieldID *jfieldID;
+struct _jmethodID;
+typedef struct _jmethodID *jmethodID;
+
+typedef union jvalue {
+	jboolean z;
+	jbyte b;
+	jchar c;
+	jshort s;
+	jint i;
+	jlong j;
+	jfloat f;
+	jdouble d;
+	jobject l;
+} jvalue;
+
+#define JNI_FALSE 0
+#define JNI_TRUE 1
+
+#define JNI_VERSION_1_4 0x00010004
+#define JNI_VERSION_1_6 0x00010006
+
+#define JNI_OK (0)
+#define JNI_ERR (-1)
+#define JNI_EDETACHED (-2)
+#define JNI_EVERSION (-3)
+
+#define JNI_COMMIT 1
+#define JNI_ABORT 2
+
+#define JNIEXPORT
+#define JNICALL
+
+typedef struct {
+	const char *name;
+	const char *signature;
+	void *fnPtr;
+} JNINativeMethod;
+
+struct JNINativeInterface;
+struct JNIInvokeInterface;
+typedef const struct JNINativeInterface *JNIEnv;
+typedef const struct JNIInvokeInterface *JavaVM;
+
+typedef struct JavaVMAttachArgs {
+	jint version;
+	const char *name;
+	jobject group;
+} JavaVMAttachArgs;
+
+struct JNINativeInterface {
+	jclass (*FindClass)(JNIEnv *, const char *);
+	jint (*ThrowNew)(JNIEnv *, jclass, const char *);
+	jthrowable (*ExceptionOccurred)(JNIEnv *);
+	void (*ExceptionDescribe)(JNIEnv *);
+	void (*ExceptionClear)(JNIEnv *);
+	jboolean (*ExceptionCheck)(JNIEnv *);
+
+	jobject (*NewGlobalRef)(JNIEnv *, jobject);
+	void (*DeleteGlobalRef)(JNIEnv *, jobject);
+	void (*DeleteLocalRef)(JNIEnv *, jobject);
+
+	jobject (*NewObject)(JNIEnv *, jclass, jmethodID, ...);
+	jmethodID (*GetMethodID)(JNIEnv *, jclass, const char *, const char *);
+	jobject (*CallObjectMethod)(JNIEnv *, jobject, jmethodID, ...);
+	jboolean (*CallBooleanMethod)(JNIEnv *, jobject, jmethodID, ...);
+	jint (*CallIntMethod)(JNIEnv *, jobject, jmethodID, ...);
+	jlong (*CallLongMethod)(JNIEnv *, jobject, jmethodID, ...);
+	void (*CallVoidMethod)(JNIEnv *, jobject, jmethodID, ...);
+
+	jfieldID (*GetFieldID)(JNIEnv *, jclass, const char *, const char *);
+	jlong (*GetLongField)(JNIEnv *, jobject, jfieldID);
+	void (*SetLongField)(JNIEnv *, jobject, jfieldID, jlong);
+
+	jstring (*NewStringUTF)(JNIEnv *, const char *);
+	const char *(*GetStringUTFChars)(JNIEnv *, jstring, jboolean *);
+	void (*ReleaseStringUTFChars)(JNIEnv *, jstring, const char *);
+
+	jsize (*GetArrayLength)(JNIEnv *, jarray);
+	jobjectArray (*NewObjectArray)(JNIEnv *, jsize, jclass, jobject);
+	void (*SetObjectArrayElement)(JNIEnv *, jobjectArray, jsize, jobject);
+	jbyteArray (*NewByteArray)(JNIEnv *, jsize);
+	jlongArray (*NewLongArray)(JNIEnv *, jsize);
+	jbyte *(*GetByteArrayElements)(JNIEnv *, jbyteArray, jboolean *);
+	void (*ReleaseByteArrayElements)(JNIEnv *, jbyteArray, jbyte *, jint);
+	jlong *(*GetLongArrayElements)(JNIEnv *, jlongArray, jboolean *);
+	void (*ReleaseLongArrayElements)(JNIEnv *, jlongArray, jlong *, jint);
+	void (*GetByteArrayRegion)(JNIEnv *, jbyteArray, jsize, jsize, jbyte *);
+	void (*SetByteArrayRegion)(JNIEnv *, jbyteArray, jsize, jsize,
+			const jbyte *);
+	void (*SetLongArrayRegion)(JNIEnv *, jlongArray, jsize, jsize,
+			const jlong *);
+
+	jint (*RegisterNatives)(JNIEnv *, jclass, const JNINativeMethod *, jint);
+	jint (*GetJavaVM)(JNIEnv *, JavaVM **);
+
+	jobject (*NewDirectByteBuffer)(JNIEnv *, void *, jlong);
+	void *(*GetDirectBufferAddress)(JNIEnv *, jobject);
+	jlong (*GetDirectBufferCapacity)(JNIEnv *, jobject);
+};
+
+struct JNIInvokeInterface {
+	jint (*AttachCurrentThread)(JavaVM *, JNIEnv **, void *);
+	jint (*DetachCurrentThread)(JavaVM *);
+	jint (*GetEnv)(JavaVM *, void **, jint);
+};
+
+#endif /* HOST_JNI_H_ */
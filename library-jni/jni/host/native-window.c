@@ -0,0 +1,160 @@
+/*
+ * native-window.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * ANativeWindow for host builds (tools/build_host.sh): RGBA buffer in
+ * memory, posted frames are only counted.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <android/native_window.h>
+
+struct ANativeWindow {
+	pthread_mutex_t mutex;
+	int refs;
+	int32_t width;
+	int32_t height;
+	int32_t format;
+	uint32_t *bits;
+	int locked;
+	int64_t posted;
+};
+
+ANativeWindow *host_window_new(int32_t width, int32_t height) {
+	ANativeWindow *window = calloc(1, sizeof(*window));
+	if (window == NULL)
+		return NULL;
+	pthread_mutex_init(&window->mutex, NULL);
+	window->refs = 1;
+	window->width = width;
+	window->height = height;
+	window->format = WINDOW_FORMAT_RGBA_8888;
+	return window;
+}
+
+int64_t host_window_get_posted(ANativeWindow *window) {
+	int64_t posted;
+	pthread_mutex_lock(&window->mutex);
+	posted = window->posted;
+	pthread_mutex_unlock(&window->mutex);
+	return posted;
+}
+
+void ANativeWindow_acquire(ANativeWindow *window) {
+	pthread_mutex_lock(&window->mutex);
+	window->refs += 1;
+	pthread_mutex_unlock(&window->mutex);
+}
+
+void ANativeWindow_release(ANativeWindow *window) {
+	int refs;
+	pthread_mutex_lock(&window->mutex);
+	refs = --window->refs;
+	pthread_mutex_unlock(&window->mutex);
+	if (refs > 0)
+		return;
+	pthread_mutex_destroy(&window->mutex);
+	free(window->bits);
+	free(window);
+}
+
+int32_t ANativeWindow_getWidth(ANativeWindow *window) {
+	return window->width;
+}
+
+int32_t ANativeWindow_getHeight(ANativeWindow *window) {
+	return window->height;
+}
+
+int32_t ANativeWindow_getFormat(ANativeWindow *window) {
+	return window->format;
+}
+
+int32_t ANativeWindow_setBuffersGeometry(ANativeWindow *window, int32_t width,
+		int32_t height, int32_t format) {
+	int32_t ret = 0;
+	pthread_mutex_lock(&window->mutex);
+	if (window->locked || width < 0 || height < 0) {
+		ret = -1;
+		goto end;
+	}
+	if (width != window->width || height != window->height) {
+		free(window->bits);
+		window->bits = NULL;
+		window->width = width;
+		window->height = height;
+	}
+	// only RGBA buffers are allocated
+	if (format != 0)
+		window->format = WINDOW_FORMAT_RGBA_8888;
+
+	end:
+	pthread_mutex_unlock(&window->mutex);
+	return ret;
+}
+
+int32_t ANativeWindow_lock(ANativeWindow *window,
+		ANativeWindow_Buffer *outBuffer, ARect *inOutDirtyBounds) {
+	int32_t ret = 0;
+	pthread_mutex_lock(&window->mutex);
+	if (window->locked || window->width == 0 || window->height == 0) {
+		ret = -1;
+		goto end;
+	}
+	if (window->bits == NULL) {
+		window->bits = malloc((size_t) window->width * window->height
+				* sizeof(*window->bits));
+		if (window->bits == NULL) {
+			ret = -1;
+			goto end;
+		}
+	}
+	window->locked = 1;
+	outBuffer->width = window->width;
+	outBuffer->height = window->height;
+	outBuffer->stride = window->width;
+	outBuffer->format = window->format;
+	outBuffer->bits = window->bits;
+	if (inOutDirtyBounds != NULL) {
+		inOutDirtyBounds->left = 0;
+		inOutDirtyBounds->top = 0;
+		inOutDirtyBounds->right = window->width;
+		inOutDirtyBounds->bottom = window->height;
+	}
+
+	end:
+	pthread_mutex_unlock(&window->mutex);
+	return ret;
+}
+
+int32_t ANativeWindow_unlockAndPost(ANativeWindow *window) {
+	int32_t ret = 0;
+	pthread_mutex_lock(&window->mutex);
+	if (!window->locked) {
+		ret = -1;
+		goto end;
+	}
+	window->locked = 0;
+	window->posted += 1;
+
+	end:
+	pthread_mutex_unlock(&window->mutex);
+	return ret;
+}
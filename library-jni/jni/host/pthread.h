@@ -0,0 +1,48 @@
+/*
+ * pthread.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Host builds (tools/build_host.sh) add bionic only extensions used by
+ * player.c to the system pthread.h.
+ */
+
+#ifndef HOST_PTHREAD_H_
+#define HOST_PTHREAD_H_
+
+#include_next <pthread.h>
+
+#include <errno.h>
+#include <time.h>
+
+/*
+ * Waits on cond created with default (realtime) clock at most msecs
+ */
+static inline int pthread_cond_timeout_np(pthread_cond_t *cond,
+		pthread_mutex_t *mutex, unsigned msecs) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += msecs / 1000;
+	ts.tv_nsec += (msecs % 1000) * 1000000l;
+	if (ts.tv_nsec >= 1000000000l) {
+		ts.tv_sec += 1;
+		ts.tv_nsec -= 1000000000l;
+	}
+	return pthread_cond_timedwait(cond, mutex, &ts);
+}
+
+#endif /* HOST_PTHREAD_H_ */
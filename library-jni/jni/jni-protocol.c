@@ -16,174 +16,271 @@
  *
  */
 
+#include <pthread.h>
+#include <time.h>
+
 #include <libavutil/avstring.h>
 #include <libavformat/avformat.h>
+#include <libavutil/opt.h>
 #include <jni.h>
+#include <android/log.h>
 
 #include "ffmpeg/libavformat/url.h"
 
+#include "helpers.h"
 #include "jni-protocol.h"
+#include "log.h"
+
+#define FALSE 0
+#define TRUE (!(FALSE))
+
+#define LOG_SUBSYSTEM LOG_SUBSYSTEM_JNI
+#define LOG_TAG "jni-protocol.c"
+#define LOGI(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
+#define LOGE(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
 
 static const char *jni_reader_class_name = "com/appunite/ffmpeg/JniReader";
+static JavaMethod jni_reader_constructor = {"<init>", "(Ljava/lang/String;I)V"};
+static JavaMethod jni_reader_read = {"read", "([B)I"};
+static JavaMethod jni_reader_read_direct = {"read", "(Ljava/nio/ByteBuffer;II)I"};
+static JavaMethod jni_reader_write = {"write", "([B)I"};
+static JavaMethod jni_reader_check = {"check", "(I)I"};
+static JavaMethod jni_reader_seek = {"seek", "(JI)J"};
+
 static JavaVM *global_jvm;
 
-static int jni_read(URLContext *h, unsigned char *buf, int size) {
-	int err = 0;
-	JNIEnv* env;
-	jclass jni_reader_class;
-	jmethodID jni_reader_read;
-	jobject jni_reader;
-	jbyteArray byte_array;
-	jbyte *jni_samples;
-	if ((*global_jvm)->GetEnv(global_jvm, (void**) &env, JNI_VERSION_1_4)) {
-		err = -1;
-		goto end;
-	}
-	if (env == NULL) {
-		err = -1;
-		goto end;
-	}
+// resolved once by register_jni_protocol
+static pthread_mutex_t jni_protocol_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int jni_protocol_registered = FALSE;
+// set for threads attached by jni_get_env, destructor detaches them
+static pthread_key_t jni_env_key;
+static jclass jni_reader_class;
+static jmethodID jni_reader_constructor_method;
+static jmethodID jni_reader_read_method;
+// could be NULL if JniReader reads only to byte arrays
+static jmethodID jni_reader_read_direct_method;
+static jmethodID jni_reader_write_method;
+static jmethodID jni_reader_check_method;
+static jmethodID jni_reader_seek_method;
+
+#define DEFAULT_PACKET_SIZE (128 * 1024)
+#define MAX_PACKET_SIZE (4 * 1024 * 1024)
+
+typedef struct {
+	const AVClass *class;
+	int packet_size;
+	jobject reader;
+	// direct ByteBuffer wrapping [buffer_address, buffer_address + buffer_size)
+	jobject buffer;
+	unsigned char *buffer_address;
+	int buffer_size;
+} JniContext;
+
+#define OFFSET(x) offsetof(JniContext, x)
+
+static const AVOption options[] = {
+		{ "jni_packet_size", "Maximal size of data read from JniReader at once, 0 for ffmpeg default",
+		OFFSET(packet_size), AV_OPT_TYPE_INT, { .i64 = DEFAULT_PACKET_SIZE },
+		0, MAX_PACKET_SIZE, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+		{ NULL } };
+
+static const AVClass jni_class = { .class_name = "jni", .item_name =
+		av_default_item_name, .option = options, .version =
+		LIBAVUTIL_VERSION_INT, };
+
+static void jni_detach_thread(void *value) {
+	LOGI(3, "jni_detach_thread: detaching thread");
+	(*global_jvm)->DetachCurrentThread(global_jvm);
+}
 
-	jni_reader_class = (*env)->FindClass(env, jni_reader_class_name);
-	if (jni_reader_class == NULL) {
-		err = -1;
-		goto end;
+/*
+ * ffmpeg could call protocol from any thread (probing, read-ahead), so
+ * threads which are not attached yet are attached here and detached when
+ * they exit
+ */
+static JNIEnv *jni_get_env() {
+	JNIEnv *env = NULL;
+	JavaVMAttachArgs thread_spec = { JNI_VERSION_1_4, "FFmpegJniProtocol",
+			NULL };
+	jint ret = (*global_jvm)->GetEnv(global_jvm, (void**) &env,
+			JNI_VERSION_1_4);
+	if (ret == JNI_OK)
+		return env;
+	if (ret != JNI_EDETACHED)
+		return NULL;
+
+	if ((*global_jvm)->AttachCurrentThread(global_jvm, &env, &thread_spec)
+			|| env == NULL) {
+		LOGE(1, "jni_get_env: could not attach thread");
+		return NULL;
 	}
-
-	jni_reader_read = (*env)->GetMethodID(env, jni_reader_class, "read",
-			"([B)I");
-	if (jni_reader_read == NULL) {
-		err = -1;
-		goto end;
+	if (pthread_setspecific(jni_env_key, env)) {
+		LOGE(1, "jni_get_env: could not register thread for detaching");
+		(*global_jvm)->DetachCurrentThread(global_jvm);
+		return NULL;
 	}
+	LOGI(3, "jni_get_env: attached thread");
+	return env;
+}
 
-	jni_reader = (jobject) h->priv_data;
+/*
+ * Java exceptions have to be cleared before next jni call
+ */
+static int jni_check_exception(JNIEnv *env) {
+	if (!(*env)->ExceptionCheck(env))
+		return FALSE;
+	(*env)->ExceptionDescribe(env);
+	(*env)->ExceptionClear(env);
+	return TRUE;
+}
 
-	byte_array = (*env)->NewByteArray(env, size);
+/*
+ * Returns direct ByteBuffer covering [buf, buf + size) and offset of buf in
+ * it. Buffer is kept between reads because avio reads to the same memory.
+ */
+static jobject jni_get_buffer(JNIEnv *env, JniContext *c, unsigned char *buf,
+		int size, int *offset) {
+	jobject local_buffer;
+	if (c->buffer != NULL && buf >= c->buffer_address
+			&& buf + size <= c->buffer_address + c->buffer_size) {
+		*offset = buf - c->buffer_address;
+		return c->buffer;
+	}
+	if (c->buffer != NULL) {
+		(*env)->DeleteGlobalRef(env, c->buffer);
+		c->buffer = NULL;
+	}
+	local_buffer = (*env)->NewDirectByteBuffer(env, buf, size);
+	if (local_buffer == NULL) {
+		jni_check_exception(env);
+		return NULL;
+	}
+	c->buffer = (*env)->NewGlobalRef(env, local_buffer);
+	(*env)->DeleteLocalRef(env, local_buffer);
+	if (c->buffer == NULL)
+		return NULL;
+	c->buffer_address = buf;
+	c->buffer_size = size;
+	*offset = 0;
+	return c->buffer;
+}
 
-	err = (*env)->CallIntMethod(env, jni_reader, jni_reader_read, byte_array);
+/*
+ * Fallback for JniReader without read(ByteBuffer, int, int)
+ */
+static int jni_read_array(JNIEnv *env, JniContext *c, unsigned char *buf,
+		int size) {
+	int ret;
+	jbyteArray byte_array = (*env)->NewByteArray(env, size);
+	if (byte_array == NULL) {
+		jni_check_exception(env);
+		return AVERROR(ENOMEM);
+	}
 
-	jni_samples = (*env)->GetByteArrayElements(env, byte_array, NULL);
-	memcpy(buf, jni_samples, size);
-	(*env)->ReleaseByteArrayElements(env, byte_array, jni_samples, 0);
+	ret = (*env)->CallIntMethod(env, c->reader, jni_reader_read_method,
+			byte_array);
+	if (jni_check_exception(env) || ret > size || ret < -1) {
+		ret = AVERROR(EIO);
+		goto free_byte_array;
+	}
+	// copy only what JniReader really read
+	if (ret > 0)
+		(*env)->GetByteArrayRegion(env, byte_array, 0, ret, (jbyte *) buf);
 
+	free_byte_array:
 	(*env)->DeleteLocalRef(env, byte_array);
+	return ret;
+}
+
+static int jni_read(URLContext *h, unsigned char *buf, int size) {
+	int ret;
+	JNIEnv* env;
+	JniContext *c = h->priv_data;
+	jobject buffer;
+	int offset;
+	if ((env = jni_get_env()) == NULL)
+		return AVERROR(EIO);
+
+	if (jni_reader_read_direct_method == NULL) {
+		ret = jni_read_array(env, c, buf, size);
+		goto end;
+	}
 
-	end: return err >= 0 ? err : AVERROR(err);
+	// JniReader writes directly to avio buffer
+	buffer = jni_get_buffer(env, c, buf, size, &offset);
+	if (buffer == NULL)
+		return AVERROR(ENOMEM);
+	ret = (*env)->CallIntMethod(env, c->reader, jni_reader_read_direct_method,
+			buffer, offset, size);
+	if (jni_check_exception(env) || ret > size || ret < -1)
+		ret = AVERROR(EIO);
+
+	end:
+	// JniReader returns -1 at end of stream, avio expects 0
+	return ret == -1 ? 0 : ret;
 }
 
 static int jni_write(URLContext *h, const unsigned char *buf, int size) {
 	int err = 0;
 	JNIEnv* env;
-	jclass jni_reader_class;
-	jmethodID jni_reader_write;
-	jobject jni_reader;
+	JniContext *c = h->priv_data;
 	jbyteArray byte_array;
-	jbyte *jni_samples;
-	if ((*global_jvm)->GetEnv(global_jvm, (void**) &env, JNI_VERSION_1_4)) {
-		err = -1;
-		goto end;
-	}
-	if (env == NULL) {
-		err = -1;
-		goto end;
-	}
-
-	jni_reader_class = (*env)->FindClass(env, jni_reader_class_name);
-	if (jni_reader_class == NULL) {
+	if ((env = jni_get_env()) == NULL) {
 		err = -1;
 		goto end;
 	}
 
-	jni_reader_write = (*env)->GetMethodID(env, jni_reader_class, "write",
-			"([B)I");
-	if (jni_reader_write == NULL) {
+	byte_array = (*env)->NewByteArray(env, size);
+	if (byte_array == NULL) {
+		jni_check_exception(env);
 		err = -1;
 		goto end;
 	}
 
-	jni_reader = (jobject) h->priv_data;
-
-	byte_array = (*env)->NewByteArray(env, size);
+	(*env)->SetByteArrayRegion(env, byte_array, 0, size, (const jbyte *) buf);
 
-	jni_samples = (*env)->GetByteArrayElements(env, byte_array, NULL);
-	memcpy(jni_samples, buf, size);
-	(*env)->ReleaseByteArrayElements(env, byte_array, jni_samples, 0);
-
-	err = (*env)->CallIntMethod(env, jni_reader, jni_reader_write, byte_array);
+	err = (*env)->CallIntMethod(env, c->reader, jni_reader_write_method,
+			byte_array);
+	if (jni_check_exception(env))
+		err = -1;
 
 	(*env)->DeleteLocalRef(env, byte_array);
 
-	end: return err >= 0 ? err : AVERROR(err);
+	end: return err >= 0 ? err : AVERROR(EIO);
 }
 
 static int jni_get_handle(URLContext *h) {
-	return (intptr_t) h->priv_data;
+	JniContext *c = h->priv_data;
+	return (intptr_t) c->reader;
 }
 
 static int jni_check(URLContext *h, int mask) {
 	int err = 0;
 	JNIEnv* env;
-	jclass jni_reader_class;
-	jmethodID jni_reader_check;
-	jobject jni_reader;
+	JniContext *c = h->priv_data;
 
-	if ((*global_jvm)->GetEnv(global_jvm, (void**) &env, JNI_VERSION_1_4)) {
-		err = -1;
-		goto end;
-	}
-	if (env == NULL) {
+	if ((env = jni_get_env()) == NULL) {
 		err = -1;
 		goto end;
 	}
 
-	jni_reader_class = (*env)->FindClass(env, jni_reader_class_name);
-	if (jni_reader_class == NULL) {
+	err = (*env)->CallIntMethod(env, c->reader, jni_reader_check_method,
+			mask);
+	if (jni_check_exception(env))
 		err = -1;
-		goto end;
-	}
 
-	jni_reader_check = (*env)->GetMethodID(env, jni_reader_class, "check",
-			"(I)I");
-	if (jni_reader_check == NULL) {
-		err = -1;
-		goto end;
-	}
-
-	jni_reader = (jobject) h->priv_data;
-
-	err = (*env)->CallIntMethod(env, jni_reader, jni_reader_check, mask);
-
-	end: return err >= 0 ? err : AVERROR(err);
+	end: return err >= 0 ? err : AVERROR(EIO);
 }
 
 static int jni_open2(URLContext *h, const char *url, int flags,
 		AVDictionary **options) {
 	int err = 0;
 	JNIEnv* env;
-	jclass jni_reader_class;
-	jmethodID jni_reader_constructor;
+	JniContext *c = h->priv_data;
 	jstring url_java_string;
 	jobject jni_reader;
 
-	if ((*global_jvm)->GetEnv(global_jvm, (void**) &env, JNI_VERSION_1_4)) {
-		err = -1;
-		goto end;
-	}
-	if (env == NULL) {
-		err = -1;
-		goto end;
-	}
-
-	jni_reader_class = (*env)->FindClass(env, jni_reader_class_name);
-	if (jni_reader_class == NULL) {
-		err = -1;
-		goto end;
-	}
-
-	jni_reader_constructor = (*env)->GetMethodID(env, jni_reader_class,
-			"<init>", "(Ljava/lang/String;I)V");
-	if (jni_reader_constructor == NULL) {
+	if ((env = jni_get_env()) == NULL) {
 		err = -1;
 		goto end;
 	}
@@ -191,23 +288,29 @@ static int jni_open2(URLContext *h, const char *url, int flags,
 	url_java_string = (*env)->NewStringUTF(env, url);
 
 	if (url_java_string == NULL) {
+		jni_check_exception(env);
 		err = -1;
 		goto end;
 	}
 
 	jni_reader = (*env)->NewObject(env, jni_reader_class,
-			jni_reader_constructor, url_java_string, flags);
+			jni_reader_constructor_method, url_java_string, flags);
 	if (jni_reader == NULL) {
+		jni_check_exception(env);
 		err = -1;
 		goto free_url_java_string;
 	}
 
-	h->priv_data = (void *) (*env)->NewGlobalRef(env, jni_reader);
-	if (h->priv_data == NULL) {
+	c->reader = (*env)->NewGlobalRef(env, jni_reader);
+	if (c->reader == NULL) {
 		err = -1;
 		goto free_jni_reader;
 	}
 
+	// bigger packets means less calls through jni
+	if (c->packet_size > 0)
+		h->max_packet_size = c->packet_size;
+
 	free_jni_reader:
 
 	(*env)->DeleteLocalRef(env, jni_reader);
@@ -216,7 +319,7 @@ static int jni_open2(URLContext *h, const char *url, int flags,
 
 	(*env)->DeleteLocalRef(env, url_java_string);
 
-	end: return err >= 0 ? err : AVERROR(err);
+	end: return err >= 0 ? err : AVERROR(EIO);
 }
 
 static int jni_open(URLContext *h, const char *filename, int flags) {
@@ -226,66 +329,163 @@ static int jni_open(URLContext *h, const char *filename, int flags) {
 static int64_t jni_seek(URLContext *h, int64_t pos, int whence) {
 	int64_t err = 0;
 	JNIEnv* env;
-	jclass jni_reader_class;
-	jmethodID jni_reader_seek;
-	jobject jni_reader;
+	JniContext *c = h->priv_data;
 
-	if ((*global_jvm)->GetEnv(global_jvm, (void**) &env, JNI_VERSION_1_4)) {
-		err = -1;
-		goto end;
-	}
-	if (env == NULL) {
+	if ((env = jni_get_env()) == NULL) {
 		err = -1;
 		goto end;
 	}
 
-	jni_reader_class = (*env)->FindClass(env, jni_reader_class_name);
-	if (jni_reader_class == NULL) {
+	// whence could be also AVSEEK_SIZE, JniReader returns -1 if not supported
+	err = (*env)->CallLongMethod(env, c->reader, jni_reader_seek_method,
+			(jlong) pos, (jint) whence);
+	if (jni_check_exception(env))
 		err = -1;
-		goto end;
-	}
 
-	jni_reader_seek = (*env)->GetMethodID(env, jni_reader_class, "seek",
-			"(JI)J");
-	if (jni_reader_seek == NULL) {
+	end: return err >= 0 ? err : AVERROR(ENOSYS);
+}
+
+static int jni_close(URLContext *h) {
+	int err = 0;
+	JNIEnv* env;
+	JniContext *c = h->priv_data;
+
+	if ((env = jni_get_env()) == NULL) {
 		err = -1;
 		goto end;
 	}
 
-	jni_reader = (jobject) h->priv_data;
+	if (c->buffer != NULL)
+		(*env)->DeleteGlobalRef(env, c->buffer);
+	c->buffer = NULL;
+	if (c->reader != NULL)
+		(*env)->DeleteGlobalRef(env, c->reader);
+	c->reader = NULL;
 
-	err = (*env)->CallIntMethod(env, jni_reader, jni_reader_seek, pos, whence);
+	end: return err >= 0 ? err : AVERROR(EIO);
+}
 
-	end: return err >= 0 ? err : AVERROR(err);
+URLProtocol jni_protocol = { .name = "jni", .url_open2 = jni_open2,
+		.url_open = jni_open, .url_read = jni_read, .url_write = jni_write,
+		.url_seek = jni_seek, .url_close = jni_close, .url_get_file_handle =
+				jni_get_handle, .url_check = jni_check,
+		.priv_data_size = sizeof(JniContext), .priv_data_class = &jni_class, };
+
+static int jni_protocol_resolve(JNIEnv *env) {
+	jclass local_class = (*env)->FindClass(env, jni_reader_class_name);
+	if (local_class == NULL) {
+		jni_check_exception(env);
+		LOGE(1, "jni_protocol_resolve: could not find %s",
+				jni_reader_class_name);
+		return -1;
+	}
+	jni_reader_class = (*env)->NewGlobalRef(env, local_class);
+	(*env)->DeleteLocalRef(env, local_class);
+	if (jni_reader_class == NULL)
+		return -1;
+
+	jni_reader_constructor_method = java_get_method(env, jni_reader_class,
+			jni_reader_constructor);
+	jni_reader_read_method = java_get_method(env, jni_reader_class,
+			jni_reader_read);
+	jni_reader_write_method = java_get_method(env, jni_reader_class,
+			jni_reader_write);
+	jni_reader_check_method = java_get_method(env, jni_reader_class,
+			jni_reader_check);
+	jni_reader_seek_method = java_get_method(env, jni_reader_class,
+			jni_reader_seek);
+	// optional, older JniReader implementations read only to byte arrays
+	jni_reader_read_direct_method = java_get_method(env, jni_reader_class,
+			jni_reader_read_direct);
+	if (jni_reader_read_direct_method == NULL) {
+		(*env)->ExceptionClear(env);
+		LOGI(2, "jni_protocol_resolve: JniReader does not support ByteBuffer reads");
+	}
+	if (jni_reader_constructor_method == NULL || jni_reader_read_method == NULL
+			|| jni_reader_write_method == NULL
+			|| jni_reader_check_method == NULL
+			|| jni_reader_seek_method == NULL) {
+		jni_check_exception(env);
+		LOGE(1, "jni_protocol_resolve: could not find JniReader methods");
+		(*env)->DeleteGlobalRef(env, jni_reader_class);
+		jni_reader_class = NULL;
+		return -1;
+	}
+	return 0;
 }
 
-static int jni_close(URLContext *h) {
+int register_jni_protocol(JavaVM *jvm) {
+	JNIEnv *env;
 	int err = 0;
-	JNIEnv* env;
-	jobject jni_reader;
+	pthread_mutex_lock(&jni_protocol_mutex);
+	if (jni_protocol_registered)
+		goto end;
 
-	if ((*global_jvm)->GetEnv(global_jvm, (void**) &env, JNI_VERSION_1_4)) {
+	global_jvm = jvm;
+	if (pthread_key_create(&jni_env_key, jni_detach_thread)) {
 		err = -1;
 		goto end;
 	}
-	if (env == NULL) {
+	if ((env = jni_get_env()) == NULL) {
 		err = -1;
-		goto end;
+		goto delete_key;
 	}
+	if ((err = jni_protocol_resolve(env)) < 0)
+		goto delete_key;
 
-	jni_reader = (jobject) h->priv_data;
+	// protocol could be registered only once, ffmpeg keeps it in a list
+	ffurl_register_protocol(&jni_protocol, sizeof(jni_protocol));
+	jni_protocol_registered = TRUE;
+	goto end;
 
-	(*env)->DeleteGlobalRef(env, jni_reader);
+	delete_key:
+	pthread_key_delete(jni_env_key);
 
-	end: return err >= 0 ? err : AVERROR(err);
+	end:
+	pthread_mutex_unlock(&jni_protocol_mutex);
+	return err;
 }
 
-URLProtocol jni_protocol = { .name = "jni", .url_open2 = jni_open2,
-		.url_open = jni_open, .url_read = jni_read, .url_write = jni_write,
-		.url_seek = jni_seek, .url_close = jni_close, .url_get_file_handle =
-				jni_get_handle, .url_check = jni_check, };
-
-void register_jni_protocol(JavaVM *jvm) {
-	global_jvm = jvm;
-	ffurl_register_protocol(&jni_protocol, sizeof(jni_protocol));
+jlong jni_protocol_benchmark_read(JNIEnv *env, jclass clazz, jstring url,
+		jint read_size, jint reads) {
+	const char *url_str;
+	URLContext *uc = NULL;
+	unsigned char *buf = NULL;
+	struct timespec start, stop;
+	jlong result = -1;
+	int i;
+
+	if (!jni_protocol_registered || read_size <= 0 || reads <= 0)
+		return -1;
+	url_str = (*env)->GetStringUTFChars(env, url, NULL);
+	if (url_str == NULL)
+		return -1;
+	if (ffurl_open(&uc, url_str, AVIO_FLAG_READ, NULL, NULL) < 0) {
+		LOGE(1, "jni_protocol_benchmark_read: could not open %s", url_str);
+		goto release_url;
+	}
+	buf = av_malloc(read_size);
+	if (buf == NULL)
+		goto close_url;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < reads; i++) {
+		if (ffurl_read(uc, buf, read_size) < 0)
+			goto free_buf;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	// nanoseconds per read
+	result = ((stop.tv_sec - start.tv_sec) * 1000000000LL
+			+ (stop.tv_nsec - start.tv_nsec)) / reads;
+	LOGI(2, "jni_protocol_benchmark_read: %d reads of %d bytes, %lld ns each",
+			reads, read_size, (long long) result);
+
+	free_buf:
+	av_free(buf);
+	close_url:
+	ffurl_close(uc);
+	release_url:
+	(*env)->ReleaseStringUTFChars(env, url, url_str);
+	return result;
 }
@@ -19,6 +19,19 @@
 #ifndef JNI_PROTOCOL_H
 #define JNI_PROTOCOL_H
 
-void register_jni_protocol(JavaVM *jvm);
+#include <jni.h>
+
+/*
+ * Resolves JniReader class and methods and registers jni protocol,
+ * could be called many times. Returns 0 on success.
+ */
+int register_jni_protocol(JavaVM *jvm);
+
+/*
+ * Opens url with ffmpeg protocols and returns average time of reading
+ * read_size bytes in nanoseconds, or -1 on error
+ */
+jlong jni_protocol_benchmark_read(JNIEnv *env, jclass clazz, jstring url,
+		jint read_size, jint reads);
 
 #endif /* H_JNI_PROTOCOL */
@@ -0,0 +1,173 @@
+/*
+ * log.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+
+#define FALSE 0
+#define TRUE (!(FALSE))
+
+#define LOG_RING_SIZE 256
+#define LOG_MESSAGE_SIZE 512
+
+struct LogMessage {
+	int prio;
+	// tags are static strings
+	const char *tag;
+	char text[LOG_MESSAGE_SIZE];
+};
+
+volatile int log_levels[LOG_SUBSYSTEMS_NB] = {
+	[LOG_SUBSYSTEM_PLAYER] = 2,
+	[LOG_SUBSYSTEM_FFMPEG] = 24, // AV_LOG_WARNING
+	[LOG_SUBSYSTEM_AES] = 2,
+	[LOG_SUBSYSTEM_JNI] = 2,
+	[LOG_SUBSYSTEM_RENDER] = 2,
+	[LOG_SUBSYSTEM_TRACE] = 2,
+};
+
+static volatile int log_async = FALSE;
+
+// serializes log_set_async
+static pthread_mutex_t log_control_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t log_thread;
+static int log_thread_created = FALSE;
+
+// guards ring
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+static struct LogMessage log_ring[LOG_RING_SIZE];
+static unsigned int log_read = 0;
+static unsigned int log_written = 0;
+static int log_dropped = 0;
+static int log_stop = FALSE;
+
+void log_set_level(enum LogSubsystem subsystem, int level) {
+	int i;
+	if (subsystem == LOG_SUBSYSTEM_ALL) {
+		// ffmpeg levels are in different units
+		for (i = 0; i < LOG_SUBSYSTEMS_NB; ++i)
+			if (i != LOG_SUBSYSTEM_FFMPEG)
+				log_levels[i] = level;
+		return;
+	}
+	if (subsystem < 0 || subsystem >= LOG_SUBSYSTEMS_NB)
+		return;
+	log_levels[subsystem] = level;
+}
+
+static void *log_drain(void *data) {
+	struct LogMessage message;
+	int dropped, has_message;
+	(void) data;
+	pthread_mutex_lock(&log_mutex);
+	for (;;) {
+		while (!log_stop && log_read == log_written && log_dropped == 0)
+			pthread_cond_wait(&log_cond, &log_mutex);
+		dropped = log_dropped;
+		log_dropped = 0;
+		has_message = log_read != log_written;
+		if (!has_message && dropped == 0)
+			break;
+		if (has_message) {
+			message = log_ring[log_read % LOG_RING_SIZE];
+			log_read++;
+		}
+		pthread_mutex_unlock(&log_mutex);
+
+		if (dropped > 0)
+			__android_log_print(ANDROID_LOG_WARN, "log.c",
+					"log_drain: dropped %d messages", dropped);
+		if (has_message)
+			__android_log_write(message.prio, message.tag, message.text);
+
+		pthread_mutex_lock(&log_mutex);
+	}
+	pthread_mutex_unlock(&log_mutex);
+	return NULL;
+}
+
+int log_set_async(int async) {
+	int err = 0;
+	pthread_mutex_lock(&log_control_mutex);
+	if (async && !log_thread_created) {
+		pthread_mutex_lock(&log_mutex);
+		log_stop = FALSE;
+		pthread_mutex_unlock(&log_mutex);
+		if (pthread_create(&log_thread, NULL, log_drain, NULL) != 0) {
+			err = -1;
+			goto end;
+		}
+		log_thread_created = TRUE;
+		log_async = TRUE;
+	} else if (!async && log_thread_created) {
+		log_async = FALSE;
+		pthread_mutex_lock(&log_mutex);
+		log_stop = TRUE;
+		pthread_cond_signal(&log_cond);
+		pthread_mutex_unlock(&log_mutex);
+		// queued messages are written before thread exits
+		pthread_join(log_thread, NULL);
+		log_thread_created = FALSE;
+	}
+	end:
+	pthread_mutex_unlock(&log_control_mutex);
+	return err;
+}
+
+void log_vprint(int prio, const char *tag, const char *fmt, va_list ap) {
+	char text[LOG_MESSAGE_SIZE];
+	struct LogMessage *message;
+
+	if (!log_async) {
+		__android_log_vprint(prio, tag, fmt, ap);
+		return;
+	}
+
+	vsnprintf(text, sizeof(text), fmt, ap);
+	pthread_mutex_lock(&log_mutex);
+	if (log_stop) {
+		// async logging was disabled in the meantime
+		pthread_mutex_unlock(&log_mutex);
+		__android_log_write(prio, tag, text);
+		return;
+	}
+	if (log_written - log_read >= LOG_RING_SIZE) {
+		// never block caller on logcat
+		log_dropped++;
+		pthread_mutex_unlock(&log_mutex);
+		return;
+	}
+	message = &log_ring[log_written % LOG_RING_SIZE];
+	message->prio = prio;
+	message->tag = tag;
+	strcpy(message->text, text);
+	log_written++;
+	pthread_cond_signal(&log_cond);
+	pthread_mutex_unlock(&log_mutex);
+}
+
+void log_print(int prio, const char *tag, const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	log_vprint(prio, tag, fmt, ap);
+	va_end(ap);
+}
@@ -0,0 +1,70 @@
+/*
+ * log.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <stdarg.h>
+
+#include <android/log.h>
+
+/*
+ * Parts of the library with separately adjustable log levels, order is
+ * shared with FFmpegPlayer.LOG_* constants
+ */
+enum LogSubsystem {
+	// every subsystem except ffmpeg, only for log_set_level
+	LOG_SUBSYSTEM_ALL = -1,
+	LOG_SUBSYSTEM_PLAYER = 0,
+	// level in AV_LOG_* units
+	LOG_SUBSYSTEM_FFMPEG,
+	LOG_SUBSYSTEM_AES,
+	LOG_SUBSYSTEM_JNI,
+	LOG_SUBSYSTEM_RENDER,
+	LOG_SUBSYSTEM_TRACE,
+	LOG_SUBSYSTEMS_NB,
+};
+
+// calls above this level are compiled out
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL 10
+#endif
+
+extern volatile int log_levels[LOG_SUBSYSTEMS_NB];
+
+/*
+ * Checked before arguments of a message are evaluated, so disabled
+ * messages cost one load and compare
+ */
+#define LOG_ENABLED(subsystem, level) \
+	((level) <= LOG_MAX_LEVEL && (level) <= log_levels[subsystem])
+
+void log_set_level(enum LogSubsystem subsystem, int level);
+
+/*
+ * When enabled messages are formatted by the caller and written to logcat
+ * by a background thread, messages are dropped if the ring is full.
+ * Returns negative value if thread could not be started.
+ */
+int log_set_async(int async);
+
+void log_print(int prio, const char *tag, const char *fmt, ...)
+		__attribute__ ((format (printf, 3, 4)));
+void log_vprint(int prio, const char *tag, const char *fmt, va_list ap);
+
+#endif /* LOG_H_ */
@@ -0,0 +1,124 @@
+/*
+ * metrics.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+
+#define METRICS_FIRST_BUCKET_SHIFT 6
+
+#ifndef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8
+// no 64-bit atomics (armeabi, mips), updates of all players are locked
+#define METRICS_LOCKED
+static pthread_mutex_t metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+int64_t metrics_now_us() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000ll + now.tv_nsec / 1000;
+}
+
+void metrics_reset(struct Metrics *metrics) {
+#ifdef METRICS_LOCKED
+	pthread_mutex_lock(&metrics_mutex);
+	memset(metrics, 0, sizeof(*metrics));
+	pthread_mutex_unlock(&metrics_mutex);
+#else
+	memset(metrics, 0, sizeof(*metrics));
+	__sync_synchronize();
+#endif
+}
+
+static int metrics_bucket(int64_t time_us) {
+	int bucket;
+	if (time_us < (1 << METRICS_FIRST_BUCKET_SHIFT))
+		return 0;
+	// position of highest bit
+	bucket = 63 - __builtin_clzll((uint64_t) time_us)
+			- METRICS_FIRST_BUCKET_SHIFT + 1;
+	return bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1;
+}
+
+int64_t metrics_add_time(struct Metrics *metrics, enum MetricsStage stage,
+		int64_t start_us) {
+	struct MetricsHistogram *histogram = &metrics->stages[stage];
+	int64_t now = metrics_now_us();
+	int64_t time_us = now - start_us;
+	int64_t max;
+	if (time_us < 0)
+		time_us = 0;
+
+#ifdef METRICS_LOCKED
+	pthread_mutex_lock(&metrics_mutex);
+	histogram->count += 1;
+	histogram->sum_us += time_us;
+	histogram->buckets[metrics_bucket(time_us)] += 1;
+	if (histogram->max_us < time_us)
+		histogram->max_us = time_us;
+	pthread_mutex_unlock(&metrics_mutex);
+	(void) max;
+#else
+	__sync_fetch_and_add(&histogram->count, 1);
+	__sync_fetch_and_add(&histogram->sum_us, time_us);
+	__sync_fetch_and_add(&histogram->buckets[metrics_bucket(time_us)], 1);
+	while ((max = histogram->max_us) < time_us) {
+		if (__sync_bool_compare_and_swap(&histogram->max_us, max, time_us))
+			break;
+	}
+#endif
+	return now;
+}
+
+void metrics_count(struct Metrics *metrics, enum MetricsCounter counter,
+		int64_t value) {
+#ifdef METRICS_LOCKED
+	pthread_mutex_lock(&metrics_mutex);
+	metrics->counters[counter] += value;
+	pthread_mutex_unlock(&metrics_mutex);
+#else
+	__sync_fetch_and_add(&metrics->counters[counter], value);
+#endif
+}
+
+void metrics_snapshot(struct Metrics *metrics, int64_t *out) {
+	int stage, i;
+	*out++ = METRICS_SNAPSHOT_VERSION;
+	*out++ = METRICS_STAGES_NB;
+	*out++ = METRICS_BUCKETS;
+	*out++ = METRICS_COUNTERS_NB;
+	// values could be updated while copying, snapshot is not atomic
+#ifdef METRICS_LOCKED
+	pthread_mutex_lock(&metrics_mutex);
+#endif
+	for (stage = 0; stage < METRICS_STAGES_NB; ++stage) {
+		struct MetricsHistogram *histogram = &metrics->stages[stage];
+		*out++ = histogram->count;
+		*out++ = histogram->sum_us;
+		*out++ = histogram->max_us;
+		for (i = 0; i < METRICS_BUCKETS; ++i)
+			*out++ = histogram->buckets[i];
+	}
+	for (i = 0; i < METRICS_COUNTERS_NB; ++i)
+		*out++ = metrics->counters[i];
+#ifdef METRICS_LOCKED
+	pthread_mutex_unlock(&metrics_mutex);
+#endif
+}
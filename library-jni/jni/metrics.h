@@ -0,0 +1,101 @@
+/*
+ * metrics.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdint.h>
+
+/*
+ * Stages of playback measured by player, order is part of the snapshot
+ * format read by FFmpegStats.java
+ */
+enum MetricsStage {
+	METRICS_STAGE_DEMUX = 0,
+	METRICS_STAGE_DECODE,
+	METRICS_STAGE_CONVERT,
+	METRICS_STAGE_BLEND,
+	METRICS_STAGE_WINDOW_LOCK,
+	METRICS_STAGE_WINDOW_POST,
+	METRICS_STAGE_AUDIO_WRITE,
+	METRICS_STAGE_WAIT,
+	// mutex_queue hold time while taking window for a frame
+	METRICS_STAGE_QUEUE_LOCK,
+	METRICS_STAGES_NB,
+};
+
+enum MetricsCounter {
+	METRICS_COUNTER_DROPPED_FRAMES = 0,
+	METRICS_COUNTER_LATE_FRAMES,
+	METRICS_COUNTER_BYTES_READ,
+	// frames dropped by governor decimation
+	METRICS_COUNTER_DECIMATED_FRAMES,
+	METRICS_COUNTER_GOVERNOR_CHANGES,
+	// current governor level (changes are added)
+	METRICS_COUNTER_GOVERNOR_LEVEL,
+	METRICS_COUNTERS_NB,
+};
+
+// bucket 0 is below 64us, bucket i is [2^(i+5), 2^(i+6)) us, last is open
+#define METRICS_BUCKETS 16
+#define METRICS_SNAPSHOT_VERSION 1
+
+struct MetricsHistogram {
+	int64_t count;
+	int64_t sum_us;
+	int64_t max_us;
+	int64_t buckets[METRICS_BUCKETS];
+};
+
+/*
+ * Always enabled playback statistics. Updates are lock free (locked on
+ * abis without 64-bit atomics) so they could be done from any player
+ * thread.
+ */
+struct Metrics {
+	struct MetricsHistogram stages[METRICS_STAGES_NB];
+	int64_t counters[METRICS_COUNTERS_NB];
+};
+
+// number of longs written by metrics_snapshot
+#define METRICS_SNAPSHOT_SIZE (4 + METRICS_STAGES_NB * (3 + METRICS_BUCKETS) \
+		+ METRICS_COUNTERS_NB)
+
+int64_t metrics_now_us();
+
+void metrics_reset(struct Metrics *metrics);
+
+/*
+ * Adds time from start_us to now to the stage histogram, returns now so
+ * consecutive stages could be measured with one clock read
+ */
+int64_t metrics_add_time(struct Metrics *metrics, enum MetricsStage stage,
+		int64_t start_us);
+
+void metrics_count(struct Metrics *metrics, enum MetricsCounter counter,
+		int64_t value);
+
+/*
+ * Writes METRICS_SNAPSHOT_SIZE values:
+ * version, stages number, buckets number, counters number,
+ * for every stage: count, sum_us, max_us, buckets,
+ * counters
+ */
+void metrics_snapshot(struct Metrics *metrics, int64_t *out);
+
+#endif /* METRICS_H_ */
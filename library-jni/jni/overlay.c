@@ -0,0 +1,336 @@
+/*
+ * overlay.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <android/log.h>
+#include <limits.h>
+#include <string.h>
+#include <libavutil/common.h>
+#include <libavutil/mem.h>
+
+#include "blend.h"
+#include "overlay.h"
+#include "log.h"
+
+#define LOG_TAG "overlay.c"
+#define LOG_SUBSYSTEM LOG_SUBSYSTEM_RENDER
+#define LOGI(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
+#define LOGE(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
+
+#define FALSE 0
+#define TRUE (!(FALSE))
+
+// transparent gaps shorter than this do not split spans
+#define SPAN_MIN_GAP 8
+
+#define AR(c)  ( (c)>>24)
+#define AG(c)  (((c)>>16)&0xFF)
+#define AB(c)  (((c)>>8) &0xFF)
+#define AA(c)  ((0xFF-c) &0xFF)
+
+void overlay_init(struct SubtitleOverlay *overlay) {
+	memset(overlay, 0, sizeof(*overlay));
+}
+
+void overlay_free(struct SubtitleOverlay *overlay) {
+	if (overlay->pixels != NULL) {
+		av_free(overlay->pixels);
+		overlay->pixels = NULL;
+	}
+	overlay->capacity = 0;
+	overlay->width = 0;
+	overlay->height = 0;
+	overlay->valid = FALSE;
+}
+
+void overlay_invalidate(struct SubtitleOverlay *overlay) {
+	overlay->valid = FALSE;
+}
+
+static void overlay_compose_image(struct SubtitleOverlay *overlay,
+		const ASS_Image *image) {
+	// same color interpretation as blend_ass_image
+	uint8_t color_r = AR(image->color);
+	uint8_t color_g = AG(image->color);
+	uint8_t color_b = AB(image->color);
+	uint8_t alpha = AA(image->color);
+	const uint8_t *src = image->bitmap;
+	uint32_t *dst = overlay->pixels
+			+ (image->dst_y - overlay->y) * overlay->width
+			+ (image->dst_x - overlay->x);
+	int x, y;
+
+	for (y = 0; y < image->h; y++) {
+		for (x = 0; x < image->w; x++) {
+			uint8_t m = src[x];
+			int a = m & alpha;
+			if (a == 0)
+				continue;
+			int ia = 0xff - a;
+			uint32_t o = dst[x];
+			uint32_t c0 = blend_div255((m & color_b) * a)
+					+ blend_div255((o & 0xff) * ia);
+			uint32_t c1 = blend_div255((m & color_g) * a)
+					+ blend_div255(((o >> 8) & 0xff) * ia);
+			uint32_t c2 = blend_div255((m & color_r) * a)
+					+ blend_div255(((o >> 16) & 0xff) * ia);
+			uint32_t ca = a + blend_div255((o >> 24) * ia);
+			dst[x] = (ca << 24) | (c2 << 16) | (c1 << 8) | c0;
+		}
+		src += image->stride;
+		dst += overlay->width;
+	}
+}
+
+int overlay_compose_ass(struct SubtitleOverlay *overlay,
+		const ASS_Image *image) {
+	const ASS_Image *it;
+	int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+
+	for (it = image; it != NULL; it = it->next) {
+		if (it->w <= 0 || it->h <= 0)
+			continue;
+		x0 = FFMIN(x0, it->dst_x);
+		y0 = FFMIN(y0, it->dst_y);
+		x1 = FFMAX(x1, it->dst_x + it->w);
+		y1 = FFMAX(y1, it->dst_y + it->h);
+	}
+	overlay->valid = TRUE;
+	if (x0 >= x1 || y0 >= y1) {
+		overlay->width = 0;
+		overlay->height = 0;
+		return 0;
+	}
+
+	int size = (x1 - x0) * (y1 - y0);
+	if (size > overlay->capacity) {
+		if (overlay->pixels != NULL)
+			av_free(overlay->pixels);
+		overlay->pixels = av_malloc(size * sizeof(uint32_t));
+		if (overlay->pixels == NULL) {
+			LOGE(1, "overlay_compose_ass could not allocate %dx%d overlay",
+					x1 - x0, y1 - y0);
+			overlay->capacity = 0;
+			overlay->width = 0;
+			overlay->height = 0;
+			overlay->valid = FALSE;
+			return -1;
+		}
+		overlay->capacity = size;
+	}
+	overlay->x = x0;
+	overlay->y = y0;
+	overlay->width = x1 - x0;
+	overlay->height = y1 - y0;
+	memset(overlay->pixels, 0, size * sizeof(uint32_t));
+
+	for (it = image; it != NULL; it = it->next) {
+		if (it->w <= 0 || it->h <= 0)
+			continue;
+		overlay_compose_image(overlay, it);
+	}
+	LOGI(7, "overlay_compose_ass overlay: (%d,%d) %dx%d",
+			overlay->x, overlay->y, overlay->width, overlay->height);
+	return 1;
+}
+
+int overlay_render_ass(struct SubtitleOverlay *overlay, ASS_Renderer *renderer,
+		ASS_Track *track, long long time_ms) {
+	int changed = 0;
+	ASS_Image *image = ass_render_frame(renderer, track, time_ms, &changed);
+	if (overlay->valid && changed == 0)
+		return 0;
+	// libass does not report which images changed, so whole bounding box
+	// is composed again
+	return overlay_compose_ass(overlay, image);
+}
+
+void overlay_blend(AVPicture *dest, const struct SubtitleOverlay *overlay,
+		int imgw, int imgh, enum PixelFormat pixel_format) {
+	const struct BlendKernels *kernels;
+	int x0, y0, x1, y1, y;
+	uint8_t *dst;
+	const uint32_t *src;
+
+	if (pixel_format != PIX_FMT_RGBA)
+		return;
+	if (overlay->width == 0 || overlay->height == 0)
+		return;
+
+	// overlay could be composed for previous frame geometry
+	x0 = FFMAX(overlay->x, 0);
+	y0 = FFMAX(overlay->y, 0);
+	x1 = FFMIN(overlay->x + overlay->width, imgw);
+	y1 = FFMIN(overlay->y + overlay->height, imgh);
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	kernels = blend_get_kernels();
+	dst = dest->data[0] + y0 * dest->linesize[0] + x0 * 4;
+	src = overlay->pixels + (y0 - overlay->y) * overlay->width
+			+ (x0 - overlay->x);
+	for (y = y0; y < y1; y++) {
+		kernels->row_premul((uint32_t *) dst, src, x1 - x0);
+		dst += dest->linesize[0];
+		src += overlay->width;
+	}
+}
+
+void bitmap_overlay_init(struct BitmapOverlay *overlay) {
+	memset(overlay, 0, sizeof(*overlay));
+}
+
+void bitmap_overlay_free(struct BitmapOverlay *overlay) {
+	if (overlay->pixels != NULL)
+		av_free(overlay->pixels);
+	if (overlay->spans != NULL)
+		av_free(overlay->spans);
+	bitmap_overlay_init(overlay);
+}
+
+/*
+ * Finds spans in rect row, fills them when spans is not NULL and
+ * advances pixels counter. Returns number of spans.
+ */
+static int bitmap_overlay_row_spans(const AVSubtitleRect *rect, int y,
+		struct OverlaySpan *spans, int *pixels) {
+	const uint8_t *src = rect->pict.data[0] + y * rect->pict.linesize[0];
+	const uint32_t *pal = (const uint32_t *) rect->pict.data[1];
+	int nb_spans = 0;
+	int x = 0;
+
+	while (x < rect->w) {
+		int start, end, gap;
+		while (x < rect->w && (pal[src[x]] >> 24) == 0)
+			x++;
+		if (x >= rect->w)
+			break;
+		start = x;
+		end = x;
+		gap = 0;
+		for (; x < rect->w; x++) {
+			if ((pal[src[x]] >> 24) != 0) {
+				end = x + 1;
+				gap = 0;
+			} else if (++gap >= SPAN_MIN_GAP) {
+				break;
+			}
+		}
+		if (spans != NULL) {
+			struct OverlaySpan *span = &spans[nb_spans];
+			span->x = rect->x + start;
+			span->y = rect->y + y;
+			span->width = end - start;
+			span->offset = *pixels;
+		}
+		*pixels += end - start;
+		nb_spans++;
+	}
+	return nb_spans;
+}
+
+static void bitmap_overlay_fill_span(const AVSubtitleRect *rect,
+		const struct OverlaySpan *span, uint32_t *dst) {
+	const uint8_t *src = rect->pict.data[0]
+			+ (span->y - rect->y) * rect->pict.linesize[0]
+			+ (span->x - rect->x);
+	const uint32_t *pal = (const uint32_t *) rect->pict.data[1];
+	int x;
+
+	for (x = 0; x < span->width; x++) {
+		uint32_t v = pal[src[x]];
+		int a = v >> 24;
+		if (a == 0) {
+			dst[x] = 0;
+			continue;
+		}
+		uint32_t c0 = blend_div255((v & 0xff) * a);
+		uint32_t c1 = blend_div255(((v >> 8) & 0xff) * a);
+		uint32_t c2 = blend_div255(((v >> 16) & 0xff) * a);
+		dst[x] = (a << 24) | (c2 << 16) | (c1 << 8) | c0;
+	}
+}
+
+int bitmap_overlay_from_subtitle(struct BitmapOverlay *overlay,
+		const AVSubtitle *sub) {
+	int nb_spans = 0;
+	int nb_pixels = 0;
+	int i, y;
+
+	bitmap_overlay_init(overlay);
+	for (i = 0; i < sub->num_rects; i++) {
+		const AVSubtitleRect *rect = sub->rects[i];
+		if (rect->type != SUBTITLE_BITMAP)
+			continue;
+		for (y = 0; y < rect->h; y++)
+			nb_spans += bitmap_overlay_row_spans(rect, y, NULL, &nb_pixels);
+	}
+	if (nb_spans == 0)
+		return 0;
+
+	overlay->spans = av_malloc(nb_spans * sizeof(struct OverlaySpan));
+	overlay->pixels = av_malloc(nb_pixels * sizeof(uint32_t));
+	if (overlay->spans == NULL || overlay->pixels == NULL) {
+		LOGE(1, "bitmap_overlay_from_subtitle could not allocate %d spans",
+				nb_spans);
+		bitmap_overlay_free(overlay);
+		return -1;
+	}
+
+	nb_pixels = 0;
+	for (i = 0; i < sub->num_rects; i++) {
+		const AVSubtitleRect *rect = sub->rects[i];
+		if (rect->type != SUBTITLE_BITMAP)
+			continue;
+		for (y = 0; y < rect->h; y++) {
+			struct OverlaySpan *first = &overlay->spans[overlay->nb_spans];
+			int count = bitmap_overlay_row_spans(rect, y, first, &nb_pixels);
+			int span_no;
+			for (span_no = 0; span_no < count; span_no++) {
+				bitmap_overlay_fill_span(rect, &first[span_no],
+						overlay->pixels + first[span_no].offset);
+			}
+			overlay->nb_spans += count;
+		}
+	}
+	overlay->size = nb_spans * sizeof(struct OverlaySpan)
+			+ nb_pixels * sizeof(uint32_t);
+	LOGI(7, "bitmap_overlay_from_subtitle %d spans, %d pixels",
+			nb_spans, nb_pixels);
+	return 0;
+}
+
+void bitmap_overlay_blend(AVPicture *dest, const struct BitmapOverlay *overlay,
+		int imgw, int imgh, enum PixelFormat pixel_format) {
+	const struct BlendKernels *kernels;
+	int i;
+
+	if (pixel_format != PIX_FMT_RGBA)
+		return;
+
+	kernels = blend_get_kernels();
+	for (i = 0; i < overlay->nb_spans; i++) {
+		const struct OverlaySpan *span = &overlay->spans[i];
+		int x0 = FFMAX(span->x, 0);
+		int x1 = FFMIN(span->x + span->width, imgw);
+		if (span->y < 0 || span->y >= imgh || x0 >= x1)
+			continue;
+		uint8_t *dst = dest->data[0] + span->y * dest->linesize[0] + x0 * 4;
+		kernels->row_premul((uint32_t *) dst,
+				overlay->pixels + span->offset + (x0 - span->x), x1 - x0);
+	}
+}
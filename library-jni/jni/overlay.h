@@ -0,0 +1,107 @@
+/*
+ * overlay.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef OVERLAY_H_
+#define OVERLAY_H_
+
+#include <libavcodec/avcodec.h>
+#include <ass/ass.h>
+
+/*
+ * Pre-composited subtitle image kept only for its bounding box.
+ * Pixels are premultiplied with the same byte order as the blend
+ * functions write to the destination.
+ */
+struct SubtitleOverlay {
+	uint32_t *pixels;
+	int capacity;
+
+	// bounding box in destination coordinates, empty when width == 0
+	int x;
+	int y;
+	int width;
+	int height;
+
+	// FALSE when overlay has to be rebuilt regardless of libass changes
+	int valid;
+};
+
+void overlay_init(struct SubtitleOverlay *overlay);
+void overlay_free(struct SubtitleOverlay *overlay);
+
+/*
+ * Forces rebuild on next overlay_render_ass call
+ */
+void overlay_invalidate(struct SubtitleOverlay *overlay);
+
+/*
+ * Renders track at time_ms, composing images into overlay only if libass
+ * reports a change or overlay was invalidated.
+ * Has to be called with renderer lock held.
+ * Returns 1 when overlay was rebuilt, 0 when unchanged and negative
+ * value on memory allocation error.
+ */
+int overlay_render_ass(struct SubtitleOverlay *overlay, ASS_Renderer *renderer,
+		ASS_Track *track, long long time_ms);
+
+/*
+ * Composes images list into overlay
+ */
+int overlay_compose_ass(struct SubtitleOverlay *overlay,
+		const ASS_Image *image);
+
+void overlay_blend(AVPicture *dest, const struct SubtitleOverlay *overlay,
+		int imgw, int imgh, enum PixelFormat pixel_format);
+
+/*
+ * Run of non transparent pixels in destination coordinates
+ */
+struct OverlaySpan {
+	int x;
+	int y;
+	int width;
+	// index of first pixel in BitmapOverlay.pixels
+	int offset;
+};
+
+/*
+ * Bitmap subtitle (dvb, pgs, ...) converted once into premultiplied
+ * pixels, stored only for its non transparent spans
+ */
+struct BitmapOverlay {
+	uint32_t *pixels;
+	struct OverlaySpan *spans;
+	int nb_spans;
+	// memory used by pixels and spans
+	size_t size;
+};
+
+void bitmap_overlay_init(struct BitmapOverlay *overlay);
+void bitmap_overlay_free(struct BitmapOverlay *overlay);
+
+/*
+ * Converts all SUBTITLE_BITMAP rects of sub. Returns 0 on success or
+ * negative value on memory allocation error.
+ */
+int bitmap_overlay_from_subtitle(struct BitmapOverlay *overlay,
+		const AVSubtitle *sub);
+
+void bitmap_overlay_blend(AVPicture *dest, const struct BitmapOverlay *overlay,
+		int imgw, int imgh, enum PixelFormat pixel_format);
+
+#endif /* OVERLAY_H_ */
@@ -40,6 +40,7 @@
 
 #include <jni.h>
 #include <pthread.h>
+#include <unistd.h>
 
 /* Android profiler */
 #ifdef PROFILER
@@ -51,18 +52,26 @@
 #include "convert.h"
 #include "helpers.h"
 #include "queue.h"
+#include "render.h"
 #include "player.h"
 #include "jni-protocol.h"
 #include "aes-protocol.h"
+#include "checksum.h"
+#include "executor.h"
+#include "governor.h"
+#include "frame_cache.h"
+#include "extract.h"
+#include "log.h"
+#include "metrics.h"
 #include "sync.h"
+#include "trace.h"
 
-#define FFMPEG_LOG_LEVEL AV_LOG_WARNING
-#define LOG_LEVEL 2
+#define LOG_SUBSYSTEM LOG_SUBSYSTEM_PLAYER
 #define LOG_TAG "player.c"
-#define LOG(...) {__android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
-#define LOGI(level, ...) if (level <= LOG_LEVEL) {__android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
-#define LOGE(level, ...) if (level <= LOG_LEVEL + 10) {__android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
-#define LOGW(level, ...) if (level <= LOG_LEVEL + 5) {__android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__);}
+#define LOG(...) {log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
+#define LOGI(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
+#define LOGE(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, (level) - 10)) {log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
+#define LOGW(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, (level) - 5)) {log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__);}
 
 #define FALSE 0
 #define TRUE (!(FALSE))
@@ -71,6 +80,7 @@
 
 #ifdef SUBTITLES
 #include "blend.h"
+#include "overlay.h"
 #include <ass/ass.h>
 #endif // SUBTITLES
 #define DO_NOT_SEEK -1
@@ -80,24 +90,26 @@
 
 #define AUDIO_TIME_ADJUST_US -200000ll
 
-//#define MEASURE_TIME
+// video frames shown later than that are counted as late
+#define LATE_FRAME_US 40000ll
+
+// media time between key frames shown in trick play is rate times that,
+// so at most 8 key frames per second are read whatever the rate is
+#define TRICK_FRAME_US 125000ll
+// largest trick play rate, both directions
+#define TRICK_MAX_RATE 64
+// reverse playback at normal speed, whole GOPs are decoded and presented
+// from their end
+#define TRICK_RATE_REVERSE -1
+// memory of decoded frames of both GOPs in reverse playback
+#define REVERSE_CACHE_DEFAULT_MB 64
+#define REVERSE_CACHE_MAX_SCALE 2
+
+// packets read by one run of demux task before other tasks get a chance
+#define DEMUX_TASK_PACKETS 16
+// demux workers per core, av_read_frame could block on network
+#define IO_WORKERS_PER_CORE 2
 
-#ifdef MEASURE_TIME
-struct timespec render_frame_start, render_frame_stop;
-
-// http://www.guyrutenberg.com/2007/09/22/profiling-code-using-clock_gettime/
-struct timespec timespec_diff(struct timespec start, struct timespec end) {
-	struct timespec temp;
-	if ((end.tv_nsec - start.tv_nsec) < 0) {
-		temp.tv_sec = end.tv_sec - start.tv_sec - 1;
-		temp.tv_nsec = 1000000000 + end.tv_nsec - start.tv_nsec;
-	} else {
-		temp.tv_sec = end.tv_sec - start.tv_sec;
-		temp.tv_nsec = end.tv_nsec - start.tv_nsec;
-	}
-	return temp;
-}
-#endif // MEASURE_TIME
 void player_print_codec_description(const struct AVCodec *codec) {
 	char *type = "???";
 	switch (codec->type) {
@@ -135,10 +147,74 @@ struct SubtitleElem {
 	AVSubtitle subtitle;
 	int64_t start_time;
 	int64_t stop_time;
+#ifdef SUBTITLES
+	// bitmap rects converted on first use, subtitle is freed then
+	struct BitmapOverlay overlay;
+	int overlay_converted;
+	// bytes accounted in Player.subtitles_bytes
+	size_t size;
+#endif // SUBTITLES
+};
+
+#ifdef SUBTITLES
+
+// number of ass overlays rendered ahead of presentation
+#define SUBTITLE_OVERLAYS 4
+// how far ahead of the last decoded video frame ass is rendered
+#define SUBTITLE_RENDER_AHEAD_MS 1000ll
+#define SUBTITLE_DEFAULT_FRAME_MS 40
+
+enum SubtitleOverlayState {
+	SUBTITLE_OVERLAY_FREE = 0,
+	SUBTITLE_OVERLAY_RENDERING,
+	SUBTITLE_OVERLAY_READY,
+	SUBTITLE_OVERLAY_IN_USE,
+};
+
+struct SubtitleOverlaySlot {
+	struct SubtitleOverlay overlay;
+	enum SubtitleOverlayState state;
+	// overlay is valid for [start_ms, end_ms)
+	int64_t start_ms;
+	int64_t end_ms;
+};
+
+// who called ass_render_frame last - detect_change is only meaningful
+// for consecutive calls of the same user
+enum AssRendererUser {
+	ASS_RENDERER_USER_NONE = 0,
+	ASS_RENDERER_USER_VIDEO,
+	ASS_RENDERER_USER_RENDER_THREAD,
+};
+
+#endif // SUBTITLES
+
+enum PacketTrick {
+	PACKET_TRICK_NONE = 0,
+	// key frame queued in trick play, decoded on its own
+	PACKET_TRICK_KEY_FRAME,
+	// key frame starting GOP in reverse playback
+	PACKET_TRICK_GOP_START,
+	// following packets of that GOP
+	PACKET_TRICK_GOP,
+};
+
+/*
+ * Input move of trick play planned with mutex_queue held and done by the
+ * demuxer after unlocking, av_seek_frame could block on network
+ */
+struct TrickJump {
+	// in time base of the stream, AV_NOPTS_VALUE when nothing is planned
+	int64_t target;
+	int stream_index;
+	int flags;
+	// trick play ends when input could not be moved
+	int end_on_error;
 };
 
 struct PacketData {
 	int end_of_stream;
+	enum PacketTrick trick;
 	AVPacket *packet;
 };
 
@@ -155,6 +231,20 @@ struct DecoderData {
 
 #define MAX_STREAMS 3
 
+enum DemuxState {
+	DEMUX_STATE_READ = 0,
+	DEMUX_STATE_WAIT_FLUSH,
+	DEMUX_STATE_END_OF_STREAM,
+	DEMUX_STATE_WAIT_STOP,
+	DEMUX_STATE_DONE,
+};
+
+enum DemuxPending {
+	DEMUX_PENDING_NONE = 0,
+	DEMUX_PENDING_PACKET,
+	DEMUX_PENDING_END_OF_STREAM,
+};
+
 struct Player {
 	JavaVM *get_javavm;
 	jobject thiz;
@@ -162,6 +252,15 @@ struct Player {
 	ANativeWindow* window;
 	AVFrame *rgb_frame;
 
+	// cached window configuration - only renegotiated when the window,
+	// its buffer format or the video geometry changes
+	int window_changed;
+	int window_format;
+	int window_bytes_per_pixel;
+	enum PixelFormat out_format;
+	int video_width;
+	int video_height;
+
 	AVFrame *tmp_frame;
 	uint8_t *tmp_buffer;
 	AVFrame *tmp_frame2;
@@ -221,6 +320,8 @@ struct Player {
 	pthread_cond_t cond_queue;
 	Queue *packets[MAX_STREAMS];
 	Queue *subtitles_queue;
+	// memory held by queued subtitles, guarded by mutex_queue
+	size_t subtitles_bytes;
 
 	int pause;
 	int stop;
@@ -236,17 +337,110 @@ struct Player {
 	int thread_player_read_from_stream_created;
 	int decode_threads_created[MAX_STREAMS];
 
+	// shared executor mode, set from "executor" data source option.
+	// Demuxing and video decoding run as tasks on process wide workers
+	// instead of own threads, audio and subtitles keep their threads.
+	int shared;
+	int shared_priority;
+	int shared_tasks_created;
+	struct ExecutorTask demux_task;
+	struct ExecutorTask video_task;
+	struct DecoderData video_decoder_data;
+	// guarded by mutex_queue
+	enum DemuxState demux_state;
+	enum DemuxPending demux_pending;
+	AVPacket demux_packet;
+	// packet which frame is waiting for its time, only used by video_task
+	struct PacketData *video_packet_data;
+	int64_t video_frame_time;
+	int video_frame_checked;
+	int video_task_stopped;
+
+	// decode governor, disabled by "governor" = "0" and in checksum mode.
+	// Level applied to the video decoder, decode time of the last frame
+	// and number of decoded frames, only used by video decoding.
+	struct GovernorClient governor;
+	int governor_level;
+	int64_t governor_cost_us;
+	unsigned int governor_frame_no;
+
 	int64_t audio_clock;
 
 	int64_t start_time;
 	int64_t pause_time;
 
+	// trick play, guarded by mutex_queue. trick_rate is 0 for normal
+	// playback, otherwise only video key frames are read and the clock
+	// runs trick_rate times faster (backward when negative) from
+	// trick_base_time at trick_start_time. trick_rate_requested is applied
+	// by the next seek. trick_position is time of the last queued key
+	// frame, trick_end is set when there is none further. In reverse
+	// playback trick_in_gop is set while GOP starting with key frame at
+	// trick_gop_time is read. trick_jump is only used by the demuxer.
+	int trick_rate;
+	int trick_rate_requested;
+	int64_t trick_base_time;
+	int64_t trick_start_time;
+	int64_t trick_position;
+	int trick_end;
+	int trick_in_gop;
+	int64_t trick_gop_time;
+	struct TrickJump trick_jump;
+
+	// reverse playback, only used by video decoding. GOP being decoded is
+	// put to reverse_caches[reverse_filling] while the other one is
+	// presented from its end. Frames of GOP before reverse_gop_start and
+	// from reverse_limit on (already shown) are not kept. Budget and scale
+	// are set from "reverse_cache_mb" and "reverse_cache_scale" options.
+	struct FrameCache reverse_caches[2];
+	int reverse_filling;
+	int reverse_filling_started;
+	int64_t reverse_gop_start;
+	int64_t reverse_limit;
+	int reverse_frame_checked;
+	int reverse_cache_mb;
+	int reverse_cache_scale;
+
+	struct Metrics metrics;
+
+	// checksum verification mode, set from "checksum_log" and
+	// "checksum_present" data source options, constant while playing
+	FILE *checksum_file;
+	int checksum_present;
+	// render target used instead of window when frames are not presented
+	AVFrame *headless_frame;
+	uint8_t *headless_buffer;
+	// "free_run" data source option, frames and audio are presented as
+	// soon as they are decoded, constant while playing
+	int free_run;
+
 #ifdef SUBTITLES
 	int subtitle_stream_no;
 	ASS_Library * ass_library;
 	ASS_Renderer * ass_renderer;
 	ASS_Track * ass_track;
+	// last ass frame rendered by video thread, guarded by mutex_ass
+	struct SubtitleOverlay ass_overlay;
+	enum AssRendererUser ass_renderer_user;
 	pthread_mutex_t mutex_ass;
+
+	// ass frames rendered ahead by thread_subtitle_render,
+	// guarded by mutex_overlays (taken after mutex_ass if both needed)
+	struct SubtitleOverlaySlot subtitle_overlays[SUBTITLE_OVERLAYS];
+	pthread_mutex_t mutex_overlays;
+	pthread_cond_t cond_overlays;
+	pthread_t thread_subtitle_render;
+	int thread_subtitle_render_created;
+	int subtitle_render_stop;
+	// time of last decoded video frame
+	int64_t subtitle_clock_ms;
+	// next time to render
+	int64_t subtitle_render_ms;
+	int subtitle_frame_ms;
+	// slot that could be extended when libass reports no change
+	int subtitle_last_slot;
+	// increased on every invalidation of ahead rendered overlays
+	int ass_generation;
 #endif // SUBTITLES
 };
 
@@ -327,6 +521,7 @@ enum PlayerErrors {
 	ERROR_COULD_NOT_CREATE_PTHREAD,
 	ERROR_COULD_NOT_DESTROY_PTHREAD_ATTR,
 	ERROR_COULD_NOT_ALLOCATE_MEMORY,
+	ERROR_COULD_NOT_OPEN_CHECKSUM_LOG,
 };
 
 #define AV_LOG_QUIET    -8
@@ -339,7 +534,7 @@ enum PlayerErrors {
 #define AV_LOG_DEBUG    48
 
 void ffmpeg_log_callback(void* avcl, int level, const char* fmt, va_list vl) {
-	if (level > av_log_get_level())
+	if (level > log_levels[LOG_SUBSYSTEM_FFMPEG])
 		return;
 	int andriod_level = ANDROID_LOG_DEFAULT;
 	if (level > AV_LOG_DEBUG) {
@@ -359,7 +554,7 @@ void ffmpeg_log_callback(void* avcl, int level, const char* fmt, va_list vl) {
 	} else if (level > AV_LOG_QUIET) {
 		andriod_level = ANDROID_LOG_SILENT;
 	}
-	__android_log_vprint(andriod_level, "ffmpeg", fmt, vl);
+	log_vprint(andriod_level, "ffmpeg", fmt, vl);
 }
 
 void throw_exception(JNIEnv *env, const char * exception_class_path_name,
@@ -425,7 +620,11 @@ int player_decode_audio(struct DecoderData * decoder_data, JNIEnv * env,
 
 	// Some videos will not decode the entire next frame once and will require multiple decoding
 	do {
+		int64_t decode_start = metrics_now_us();
+		TRACE_BEGIN("decode", stream_no, TRACE_NO_PTS);
 		int len = avcodec_decode_audio4(ctx, frame, &got_frame_ptr, packet);
+		TRACE_END("decode", stream_no, TRACE_NO_PTS);
+		metrics_add_time(&player->metrics, METRICS_STAGE_DECODE, decode_start);
 		if (len >= 0) {
 			packet->dts = packet->pts = AV_NOPTS_VALUE;
 			if (packet->data) {
@@ -485,16 +684,55 @@ int player_decode_audio(struct DecoderData * decoder_data, JNIEnv * env,
 	}
 	return 0;
 }
+#ifdef SUBTITLES
+static size_t player_subtitle_size(const AVSubtitle *sub) {
+	size_t size = 0;
+	int i;
+	for (i = 0; i < sub->num_rects; i++) {
+		const AVSubtitleRect *rect = sub->rects[i];
+		size += sizeof(AVSubtitleRect);
+		if (rect->type == SUBTITLE_BITMAP) {
+			size += rect->pict.linesize[0] * rect->h;
+			size += rect->nb_colors * sizeof(uint32_t);
+		}
+		if (rect->text != NULL)
+			size += strlen(rect->text);
+		if (rect->ass != NULL)
+			size += strlen(rect->ass);
+	}
+	return size;
+}
+
+static void player_free_subtitle_elem_already_locked(struct Player *player,
+		struct SubtitleElem *elem) {
+	player->subtitles_bytes -= elem->size;
+	elem->size = 0;
+	avsubtitle_free(&elem->subtitle);
+	bitmap_overlay_free(&elem->overlay);
+	elem->overlay_converted = FALSE;
+}
+#endif // SUBTITLES
+
+static void player_reverse_flush(struct Player *player) {
+	frame_cache_clear(&player->reverse_caches[0]);
+	frame_cache_clear(&player->reverse_caches[1]);
+	player->reverse_filling_started = FALSE;
+	player->reverse_frame_checked = FALSE;
+	// reverse playback starts from the seek position
+	player->reverse_limit = player->trick_base_time;
+}
+
 void player_decode_video_flush(struct DecoderData * decoder_data, JNIEnv * env) {
 	struct Player *player = decoder_data->player;
 	LOGI(2, "player_decode_video_flush flushing");
+	player_reverse_flush(player);
 
 #ifdef SUBTITLES
 	if (player->subtitle_stream_no >= 0) {
 		struct SubtitleElem * subtitle = NULL;
 		while ((subtitle = queue_pop_start_already_locked_non_block(
 				player->subtitles_queue)) != NULL) {
-			avsubtitle_free(&subtitle->subtitle);
+			player_free_subtitle_elem_already_locked(player, subtitle);
 			queue_pop_finish_already_locked(player->subtitles_queue,
 					&player->mutex_queue, &player->cond_queue);
 		}
@@ -503,7 +741,7 @@ void player_decode_video_flush(struct DecoderData * decoder_data, JNIEnv * env)
 }
 #ifdef SUBTITLES
 static void player_print_subtitle(AVSubtitle *sub, int64_t time) {
-	if (LOG_LEVEL >= 4)
+	if (!LOG_ENABLED(LOG_SUBSYSTEM, 4))
 		return;
 	LOG("player_decode_subtitles pts: %fd", time / 1000000.0);
 	LOG("player_decode_subtitles sub.format: %d", sub->format);
@@ -535,21 +773,63 @@ static void player_print_subtitle(AVSubtitle *sub, int64_t time) {
 		}
 		LOG("player_decode_subtitles --rect->type = %s", type);
 	}
-	LOG("player_decode_subtitles sub.pts: %d", sub->pts);
+	LOG("player_decode_subtitles sub.pts: %" PRId64, sub->pts);
+}
+/*
+ * Drops ahead rendered ass overlays from from_ms on.
+ * Overlays starting earlier are shortened so they are still used.
+ */
+static void player_invalidate_overlays_already_locked(struct Player *player,
+		int64_t from_ms) {
+	int i;
+	player->ass_generation++;
+	for (i = 0; i < SUBTITLE_OVERLAYS; ++i) {
+		struct SubtitleOverlaySlot *slot = &player->subtitle_overlays[i];
+		if (slot->state != SUBTITLE_OVERLAY_READY
+				&& slot->state != SUBTITLE_OVERLAY_IN_USE)
+			continue;
+		if (slot->end_ms <= from_ms)
+			continue;
+		if (slot->start_ms >= from_ms) {
+			slot->end_ms = slot->start_ms;
+			if (slot->state == SUBTITLE_OVERLAY_READY)
+				slot->state = SUBTITLE_OVERLAY_FREE;
+		} else {
+			slot->end_ms = from_ms;
+		}
+	}
+	if (player->subtitle_render_ms != AV_NOPTS_VALUE
+			&& player->subtitle_render_ms > from_ms) {
+		player->subtitle_render_ms = from_ms;
+		if (player->subtitle_clock_ms != AV_NOPTS_VALUE
+				&& player->subtitle_render_ms < player->subtitle_clock_ms)
+			player->subtitle_render_ms = player->subtitle_clock_ms;
+	}
+	player->subtitle_last_slot = -1;
+	pthread_cond_broadcast(&player->cond_overlays);
 }
+
 void player_decode_subtitles_flush(struct DecoderData * decoder_data,
 		JNIEnv * env) {
 	struct Player *player = decoder_data->player;
 
 	pthread_mutex_lock(&player->mutex_ass);
 	ass_flush_events(player->ass_track);
+	overlay_invalidate(&player->ass_overlay);
+	player->ass_renderer_user = ASS_RENDERER_USER_NONE;
 	pthread_mutex_unlock(&player->mutex_ass);
 
+	pthread_mutex_lock(&player->mutex_overlays);
+	player_invalidate_overlays_already_locked(player, INT64_MIN);
+	player->subtitle_clock_ms = AV_NOPTS_VALUE;
+	player->subtitle_render_ms = AV_NOPTS_VALUE;
+	pthread_mutex_unlock(&player->mutex_overlays);
+
 	if (player->subtitle_stream_no >= 0) {
 		struct SubtitleElem * subtitle = NULL;
 		while ((subtitle = queue_pop_start_already_locked_non_block(
 				player->subtitles_queue)) != NULL) {
-			avsubtitle_free(&subtitle->subtitle);
+			player_free_subtitle_elem_already_locked(player, subtitle);
 			queue_pop_finish_already_locked(player->subtitles_queue,
 					&player->mutex_queue, &player->cond_queue);
 		}
@@ -599,13 +879,25 @@ int player_decode_subtitles(struct DecoderData * decoder_data, JNIEnv * env,
 	}
 
 	int rect_no;
+	int64_t changed_from_ms = INT64_MAX;
 	pthread_mutex_lock(&player->mutex_ass);
 	for (rect_no = 0; rect_no < sub.num_rects; ++rect_no) {
 		AVSubtitleRect *rect = sub.rects[rect_no];
 		if (rect->type != SUBTITLE_ASS)
 			continue;
 		LOGI(3, "player_decode_video_subtitles: ass: %s", rect->ass);
+		int event_no = player->ass_track->n_events;
 		ass_process_data(player->ass_track, rect->ass, strlen(rect->ass));
+		for (; event_no < player->ass_track->n_events; ++event_no) {
+			ASS_Event *event = &player->ass_track->events[event_no];
+			changed_from_ms = FFMIN(changed_from_ms, event->Start);
+		}
+	}
+	if (changed_from_ms != INT64_MAX) {
+		// new events could be visible in already rendered overlays
+		pthread_mutex_lock(&player->mutex_overlays);
+		player_invalidate_overlays_already_locked(player, changed_from_ms);
+		pthread_mutex_unlock(&player->mutex_overlays);
 	}
 	pthread_mutex_unlock(&player->mutex_ass);
 
@@ -639,11 +931,235 @@ int player_decode_subtitles(struct DecoderData * decoder_data, JNIEnv * env,
 	elem->subtitle = sub;
 	elem->start_time = time + (sub.start_display_time * 1000ll);
 	elem->stop_time = time + (sub.end_display_time * 1000ll);
+	bitmap_overlay_init(&elem->overlay);
+	elem->overlay_converted = FALSE;
+	elem->size = player_subtitle_size(&sub);
+
+	pthread_mutex_lock(&player->mutex_queue);
+	player->subtitles_bytes += elem->size;
+	LOGI(5, "player_decode_subtitles queued subtitles bytes: %lu",
+			(unsigned long) player->subtitles_bytes);
+	pthread_mutex_unlock(&player->mutex_queue);
 
 	queue_push_finish(player->subtitles_queue, &player->mutex_queue,
 			&player->cond_queue, to_write);
 	return ERROR_NO_ERROR;
 }
+
+/*
+ * Called by video thread for every decoded frame, so thread_subtitle_render
+ * knows what to render next.
+ */
+static void player_update_subtitle_clock(struct Player *player,
+		int64_t time_ms) {
+	int i;
+	pthread_mutex_lock(&player->mutex_overlays);
+	int64_t prev_clock_ms = player->subtitle_clock_ms;
+	player->subtitle_clock_ms = time_ms;
+	for (i = 0; i < SUBTITLE_OVERLAYS; ++i) {
+		struct SubtitleOverlaySlot *slot = &player->subtitle_overlays[i];
+		if (slot->state == SUBTITLE_OVERLAY_READY && slot->end_ms <= time_ms)
+			slot->state = SUBTITLE_OVERLAY_FREE;
+	}
+	if (player->subtitle_render_ms == AV_NOPTS_VALUE
+			|| player->subtitle_render_ms < time_ms
+			|| (prev_clock_ms != AV_NOPTS_VALUE && time_ms < prev_clock_ms)) {
+		// renderer is behind or clock jumped back
+		player->subtitle_render_ms = time_ms;
+		player->subtitle_last_slot = -1;
+	}
+	pthread_cond_broadcast(&player->cond_overlays);
+	pthread_mutex_unlock(&player->mutex_overlays);
+}
+
+static struct SubtitleOverlaySlot *player_acquire_overlay(
+		struct Player *player, int64_t time_ms) {
+	struct SubtitleOverlaySlot *found = NULL;
+	int i;
+	pthread_mutex_lock(&player->mutex_overlays);
+	for (i = 0; i < SUBTITLE_OVERLAYS; ++i) {
+		struct SubtitleOverlaySlot *slot = &player->subtitle_overlays[i];
+		if (slot->state != SUBTITLE_OVERLAY_READY)
+			continue;
+		if (slot->start_ms <= time_ms && time_ms < slot->end_ms) {
+			slot->state = SUBTITLE_OVERLAY_IN_USE;
+			found = slot;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&player->mutex_overlays);
+	return found;
+}
+
+static void player_release_overlay(struct Player *player,
+		struct SubtitleOverlaySlot *slot) {
+	pthread_mutex_lock(&player->mutex_overlays);
+	if (slot->end_ms <= slot->start_ms
+			|| slot->end_ms <= player->subtitle_clock_ms) {
+		slot->state = SUBTITLE_OVERLAY_FREE;
+	} else {
+		slot->state = SUBTITLE_OVERLAY_READY;
+	}
+	pthread_cond_broadcast(&player->cond_overlays);
+	pthread_mutex_unlock(&player->mutex_overlays);
+}
+
+/*
+ * Returns first event boundary after time_ms or AV_NOPTS_VALUE
+ */
+static int64_t player_ass_next_change_ms(ASS_Track *track, int64_t time_ms) {
+	int64_t next = AV_NOPTS_VALUE;
+	int i;
+	for (i = 0; i < track->n_events; ++i) {
+		ASS_Event *event = &track->events[i];
+		int64_t start = event->Start;
+		int64_t stop = event->Start + event->Duration;
+		if (start > time_ms && (next == AV_NOPTS_VALUE || start < next))
+			next = start;
+		if (stop > time_ms && (next == AV_NOPTS_VALUE || stop < next))
+			next = stop;
+	}
+	return next;
+}
+
+static struct SubtitleOverlaySlot *player_find_free_overlay_already_locked(
+		struct Player *player) {
+	int i;
+	for (i = 0; i < SUBTITLE_OVERLAYS; ++i) {
+		struct SubtitleOverlaySlot *slot = &player->subtitle_overlays[i];
+		if (slot->state == SUBTITLE_OVERLAY_FREE)
+			return slot;
+	}
+	return NULL;
+}
+
+void * player_render_subtitles(void *data) {
+	struct Player *player = data;
+	struct SubtitleOverlaySlot *slot;
+	// mutex_ass can not be taken under mutex_overlays
+	int forget_ass_frame = FALSE;
+
+	trace_set_thread_name("FFmpegSubtitleRender", TRACE_NO_STREAM);
+	pthread_mutex_lock(&player->mutex_overlays);
+	for (;;) {
+		if (player->subtitle_render_stop)
+			break;
+		int64_t time_ms = player->subtitle_render_ms;
+		if (player->subtitle_clock_ms == AV_NOPTS_VALUE
+				|| time_ms == AV_NOPTS_VALUE
+				|| time_ms - player->subtitle_clock_ms
+						>= SUBTITLE_RENDER_AHEAD_MS
+				|| (slot = player_find_free_overlay_already_locked(player))
+						== NULL) {
+			pthread_cond_wait(&player->cond_overlays,
+					&player->mutex_overlays);
+			continue;
+		}
+		slot->state = SUBTITLE_OVERLAY_RENDERING;
+		int generation = player->ass_generation;
+		int last_slot = player->subtitle_last_slot;
+		pthread_mutex_unlock(&player->mutex_overlays);
+
+		int changed = 0;
+		int err = 0;
+		TRACE_BEGIN("ass_render", player->subtitle_stream_no, time_ms * 1000);
+		pthread_mutex_lock(&player->mutex_ass);
+		if (forget_ass_frame) {
+			player->ass_renderer_user = ASS_RENDERER_USER_NONE;
+			forget_ass_frame = FALSE;
+		}
+		int trusted = player->ass_renderer_user
+				== ASS_RENDERER_USER_RENDER_THREAD;
+		player->ass_renderer_user = ASS_RENDERER_USER_RENDER_THREAD;
+		ASS_Image *image = ass_render_frame(player->ass_renderer,
+				player->ass_track, time_ms, &changed);
+		int64_t end_ms = time_ms + player->subtitle_frame_ms;
+		if (image == NULL) {
+			// nothing to show till next event starts
+			end_ms = player_ass_next_change_ms(player->ass_track, time_ms);
+			if (end_ms == AV_NOPTS_VALUE)
+				end_ms = time_ms + SUBTITLE_RENDER_AHEAD_MS;
+		}
+		int extend = trusted && changed == 0 && last_slot >= 0;
+		if (!extend)
+			err = overlay_compose_ass(&slot->overlay, image);
+		pthread_mutex_unlock(&player->mutex_ass);
+		TRACE_END("ass_render", player->subtitle_stream_no, TRACE_NO_PTS);
+
+		pthread_mutex_lock(&player->mutex_overlays);
+		if (err < 0 || generation != player->ass_generation) {
+			LOGI(7, "player_render_subtitles dropping overlay for: %" SCNd64,
+					time_ms);
+			slot->state = SUBTITLE_OVERLAY_FREE;
+			continue;
+		}
+		if (extend) {
+			slot->state = SUBTITLE_OVERLAY_FREE;
+			struct SubtitleOverlaySlot *prev =
+					&player->subtitle_overlays[last_slot];
+			if ((prev->state != SUBTITLE_OVERLAY_READY
+					&& prev->state != SUBTITLE_OVERLAY_IN_USE)
+					|| prev->end_ms != time_ms) {
+				// previous overlay is gone - render it again
+				player->subtitle_last_slot = -1;
+				forget_ass_frame = TRUE;
+				continue;
+			}
+			prev->end_ms = end_ms;
+		} else {
+			slot->start_ms = time_ms;
+			slot->end_ms = end_ms;
+			slot->state = SUBTITLE_OVERLAY_READY;
+			player->subtitle_last_slot = slot - player->subtitle_overlays;
+		}
+		player->subtitle_render_ms = end_ms;
+		pthread_cond_broadcast(&player->cond_overlays);
+	}
+	pthread_mutex_unlock(&player->mutex_overlays);
+	return NULL;
+}
+
+void player_start_subtitle_render_thread_free(struct Player *player) {
+	int i;
+	if (player->thread_subtitle_render_created) {
+		pthread_mutex_lock(&player->mutex_overlays);
+		player->subtitle_render_stop = TRUE;
+		pthread_cond_broadcast(&player->cond_overlays);
+		pthread_mutex_unlock(&player->mutex_overlays);
+
+		pthread_join(player->thread_subtitle_render, NULL);
+		player->thread_subtitle_render_created = FALSE;
+	}
+	for (i = 0; i < SUBTITLE_OVERLAYS; ++i) {
+		overlay_free(&player->subtitle_overlays[i].overlay);
+		player->subtitle_overlays[i].state = SUBTITLE_OVERLAY_FREE;
+	}
+}
+
+int player_start_subtitle_render_thread(struct Player *player) {
+	AVStream *stream = player->input_streams[player->video_stream_no];
+	int i;
+
+	for (i = 0; i < SUBTITLE_OVERLAYS; ++i) {
+		overlay_init(&player->subtitle_overlays[i].overlay);
+		player->subtitle_overlays[i].state = SUBTITLE_OVERLAY_FREE;
+	}
+	player->subtitle_render_stop = FALSE;
+	player->subtitle_clock_ms = AV_NOPTS_VALUE;
+	player->subtitle_render_ms = AV_NOPTS_VALUE;
+	player->subtitle_last_slot = -1;
+	player->subtitle_frame_ms = SUBTITLE_DEFAULT_FRAME_MS;
+	if (stream->avg_frame_rate.num > 0 && stream->avg_frame_rate.den > 0) {
+		player->subtitle_frame_ms = FFMAX(1,
+				1000 * stream->avg_frame_rate.den / stream->avg_frame_rate.num);
+	}
+
+	if (pthread_create(&player->thread_subtitle_render, NULL,
+			player_render_subtitles, player))
+		return -ERROR_COULD_NOT_CREATE_PTHREAD;
+	player->thread_subtitle_render_created = TRUE;
+	return 0;
+}
 #endif // SUBTITLES
 
 void player_sws_context_free(struct Player *player) {
@@ -654,6 +1170,11 @@ void player_sws_context_free(struct Player *player) {
 }
 
 inline int64_t player_get_current_video_time(struct Player *player) {
+	if (player->trick_rate != 0) {
+		int64_t now = player->pause ? player->pause_time : av_gettime();
+		return player->trick_base_time
+				+ player->trick_rate * (now - player->trick_start_time);
+	}
 	if (player->pause) {
 		return player->pause_time - player->start_time;
 	} else {
@@ -710,9 +1231,71 @@ void player_update_time(struct State *state, int is_finished) {
 	}
 }
 
+/*
+ * Returns how long stream_time is ahead of the player clock, corrects the
+ * clock when more than 300 ms late. first_check counts late video frames.
+ * In free run frames are never ahead.
+ */
+static int64_t player_frame_delay_already_locked(struct Player *player,
+		int64_t stream_time, int stream_no, int first_check) {
+	if (player->free_run)
+		return 0;
+	int64_t current_video_time = player_get_current_video_time(player);
+
+	LOGI(8,
+			"player_wait_for_frame[%d = %s] = (%f) - (%f)",
+			stream_no,
+			player->video_stream_no == stream_no ? "Video" : "Audio",
+			stream_time/1000000.0,
+			current_video_time/1000000.0);
+
+	int64_t sleep_time = stream_time - current_video_time;
+	if (player->trick_rate != 0) {
+		// wall clock time until scaled clock reaches the frame
+		sleep_time /= player->trick_rate;
+	}
+	if (first_check && stream_no == player->video_stream_no
+			&& sleep_time < -LATE_FRAME_US) {
+		metrics_count(&player->metrics, METRICS_COUNTER_LATE_FRAMES, 1);
+		TRACE_INSTANT("late", stream_no, stream_time);
+	}
+	if (first_check && stream_no == player->video_stream_no
+			&& player->governor.registered)
+		governor_report_frame(&player->governor, player->governor_cost_us,
+				-sleep_time);
+
+	LOGI(8,
+			"player_wait_for_frame[%d] Waiting for frame: sleeping: %" SCNd64,
+			stream_no, sleep_time);
+
+	if (sleep_time < -300000ll && player->trick_rate != 0) {
+		// key frames are far apart or slow to read, continue from this one
+		LOGI(4, "player_wait_for_frame[%d] trick play late, jumping to %f",
+				stream_no, stream_time / 1000000.0);
+		player->trick_base_time = stream_time;
+		player->trick_start_time = av_gettime();
+		pthread_cond_broadcast(&player->cond_queue);
+	} else if (sleep_time < -300000ll) {
+		// 300 ms late
+		int64_t new_value = player->start_time - sleep_time;
+
+		LOGI(4,
+				"player_wait_for_frame[%d] correcting %f to %f because late",
+				stream_no, (av_gettime() - player->start_time) / 1000000.0,
+				(av_gettime() - new_value) / 1000000.0);
+
+		player->start_time = new_value;
+		pthread_cond_broadcast(&player->cond_queue);
+	}
+	return sleep_time;
+}
+
 enum WaitFuncRet player_wait_for_frame(struct Player *player, int64_t stream_time,
 		int stream_no) {
 	LOGI(6, "player_wait_for_frame[%d] start", stream_no);
+	int64_t wait_start = metrics_now_us();
+	int first_check = TRUE;
+	TRACE_BEGIN("wait", stream_no, stream_time);
 	pthread_mutex_lock(&player->mutex_queue);
 	int ret = WAIT_FUNC_RET_OK;
 	while (1) {
@@ -731,33 +1314,9 @@ enum WaitFuncRet player_wait_for_frame(struct Player *player, int64_t stream_tim
 			continue;
 		}
 
-		int64_t current_video_time = player_get_current_video_time(player);
-
-		LOGI(8,
-				"player_wait_for_frame[%d = %s] = (%f) - (%f)",
-				stream_no,
-				player->video_stream_no == stream_no ? "Video" : "Audio",
-				stream_time/1000000.0,
-				current_video_time/1000000.0);
-
-		int64_t sleep_time = stream_time - current_video_time;
-
-		LOGI(8,
-				"player_wait_for_frame[%d] Waiting for frame: sleeping: %" SCNd64,
-				stream_no, sleep_time);
-
-		if (sleep_time < -300000ll) {
-			// 300 ms late
-			int64_t new_value = player->start_time - sleep_time;
-
-			LOGI(4,
-					"player_wait_for_frame[%d] correcting %f to %f because late",
-					stream_no, (av_gettime() - player->start_time) / 1000000.0,
-					(av_gettime() - new_value) / 1000000.0);
-
-			player->start_time = new_value;
-			pthread_cond_broadcast(&player->cond_queue);
-		}
+		int64_t sleep_time = player_frame_delay_already_locked(player,
+				stream_time, stream_no, first_check);
+		first_check = FALSE;
 
 		if (sleep_time <= MIN_SLEEP_TIME_US) {
 			// We do not need to wait if time is slower then minimal sleep time
@@ -782,41 +1341,103 @@ enum WaitFuncRet player_wait_for_frame(struct Player *player, int64_t stream_tim
 	// just go further
 	LOGI(6, "player_wait_for_frame[%d] finish[%d]", stream_no, ret);
 	pthread_mutex_unlock(&player->mutex_queue);
+	metrics_add_time(&player->metrics, METRICS_STAGE_WAIT, wait_start);
+	TRACE_END("wait", stream_no, TRACE_NO_PTS);
 	return ret;
 }
 
-int player_decode_video(struct DecoderData * decoder_data, JNIEnv * env,
-		struct PacketData *packet_data) {
-	int got_frame_ptr;
+int player_reconfigure_video(struct Player *player, int width, int height);
+
+static void player_update_window_format(struct Player *player, int format) {
+	player->window_format = format;
+	if (format == WINDOW_FORMAT_RGBA_8888) {
+		player->out_format = PIX_FMT_RGBA;
+		player->window_bytes_per_pixel = 4;
+		LOGI(3, "Format: WINDOW_FORMAT_RGBA_8888");
+	} else if (format == WINDOW_FORMAT_RGBX_8888) {
+		player->out_format = PIX_FMT_RGB0;
+		player->window_bytes_per_pixel = 4;
+		LOGE(1, "Format: WINDOW_FORMAT_RGBX_8888 (not supported)");
+	} else if (format == WINDOW_FORMAT_RGB_565) {
+		player->out_format = PIX_FMT_RGB565;
+		player->window_bytes_per_pixel = 2;
+		LOGE(1, "Format: WINDOW_FORMAT_RGB_565 (not supported)");
+	} else {
+		player->out_format = PIX_FMT_RGBA;
+		player->window_bytes_per_pixel = 4;
+		LOGE(1, "Unknown window format: %d", format);
+	}
+}
+
+/*
+ * Brings video decoder to the level chosen by governor
+ */
+static void player_governor_apply(struct Player *player, AVCodecContext *ctx) {
+	int level = player->governor.level;
+	int previous = player->governor_level;
+	if (level == previous)
+		return;
+
+	LOGI(3, "player_governor_apply level %d -> %d", previous, level);
+	ctx->skip_loop_filter = level >= GOVERNOR_LEVEL_SKIP_LOOP_FILTER ?
+			AVDISCARD_ALL : AVDISCARD_DEFAULT;
+	if (level >= GOVERNOR_LEVEL_KEYFRAMES)
+		ctx->skip_frame = AVDISCARD_NONKEY;
+	else if (level >= GOVERNOR_LEVEL_DECIMATE)
+		ctx->skip_frame = AVDISCARD_NONREF;
+	else
+		ctx->skip_frame = AVDISCARD_DEFAULT;
+	if ((level >= GOVERNOR_LEVEL_LOW_RESOLUTION)
+			!= (previous >= GOVERNOR_LEVEL_LOW_RESOLUTION)) {
+		pthread_mutex_lock(&player->mutex_queue);
+		player->window_changed = TRUE;
+		pthread_mutex_unlock(&player->mutex_queue);
+	}
+	metrics_count(&player->metrics, METRICS_COUNTER_GOVERNOR_CHANGES, 1);
+	metrics_count(&player->metrics, METRICS_COUNTER_GOVERNOR_LEVEL,
+			level - previous);
+	player->governor_level = level;
+}
+
+/*
+ * Decodes packet into input frame of the stream. Returns 1 and frame
+ * presentation time when frame is ready, 0 when decoder needs more data.
+ */
+static int player_decode_video_frame(struct DecoderData * decoder_data,
+		struct PacketData *packet_data, int64_t *frame_time) {
 	struct Player *player = decoder_data->player;
 	int stream_no = decoder_data->stream_no;
 	AVCodecContext * ctx = player->input_codec_ctxs[stream_no];
 	AVFrame * frame = player->input_frames[stream_no];
 	AVStream * stream = player->input_streams[stream_no];
-	int interrupt_ret;
-	int to_write;
-	int err = 0;
-	AVFrame *rgb_frame = player->rgb_frame;
-	ANativeWindow_Buffer buffer;
-	ANativeWindow * window;
+	struct Metrics *metrics = &player->metrics;
+	FILE *checksum_file = player->checksum_file;
+	int64_t stage_start;
 
-#ifdef MEASURE_TIME
-	struct timespec timespec1, timespec2, diff;
-#endif // MEASURE_TIME
 	LOGI(10, "player_decode_video decoding");
 	int frameFinished;
 
-#ifdef MEASURE_TIME
-	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &timespec1);
-#endif // MEASURE_TIME
+	player_governor_apply(player, ctx);
+	stage_start = metrics_now_us();
+	TRACE_BEGIN("decode", stream_no, TRACE_NO_PTS);
+	if (packet_data->trick == PACKET_TRICK_KEY_FRAME) {
+		// previous key frame is not a reference of this one
+		avcodec_flush_buffers(ctx);
+	}
 	int ret = avcodec_decode_video2(ctx, frame, &frameFinished,
 			packet_data->packet);
-
-#ifdef MEASURE_TIME
-	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &timespec2);
-	diff = timespec_diff(timespec1, timespec2);
-	LOGI(3, "decode_video timediff: %d.%9ld", diff.tv_sec, diff.tv_nsec);
-#endif // MEASURE_TIME
+	if (ret >= 0 && !frameFinished
+			&& packet_data->trick == PACKET_TRICK_KEY_FRAME) {
+		// decoders with frame delay keep the key frame until drained
+		AVPacket drain;
+		av_init_packet(&drain);
+		drain.data = NULL;
+		drain.size = 0;
+		ret = avcodec_decode_video2(ctx, frame, &frameFinished, &drain);
+	}
+	TRACE_END("decode", stream_no, TRACE_NO_PTS);
+	player->governor_cost_us = metrics_add_time(metrics, METRICS_STAGE_DECODE,
+			stage_start) - stage_start;
 
 	if (ret < 0) {
 		LOGE(1, "player_decode_video Fail decoding video %d\n", ret);
@@ -827,122 +1448,131 @@ int player_decode_video(struct DecoderData * decoder_data, JNIEnv * env,
 		return 0;
 	}
 
-	// saving in buffer converted video frame
-	LOGI(7, "player_decode_video copy wait");
-
-#ifdef MEASURE_TIME
-	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &timespec1);
-#endif // MEASURE_TIME
-
-	pthread_mutex_lock(&player->mutex_queue);
-	window = player->window;
-	if (window == NULL) {
-		pthread_mutex_unlock(&player->mutex_queue);
-		goto skip_frame;
+	int64_t pts = av_frame_get_best_effort_timestamp(frame);
+	if (pts == AV_NOPTS_VALUE) {
+		pts = 0;
 	}
-	ANativeWindow_setBuffersGeometry(window, ctx->width, ctx->height,
-			WINDOW_FORMAT_RGBA_8888);
-	if (ANativeWindow_lock(window, &buffer, NULL) != 0) {
-		pthread_mutex_unlock(&player->mutex_queue);
-		goto skip_frame;
+	int64_t time = av_rescale_q(pts, stream->time_base, AV_TIME_BASE_Q);
+	if (checksum_file != NULL)
+		checksum_log(checksum_file, "video", time,
+				checksum_picture((AVPicture *) frame, ctx->pix_fmt,
+						ctx->width, ctx->height));
+	LOGI(10,
+			"player_decode_video Decoded video frame: %f, time_base: %" SCNd64,
+			time/1000000.0, pts);
+	player->governor_frame_no += 1;
+	if (packet_data->trick == PACKET_TRICK_NONE && (player->governor_level == GOVERNOR_LEVEL_DECIMATE
+			|| player->governor_level == GOVERNOR_LEVEL_LOW_RESOLUTION)
+			&& (player->governor_frame_no & 1)) {
+		metrics_count(metrics, METRICS_COUNTER_DECIMATED_FRAMES, 1);
+		return 0;
 	}
-	pthread_mutex_unlock(&player->mutex_queue);
+	*frame_time = time;
+	return 1;
+}
 
-	int format = buffer.format;
-	if (format < 0) {
-		LOGE(1, "Could not get window format")
-	}
+/*
+ * Converts frame of width x height in pix_fmt into the window (or
+ * headless frame), blends subtitles and posts it. With wait the frame is
+ * posted at its time, otherwise caller has already waited.
+ */
+static int player_present_frame(struct DecoderData * decoder_data,
+		JNIEnv * env, const AVFrame *frame, int width, int height,
+		enum PixelFormat pix_fmt, int64_t time, int wait) {
+	struct Player *player = decoder_data->player;
+	int stream_no = decoder_data->stream_no;
+	int err = 0;
+	AVFrame *rgb_frame = player->rgb_frame;
+	ANativeWindow_Buffer buffer;
+	ANativeWindow * window;
+	struct Metrics *metrics = &player->metrics;
+	FILE *checksum_file = player->checksum_file;
 	enum PixelFormat out_format;
-	if (format == WINDOW_FORMAT_RGBA_8888) {
+	int64_t stage_start;
+
+	// saving in buffer converted video frame
+	LOGI(7, "player_decode_video copy wait");
+
+	if (player->headless_frame != NULL) {
+		// checksum mode, frames are rendered at video size into memory
+		window = NULL;
+		rgb_frame = player->headless_frame;
+		buffer.width = player->video_width;
+		buffer.height = player->video_height;
 		out_format = PIX_FMT_RGBA;
-		LOGI(6, "Format: WINDOW_FORMAT_RGBA_8888");
-	} else if (format == WINDOW_FORMAT_RGBX_8888) {
-		out_format = PIX_FMT_RGB0;
-		LOGE(1, "Format: WINDOW_FORMAT_RGBX_8888 (not supported)");
-	} else if (format == WINDOW_FORMAT_RGB_565) {
-		out_format = PIX_FMT_RGB565;
-		LOGE(1, "Format: WINDOW_FORMAT_RGB_565 (not supported)");
+		stage_start = metrics_now_us();
+		TRACE_BEGIN("convert", stream_no, TRACE_NO_PTS);
 	} else {
-		LOGE(1, "Unknown window format");
+		pthread_mutex_lock(&player->mutex_queue);
+		stage_start = metrics_now_us();
+		window = player->window;
+		if (window == NULL) {
+			metrics_add_time(metrics, METRICS_STAGE_QUEUE_LOCK, stage_start);
+			pthread_mutex_unlock(&player->mutex_queue);
+			goto drop_frame;
+		}
+		// keep reference so window could be locked without mutex_queue
+		ANativeWindow_acquire(window);
+		int window_changed = player->window_changed;
+		player->window_changed = FALSE;
+		stage_start = metrics_add_time(metrics, METRICS_STAGE_QUEUE_LOCK,
+				stage_start);
+		pthread_mutex_unlock(&player->mutex_queue);
+
+		TRACE_BEGIN("window_lock", stream_no, TRACE_NO_PTS);
+		if (window_changed) {
+			// compositor scales half resolution buffers up
+			int shift = player->governor_level
+					>= GOVERNOR_LEVEL_LOW_RESOLUTION ? 1 : 0;
+			LOGI(3, "player_decode_video configuring window: %dx%d",
+					player->video_width >> shift,
+					player->video_height >> shift);
+			ANativeWindow_setBuffersGeometry(window,
+					player->video_width >> shift,
+					player->video_height >> shift, WINDOW_FORMAT_RGBA_8888);
+		}
+		if (ANativeWindow_lock(window, &buffer, NULL) != 0) {
+			TRACE_END("window_lock", stream_no, TRACE_NO_PTS);
+			ANativeWindow_release(window);
+			goto drop_frame;
+		}
+		TRACE_END("window_lock", stream_no, TRACE_NO_PTS);
+		stage_start = metrics_add_time(metrics, METRICS_STAGE_WINDOW_LOCK,
+				stage_start);
+		TRACE_BEGIN("convert", stream_no, TRACE_NO_PTS);
+
+		if (buffer.format != player->window_format) {
+			player_update_window_format(player, buffer.format);
+		}
+		out_format = player->out_format;
+
+		rgb_frame->data[0] = buffer.bits;
+		rgb_frame->linesize[0] = buffer.stride * player->window_bytes_per_pixel;
+		LOGI(6,
+				"Buffer: width: %d, height: %d, stride: %d",
+				buffer.width, buffer.height, buffer.stride);
 	}
 
-	avpicture_fill((AVPicture *) rgb_frame, buffer.bits, out_format,
-			buffer.width, buffer.height);
-	rgb_frame->data[0] = buffer.bits;
-	if (format == WINDOW_FORMAT_RGBA_8888) {
-		rgb_frame->linesize[0] = buffer.stride * 4;
-	} else {
-		LOGE(1, "Unknown window format");
-	}
-	LOGI(6,
-			"Buffer: width: %d, height: %d, stride: %d",
-			buffer.width, buffer.height, buffer.stride);
-	int i = 0;
-
-#ifdef MEASURE_TIME
-	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &timespec2);
-	diff = timespec_diff(timespec1, timespec2);
-	LOGI(1,
-			"lockPixels and fillimage timediff: %d.%9ld", diff.tv_sec, diff.tv_nsec);
-#endif // MEASURE_TIME
-#ifdef MEASURE_TIME
-	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &timespec1);
-#endif // MEASURE_TIME
 	LOGI(7, "player_decode_video copying...");
-	AVFrame * out_frame;
-	int rescale;
-	if (ctx->width == buffer.width && ctx->height == buffer.height) {
-		// This always should be true
-		out_frame = rgb_frame;
-		rescale = FALSE;
-	} else {
-		out_frame = player->tmp_frame2;
-		rescale = TRUE;
-	}
-
-	if (ctx->pix_fmt == PIX_FMT_YUV420P) {
-		__I420ToARGB(frame->data[0], frame->linesize[0], frame->data[2],
-				frame->linesize[2], frame->data[1], frame->linesize[1],
-				out_frame->data[0], out_frame->linesize[0], ctx->width,
-				ctx->height);
-	} else if (ctx->pix_fmt == PIX_FMT_NV12) {
-		__NV21ToARGB(frame->data[0], frame->linesize[0], frame->data[1],
-				frame->linesize[1], out_frame->data[0], out_frame->linesize[0],
-				ctx->width, ctx->height);
-	} else {
-		LOGI(3, "Using slow conversion: %d ", ctx->pix_fmt);
-		struct SwsContext *sws_context = player->sws_context;
-		sws_context = sws_getCachedContext(sws_context, ctx->width, ctx->height,
-				ctx->pix_fmt, ctx->width, ctx->height, out_format,
-				SWS_FAST_BILINEAR, NULL, NULL, NULL);
-		player->sws_context = sws_context;
-		if (sws_context == NULL) {
-			LOGE(1, "could not initialize conversion context from: %d"
-			", to :%d\n", ctx->pix_fmt, out_format);
-			// TODO some error
-		}
-		sws_scale(sws_context, (const uint8_t * const *) frame->data,
-				frame->linesize, 0, ctx->height, out_frame->data,
-				out_frame->linesize);
-	}
-
-	if (rescale) {
-		// Never occurs
-		__ARGBScale(out_frame->data[0], out_frame->linesize[0], ctx->width,
-				ctx->height, rgb_frame->data[0], rgb_frame->linesize[0],
-				buffer.width, buffer.height, __kFilterNone);
-		out_frame = rgb_frame;
-	}
+	AVFrame * out_frame = rgb_frame;
+	if (render_frame(&player->sws_context, frame, width, height,
+			pix_fmt, (AVPicture *) rgb_frame, buffer.width, buffer.height,
+			(AVPicture *) player->tmp_frame2, out_format) < 0) {
+		LOGE(1, "player_decode_video could not convert frame");
+	}
+	metrics_add_time(metrics, METRICS_STAGE_CONVERT, stage_start);
+	TRACE_END("convert", stream_no, TRACE_NO_PTS);
+	if (checksum_file != NULL)
+		checksum_log(checksum_file, "rgba", time,
+				checksum_picture((AVPicture *) out_frame, out_format,
+						buffer.width, buffer.height));
 
-	int64_t pts = av_frame_get_best_effort_timestamp(frame);
-	if (pts == AV_NOPTS_VALUE) {
-		pts = 0;
-	}
-	int64_t time = av_rescale_q(pts, stream->time_base, AV_TIME_BASE_Q);
-	LOGI(10,
-			"player_decode_video Decoded video frame: %f, time_base: %" SCNd64,
-			time/1000000.0, pts);
-	player_wait_for_frame(player, time, stream_no);
+#ifdef SUBTITLES
+	if (player->subtitle_stream_no >= 0)
+		player_update_subtitle_clock(player, time / 1000);
+#endif // SUBTITLES
+	if (wait)
+		player_wait_for_frame(player, time, stream_no);
 
 
 #ifdef SUBTITLES
@@ -962,7 +1592,7 @@ int player_decode_video(struct DecoderData * decoder_data, JNIEnv * env,
 			}
 			if (subtitle->stop_time >= time)
 				break;
-			avsubtitle_free(&subtitle->subtitle);
+			player_free_subtitle_elem_already_locked(player, subtitle);
 			subtitle = NULL;
 			LOGI(5, "player_decode_video discarding old subtitle");
 			queue_pop_finish_already_locked(player->subtitles_queue,
@@ -982,21 +1612,43 @@ int player_decode_video(struct DecoderData * decoder_data, JNIEnv * env,
 
 		pthread_mutex_unlock(&player->mutex_queue);
 
+		stage_start = metrics_now_us();
+		TRACE_BEGIN("blend", stream_no, time);
 
 		/* libass stores an RGBA color in the format RRGGBBAA,
 		 * where AA is the transparency level */
+		ssize_t subtitle_size_change = 0;
+		if (subtitle != NULL && !subtitle->overlay_converted) {
+			// element is popped so it could be converted without mutex_queue
+			LOGI(5, "player_decode_video converting subtitle");
+			if (bitmap_overlay_from_subtitle(&subtitle->overlay,
+					&subtitle->subtitle) >= 0) {
+				subtitle->overlay_converted = TRUE;
+				avsubtitle_free(&subtitle->subtitle);
+				subtitle_size_change = (ssize_t) subtitle->overlay.size
+						- (ssize_t) subtitle->size;
+			} else {
+				LOGE(1, "player_decode_video could not convert subtitle");
+			}
+		}
 		if (subtitle != NULL) {
 			LOGI(5, "player_decode_video blend subtitle");
-			int i;
-			struct AVSubtitle *sub = &subtitle->subtitle;
-			for (i = 0; i < sub->num_rects; i++) {
-				AVSubtitleRect *rect = sub->rects[i];
-				if (rect->type != SUBTITLE_BITMAP) {
-					continue;
+			if (subtitle->overlay_converted) {
+				bitmap_overlay_blend((AVPicture *) out_frame,
+						&subtitle->overlay, buffer.width, buffer.height,
+						out_format);
+			} else {
+				int i;
+				struct AVSubtitle *sub = &subtitle->subtitle;
+				for (i = 0; i < sub->num_rects; i++) {
+					AVSubtitleRect *rect = sub->rects[i];
+					if (rect->type != SUBTITLE_BITMAP) {
+						continue;
+					}
+					LOGI(5, "player_decode_video blending subtitle");
+					blend_subrect_rgba((AVPicture *) out_frame, rect,
+							buffer.width, buffer.height, out_format);
 				}
-				LOGI(5, "player_decode_video blending subtitle");
-				blend_subrect_rgba((AVPicture *) out_frame, rect, buffer.width,
-						buffer.height, out_format);
 			}
 		}
 		int64_t time_ms = time / 1000;
@@ -1004,20 +1656,43 @@ int player_decode_video(struct DecoderData * decoder_data, JNIEnv * env,
 		LOGI(3,
 				"player_decode_video_subtitles: trying to find subtitles in : %" SCNd64,
 				time_ms);
-		pthread_mutex_lock(&player->mutex_ass);
-		ASS_Image *image = ass_render_frame(player->ass_renderer,
-				player->ass_track, time_ms, NULL);
-		for (; image != NULL; image = image->next) {
-			LOGI(3,
-					"player_decode_video_subtitles: printing subtitles in : %" SCNd64,
+		struct SubtitleOverlaySlot *slot = player_acquire_overlay(player,
+				time_ms);
+		if (slot != NULL) {
+			// rendered ahead by thread_subtitle_render
+			overlay_blend((AVPicture *) out_frame, &slot->overlay,
+					buffer.width, buffer.height, out_format);
+			player_release_overlay(player, slot);
+		} else {
+			LOGI(5, "player_decode_video_subtitles: rendering in place: %" SCNd64,
 					time_ms);
-			blend_ass_image((AVPicture *) out_frame, image, buffer.width,
-					buffer.height, out_format);
+			pthread_mutex_lock(&player->mutex_ass);
+			if (player->ass_renderer_user != ASS_RENDERER_USER_VIDEO) {
+				overlay_invalidate(&player->ass_overlay);
+				player->ass_renderer_user = ASS_RENDERER_USER_VIDEO;
+			}
+			// overlay is composed again only when libass reports a change
+			if (overlay_render_ass(&player->ass_overlay, player->ass_renderer,
+					player->ass_track, time_ms) > 0) {
+				LOGI(3,
+						"player_decode_video_subtitles: subtitles changed in : %" SCNd64,
+						time_ms);
+			}
+			overlay_blend((AVPicture *) out_frame, &player->ass_overlay,
+					buffer.width, buffer.height, out_format);
+			pthread_mutex_unlock(&player->mutex_ass);
 		}
-		pthread_mutex_unlock(&player->mutex_ass);
+		metrics_add_time(metrics, METRICS_STAGE_BLEND, stage_start);
+		TRACE_END("blend", stream_no, TRACE_NO_PTS);
+		if (checksum_file != NULL)
+			checksum_log(checksum_file, "blend", time,
+					checksum_picture((AVPicture *) out_frame, out_format,
+							buffer.width, buffer.height));
 
 		pthread_mutex_lock(&player->mutex_queue);
 		if (subtitle != NULL) {
+			subtitle->size += subtitle_size_change;
+			player->subtitles_bytes += subtitle_size_change;
 			LOGI(5, "player_decode_video rollback wroten subtitle");
 			queue_pop_roll_back_already_locked(player->subtitles_queue, &player->mutex_queue,
 					&player->cond_queue);
@@ -1027,20 +1702,275 @@ int player_decode_video(struct DecoderData * decoder_data, JNIEnv * env,
 	}
 #endif // SUBTITLES
 
+	if (window == NULL)
+		return err;
+	stage_start = metrics_now_us();
+	TRACE_BEGIN("window_post", stream_no, time);
 	ANativeWindow_unlockAndPost(window);
-skip_frame:
+	TRACE_END("window_post", stream_no, TRACE_NO_PTS);
+	metrics_add_time(metrics, METRICS_STAGE_WINDOW_POST, stage_start);
+	ANativeWindow_release(window);
 	return err;
-}
 
-void * player_decode(void * data) {
+drop_frame:
+	metrics_count(metrics, METRICS_COUNTER_DROPPED_FRAMES, 1);
+	TRACE_INSTANT("drop", stream_no, TRACE_NO_PTS);
+	return err;
+}
 
-	int err = ERROR_NO_ERROR;
-	struct DecoderData *decoder_data = data;
+static int player_present_video(struct DecoderData * decoder_data,
+		JNIEnv * env, int64_t time, int wait) {
 	struct Player *player = decoder_data->player;
 	int stream_no = decoder_data->stream_no;
-	Queue *queue = player->packets[stream_no];
 	AVCodecContext * ctx = player->input_codec_ctxs[stream_no];
-	enum AVMediaType codec_type = ctx->codec_type;
+	int err;
+
+	if (ctx->width != player->video_width
+			|| ctx->height != player->video_height) {
+		// e.g. adaptive HLS switched to another variant
+		if ((err = player_reconfigure_video(player, ctx->width, ctx->height))
+				< 0)
+			return err;
+	}
+	return player_present_frame(decoder_data, env,
+			player->input_frames[stream_no], ctx->width, ctx->height,
+			ctx->pix_fmt, time, wait);
+}
+
+/*
+ * Decodes packet of reverse playback GOP (NULL drains the decoder) into
+ * filling cache. Returns 1 when decoder returned a frame, 0 when not.
+ */
+static int player_reverse_decode(struct DecoderData *decoder_data,
+		AVPacket *packet) {
+	struct Player *player = decoder_data->player;
+	int stream_no = decoder_data->stream_no;
+	AVCodecContext * ctx = player->input_codec_ctxs[stream_no];
+	AVFrame * frame = player->input_frames[stream_no];
+	AVStream * stream = player->input_streams[stream_no];
+	struct FrameCache *filling =
+			&player->reverse_caches[player->reverse_filling];
+	AVPacket drain;
+	int64_t stage_start;
+	int frameFinished;
+	int ret;
+
+	if (packet == NULL) {
+		av_init_packet(&drain);
+		drain.data = NULL;
+		drain.size = 0;
+		packet = &drain;
+	}
+	stage_start = metrics_now_us();
+	TRACE_BEGIN("decode", stream_no, TRACE_NO_PTS);
+	ret = avcodec_decode_video2(ctx, frame, &frameFinished, packet);
+	TRACE_END("decode", stream_no, TRACE_NO_PTS);
+	player->governor_cost_us = metrics_add_time(&player->metrics,
+			METRICS_STAGE_DECODE, stage_start) - stage_start;
+	if (ret < 0) {
+		// broken packet spoils only part of the GOP
+		LOGE(1, "player_reverse_decode Fail decoding video %d", ret);
+		return 0;
+	}
+	if (!frameFinished)
+		return 0;
+
+	int64_t pts = av_frame_get_best_effort_timestamp(frame);
+	if (pts == AV_NOPTS_VALUE)
+		pts = 0;
+	int64_t time = av_rescale_q(pts, stream->time_base, AV_TIME_BASE_Q);
+	if (time < player->reverse_gop_start || time >= player->reverse_limit) {
+		LOGI(10, "player_reverse_decode skipping frame: %f", time / 1000000.0);
+		return 1;
+	}
+	if (ctx->width != player->video_width
+			|| ctx->height != player->video_height) {
+		// frames of the other size are dropped
+		frame_cache_clear(&player->reverse_caches[0]);
+		frame_cache_clear(&player->reverse_caches[1]);
+		if (player_reconfigure_video(player, ctx->width, ctx->height) < 0)
+			return 1;
+	}
+	if (frame_cache_add(filling, frame, ctx->width, ctx->height,
+			ctx->pix_fmt, time) == 0)
+		metrics_count(&player->metrics, METRICS_COUNTER_DECIMATED_FRAMES, 1);
+	return 1;
+}
+
+/*
+ * Feeds packet to reverse playback. Packet starting GOP (or end of stream)
+ * completes the GOP being decoded, it is then presented, but only after
+ * the previous one was. Returns 1 when packet was consumed, 0 when it has
+ * to wait until presented cache is empty.
+ */
+static int player_reverse_packet(struct DecoderData *decoder_data,
+		struct PacketData *packet_data) {
+	struct Player *player = decoder_data->player;
+	int stream_no = decoder_data->stream_no;
+	AVStream * stream = player->input_streams[stream_no];
+	AVPacket *packet = packet_data->packet;
+	struct FrameCache *showing =
+			&player->reverse_caches[!player->reverse_filling];
+	int boundary = packet_data->end_of_stream
+			|| packet_data->trick == PACKET_TRICK_GOP_START;
+
+	if (boundary && player->reverse_filling_started) {
+		if (frame_cache_count(showing) > 0)
+			return 0;
+		while (player_reverse_decode(decoder_data, NULL) > 0)
+			;
+		avcodec_flush_buffers(player->input_codec_ctxs[stream_no]);
+		LOGI(5, "player_reverse_packet GOP %f decoded",
+				player->reverse_gop_start / 1000000.0);
+		player->reverse_limit = player->reverse_gop_start;
+		player->reverse_filling = !player->reverse_filling;
+		player->reverse_filling_started = FALSE;
+		player->reverse_frame_checked = FALSE;
+		showing = &player->reverse_caches[!player->reverse_filling];
+		frame_cache_clear(&player->reverse_caches[player->reverse_filling]);
+	}
+	if (packet_data->end_of_stream) {
+		// the first GOP is shown before playback finishes
+		return frame_cache_count(showing) > 0 ? 0 : 1;
+	}
+	if (packet_data->trick == PACKET_TRICK_GOP_START) {
+		int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts
+				: packet->dts;
+		player->reverse_gop_start = pts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE
+				: av_rescale_q(pts, stream->time_base, AV_TIME_BASE_Q);
+		player->reverse_filling_started = TRUE;
+	} else if (!player->reverse_filling_started) {
+		// GOP start was flushed
+		return 1;
+	}
+	player_reverse_decode(decoder_data, packet);
+	return 1;
+}
+
+/*
+ * Presents frames of the shown GOP which are due, from its end. Returns
+ * time until the next one, 0 when all are presented or error.
+ */
+static int64_t player_reverse_present_due(struct DecoderData *decoder_data,
+		JNIEnv *env) {
+	struct Player *player = decoder_data->player;
+	int stream_no = decoder_data->stream_no;
+	struct FrameCache *showing =
+			&player->reverse_caches[!player->reverse_filling];
+	struct FrameCacheEntry *entry;
+	int64_t delay;
+	int err;
+
+	while ((entry = frame_cache_last(showing)) != NULL) {
+		pthread_mutex_lock(&player->mutex_queue);
+		delay = player_frame_delay_already_locked(player, entry->time,
+				stream_no, !player->reverse_frame_checked);
+		pthread_mutex_unlock(&player->mutex_queue);
+		player->reverse_frame_checked = TRUE;
+		if (delay > MIN_SLEEP_TIME_US)
+			return delay;
+
+		err = player_present_frame(decoder_data, env, entry->frame,
+				showing->width, showing->height, showing->pix_fmt,
+				entry->time, FALSE);
+		frame_cache_drop_last(showing);
+		player->reverse_frame_checked = FALSE;
+		if (err < 0)
+			return err;
+	}
+	return 0;
+}
+
+static int player_is_reverse_packet(struct Player *player,
+		struct PacketData *packet_data) {
+	if (packet_data->trick == PACKET_TRICK_GOP_START
+			|| packet_data->trick == PACKET_TRICK_GOP)
+		return TRUE;
+	// end of stream after reverse playback
+	return packet_data->end_of_stream && (player->reverse_filling_started
+			|| frame_cache_count(&player->reverse_caches[0]) > 0
+			|| frame_cache_count(&player->reverse_caches[1]) > 0);
+}
+
+/*
+ * Reverse playback with own thread, waits until the previous GOP is
+ * presented when packet of the next one is decoded already
+ */
+static int player_decode_video_reverse(struct DecoderData * decoder_data,
+		JNIEnv * env, struct PacketData *packet_data) {
+	struct Player *player = decoder_data->player;
+	int stream_no = decoder_data->stream_no;
+	int64_t delay;
+	int interrupted;
+
+	while (player_reverse_packet(decoder_data, packet_data) == 0) {
+		delay = player_reverse_present_due(decoder_data, env);
+		if (delay < 0)
+			return delay;
+		if (delay == 0)
+			continue;
+		pthread_mutex_lock(&player->mutex_queue);
+		interrupted = player->flush_streams[stream_no]
+				|| player->stop_streams[stream_no];
+		if (!interrupted)
+			pthread_cond_timeout_np(&player->cond_queue, &player->mutex_queue,
+					(delay > 500000ll ? 500000ll : delay) / 1000ll);
+		interrupted = player->flush_streams[stream_no]
+				|| player->stop_streams[stream_no];
+		pthread_mutex_unlock(&player->mutex_queue);
+		if (interrupted)
+			return 0;
+	}
+	delay = player_reverse_present_due(decoder_data, env);
+	return delay < 0 ? delay : 0;
+}
+
+int player_decode_video(struct DecoderData * decoder_data, JNIEnv * env,
+		struct PacketData *packet_data) {
+	int64_t time;
+	if (player_is_reverse_packet(decoder_data->player, packet_data))
+		return player_decode_video_reverse(decoder_data, env, packet_data);
+
+	int ret = player_decode_video_frame(decoder_data, packet_data, &time);
+	if (ret <= 0)
+		return ret;
+	return player_present_video(decoder_data, env, time, TRUE);
+}
+
+static int64_t player_packet_time(struct Player *player, int stream_no,
+		struct PacketData *packet_data) {
+	AVPacket *packet = packet_data->packet;
+	if (packet_data->end_of_stream || packet->pts == AV_NOPTS_VALUE)
+		return TRACE_NO_PTS;
+	return av_rescale_q(packet->pts, player->input_streams[stream_no]->time_base,
+			AV_TIME_BASE_Q);
+}
+
+/*
+ * In shared mode demux task does not wait on queues, it is scheduled again
+ * by consumers of the queues. No-op for threads.
+ */
+static void player_wake_demux(struct Player *player) {
+	if (player->shared_tasks_created)
+		executor_task_schedule(&player->demux_task);
+}
+
+static void player_wake_tasks(struct Player *player) {
+	if (!player->shared_tasks_created)
+		return;
+	executor_task_schedule(&player->demux_task);
+	executor_task_schedule(&player->video_task);
+}
+
+void * player_decode(void * data) {
+
+	int err = ERROR_NO_ERROR;
+	struct DecoderData *decoder_data = data;
+	struct Player *player = decoder_data->player;
+	int stream_no = decoder_data->stream_no;
+	Queue *queue = player->packets[stream_no];
+	AVCodecContext * ctx = player->input_codec_ctxs[stream_no];
+	enum AVMediaType codec_type = ctx->codec_type;
 
 	int stop = FALSE;
 	JNIEnv * env;
@@ -1055,6 +1985,7 @@ void * player_decode(void * data) {
 		err = -ERROR_COULD_NOT_ATTACH_THREAD;
 		goto end;
 	}
+	trace_set_thread_name("FFmpegDecode", stream_no);
 
 	for (;;) {
 		LOGI(10, "player_decode waiting for frame[%d]", stream_no);
@@ -1081,10 +2012,8 @@ void * player_decode(void * data) {
 			LOGI(10, "player_decode read end of stream");
 		}
 
-#ifdef MEASURE_TIME
-		struct timespec timespec1, timespec2;
-		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &timespec1);
-#endif // MEASURE_TIME
+		TRACE_BEGIN("packet", stream_no,
+				player_packet_time(player, stream_no, packet_data));
 		if (codec_type == AVMEDIA_TYPE_AUDIO) {
 			// Some audio sources need to be decoded multiple times when packet buffer is not empty
 			while(err >= 0 && packet_data->packet->size > 0) {
@@ -1102,27 +2031,16 @@ void * player_decode(void * data) {
 			assert(FALSE);
 		}
 
+		TRACE_END("packet", stream_no, TRACE_NO_PTS);
+
 		struct State state = {player: player, env:env};
 		player_update_time(&state, packet_data->end_of_stream);
 
-#ifdef MEASURE_TIME
-		char * type = "unknown";
-		if (codec_type == AVMEDIA_TYPE_AUDIO) {
-			type = "audio";
-		} else if (codec_type == AVMEDIA_TYPE_VIDEO) {
-			type = "video";
-		} else if (codec_type == AVMEDIA_TYPE_SUBTITLE) {
-			type = "subtitle";
-		}
-		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &timespec2);
-		struct timespec diff = timespec_diff(timespec1, timespec2);
-		LOGI(7,
-				"decode timediff (%s): %d.%9ld", type, diff.tv_sec, diff.tv_nsec);
-#endif // MEASURE_TIME
 		if (!packet_data->end_of_stream) {
 			av_free_packet(packet_data->packet);
 		}
 		queue_pop_finish(queue, &player->mutex_queue, &player->cond_queue);
+		player_wake_demux(player);
 		if (err < 0) {
 			pthread_mutex_lock(&player->mutex_queue);
 			goto stop;
@@ -1167,11 +2085,13 @@ void * player_decode(void * data) {
 			player->stop_streams[stream_no] = FALSE;
 			pthread_cond_broadcast(&player->cond_queue);
 			pthread_mutex_unlock(&player->mutex_queue);
+			player_wake_demux(player);
 			goto detach_current_thread;
 		} else {
 			LOGI(2, "player_decode flush stream[%d]", stream_no);
 			player->flush_streams[stream_no] = FALSE;
 			pthread_cond_broadcast(&player->cond_queue);
+			player_wake_demux(player);
 			goto pop;
 		}
 		end_loop: continue;
@@ -1225,19 +2145,245 @@ static int player_if_all_no_array_elements_has_value(struct Player *player,
 	return TRUE;
 }
 
+/*
+ * Seeks input to seek_position and requests streams to flush. On error
+ * seek request is dropped and playback continues without it.
+ */
+static int player_seek_already_locked(struct Player *player, JNIEnv *env) {
+	int seek_input_stream_number;
+	AVStream * seek_input_stream;
+	int64_t seek_target;
+
+	// setting stream thet will be used as a base for seeking
+	seek_input_stream_number =
+			player->input_stream_numbers[player->video_stream_no];
+	seek_input_stream = player->input_streams[player->video_stream_no];
+
+	// getting seek target time in time_base value
+	seek_target = av_rescale_q(
+			player->seek_position, AV_TIME_BASE_Q,
+			seek_input_stream->time_base);
+	TRACE_INSTANT("seek", TRACE_NO_STREAM, player->seek_position);
+	LOGI(3, "player_read_from_stream seeking to: "
+	"%fs, time_base: %" PRId64, player->seek_position / 1000000.0, seek_target);
+
+	// seeking, rewind starts from key frame before the position
+	if (av_seek_frame(player->input_format_ctx, seek_input_stream_number,
+			seek_target, player->trick_rate_requested < 0 ?
+					AVSEEK_FLAG_BACKWARD : 0) < 0) {
+		// seeking error - trying to play movie without it
+		LOGE(1, "Error while seeking");
+		player->seek_position = DO_NOT_SEEK;
+		pthread_cond_broadcast(&player->cond_queue);
+		return -1;
+	}
+
+	LOGI(3, "player_read_from_stream seeking success");
+
+	int64_t current_time = av_gettime();
+	player->start_time = current_time - player->seek_position;
+	player->pause_time = current_time;
+	player->trick_rate = player->trick_rate_requested;
+	player->trick_base_time = player->seek_position;
+	player->trick_start_time = current_time;
+	player->trick_position = AV_NOPTS_VALUE;
+	player->trick_end = FALSE;
+	player->trick_in_gop = FALSE;
+	player->trick_jump.target = AV_NOPTS_VALUE;
+
+	// request stream to flush
+	player_assign_to_no_boolean_array(player, player->flush_streams, TRUE);
+	if (player->audio_track != NULL) {
+		LOGI(3, "player_read_from_stream flushing audio")
+		// flush audio buffer
+		(*env)->CallVoidMethod(env, player->audio_track,
+				player->audio_track_flush_method);
+		LOGI(3, "player_read_from_stream flushed audio");
+	}
+	pthread_cond_broadcast(&player->cond_queue);
+	return 0;
+}
+
+static int64_t player_trick_packet_time(struct Player *player,
+		AVPacket *packet) {
+	AVStream *stream = player->input_streams[player->video_stream_no];
+	int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+	if (pts == AV_NOPTS_VALUE)
+		return AV_NOPTS_VALUE;
+	return av_rescale_q(pts, stream->time_base, AV_TIME_BASE_Q);
+}
+
+enum TrickFilter {
+	TRICK_FILTER_DROP = 0,
+	TRICK_FILTER_QUEUE,
+	// packet starts next GOP in reverse playback, input has to jump back
+	TRICK_FILTER_GOP_END,
+};
+
+/*
+ * Reverse playback queues whole GOPs starting with a key frame before
+ * the one read last time
+ */
+static enum TrickFilter player_reverse_filter_already_locked(
+		struct Player *player, AVPacket *packet, enum PacketTrick *trick) {
+	int key = packet->flags & AV_PKT_FLAG_KEY;
+	int64_t time = player_trick_packet_time(player, packet);
+
+	if (!player->trick_in_gop) {
+		if (!key)
+			return TRICK_FILTER_DROP;
+		if (time != AV_NOPTS_VALUE && player->trick_position != AV_NOPTS_VALUE
+				&& time >= player->trick_position) {
+			LOGI(3, "player_read_from_stream reverse play reached first GOP");
+			player->trick_end = TRUE;
+			return TRICK_FILTER_DROP;
+		}
+		player->trick_in_gop = TRUE;
+		player->trick_gop_time = time;
+		*trick = PACKET_TRICK_GOP_START;
+		return TRICK_FILTER_QUEUE;
+	}
+	if (key && time != AV_NOPTS_VALUE && time > player->trick_gop_time)
+		return TRICK_FILTER_GOP_END;
+	*trick = PACKET_TRICK_GOP;
+	return TRICK_FILTER_QUEUE;
+}
+
+/*
+ * Decides what to do with read packet. In trick play only video key
+ * frames further in play direction than the last queued one are kept,
+ * their time is returned in trick_time.
+ */
+static enum TrickFilter player_trick_filter_already_locked(
+		struct Player *player, int stream_no, AVPacket *packet,
+		enum PacketTrick *trick, int64_t *trick_time) {
+	int rate = player->trick_rate;
+	*trick = PACKET_TRICK_NONE;
+	if (rate == 0)
+		return TRICK_FILTER_QUEUE;
+	if (stream_no != player->video_stream_no)
+		return TRICK_FILTER_DROP;
+	if (rate == TRICK_RATE_REVERSE)
+		return player_reverse_filter_already_locked(player, packet, trick);
+	if (!(packet->flags & AV_PKT_FLAG_KEY))
+		return TRICK_FILTER_DROP;
+
+	*trick = PACKET_TRICK_KEY_FRAME;
+	*trick_time = player_trick_packet_time(player, packet);
+	if (*trick_time == AV_NOPTS_VALUE
+			|| player->trick_position == AV_NOPTS_VALUE)
+		return TRICK_FILTER_QUEUE;
+	if (rate > 0 && *trick_time <= player->trick_position) {
+		// seek landed before the last key frame, reading on reaches next
+		return TRICK_FILTER_DROP;
+	}
+	if (rate < 0 && *trick_time >= player->trick_position) {
+		LOGI(3, "player_read_from_stream trick play reached first key frame");
+		player->trick_end = TRUE;
+		return TRICK_FILTER_DROP;
+	}
+	return TRICK_FILTER_QUEUE;
+}
+
+/*
+ * Plans moving input to the key frame rate * TRICK_FRAME_US away from
+ * just queued key frame at trick_time, so only key frames are demuxed
+ * and the cost does not grow with the rate.
+ */
+static void player_trick_jump_already_locked(struct Player *player,
+		int64_t trick_time) {
+	int rate = player->trick_rate;
+	int stream_no = player->video_stream_no;
+	AVStream *stream = player->input_streams[stream_no];
+	struct TrickJump *jump = &player->trick_jump;
+	int64_t target;
+
+	if (trick_time == AV_NOPTS_VALUE) {
+		// nothing to jump from, key frames are found by reading
+		return;
+	}
+	player->trick_position = trick_time;
+	target = trick_time + rate * TRICK_FRAME_US;
+	if (target < 0)
+		target = 0;
+	TRACE_INSTANT("trick_jump", TRACE_NO_STREAM, target);
+	LOGI(5, "player_read_from_stream trick play jumping to %f",
+			target / 1000000.0);
+	jump->target = av_rescale_q(target, AV_TIME_BASE_Q, stream->time_base);
+	jump->stream_index = player->input_stream_numbers[stream_no];
+	jump->flags = rate < 0 ? AVSEEK_FLAG_BACKWARD : 0;
+	// forward reading on reaches next key frames or the end
+	jump->end_on_error = rate < 0;
+}
+
+/*
+ * GOP of reverse playback is read, plans moving input to the key frame
+ * before its start
+ */
+static void player_reverse_jump_already_locked(struct Player *player) {
+	int stream_no = player->video_stream_no;
+	AVStream *stream = player->input_streams[stream_no];
+	struct TrickJump *jump = &player->trick_jump;
+
+	player->trick_in_gop = FALSE;
+	player->trick_position = player->trick_gop_time;
+	if (player->trick_gop_time == AV_NOPTS_VALUE
+			|| player->trick_gop_time <= 0) {
+		player->trick_end = TRUE;
+		return;
+	}
+	TRACE_INSTANT("reverse_jump", TRACE_NO_STREAM, player->trick_gop_time);
+	LOGI(5, "player_read_from_stream reverse play jumping before %f",
+			player->trick_gop_time / 1000000.0);
+	jump->target = av_rescale_q(player->trick_gop_time, AV_TIME_BASE_Q,
+			stream->time_base) - 1;
+	jump->stream_index = player->input_stream_numbers[stream_no];
+	jump->flags = AVSEEK_FLAG_BACKWARD;
+	jump->end_on_error = TRUE;
+}
+
+/*
+ * Does the jump planned by player_*_jump_already_locked. Called by the
+ * demuxer without mutex_queue, the only user of input_format_ctx.
+ * Returns TRUE when trick play ended.
+ */
+static int player_trick_jump(struct Player *player) {
+	struct TrickJump *jump = &player->trick_jump;
+	int64_t target = jump->target;
+	int end = FALSE;
+
+	if (target == AV_NOPTS_VALUE)
+		return FALSE;
+	jump->target = AV_NOPTS_VALUE;
+	if (av_seek_frame(player->input_format_ctx, jump->stream_index, target,
+			jump->flags) >= 0)
+		return FALSE;
+	LOGI(3, "player_read_from_stream trick play could not seek");
+	if (!jump->end_on_error)
+		return FALSE;
+	pthread_mutex_lock(&player->mutex_queue);
+	// pending seek restarts trick play anyway
+	if (player->seek_position == DO_NOT_SEEK) {
+		player->trick_end = TRUE;
+		end = TRUE;
+	}
+	pthread_mutex_unlock(&player->mutex_queue);
+	return end;
+}
+
 void * player_read_from_stream(void *data) {
 	struct Player *player = (struct Player *) data;
 	int err = ERROR_NO_ERROR;
 
 	AVPacket packet, *pkt = &packet;
-	int64_t seek_target;
 	JNIEnv * env;
 	Queue *queue;
-	int seek_input_stream_number;
-	AVStream * seek_input_stream;
 	struct PacketData *packet_data;
 	int to_write;
 	int interrupt_ret;
+	enum TrickFilter trick_filter;
+	enum PacketTrick trick;
+	int64_t trick_time;
 	JavaVMAttachArgs thread_spec = { JNI_VERSION_1_4, "FFmpegReadFromStream",
 			NULL };
 
@@ -1247,11 +2393,35 @@ void * player_read_from_stream(void *data) {
 		err = ERROR_COULD_NOT_ATTACH_THREAD;
 		goto end;
 	}
+	trace_set_thread_name("FFmpegReadFromStream", TRACE_NO_STREAM);
 
 	for (;;) {
-		int ret = av_read_frame(player->input_format_ctx, pkt);
+		// jump planned with mutex_queue held, seeking could block
+		player_trick_jump(player);
+		int64_t demux_start = metrics_now_us();
+		TRACE_BEGIN("demux", TRACE_NO_STREAM, TRACE_NO_PTS);
+		int ret;
+		if (player->trick_end) {
+			// trick play has no more key frames in its direction
+			av_init_packet(pkt);
+			pkt->data = NULL;
+			pkt->size = 0;
+			ret = AVERROR_EOF;
+		} else {
+			ret = av_read_frame(player->input_format_ctx, pkt);
+		}
+		TRACE_END("demux", ret < 0 ? TRACE_NO_STREAM : pkt->stream_index,
+				TRACE_NO_PTS);
+		metrics_add_time(&player->metrics, METRICS_STAGE_DEMUX, demux_start);
 		if (ret < 0) {
 			pthread_mutex_lock(&player->mutex_queue);
+			if (player->trick_in_gop && !player->trick_end
+					&& player->seek_position == DO_NOT_SEEK) {
+				// reverse playback read the last GOP of the stream
+				player_reverse_jump_already_locked(player);
+				pthread_mutex_unlock(&player->mutex_queue);
+				continue;
+			}
 			LOGI(3, "player_read_from_stream stream end");
 			queue = player->packets[player->video_stream_no];
 			packet_data = queue_push_start_already_locked(queue,
@@ -1270,6 +2440,7 @@ void * player_read_from_stream(void *data) {
 				}
 			}
 			packet_data->end_of_stream = TRUE;
+			packet_data->trick = PACKET_TRICK_NONE;
 			LOGI(3, "player_read_from_stream sending end_of_stream packet");
 			queue_push_finish_already_locked(queue, &player->mutex_queue,
 					&player->cond_queue, to_write);
@@ -1285,6 +2456,7 @@ void * player_read_from_stream(void *data) {
 		}
 
 		LOGI(8, "player_read_from_stream Read frame");
+		metrics_count(&player->metrics, METRICS_COUNTER_BYTES_READ, pkt->size);
 		pthread_mutex_lock(&player->mutex_queue);
 		if (player->stop) {
 			LOGI(4, "player_read_from_stream stopping");
@@ -1295,13 +2467,16 @@ void * player_read_from_stream(void *data) {
 		}
 		int stream_no;
 		int caputre_streams_no = player->caputre_streams_no;
+		int packet_stream_no;
 
 		parse_frame: queue = NULL;
+		packet_stream_no = -1;
 		LOGI(3, "player_read_from_stream looking for stream")
 		for (stream_no = 0; stream_no < caputre_streams_no; ++stream_no) {
 			if (packet.stream_index
 					== player->input_stream_numbers[stream_no]) {
 				queue = player->packets[stream_no];
+				packet_stream_no = stream_no;
 				LOGI(3, "player_read_from_stream stream found [%d]", stream_no);
 			}
 		}
@@ -1311,6 +2486,18 @@ void * player_read_from_stream(void *data) {
 			goto skip_loop;
 		}
 
+		trick_time = AV_NOPTS_VALUE;
+		trick_filter = player_trick_filter_already_locked(player,
+				packet_stream_no, pkt, &trick, &trick_time);
+		if (trick_filter == TRICK_FILTER_GOP_END) {
+			player_reverse_jump_already_locked(player);
+			goto skip_loop;
+		}
+		if (trick_filter == TRICK_FILTER_DROP) {
+			LOGI(10, "player_read_from_stream trick play skipping packet");
+			goto skip_loop;
+		}
+
 		push_start:
 		LOGI(10, "player_read_from_stream waiting for queue");
 		packet_data = queue_push_start_already_locked(queue,
@@ -1331,6 +2518,7 @@ void * player_read_from_stream(void *data) {
 
 		pthread_mutex_unlock(&player->mutex_queue);
 		packet_data->end_of_stream = FALSE;
+		packet_data->trick = trick;
 		*packet_data->packet = packet;
 
 		if (av_dup_packet(packet_data->packet) < 0) {
@@ -1342,6 +2530,14 @@ void * player_read_from_stream(void *data) {
 		queue_push_finish(queue, &player->mutex_queue, &player->cond_queue,
 				to_write);
 
+		if (trick == PACKET_TRICK_KEY_FRAME) {
+			pthread_mutex_lock(&player->mutex_queue);
+			// with pending seek input is moved anyway
+			if (player->seek_position == DO_NOT_SEEK)
+				player_trick_jump_already_locked(player, trick_time);
+			pthread_mutex_unlock(&player->mutex_queue);
+		}
+
 		goto end_loop;
 
 		exit_loop:
@@ -1367,44 +2563,8 @@ void * player_read_from_stream(void *data) {
 		goto detach_current_thread;
 
 		seek_loop:
-		// setting stream thet will be used as a base for seeking
-		seek_input_stream_number =
-				player->input_stream_numbers[player->video_stream_no];
-		seek_input_stream = player->input_streams[player->video_stream_no];
-
-		// getting seek target time in time_base value
-		seek_target = av_rescale_q(
-				player->seek_position, AV_TIME_BASE_Q,
-				seek_input_stream->time_base);
-		LOGI(3, "player_read_from_stream seeking to: "
-		"%ds, time_base: %f", player->seek_position / 1000000.0, seek_target);
-
-		// seeking
-		if (av_seek_frame(player->input_format_ctx, seek_input_stream_number,
-				seek_target, 0) < 0) {
-			// seeking error - trying to play movie without it
-			LOGE(1, "Error while seeking");
-			player->seek_position = DO_NOT_SEEK;
-			pthread_cond_broadcast(&player->cond_queue);
+		if (player_seek_already_locked(player, env) < 0)
 			goto parse_frame;
-		}
-
-		LOGI(3, "player_read_from_stream seeking success");
-
-		int64_t current_time = av_gettime();
-		player->start_time = current_time - player->seek_position;
-		player->pause_time = current_time;
-
-		// request stream to flush
-		player_assign_to_no_boolean_array(player, player->flush_streams, TRUE);
-		if (player->audio_track != NULL) {
-			LOGI(3, "player_read_from_stream flushing audio")
-			// flush audio buffer
-			(*env)->CallVoidMethod(env, player->audio_track,
-					player->audio_track_flush_method);
-			LOGI(3, "player_read_from_stream flushed audio");
-		}
-		pthread_cond_broadcast(&player->cond_queue);
 
 		LOGI(3, "player_read_from_stream waiting for flush");
 
@@ -1428,92 +2588,586 @@ void * player_read_from_stream(void *data) {
 		skip_loop: av_free_packet(pkt);
 		pthread_mutex_unlock(&player->mutex_queue);
 
-		end_loop: continue;
+		end_loop: continue;
+	}
+
+	detach_current_thread: ret = (*player->get_javavm)->DetachCurrentThread(
+			player->get_javavm);
+	if (ret && !err)
+		err = ERROR_COULD_NOT_DETACH_THREAD;
+
+	end:
+
+	// TODO do something with error valuse
+	return NULL;
+}
+
+int player_write_audio(struct DecoderData *decoder_data, JNIEnv *env,
+		int64_t pts, uint8_t *data, int data_size, int original_data_size) {
+	struct Player *player = decoder_data->player;
+	int stream_no = decoder_data->stream_no;
+	int err = ERROR_NO_ERROR;
+	int ret;
+	AVCodecContext * c = player->input_codec_ctxs[stream_no];
+	AVStream *stream = player->input_streams[stream_no];
+	LOGI(10, "player_write_audio Writing audio frame")
+
+	jbyteArray samples_byte_array = (*env)->NewByteArray(env, data_size);
+	if (samples_byte_array == NULL) {
+		err = -ERROR_NOT_CREATED_AUDIO_SAMPLE_BYTE_ARRAY;
+		goto end;
+	}
+
+	if (pts != AV_NOPTS_VALUE) {
+		player->audio_clock = av_rescale_q(pts, stream->time_base, AV_TIME_BASE_Q);
+//				av_q2d(stream->time_base) * pts;
+		LOGI(9, "player_write_audio - read from pts")
+	} else {
+		int64_t sample_time = original_data_size;
+		sample_time *= 1000000ll;
+		sample_time /= c->channels;
+		sample_time /= c->sample_rate;
+		sample_time /= av_get_bytes_per_sample(c->sample_fmt);
+		player->audio_clock += sample_time;
+		LOGI(9, "player_write_audio - added")
+	}
+	enum WaitFuncRet wait_ret = player_wait_for_frame(player,
+			player->audio_clock + AUDIO_TIME_ADJUST_US, stream_no);
+	if (wait_ret == WAIT_FUNC_RET_SKIP) {
+		goto end;
+	}
+
+	LOGI(10, "player_write_audio Writing sample data")
+	int64_t write_start = metrics_now_us();
+	TRACE_BEGIN("audio_write", stream_no, player->audio_clock);
+
+	jbyte *jni_samples = (*env)->GetByteArrayElements(env, samples_byte_array,
+			NULL);
+	memcpy(jni_samples, data, data_size);
+	(*env)->ReleaseByteArrayElements(env, samples_byte_array, jni_samples, 0);
+
+	LOGI(10, "player_write_audio playing audio track");
+	ret = (*env)->CallIntMethod(env, player->audio_track,
+			player->audio_track_write_method, samples_byte_array, 0, data_size);
+	metrics_add_time(&player->metrics, METRICS_STAGE_AUDIO_WRITE, write_start);
+	TRACE_END("audio_write", stream_no, TRACE_NO_PTS);
+	jthrowable exc = (*env)->ExceptionOccurred(env);
+	if (exc) {
+		err = -ERROR_PLAYING_AUDIO;
+		LOGE(3, "Could not write audio track: reason in exception");
+		// TODO maybe release exc
+		goto free_local_ref;
+	}
+	if (ret < 0) {
+		err = -ERROR_PLAYING_AUDIO;
+		LOGE(3,
+				"Could not write audio track: reason: %d look in AudioTrack.write()", ret);
+		goto free_local_ref;
+	}
+
+	free_local_ref:
+	LOGI(10, "player_write_audio releasing local ref");
+	(*env)->DeleteLocalRef(env, samples_byte_array);
+
+	end: return err;
+}
+
+static pthread_once_t player_executors_once = PTHREAD_ONCE_INIT;
+static JavaVM *player_executors_javavm = NULL;
+// workers live as long as the process, like aes pool
+static struct Executor *player_decode_executor = NULL;
+static struct Executor *player_io_executor = NULL;
+
+static void player_executor_attach(const char *name) {
+	JNIEnv *env;
+	JavaVMAttachArgs thread_spec = { JNI_VERSION_1_4, (char *) name, NULL };
+	if ((*player_executors_javavm)->AttachCurrentThread(
+			player_executors_javavm, &env, &thread_spec)) {
+		LOGE(1, "player_executor_attach: could not attach %s", name);
+	}
+	trace_set_thread_name(name, TRACE_NO_STREAM);
+}
+
+static void player_decode_worker_start(void *data) {
+	player_executor_attach("FFmpegDecodeWorker");
+}
+
+static void player_io_worker_start(void *data) {
+	player_executor_attach("FFmpegIoWorker");
+}
+
+static void player_worker_stop(void *data) {
+	(*player_executors_javavm)->DetachCurrentThread(player_executors_javavm);
+}
+
+static void player_executors_start() {
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cores < 1)
+		cores = 1;
+	player_decode_executor = executor_create("decode", cores,
+			player_decode_worker_start, player_worker_stop, NULL);
+	player_io_executor = executor_create("io", cores * IO_WORKERS_PER_CORE,
+			player_io_worker_start, player_worker_stop, NULL);
+}
+
+static JNIEnv *player_get_env(struct Player *player) {
+	JNIEnv *env = NULL;
+	(*player->get_javavm)->GetEnv(player->get_javavm, (void **) &env,
+			JNI_VERSION_1_4);
+	return env;
+}
+
+static void player_flush_codecs_already_locked(struct Player *player) {
+	int stream_no;
+	for (stream_no = 0; stream_no < player->caputre_streams_no; ++stream_no) {
+		avcodec_flush_buffers(player->input_codec_ctxs[stream_no]);
+	}
+}
+
+static void player_demux_drop_pending_already_locked(struct Player *player) {
+	if (player->demux_pending == DEMUX_PENDING_PACKET)
+		av_free_packet(&player->demux_packet);
+	player->demux_pending = DEMUX_PENDING_NONE;
+}
+
+/*
+ * Pushes packet read by demux task. Returns FALSE when target queue is
+ * full, demux task is scheduled again when the queue consumer pops.
+ */
+static int player_demux_push_already_locked(struct Player *player) {
+	int end_of_stream = player->demux_pending == DEMUX_PENDING_END_OF_STREAM;
+	int stream_no = -1;
+	struct PacketData *packet_data;
+	Queue *queue;
+	int to_write;
+	enum TrickFilter trick_filter;
+	enum PacketTrick trick = PACKET_TRICK_NONE;
+	int64_t trick_time = AV_NOPTS_VALUE;
+	int i;
+
+	if (end_of_stream) {
+		stream_no = player->video_stream_no;
+	} else {
+		for (i = 0; i < player->caputre_streams_no; ++i) {
+			if (player->demux_packet.stream_index
+					== player->input_stream_numbers[i])
+				stream_no = i;
+		}
+		if (stream_no < 0) {
+			LOGI(3, "player_demux_task stream not found");
+			player_demux_drop_pending_already_locked(player);
+			return TRUE;
+		}
+		trick_filter = player_trick_filter_already_locked(player, stream_no,
+				&player->demux_packet, &trick, &trick_time);
+		if (trick_filter == TRICK_FILTER_GOP_END)
+			player_reverse_jump_already_locked(player);
+		if (trick_filter != TRICK_FILTER_QUEUE) {
+			player_demux_drop_pending_already_locked(player);
+			return TRUE;
+		}
+	}
+
+	queue = player->packets[stream_no];
+	packet_data = queue_push_start_already_locked_non_block(queue, &to_write);
+	if (packet_data == NULL)
+		return FALSE;
+
+	packet_data->end_of_stream = end_of_stream;
+	packet_data->trick = trick;
+	if (end_of_stream) {
+		LOGI(3, "player_demux_task sending end_of_stream packet");
+		player->demux_state = DEMUX_STATE_END_OF_STREAM;
+	} else {
+		*packet_data->packet = player->demux_packet;
+		if (av_dup_packet(packet_data->packet) < 0) {
+			// like end of stream, reading stops until seek or stop
+			LOGE(1, "player_demux_task could not duplicate packet");
+			av_free_packet(packet_data->packet);
+			packet_data->end_of_stream = TRUE;
+			packet_data->trick = trick = PACKET_TRICK_NONE;
+			player->demux_state = DEMUX_STATE_END_OF_STREAM;
+		}
+	}
+	queue_push_finish_already_locked(queue, &player->mutex_queue,
+			&player->cond_queue, to_write);
+	player->demux_pending = DEMUX_PENDING_NONE;
+	if (trick == PACKET_TRICK_KEY_FRAME)
+		player_trick_jump_already_locked(player, trick_time);
+	if (stream_no == player->video_stream_no)
+		executor_task_schedule(&player->video_task);
+	return TRUE;
+}
+
+/*
+ * Shared mode counterpart of player_read_from_stream. Instead of waiting
+ * for queues and for flush/stop of decoders it remembers where it stopped
+ * in demux_state/demux_pending and returns.
+ */
+static void player_demux_task(void *data) {
+	struct Player *player = data;
+	JNIEnv *env = player_get_env(player);
+	int packets = 0;
+	int ret;
+
+	pthread_mutex_lock(&player->mutex_queue);
+	for (;;) {
+		if (player->demux_state == DEMUX_STATE_WAIT_FLUSH) {
+			if (!player_if_all_no_array_elements_has_value(player,
+					player->flush_streams, FALSE))
+				break;
+			LOGI(3, "player_demux_task flushing internal codec bffers");
+			player_flush_codecs_already_locked(player);
+			// finishing seeking
+			player->seek_position = DO_NOT_SEEK;
+			pthread_cond_broadcast(&player->cond_queue);
+			player->demux_state = DEMUX_STATE_READ;
+			continue;
+		}
+		if (player->demux_state == DEMUX_STATE_WAIT_STOP) {
+			if (!player_if_all_no_array_elements_has_value(player,
+					player->stop_streams, FALSE))
+				break;
+			player_flush_codecs_already_locked(player);
+			player->demux_state = DEMUX_STATE_DONE;
+			pthread_cond_broadcast(&player->cond_queue);
+			break;
+		}
+		if (player->demux_state == DEMUX_STATE_DONE)
+			break;
+
+		if (player->stop) {
+			LOGI(3, "player_demux_task stop");
+			player_demux_drop_pending_already_locked(player);
+			player_assign_to_no_boolean_array(player, player->stop_streams,
+					TRUE);
+			pthread_cond_broadcast(&player->cond_queue);
+			player->demux_state = DEMUX_STATE_WAIT_STOP;
+			executor_task_schedule(&player->video_task);
+			continue;
+		}
+		if (player->seek_position != DO_NOT_SEEK) {
+			if (player_seek_already_locked(player, env) < 0)
+				continue;
+			player_demux_drop_pending_already_locked(player);
+			player->demux_state = DEMUX_STATE_WAIT_FLUSH;
+			executor_task_schedule(&player->video_task);
+			continue;
+		}
+
+		if (player->demux_pending != DEMUX_PENDING_NONE) {
+			if (!player_demux_push_already_locked(player))
+				break;
+			continue;
+		}
+		if (player->demux_state == DEMUX_STATE_END_OF_STREAM)
+			break;
+		if (packets++ >= DEMUX_TASK_PACKETS) {
+			// let other players demux
+			executor_task_schedule(&player->demux_task);
+			break;
+		}
+
+		int trick_end = player->trick_end;
+		pthread_mutex_unlock(&player->mutex_queue);
+		// jump planned with mutex_queue held, seeking could block
+		if (player_trick_jump(player))
+			trick_end = TRUE;
+		int64_t demux_start = metrics_now_us();
+		TRACE_BEGIN("demux", TRACE_NO_STREAM, TRACE_NO_PTS);
+		// trick play has no more key frames in its direction
+		ret = trick_end ? AVERROR_EOF
+				: av_read_frame(player->input_format_ctx, &player->demux_packet);
+		TRACE_END("demux", ret < 0 ? TRACE_NO_STREAM
+				: player->demux_packet.stream_index, TRACE_NO_PTS);
+		metrics_add_time(&player->metrics, METRICS_STAGE_DEMUX, demux_start);
+		pthread_mutex_lock(&player->mutex_queue);
+		if (ret < 0 && player->trick_in_gop && !player->trick_end) {
+			// reverse playback read the last GOP of the stream
+			player_reverse_jump_already_locked(player);
+		} else if (ret < 0) {
+			LOGI(3, "player_demux_task stream end");
+			player->demux_pending = DEMUX_PENDING_END_OF_STREAM;
+		} else {
+			metrics_count(&player->metrics, METRICS_COUNTER_BYTES_READ,
+					player->demux_packet.size);
+			player->demux_pending = DEMUX_PENDING_PACKET;
+		}
+	}
+	pthread_mutex_unlock(&player->mutex_queue);
+}
+
+static void player_video_task_flush_already_locked(
+		struct DecoderData *decoder_data, JNIEnv *env) {
+	struct Player *player = decoder_data->player;
+	int stream_no = decoder_data->stream_no;
+	Queue *queue = player->packets[stream_no];
+	struct PacketData *to_free;
+
+	LOGI(2, "player_video_task flush[%d]", stream_no);
+	if (player->video_packet_data != NULL) {
+		// frame waiting for its time is dropped
+		if (!player->video_packet_data->end_of_stream)
+			av_free_packet(player->video_packet_data->packet);
+		queue_pop_finish_already_locked(queue, &player->mutex_queue,
+				&player->cond_queue);
+		player->video_packet_data = NULL;
+	}
+	while ((to_free = queue_pop_start_already_locked_non_block(queue))
+			!= NULL) {
+		if (!to_free->end_of_stream) {
+			av_free_packet(to_free->packet);
+		}
+		queue_pop_finish_already_locked(queue, &player->mutex_queue,
+				&player->cond_queue);
+	}
+	player_decode_video_flush(decoder_data, env);
+
+	if (player->stop_streams[stream_no]) {
+		player->stop_streams[stream_no] = FALSE;
+	} else {
+		player->flush_streams[stream_no] = FALSE;
+		player->video_task_stopped = FALSE;
+	}
+	pthread_cond_broadcast(&player->cond_queue);
+}
+
+/*
+ * Reverse playback in shared mode. Presents due frames, feeds one packet
+ * and when packet has to wait for presented GOP puts it back and delays
+ * the task until the next frame is due.
+ */
+static void player_video_task_reverse(struct DecoderData *decoder_data,
+		JNIEnv *env) {
+	struct Player *player = decoder_data->player;
+	int stream_no = decoder_data->stream_no;
+	Queue *queue = player->packets[stream_no];
+	struct State state = {player: player, env: env};
+	struct PacketData *packet_data;
+	int64_t delay;
+
+	delay = player_reverse_present_due(decoder_data, env);
+	if (delay < 0)
+		goto error;
+
+	pthread_mutex_lock(&player->mutex_queue);
+	packet_data = queue_pop_start_already_locked_non_block(queue);
+	pthread_mutex_unlock(&player->mutex_queue);
+	if (packet_data == NULL) {
+		// scheduled again by demux task or when the frame is due
+		goto wait;
+	}
+
+	if (player_reverse_packet(decoder_data, packet_data) == 0) {
+		pthread_mutex_lock(&player->mutex_queue);
+		queue_pop_roll_back_already_locked(queue, &player->mutex_queue,
+				&player->cond_queue);
+		pthread_mutex_unlock(&player->mutex_queue);
+		// GOP could be just completed
+		delay = player_reverse_present_due(decoder_data, env);
+		if (delay < 0)
+			goto error;
+		if (delay == 0) {
+			executor_task_schedule(&player->video_task);
+			return;
+		}
+		goto wait;
+	}
+
+	player_update_time(&state, packet_data->end_of_stream);
+	if (!packet_data->end_of_stream) {
+		av_free_packet(packet_data->packet);
+	}
+	pthread_mutex_lock(&player->mutex_queue);
+	queue_pop_finish_already_locked(queue, &player->mutex_queue,
+			&player->cond_queue);
+	pthread_mutex_unlock(&player->mutex_queue);
+	player_wake_demux(player);
+	executor_task_schedule(&player->video_task);
+	return;
+
+wait:
+	if (delay > 0)
+		executor_task_schedule_delayed(&player->video_task,
+				delay > 500000ll ? 500000ll : delay);
+	return;
+
+error:
+	LOGE(1, "player_video_task_reverse error: %d", (int) delay);
+	pthread_mutex_lock(&player->mutex_queue);
+	player->video_task_stopped = TRUE;
+	pthread_mutex_unlock(&player->mutex_queue);
+}
+
+/*
+ * Shared mode counterpart of player_decode for video stream. Decodes one
+ * packet per run, frame that is not yet due is kept and task is delayed
+ * until its time, so a waiting player never holds a worker.
+ */
+static void player_video_task(void *data) {
+	struct DecoderData *decoder_data = data;
+	struct Player *player = decoder_data->player;
+	int stream_no = decoder_data->stream_no;
+	Queue *queue = player->packets[stream_no];
+	JNIEnv *env = player_get_env(player);
+	struct State state = {player: player, env: env};
+	struct PacketData *packet_data;
+	int64_t delay;
+	int err;
+
+	pthread_mutex_lock(&player->mutex_queue);
+	if (player->stop_streams[stream_no] || player->flush_streams[stream_no]) {
+		player_video_task_flush_already_locked(decoder_data, env);
+		pthread_mutex_unlock(&player->mutex_queue);
+		player_wake_demux(player);
+		return;
+	}
+	if (player->video_task_stopped || player->pause) {
+		// scheduled again by seek, stop or resume
+		pthread_mutex_unlock(&player->mutex_queue);
+		return;
+	}
+
+	if (player->trick_rate == TRICK_RATE_REVERSE) {
+		pthread_mutex_unlock(&player->mutex_queue);
+		player_video_task_reverse(decoder_data, env);
+		return;
+	}
+
+	packet_data = player->video_packet_data;
+	if (packet_data == NULL) {
+		packet_data = queue_pop_start_already_locked_non_block(queue);
+		if (packet_data == NULL) {
+			// scheduled again by demux task
+			pthread_mutex_unlock(&player->mutex_queue);
+			return;
+		}
+		player->video_packet_data = packet_data;
+		pthread_mutex_unlock(&player->mutex_queue);
+
+		TRACE_BEGIN("packet", stream_no,
+				player_packet_time(player, stream_no, packet_data));
+		err = player_decode_video_frame(decoder_data, packet_data,
+				&player->video_frame_time);
+		TRACE_END("packet", stream_no, TRACE_NO_PTS);
+		if (err < 0)
+			goto error;
+		if (err == 0)
+			goto finish_packet;
+		player->video_frame_checked = FALSE;
+		pthread_mutex_lock(&player->mutex_queue);
+	}
+
+	delay = player_frame_delay_already_locked(player, player->video_frame_time,
+			stream_no, !player->video_frame_checked);
+	player->video_frame_checked = TRUE;
+	pthread_mutex_unlock(&player->mutex_queue);
+	if (delay > MIN_SLEEP_TIME_US) {
+		executor_task_schedule_delayed(&player->video_task,
+				delay > 500000ll ? 500000ll : delay);
+		return;
 	}
 
-	detach_current_thread: ret = (*player->get_javavm)->DetachCurrentThread(
-			player->get_javavm);
-	if (ret && !err)
-		err = ERROR_COULD_NOT_DETACH_THREAD;
+	err = player_present_video(decoder_data, env, player->video_frame_time,
+			FALSE);
+	if (err < 0)
+		goto error;
 
-	end:
+finish_packet:
+	player_update_time(&state, packet_data->end_of_stream);
+	if (!packet_data->end_of_stream) {
+		av_free_packet(packet_data->packet);
+	}
+	pthread_mutex_lock(&player->mutex_queue);
+	player->video_packet_data = NULL;
+	queue_pop_finish_already_locked(queue, &player->mutex_queue,
+			&player->cond_queue);
+	pthread_mutex_unlock(&player->mutex_queue);
+	player_wake_demux(player);
+	executor_task_schedule(&player->video_task);
+	return;
 
-	// TODO do something with error valuse
-	return NULL;
+error:
+	LOGE(1, "player_video_task error: %d", err);
+	if (!packet_data->end_of_stream) {
+		av_free_packet(packet_data->packet);
+	}
+	pthread_mutex_lock(&player->mutex_queue);
+	player->video_packet_data = NULL;
+	player->video_task_stopped = TRUE;
+	queue_pop_finish_already_locked(queue, &player->mutex_queue,
+			&player->cond_queue);
+	pthread_mutex_unlock(&player->mutex_queue);
+	player_wake_demux(player);
 }
 
-int player_write_audio(struct DecoderData *decoder_data, JNIEnv *env,
-		int64_t pts, uint8_t *data, int data_size, int original_data_size) {
-	struct Player *player = decoder_data->player;
-	int stream_no = decoder_data->stream_no;
-	int err = ERROR_NO_ERROR;
-	int ret;
-	AVCodecContext * c = player->input_codec_ctxs[stream_no];
-	AVStream *stream = player->input_streams[stream_no];
-	LOGI(10, "player_write_audio Writing audio frame")
+static int player_start_tasks(struct Player *player) {
+	struct DecoderData *decoder_data = &player->video_decoder_data;
 
-	jbyteArray samples_byte_array = (*env)->NewByteArray(env, data_size);
-	if (samples_byte_array == NULL) {
-		err = -ERROR_NOT_CREATED_AUDIO_SAMPLE_BYTE_ARRAY;
-		goto end;
+	player_executors_javavm = player->get_javavm;
+	pthread_once(&player_executors_once, player_executors_start);
+	if (player_decode_executor == NULL || player_io_executor == NULL) {
+		LOGE(1, "player_start_tasks: no shared workers, using threads");
+		player->shared = FALSE;
+		return 0;
 	}
 
-	if (pts != AV_NOPTS_VALUE) {
-		player->audio_clock = av_rescale_q(pts, stream->time_base, AV_TIME_BASE_Q);
-//				av_q2d(stream->time_base) * pts;
-		LOGI(9, "player_write_audio - read from pts")
-	} else {
-		int64_t sample_time = original_data_size;
-		sample_time *= 1000000ll;
-		sample_time /= c->channels;
-		sample_time /= c->sample_rate;
-		sample_time /= av_get_bytes_per_sample(c->sample_fmt);
-		player->audio_clock += sample_time;
-		LOGI(9, "player_write_audio - added")
-	}
-	enum WaitFuncRet wait_ret = player_wait_for_frame(player,
-			player->audio_clock + AUDIO_TIME_ADJUST_US, stream_no);
-	if (wait_ret == WAIT_FUNC_RET_SKIP) {
-		goto end;
-	}
+	*decoder_data = (struct DecoderData) {player: player,
+			stream_no: player->video_stream_no};
+	pthread_mutex_lock(&player->mutex_queue);
+	// started by player_start_tasks_run when all threads are up
+	player->demux_state = DEMUX_STATE_DONE;
+	player->demux_pending = DEMUX_PENDING_NONE;
+	player->video_packet_data = NULL;
+	player->video_task_stopped = FALSE;
+	pthread_mutex_unlock(&player->mutex_queue);
 
-	LOGI(10, "player_write_audio Writing sample data")
+	executor_task_init(&player->demux_task, player_io_executor,
+			player_demux_task, player, player->shared_priority);
+	executor_task_init(&player->video_task, player_decode_executor,
+			player_video_task, decoder_data, player->shared_priority);
+	player->shared_tasks_created = TRUE;
+	return 0;
+}
 
-	jbyte *jni_samples = (*env)->GetByteArrayElements(env, samples_byte_array,
-			NULL);
-	memcpy(jni_samples, data, data_size);
-	(*env)->ReleaseByteArrayElements(env, samples_byte_array, jni_samples, 0);
+static void player_start_tasks_run(struct Player *player) {
+	pthread_mutex_lock(&player->mutex_queue);
+	player->demux_state = DEMUX_STATE_READ;
+	pthread_mutex_unlock(&player->mutex_queue);
+	executor_task_schedule(&player->demux_task);
+}
 
-	LOGI(10, "player_write_audio playing audio track");
-	ret = (*env)->CallIntMethod(env, player->audio_track,
-			player->audio_track_write_method, samples_byte_array, 0, data_size);
-	jthrowable exc = (*env)->ExceptionOccurred(env);
-	if (exc) {
-		err = -ERROR_PLAYING_AUDIO;
-		LOGE(3, "Could not write audio track: reason in exception");
-		// TODO maybe release exc
-		goto free_local_ref;
-	}
-	if (ret < 0) {
-		err = -ERROR_PLAYING_AUDIO;
-		LOGE(3,
-				"Could not write audio track: reason: %d look in AudioTrack.write()", ret);
-		goto free_local_ref;
+static void player_set_priority(struct Player *player, int priority) {
+	if (priority < EXECUTOR_PRIORITY_HIGH || priority > EXECUTOR_PRIORITY_LOW) {
+		LOGE(1, "player_set_priority: wrong priority %d", priority);
+		return;
 	}
+	player->shared_priority = priority;
+	governor_set_priority(&player->governor, priority);
+	executor_task_set_priority(&player->demux_task, priority);
+	executor_task_set_priority(&player->video_task, priority);
+}
 
-	free_local_ref:
-	LOGI(10, "player_write_audio releasing local ref");
-	(*env)->DeleteLocalRef(env, samples_byte_array);
+static void player_start_tasks_free(struct Player *player) {
+	if (!player->shared_tasks_created)
+		return;
+	// stop was requested by player_play_prepare_free
+	pthread_mutex_lock(&player->mutex_queue);
+	while (player->demux_state != DEMUX_STATE_DONE)
+		pthread_cond_wait(&player->cond_queue, &player->mutex_queue);
+	pthread_mutex_unlock(&player->mutex_queue);
 
-	end: return err;
+	executor_task_cancel(&player->demux_task);
+	executor_task_cancel(&player->video_task);
+	player->shared_tasks_created = FALSE;
 }
 
 struct Player * player_get_player_field(JNIEnv *env, jobject thiz) {
 
 	jfieldID m_native_layer_field = java_get_field(env, player_class_path_name,
 			player_m_native_player);
-	struct Player * player = (struct Player *) (*env)->GetIntField(env, thiz,
-			m_native_layer_field);
+	struct Player * player = (struct Player *) (intptr_t) (*env)->GetLongField(
+			env, thiz, m_native_layer_field);
 	return player;
 }
 
@@ -1791,7 +3445,7 @@ int player_print_report_video_streams(JNIEnv* env, jobject thiz,
 
 void player_print_video_informations(struct Player *player,
 		const char *file_path) {
-	if (LOG_LEVEL >= 4) {
+	if (!LOG_ENABLED(LOG_SUBSYSTEM, 4)) {
 		return;
 	}
 	int i;
@@ -1834,6 +3488,8 @@ void player_print_video_informations(struct Player *player,
 int player_alloc_frames_free(struct Player *player) {
 	int capture_streams_no = player->caputre_streams_no;
 	int stream_no;
+	frame_cache_free(&player->reverse_caches[0]);
+	frame_cache_free(&player->reverse_caches[1]);
 	for (stream_no = 0; stream_no < capture_streams_no; ++stream_no) {
 		if (player->input_frames[stream_no] != NULL) {
 			av_free(player->input_frames[stream_no]);
@@ -1846,6 +3502,14 @@ int player_alloc_frames_free(struct Player *player) {
 int player_alloc_frames(struct Player *player) {
 	int capture_streams_no = player->caputre_streams_no;
 	int stream_no;
+	// budget is split between decoded and presented GOP
+	size_t reverse_budget = (size_t) player->reverse_cache_mb * 1024 * 1024 / 2;
+	frame_cache_init(&player->reverse_caches[0], reverse_budget,
+			player->reverse_cache_scale);
+	frame_cache_init(&player->reverse_caches[1], reverse_budget,
+			player->reverse_cache_scale);
+	player->reverse_filling = 0;
+	player->reverse_filling_started = FALSE;
 	for (stream_no = 0; stream_no < capture_streams_no; ++stream_no) {
 		player->input_frames[stream_no] = avcodec_alloc_frame();
 		if (player->input_frames[stream_no] == NULL) {
@@ -2057,7 +3721,13 @@ int player_start_decoding_threads(struct Player *player) {
 		err = -ERROR_COULD_NOT_INIT_PTHREAD_ATTR;
 		goto end;
 	}
+	if (player->shared) {
+		if ((err = player_start_tasks(player)) < 0)
+			goto end;
+	}
 	for (i = 0; i < player->caputre_streams_no; ++i) {
+		if (player->shared && i == player->video_stream_no)
+			continue;
 		struct DecoderData * decoder_data = malloc(sizeof(decoder_data));
 		*decoder_data = (struct DecoderData) {player: player, stream_no: i};
 		ret = pthread_create(&player->decode_threads[i], &attr, player_decode,
@@ -2069,6 +3739,10 @@ int player_start_decoding_threads(struct Player *player) {
 		player->decode_threads_created[i] = TRUE;
 	}
 
+	if (player->shared) {
+		player_start_tasks_run(player);
+		goto end;
+	}
 	ret = pthread_create(&player->thread_player_read_from_stream, &attr,
 			player_read_from_stream, player);
 	if (ret) {
@@ -2090,6 +3764,7 @@ int player_start_decoding_threads_free(struct Player *player) {
 	int err = 0;
 	int ret;
 	int i;
+	player_start_tasks_free(player);
 	if (player->thread_player_read_from_stream_created) {
 		ret = pthread_join(player->thread_player_read_from_stream, NULL);
 		player->thread_player_read_from_stream_created = FALSE;
@@ -2173,6 +3848,7 @@ void player_play_prepare_free(struct Player *player) {
 	player->stop = TRUE;
 	pthread_cond_broadcast(&player->cond_queue);
 	pthread_mutex_unlock(&player->mutex_queue);
+	player_wake_demux(player);
 }
 
 void player_play_prepare(struct Player *player) {
@@ -2180,6 +3856,11 @@ void player_play_prepare(struct Player *player) {
 	pthread_mutex_lock(&player->mutex_queue);
 	player->stop = FALSE;
 	player->seek_position = DO_NOT_SEEK;
+	player->trick_rate = 0;
+	player->trick_rate_requested = 0;
+	player->trick_position = AV_NOPTS_VALUE;
+	player->trick_end = FALSE;
+	player->trick_jump.target = AV_NOPTS_VALUE;
 	player_assign_to_no_boolean_array(player, player->flush_streams, FALSE);
 	player_assign_to_no_boolean_array(player, player->stop_streams, FALSE);
 
@@ -2190,6 +3871,7 @@ void player_play_prepare(struct Player *player) {
 #ifdef SUBTITLES
 
 void player_prepare_ass_decoder_free(struct Player *player) {
+	overlay_free(&player->ass_overlay);
 	if (player->ass_track != NULL) {
 		ass_free_track(player->ass_track);
 		player->ass_track = NULL;
@@ -2204,7 +3886,8 @@ void player_prepare_ass_decoder_free(struct Player *player) {
 	}
 }
 
-int player_prepare_ass_decoder(struct Player* player, const char *font_path) {
+int player_prepare_ass_decoder(struct Player* player, const char *font_path,
+		int glyph_cache_max, int bitmap_cache_max_mb) {
 	AVCodecContext* ctx = player->input_codec_ctxs[player->video_stream_no];
 	player->ass_library = ass_library_init();
 	if (player->ass_library == NULL)
@@ -2217,6 +3900,11 @@ int player_prepare_ass_decoder(struct Player* player, const char *font_path) {
 		return -ERROR_COULD_NOT_PREPARE_ASS_RENDERER;
 
 	ass_set_frame_size(player->ass_renderer, ctx->width, ctx->height);
+	// 0 keeps libass defaults
+	ass_set_cache_limits(player->ass_renderer, glyph_cache_max,
+			bitmap_cache_max_mb);
+	overlay_init(&player->ass_overlay);
+	player->ass_renderer_user = ASS_RENDERER_USER_NONE;
 	LOGI(3,
 			"player_prepare_ass_decoder: setting ass default font to: %s", font_path);
 	ass_set_fonts(player->ass_renderer, font_path, NULL, 1, NULL, 1);
@@ -2245,6 +3933,121 @@ int player_prepare_ass_decoder(struct Player* player, const char *font_path) {
 #endif // SUBTITLES
 
 
+void player_open_checksum_log_free(struct Player *player) {
+	if (player->checksum_file != NULL) {
+		fclose(player->checksum_file);
+		player->checksum_file = NULL;
+	}
+	player->checksum_present = TRUE;
+}
+
+void player_start_governor_free(struct Player *player) {
+	governor_unregister(&player->governor);
+}
+
+void player_start_governor(struct Player *player, AVDictionary *dictionary) {
+	AVDictionaryEntry *entry = av_dict_get(dictionary, "governor", NULL, 0);
+	player->governor_level = GOVERNOR_LEVEL_NONE;
+	player->governor_cost_us = 0;
+	if (entry != NULL && strcmp(entry->value, "0") == 0)
+		return;
+	// checksums have to match reference decoding
+	if (player->checksum_file != NULL)
+		return;
+	governor_register(&player->governor, player->shared_priority);
+}
+
+/*
+ * "reverse_cache_mb" - memory for decoded frames in reverse playback,
+ * when GOP does not fit, only some of its frames are shown
+ * "reverse_cache_scale" - 1 or 2 keeps frames downscaled 2 or 4 times
+ * in reverse playback, so longer GOPs fit into the memory
+ */
+void player_read_reverse_options(struct Player *player,
+		AVDictionary *dictionary) {
+	AVDictionaryEntry *entry = av_dict_get(dictionary, "reverse_cache_mb",
+			NULL, 0);
+	player->reverse_cache_mb = REVERSE_CACHE_DEFAULT_MB;
+	if (entry != NULL && atoi(entry->value) > 0)
+		player->reverse_cache_mb = atoi(entry->value);
+	player->reverse_cache_scale = 0;
+	entry = av_dict_get(dictionary, "reverse_cache_scale", NULL, 0);
+	if (entry != NULL)
+		player->reverse_cache_scale = FFMIN(FFMAX(atoi(entry->value), 0),
+				REVERSE_CACHE_MAX_SCALE);
+}
+
+/*
+ * "checksum_log" - path of file where hashes of decoded ("video"),
+ * converted ("rgba") and subtitle blended ("blend") frames are written
+ * as "<kind> <pts_us> <xxhash64>" lines, see checksum.h
+ * "checksum_present" - "0" renders frames into memory at video size
+ * instead of the window, so hashes do not depend on the surface
+ */
+int player_open_checksum_log(struct Player *player, AVDictionary *dictionary) {
+	AVDictionaryEntry *entry = av_dict_get(dictionary, "checksum_log", NULL,
+			0);
+	player->checksum_present = TRUE;
+	if (entry == NULL)
+		return 0;
+	player->checksum_file = fopen(entry->value, "w");
+	if (player->checksum_file == NULL) {
+		LOGE(1, "player_open_checksum_log could not open: %s", entry->value);
+		return -ERROR_COULD_NOT_OPEN_CHECKSUM_LOG;
+	}
+	entry = av_dict_get(dictionary, "checksum_present", NULL, 0);
+	if (entry != NULL)
+		player->checksum_present = atoi(entry->value) != 0;
+	LOGI(3, "player_open_checksum_log present: %d", player->checksum_present);
+	return 0;
+}
+
+void player_alloc_video_buffers_free(struct Player *player) {
+	if (player->tmp_buffer != NULL) {
+		av_free(player->tmp_buffer);
+		player->tmp_buffer = NULL;
+	}
+	if (player->tmp_buffer2 != NULL) {
+		av_free(player->tmp_buffer2);
+		player->tmp_buffer2 = NULL;
+	}
+	if (player->headless_buffer != NULL) {
+		av_free(player->headless_buffer);
+		player->headless_buffer = NULL;
+	}
+}
+
+int player_alloc_video_buffers(struct Player *player, int width, int height) {
+	int numBytes = avpicture_get_size(PIX_FMT_RGBA, width, height);
+	player->tmp_buffer = (uint8_t *) av_malloc(numBytes * sizeof(uint8_t));
+	if (player->tmp_buffer == NULL) {
+		LOGE(1, "player_alloc_video_buffers could not allocate tmp_buffer");
+		return -ERROR_COULD_NOT_ALLOCATE_MEMORY;
+	}
+	player->tmp_buffer2 = (uint8_t *) av_malloc(numBytes * sizeof(uint8_t));
+	if (player->tmp_buffer2 == NULL) {
+		LOGE(1, "player_alloc_video_buffers could not allocate tmp_buffer2");
+		return -ERROR_COULD_NOT_ALLOCATE_MEMORY;
+	}
+	avpicture_fill((AVPicture *) player->tmp_frame, player->tmp_buffer,
+			PIX_FMT_RGBA, width, height);
+	avpicture_fill((AVPicture *) player->tmp_frame2, player->tmp_buffer2,
+			PIX_FMT_RGBA, width, height);
+	if (player->headless_frame != NULL) {
+		player->headless_buffer = (uint8_t *) av_malloc(numBytes);
+		if (player->headless_buffer == NULL) {
+			LOGE(1, "player_alloc_video_buffers could not allocate headless_buffer");
+			return -ERROR_COULD_NOT_ALLOCATE_MEMORY;
+		}
+		avpicture_fill((AVPicture *) player->headless_frame,
+				player->headless_buffer, PIX_FMT_RGBA, width, height);
+	}
+	player->video_width = width;
+	player->video_height = height;
+	LOGI(3, "Allocating: %dx%d", width, height);
+	return 0;
+}
+
 int player_alloc_video_frames(struct Player *player) {
 	player->rgb_frame = avcodec_alloc_frame();
 	if (player->rgb_frame == NULL) {
@@ -2262,23 +4065,20 @@ int player_alloc_video_frames(struct Player *player) {
 		LOGE(1, "player_alloc_video_frames could not allocate tmp_frame2");
 		return -1;
 	}
-	AVCodecContext * ctx = player->input_codec_ctxs[player->video_stream_no];
-	int numBytes = avpicture_get_size(PIX_FMT_RGBA, ctx->width, ctx->height);
-	player->tmp_buffer = (uint8_t *) av_malloc(numBytes * sizeof(uint8_t));
-	if (player->tmp_buffer == NULL) {
-		LOGE(1, "player_alloc_video_frames could not allocate tmp_buffer");
-		return -1;
+	if (player->checksum_file != NULL && !player->checksum_present) {
+		player->headless_frame = avcodec_alloc_frame();
+		if (player->headless_frame == NULL) {
+			LOGE(1, "player_alloc_video_frames could not allocate headless_frame");
+			return -1;
+		}
 	}
-	player->tmp_buffer2 = (uint8_t *) av_malloc(numBytes * sizeof(uint8_t));
-	if (player->tmp_buffer2 == NULL) {
-		LOGE(1, "player_alloc_video_frames could not allocate tmp_buffer2");
+	AVCodecContext * ctx = player->input_codec_ctxs[player->video_stream_no];
+	if (player_alloc_video_buffers(player, ctx->width, ctx->height) < 0)
 		return -1;
-	}
-	avpicture_fill((AVPicture *) player->tmp_frame, player->tmp_buffer,
-			PIX_FMT_RGBA, ctx->width, ctx->height);
-	avpicture_fill((AVPicture *) player->tmp_frame2, player->tmp_buffer2,
-			PIX_FMT_RGBA, ctx->width, ctx->height);
-	LOGI(3, "Allocating: %dx%d", ctx->width, ctx->height);
+
+	pthread_mutex_lock(&player->mutex_queue);
+	player->window_changed = TRUE;
+	pthread_mutex_unlock(&player->mutex_queue);
 	return 0;
 }
 
@@ -2295,14 +4095,44 @@ void player_alloc_video_frames_free(struct Player *player) {
 		avcodec_free_frame(&player->tmp_frame2);
 		player->tmp_frame2 = NULL;
 	}
-	if (player->tmp_buffer != NULL) {
-		av_free(player->tmp_buffer);
-		player->tmp_buffer = NULL;
+	if (player->headless_frame != NULL) {
+		avcodec_free_frame(&player->headless_frame);
+		player->headless_frame = NULL;
 	}
-	if (player->tmp_buffer2 != NULL) {
-		av_free(player->tmp_buffer2);
-		player->tmp_buffer2 = NULL;
+	player_alloc_video_buffers_free(player);
+	player->video_width = 0;
+	player->video_height = 0;
+}
+
+/*
+ * Called from the video decoding thread when decoder output geometry
+ * differs from the one that buffers and window were configured for.
+ */
+int player_reconfigure_video(struct Player *player, int width, int height) {
+	int err;
+	LOGI(2, "player_reconfigure_video %dx%d -> %dx%d",
+			player->video_width, player->video_height, width, height);
+	player_alloc_video_buffers_free(player);
+	if ((err = player_alloc_video_buffers(player, width, height)) < 0)
+		return err;
+
+#ifdef SUBTITLES
+	if (player->ass_renderer != NULL) {
+		pthread_mutex_lock(&player->mutex_ass);
+		ass_set_frame_size(player->ass_renderer, width, height);
+		overlay_invalidate(&player->ass_overlay);
+		player->ass_renderer_user = ASS_RENDERER_USER_NONE;
+		pthread_mutex_lock(&player->mutex_overlays);
+		player_invalidate_overlays_already_locked(player, INT64_MIN);
+		pthread_mutex_unlock(&player->mutex_overlays);
+		pthread_mutex_unlock(&player->mutex_ass);
 	}
+#endif // SUBTITLES
+
+	pthread_mutex_lock(&player->mutex_queue);
+	player->window_changed = TRUE;
+	pthread_mutex_unlock(&player->mutex_queue);
+	return 0;
 }
 
 void player_stop_without_lock(struct State * state) {
@@ -2317,6 +4147,9 @@ void player_stop_without_lock(struct State * state) {
 
 	player_play_prepare_free(player);
 	player_start_decoding_threads_free(player);
+#ifdef SUBTITLES
+	player_start_subtitle_render_thread_free(player);
+#endif // SUBTITLES
 	if (player->no_audio == FALSE) {
 		player_create_audio_track_free(player, state);
 	}
@@ -2327,6 +4160,8 @@ void player_stop_without_lock(struct State * state) {
 	player_sws_context_free(player);
 	player_alloc_frames_free(player);
 	player_alloc_video_frames_free(player);
+	player_start_governor_free(player);
+	player_open_checksum_log_free(player);
 #ifdef SUBTITLES
 	player_prepare_ass_decoder_free(player);
 #endif // SUBTITLES
@@ -2404,7 +4239,34 @@ int player_set_data_source(struct State *state, const char *file_path,
 		strcpy(font_path, entry->value);
 		font_path[length] = '\0';
 	}
+	int ass_glyph_cache_max = 0;
+	entry = av_dict_get(dictionary, "ass_glyph_cache_max", NULL, 0);
+	if (entry != NULL)
+		ass_glyph_cache_max = atoi(entry->value);
+	int ass_bitmap_cache_max_mb = 0;
+	entry = av_dict_get(dictionary, "ass_bitmap_cache_max_mb", NULL, 0);
+	if (entry != NULL)
+		ass_bitmap_cache_max_mb = atoi(entry->value);
 #endif // SUBTITLES
+	AVDictionaryEntry *executor_entry = av_dict_get(dictionary, "executor",
+			NULL, 0);
+	player->shared = executor_entry != NULL
+			&& strcmp(executor_entry->value, "shared") == 0;
+	executor_entry = av_dict_get(dictionary, "executor_priority", NULL, 0);
+	if (executor_entry != NULL)
+		player_set_priority(player, atoi(executor_entry->value));
+
+	player_read_reverse_options(player, dictionary);
+	AVDictionaryEntry *free_run_entry = av_dict_get(dictionary, "free_run",
+			NULL, 0);
+	player->free_run = free_run_entry != NULL
+			&& strcmp(free_run_entry->value, "1") == 0;
+
+	// avformat_open_input frees dictionary, options are read before
+	if ((err = player_open_checksum_log(player, dictionary)) < 0)
+		goto error;
+	player_start_governor(player, dictionary);
+
 	// initial setup
 	player->pause = TRUE;
 	player->start_time = 0;
@@ -2454,7 +4316,8 @@ int player_set_data_source(struct State *state, const char *file_path,
 	}
 
 	if ((player->subtitle_stream_no >= 0)) {
-		err = player_prepare_ass_decoder(player, font_path);
+		err = player_prepare_ass_decoder(player, font_path,
+				ass_glyph_cache_max, ass_bitmap_cache_max_mb);
 		if (err < 0)
 			goto error;
 	}
@@ -2491,6 +4354,13 @@ int player_set_data_source(struct State *state, const char *file_path,
 
 	player_play_prepare(player);
 
+#ifdef SUBTITLES
+	if (player->subtitle_stream_no >= 0) {
+		if ((err = player_start_subtitle_render_thread(player)) < 0)
+			goto error;
+	}
+#endif // SUBTITLES
+
 	if ((err = player_start_decoding_threads(player)) < 0) {
 		goto error;
 	}
@@ -2505,6 +4375,9 @@ int player_set_data_source(struct State *state, const char *file_path,
 
 	player_play_prepare_free(player);
 	player_start_decoding_threads_free(player);
+#ifdef SUBTITLES
+	player_start_subtitle_render_thread_free(player);
+#endif // SUBTITLES
 	if (player->no_audio == FALSE) {
 		player_create_audio_track_free(player, state);
 	}
@@ -2514,6 +4387,8 @@ int player_set_data_source(struct State *state, const char *file_path,
 	player_alloc_queues_free(state);
 	player_alloc_frames_free(player);
 	player_alloc_video_frames_free(player);
+	player_start_governor_free(player);
+	player_open_checksum_log_free(player);
 #ifdef SUBTITLES
 	player_prepare_ass_decoder_free(player);
 #endif // SUBTITLES
@@ -2549,6 +4424,7 @@ void jni_player_seek(JNIEnv *env, jobject thiz, jlong positionUs) {
 	pthread_mutex_lock(&player->mutex_queue);
 	player->seek_position = positionUs;
 	pthread_cond_broadcast(&player->cond_queue);
+	player_wake_demux(player);
 
 	while (player->seek_position != DO_NOT_SEEK)
 		pthread_cond_wait(&player->cond_queue, &player->mutex_queue);
@@ -2556,6 +4432,50 @@ void jni_player_seek(JNIEnv *env, jobject thiz, jlong positionUs) {
 	end: pthread_mutex_unlock(&player->mutex_operation);
 }
 
+void jni_player_set_trick_play(JNIEnv *env, jobject thiz, jint rate) {
+	struct Player *player = player_get_player_field(env, thiz);
+	pthread_mutex_lock(&player->mutex_operation);
+
+	if (!player->playing) {
+		LOGI(1, "jni_player_set_trick_play could not change rate while not playing");
+		throw_exception(env, not_playing_exception_class_path_name,
+				"Could not change rate while not playing");
+		goto end;
+	}
+	if (rate >= 0 && rate <= 1)
+		rate = 0;
+	if (rate > TRICK_MAX_RATE)
+		rate = TRICK_MAX_RATE;
+	if (rate < -TRICK_MAX_RATE)
+		rate = -TRICK_MAX_RATE;
+
+	pthread_mutex_lock(&player->mutex_queue);
+	if (rate == player->trick_rate)
+		goto do_nothing;
+
+	LOGI(3, "jni_player_set_trick_play rate %d -> %d", player->trick_rate,
+			rate);
+	// rate is switched by seek to current position, so queued packets and
+	// audio are flushed
+	player->trick_rate_requested = rate;
+	player->seek_position = player_get_current_video_time(player);
+	if (player->seek_position < 0)
+		player->seek_position = 0;
+	pthread_cond_broadcast(&player->cond_queue);
+	player_wake_demux(player);
+
+	while (player->seek_position != DO_NOT_SEEK)
+		pthread_cond_wait(&player->cond_queue, &player->mutex_queue);
+	// when seek failed rate stays as it was
+	player->trick_rate_requested = player->trick_rate;
+
+do_nothing:
+	pthread_mutex_unlock(&player->mutex_queue);
+
+end:
+	pthread_mutex_unlock(&player->mutex_operation);
+}
+
 void jni_player_pause(JNIEnv *env, jobject thiz) {
 	struct Player * player = player_get_player_field(env, thiz);
 
@@ -2612,8 +4532,10 @@ void jni_player_resume(JNIEnv *env, jobject thiz) {
 
 	int64_t resume_time = av_gettime();
 	player->start_time += resume_time - player->pause_time;
+	player->trick_start_time += resume_time - player->pause_time;
 
 	pthread_cond_broadcast(&player->cond_queue);
+	player_wake_tasks(player);
 
 	if (player->no_audio == FALSE) {
 		(*env)->CallVoidMethod(env, player->audio_track,
@@ -2691,6 +4613,7 @@ int jni_player_set_data_source(JNIEnv *env, jobject thiz, jstring string,
 	struct Player * player = player_get_player_field(env, thiz);
 	struct State state = { player: player, env: env};
 
+	metrics_reset(&player->metrics);
 	int ret = player_set_data_source(&state, file_path, dict, video_stream_no,
 			audio_stream_no, subtitle_stream_no);
 
@@ -2721,6 +4644,7 @@ int jni_player_init(JNIEnv *env, jobject thiz) {
 	memset(player, 0, sizeof(*player));
 	player->audio_stream_no = -1;
 	player->video_stream_no = -1;
+	player->shared_priority = EXECUTOR_PRIORITY_NORMAL;
 #ifdef SUBTITLES
 	player->subtitle_stream_no = -1;
 #endif // SUBTITLES
@@ -2755,8 +4679,8 @@ int jni_player_init(JNIEnv *env, jobject thiz) {
 			goto free_player;
 		}
 
-		(*env)->SetIntField(env, thiz, player_m_native_player_field,
-				(jint) player);
+		(*env)->SetLongField(env, thiz, player_m_native_player_field,
+				(jlong) (intptr_t) player);
 
 		player->player_prepare_frame_method = java_get_method(env, player_class,
 				player_prepare_frame);
@@ -2861,6 +4785,8 @@ int jni_player_init(JNIEnv *env, jobject thiz) {
 	pthread_mutex_init(&player->mutex_queue, NULL);
 #ifdef SUBTITLES
 	pthread_mutex_init(&player->mutex_ass, NULL);
+	pthread_mutex_init(&player->mutex_overlays, NULL);
+	pthread_cond_init(&player->cond_overlays, NULL);
 #endif // SUBTITLES
 	pthread_cond_init(&player->cond_queue, NULL);
 
@@ -2870,10 +4796,11 @@ int jni_player_init(JNIEnv *env, jobject thiz) {
 	player->flush_video_play = FALSE;
 
 	av_log_set_callback(ffmpeg_log_callback);
-	av_log_set_level(FFMPEG_LOG_LEVEL);
+	av_log_set_level(log_levels[LOG_SUBSYSTEM_FFMPEG]);
 	avformat_network_init();
 	av_register_all();
-	register_jni_protocol(player->get_javavm);
+	if (register_jni_protocol(player->get_javavm) < 0)
+		LOGE(1, "Could not register jni protocol");
 #ifdef MODULE_ENCRYPT
 	register_aes_protocol();
 #endif
@@ -2927,10 +4854,151 @@ void jni_player_render(JNIEnv *env, jobject thiz, jobject surface) {
 	}
 	ANativeWindow_acquire(window);
 	player->window = window;
+	player->window_changed = TRUE;
 	pthread_cond_broadcast(&player->cond_queue);
 	pthread_mutex_unlock(&player->mutex_queue);
 }
 
+jlongArray jni_player_get_stats(JNIEnv *env, jobject thiz) {
+	struct Player * player = player_get_player_field(env, thiz);
+	jlong stats[METRICS_SNAPSHOT_SIZE + 1 + MAX_STREAMS + 3];
+	int size = METRICS_SNAPSHOT_SIZE;
+	int stream_no;
+	jlongArray array;
+#ifdef MODULE_ENCRYPT
+	struct AesCacheStats aes_stats;
+#endif // MODULE_ENCRYPT
+
+	metrics_snapshot(&player->metrics, (int64_t *) stats);
+
+	// queue depths are appended after metrics
+	pthread_mutex_lock(&player->mutex_queue);
+	stats[size++] = player->caputre_streams_no;
+	for (stream_no = 0; stream_no < player->caputre_streams_no; ++stream_no) {
+		Queue *queue = player->packets[stream_no];
+		stats[size++] = queue != NULL ?
+				queue_get_count_already_locked(queue) : 0;
+	}
+	pthread_mutex_unlock(&player->mutex_queue);
+
+	// then aes cache of the whole process
+#ifdef MODULE_ENCRYPT
+	aes_protocol_get_cache_stats(&aes_stats);
+	stats[size++] = aes_stats.hits;
+	stats[size++] = aes_stats.misses;
+	stats[size++] = aes_stats.evictions;
+#else
+	stats[size++] = 0;
+	stats[size++] = 0;
+	stats[size++] = 0;
+#endif // MODULE_ENCRYPT
+
+	array = (*env)->NewLongArray(env, size);
+	if (array == NULL)
+		return NULL;
+	(*env)->SetLongArrayRegion(env, array, 0, size, stats);
+	return array;
+}
+
+void jni_player_set_priority(JNIEnv *env, jobject thiz, jint priority) {
+	struct Player * player = player_get_player_field(env, thiz);
+	player_set_priority(player, priority);
+}
+
+static pthread_once_t player_extract_once = PTHREAD_ONCE_INIT;
+
+static void player_extract_init() {
+	// extraction does not need a player, which registers them otherwise
+	avformat_network_init();
+	av_register_all();
+}
+
+jlongArray jni_player_extract_frames(JNIEnv *env, jclass clazz, jstring url,
+		jlongArray timestamps, jint width, jint height, jobject buffer) {
+	uint8_t *out = (*env)->GetDirectBufferAddress(env, buffer);
+	jsize count = (*env)->GetArrayLength(env, timestamps);
+	const char *url_str;
+	jlong *timestamps_array;
+	int64_t *frame_times;
+	jlongArray result = NULL;
+	long cores;
+	int ret;
+
+	if (count == 0)
+		return (*env)->NewLongArray(env, 0);
+	if (out == NULL || width <= 0 || height <= 0
+			|| (*env)->GetDirectBufferCapacity(env, buffer)
+					< (jlong) count * width * height * 4) {
+		LOGE(1, "jni_player_extract_frames buffer too small");
+		return NULL;
+	}
+	pthread_once(&player_extract_once, player_extract_init);
+	if (player_executors_javavm == NULL)
+		(*env)->GetJavaVM(env, &player_executors_javavm);
+	pthread_once(&player_executors_once, player_executors_start);
+	cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	frame_times = malloc(count * sizeof(*frame_times));
+	if (frame_times == NULL)
+		return NULL;
+	url_str = (*env)->GetStringUTFChars(env, url, NULL);
+	if (url_str == NULL)
+		goto free_frame_times;
+	timestamps_array = (*env)->GetLongArrayElements(env, timestamps, NULL);
+	if (timestamps_array == NULL)
+		goto release_url;
+
+	// io workers, reading could block, thumbnails go after playback
+	ret = extract_frames(player_io_executor, EXECUTOR_PRIORITY_LOW,
+			cores < 1 ? 1 : cores, url_str, (const int64_t *) timestamps_array,
+			count, width, height, out, frame_times);
+	LOGI(3, "jni_player_extract_frames extracted: %d of %d", ret, count);
+	if (ret >= 0) {
+		result = (*env)->NewLongArray(env, count);
+		if (result != NULL)
+			(*env)->SetLongArrayRegion(env, result, 0, count,
+					(jlong *) frame_times);
+	}
+
+	(*env)->ReleaseLongArrayElements(env, timestamps, timestamps_array,
+			JNI_ABORT);
+release_url:
+	(*env)->ReleaseStringUTFChars(env, url, url_str);
+free_frame_times:
+	free(frame_times);
+	return result;
+}
+
+jint jni_player_start_trace(JNIEnv *env, jclass clazz) {
+	return trace_start();
+}
+
+void jni_player_stop_trace(JNIEnv *env, jclass clazz) {
+	trace_stop();
+}
+
+jint jni_player_dump_trace(JNIEnv *env, jclass clazz, jstring path) {
+	const char *path_str = (*env)->GetStringUTFChars(env, path, NULL);
+	int ret;
+	if (path_str == NULL)
+		return -1;
+	ret = trace_dump(path_str);
+	(*env)->ReleaseStringUTFChars(env, path, path_str);
+	return ret;
+}
+
+void jni_player_set_log_level(JNIEnv *env, jclass clazz, jint subsystem,
+		jint level) {
+	log_set_level(subsystem, level);
+	// lets ffmpeg skip building messages that would be dropped anyway
+	if (subsystem == LOG_SUBSYSTEM_FFMPEG)
+		av_log_set_level(level);
+}
+
+jint jni_player_set_log_async(JNIEnv *env, jclass clazz, jboolean async) {
+	return log_set_async(async);
+}
+
 void jni_player_render_frame_start(JNIEnv *env, jobject thiz) {
 
 }
@@ -21,6 +21,8 @@
 
 #include <libavutil/audioconvert.h>
 
+#include "jni-protocol.h"
+
 static JavaMethod empty_constructor = {"<init>", "()V"};
 
 // InterruptedException
@@ -93,7 +95,7 @@ static const struct {
 
 // FFmpegPlayer
 static char *player_class_path_name = "com/appunite/ffmpeg/FFmpegPlayer";
-static JavaField player_m_native_player = {"mNativePlayer", "I"};
+static JavaField player_m_native_player = {"mNativePlayer", "J"};
 static JavaMethod player_on_update_time = {"onUpdateTime","(JJZ)V"};
 static JavaMethod player_prepare_audio_track = {"prepareAudioTrack", "(II)Landroid/media/AudioTrack;"};
 static JavaMethod player_prepare_frame = {"prepareFrame", "(II)Landroid/graphics/Bitmap;"};
@@ -131,6 +133,22 @@ void jni_player_render_frame_stop(JNIEnv *env, jobject thiz);
 jlong jni_player_get_video_duration(JNIEnv *env, jobject thiz);
 void jni_player_render(JNIEnv *env, jobject thiz, jobject surface);
 
+jlongArray jni_player_get_stats(JNIEnv *env, jobject thiz);
+
+void jni_player_set_priority(JNIEnv *env, jobject thiz, jint priority);
+void jni_player_set_trick_play(JNIEnv *env, jobject thiz, jint rate);
+
+jlongArray jni_player_extract_frames(JNIEnv *env, jclass clazz, jstring url,
+		jlongArray timestamps, jint width, jint height, jobject buffer);
+
+jint jni_player_start_trace(JNIEnv *env, jclass clazz);
+void jni_player_stop_trace(JNIEnv *env, jclass clazz);
+jint jni_player_dump_trace(JNIEnv *env, jclass clazz, jstring path);
+
+void jni_player_set_log_level(JNIEnv *env, jclass clazz, jint subsystem,
+		jint level);
+jint jni_player_set_log_async(JNIEnv *env, jclass clazz, jboolean async);
+
 static JNINativeMethod player_methods[] = {
 
 	{"initNative", "()I", (void*) jni_player_init},
@@ -149,6 +167,21 @@ static JNINativeMethod player_methods[] = {
 
 	{"getVideoDurationNative", "()J", (void*) jni_player_get_video_duration},
 	{"render", "(Landroid/view/Surface;)V", (void*) jni_player_render},
+
+	{"getStatsNative", "()[J", (void*) jni_player_get_stats},
+	{"setPriorityNative", "(I)V", (void*) jni_player_set_priority},
+	{"setTrickPlayNative", "(I)V", (void*) jni_player_set_trick_play},
+
+	{"extractFramesNative", "(Ljava/lang/String;[JIILjava/nio/ByteBuffer;)[J", (void*) jni_player_extract_frames},
+
+	{"startTraceNative", "()I", (void*) jni_player_start_trace},
+	{"stopTraceNative", "()V", (void*) jni_player_stop_trace},
+	{"dumpTraceNative", "(Ljava/lang/String;)I", (void*) jni_player_dump_trace},
+
+	{"setLogLevelNative", "(II)V", (void*) jni_player_set_log_level},
+	{"setLogAsyncNative", "(Z)I", (void*) jni_player_set_log_async},
+
+	{"benchmarkJniReadNative", "(Ljava/lang/String;II)J", (void*) jni_protocol_benchmark_read},
 };
 
 #endif
@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <string.h>
 #include <pthread.h>
 
 #define FALSE 0
@@ -148,6 +149,16 @@ void *queue_push_start_already_locked(Queue *queue, pthread_mutex_t * mutex,
 	end: return queue->tab[*to_write];
 }
 
+void *queue_push_start_already_locked_non_block(Queue *queue, int *to_write) {
+	int next_next_to_write = queue_get_next(queue, queue->next_to_write);
+	if (next_next_to_write == queue->next_to_read)
+		return NULL;
+	*to_write = queue->next_to_write;
+	queue->ready[*to_write] = FALSE;
+	queue->next_to_write = next_next_to_write;
+	return queue->tab[*to_write];
+}
+
 void *queue_push_start(Queue *queue, pthread_mutex_t * mutex,
 		pthread_cond_t *cond, int *to_write, QueueCheckFunc func,
 		void *check_data, void *check_ret_data) {
@@ -266,6 +277,11 @@ int queue_get_size(Queue *queue) {
 	return queue->size;
 }
 
+int queue_get_count_already_locked(Queue *queue) {
+	return (queue->next_to_write - queue->next_to_read + queue->size)
+			% queue->size;
+}
+
 void queue_wait_for(Queue *queue, int size, pthread_mutex_t * mutex,
 		pthread_cond_t *cond) {
 	assert(queue->size >= size);
@@ -44,6 +44,8 @@ void queue_free(Queue *queue, pthread_mutex_t * mutex, pthread_cond_t *cond,
 void *queue_push_start_already_locked(Queue *queue, pthread_mutex_t * mutex,
 		pthread_cond_t *cond, int *to_write, QueueCheckFunc func,
 		void *check_data, void *check_ret_data);
+// returns NULL instead of waiting when queue is full
+void *queue_push_start_already_locked_non_block(Queue *queue, int *to_write);
 void *queue_push_start(Queue *queue, pthread_mutex_t * mutex,
 		pthread_cond_t *cond, int *to_write, QueueCheckFunc func,
 		void *check_data, void *check_ret_data);
@@ -69,6 +71,8 @@ void queue_pop_finish(Queue *queue, pthread_mutex_t * mutex,
 		pthread_cond_t *cond);
 
 int queue_get_size(Queue *queue);
+// number of pushed elements not yet popped
+int queue_get_count_already_locked(Queue *queue);
 
 void queue_wait_for(Queue *queue, int size, pthread_mutex_t * mutex,
 		pthread_cond_t *cond);
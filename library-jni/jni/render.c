@@ -0,0 +1,91 @@
+/*
+ * render.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <string.h>
+
+#include <android/log.h>
+
+#include "convert.h"
+#include "render.h"
+#include "log.h"
+
+#define LOG_SUBSYSTEM LOG_SUBSYSTEM_RENDER
+#define LOG_TAG "render.c"
+#define LOGI(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
+#define LOGE(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
+
+int render_frame(struct SwsContext **sws_context, const AVFrame *frame,
+		int width, int height, enum PixelFormat pix_fmt, AVPicture *dst,
+		int dst_width, int dst_height, AVPicture *tmp,
+		enum PixelFormat out_format) {
+	int rescale = width != dst_width || height != dst_height;
+	int downscale = rescale && dst_width <= width && dst_height <= height;
+	AVPicture *out = rescale ? tmp : dst;
+	AVPicture src;
+	AVPicture scaled;
+
+	memcpy(src.data, frame->data, sizeof(src.data));
+	memcpy(src.linesize, frame->linesize, sizeof(src.linesize));
+	if (downscale && pix_fmt == PIX_FMT_YUV420P) {
+		// smaller planes go to tmp, conversion writes dst directly
+		avpicture_fill(&scaled, tmp->data[0], PIX_FMT_YUV420P, dst_width,
+				dst_height);
+		__I420Scale(src.data[0], src.linesize[0], src.data[1],
+				src.linesize[1], src.data[2], src.linesize[2], width, height,
+				scaled.data[0], scaled.linesize[0], scaled.data[1],
+				scaled.linesize[1], scaled.data[2], scaled.linesize[2],
+				dst_width, dst_height, __kFilterNone);
+		src = scaled;
+		width = dst_width;
+		height = dst_height;
+		rescale = 0;
+		out = dst;
+	}
+
+	if (pix_fmt == PIX_FMT_YUV420P) {
+		__I420ToARGB(src.data[0], src.linesize[0], src.data[2],
+				src.linesize[2], src.data[1], src.linesize[1],
+				out->data[0], out->linesize[0], width, height);
+	} else if (pix_fmt == PIX_FMT_NV12 && !downscale) {
+		__NV21ToARGB(src.data[0], src.linesize[0], src.data[1],
+				src.linesize[1], out->data[0], out->linesize[0], width,
+				height);
+	} else {
+		LOGI(3, "Using slow conversion: %d ", pix_fmt);
+		// scales and converts in one pass
+		*sws_context = sws_getCachedContext(*sws_context, width, height,
+				pix_fmt, dst_width, dst_height, out_format, SWS_FAST_BILINEAR,
+				NULL, NULL, NULL);
+		if (*sws_context == NULL) {
+			LOGE(1, "could not initialize conversion context from: %d"
+			", to :%d\n", pix_fmt, out_format);
+			return -1;
+		}
+		sws_scale(*sws_context, (const uint8_t * const *) src.data,
+				src.linesize, 0, height, dst->data, dst->linesize);
+		rescale = 0;
+	}
+
+	if (rescale) {
+		// only upscaling of fast path formats
+		__ARGBScale(out->data[0], out->linesize[0], width, height,
+				dst->data[0], dst->linesize[0], dst_width, dst_height,
+				__kFilterNone);
+	}
+	return 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * render.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+
+/*
+ * Video frame conversion shared by the player and host tools, it does not
+ * depend on jni nor on ANativeWindow.
+ */
+
+/*
+ * Converts decoded frame of width x height in pix_fmt to dst picture of
+ * dst_width x dst_height in out_format. tmp has to hold width x height
+ * picture in out_format, it is used only if sizes differ. Smaller
+ * pictures are scaled before conversion, so it runs at dst size.
+ * sws_context is created or reused for formats without fast path.
+ * Returns negative value if frame could not be converted.
+ */
+int render_frame(struct SwsContext **sws_context, const AVFrame *frame,
+		int width, int height, enum PixelFormat pix_fmt, AVPicture *dst,
+		int dst_width, int dst_height, AVPicture *tmp,
+		enum PixelFormat out_format);
+
+#endif /* RENDER_H_ */
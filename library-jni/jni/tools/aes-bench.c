@@ -0,0 +1,129 @@
+/*
+ * aes-bench.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Measures sector decryption and encryption throughput of every aes cipher
+ * backend available on this cpu and checks that all of them return the
+ * same data.
+ *
+ * usage: aes-bench [size_in_kb]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aes-cipher.h"
+
+#define MAX_BACKENDS 8
+#define DEFAULT_SIZE_KB 4096
+#define MIN_TIME_S 1.0
+
+static double aes_bench_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/*
+ * Returns MB/s of decryption or encryption of size bytes of data
+ */
+static double aes_bench_measure(struct AesCipher *cipher, int encrypt,
+		unsigned char *data, int size) {
+	int iterations = 0;
+	double start = aes_bench_now();
+	double elapsed;
+	do {
+		if (encrypt)
+			aes_cipher_encrypt_sectors(cipher, 0, data, size);
+		else
+			aes_cipher_decrypt_sectors(cipher, 0, data, size);
+		iterations++;
+		elapsed = aes_bench_now() - start;
+	} while (elapsed < MIN_TIME_S);
+	return (double) size * iterations / elapsed / (1024 * 1024);
+}
+
+int main(int argc, char *argv[]) {
+	const struct AesCipherBackend *backends[MAX_BACKENDS];
+	unsigned char key[AES_CIPHER_BLOCK_SIZE];
+	unsigned char *source, *reference, *data;
+	int size_kb = DEFAULT_SIZE_KB;
+	int size, nb_backends, i, ret = 0;
+
+	if (argc > 1)
+		size_kb = atoi(argv[1]);
+	if (size_kb <= 0) {
+		fprintf(stderr, "usage: %s [size_in_kb]\n", argv[0]);
+		return 1;
+	}
+	size = size_kb * 1024;
+
+	source = malloc(size);
+	reference = malloc(size);
+	data = malloc(size);
+	if (source == NULL || reference == NULL || data == NULL) {
+		fprintf(stderr, "could not allocate %d bytes\n", size);
+		return 1;
+	}
+	srand(0);
+	for (i = 0; i < AES_CIPHER_BLOCK_SIZE; i++)
+		key[i] = rand();
+	for (i = 0; i < size; i++)
+		source[i] = rand();
+
+	nb_backends = aes_cipher_get_backends(backends, MAX_BACKENDS);
+	printf("{\n  \"size\": %d,\n  \"backends\": [\n", size);
+	for (i = nb_backends - 1; i >= 0; i--) {
+		struct AesCipher cipher;
+		int equal;
+		double decrypt_speed, encrypt_speed;
+
+		if (aes_cipher_setkey_enc(&cipher, backends[i], key, 128) < 0) {
+			fprintf(stderr, "%s: could not set key\n", backends[i]->name);
+			ret = 1;
+			continue;
+		}
+
+		// last backend (tropicssl) is measured first and is the reference
+		memcpy(data, source, size);
+		aes_cipher_decrypt_sectors(&cipher, 0, data, size);
+		if (i == nb_backends - 1)
+			memcpy(reference, data, size);
+		equal = memcmp(data, reference, size) == 0;
+		// encryption has to give back the source
+		aes_cipher_encrypt_sectors(&cipher, 0, data, size);
+		equal = equal && memcmp(data, source, size) == 0;
+		if (!equal)
+			ret = 1;
+
+		decrypt_speed = aes_bench_measure(&cipher, 0, data, size);
+		encrypt_speed = aes_bench_measure(&cipher, 1, data, size);
+
+		printf("    { \"name\": \"%s\", \"decrypt_mb_per_s\": %.1f, \"encrypt_mb_per_s\": %.1f, \"matches_reference\": %s }%s\n",
+				backends[i]->name, decrypt_speed, encrypt_speed,
+				equal ? "true" : "false", i > 0 ? "," : "");
+	}
+	printf("  ]\n}\n");
+
+	free(source);
+	free(reference);
+	free(data);
+	return ret;
+}
@@ -0,0 +1,235 @@
+/*
+ * blend_test.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Checks that vectorized blend row kernels (SSE2, NEON on arm hosts)
+ * produce exactly the same bytes as the *_c reference kernels:
+ * - every alpha/source/destination byte combination,
+ * - random data with random widths and unaligned rows, also checking
+ *   that nothing is written past the row.
+ *
+ * usage: blend_test
+ * Exits with 1 on first mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blend.h"
+
+#define FALSE 0
+#define TRUE (!(FALSE))
+
+// one row per alpha/source pair, destination goes along the row
+#define EXHAUSTIVE_WIDTH 256
+#define RANDOM_ROWS 200000
+#define RANDOM_MAX_WIDTH 67
+// pixels around the row that kernels must not touch
+#define GUARD 8
+
+struct BlendTestKernels {
+	const char *name;
+	blend_row_rgba_func row_rgba;
+	blend_row_mask_func row_mask;
+	blend_row_premul_func row_premul;
+};
+
+static const struct BlendTestKernels blend_test_kernels[] = {
+#ifdef __SSE2__
+	{ "sse2", blend_row_rgba_sse2, blend_row_mask_sse2,
+			blend_row_premul_sse2 },
+#endif // __SSE2__
+#ifdef FEATURE_NEON
+	{ "neon", blend_row_rgba_neon, blend_row_mask_neon,
+			blend_row_premul_neon },
+#endif // FEATURE_NEON
+};
+
+#define BLEND_TEST_KERNELS_NB \
+	(sizeof(blend_test_kernels) / sizeof(blend_test_kernels[0]))
+
+static uint32_t blend_test_seed = 0x12345678;
+
+// xorshift32, fixed seed so failures could be reproduced
+static uint32_t blend_test_random() {
+	uint32_t x = blend_test_seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return blend_test_seed = x;
+}
+
+/*
+ * Destination pixel with every color byte derived from d (each mapping
+ * covers all values) and random byte 3 which has to be preserved
+ */
+static uint32_t blend_test_dst_pixel(int d) {
+	return (blend_test_random() & 0xff000000) | ((d ^ 0xa5) << 16)
+			| ((0xff - d) << 8) | d;
+}
+
+static int blend_test_compare(const char *kernel, const char *row,
+		const uint32_t *expected, const uint32_t *actual, int width,
+		int offset) {
+	int x;
+	for (x = 0; x < width + 2 * GUARD; ++x) {
+		if (expected[x] == actual[x])
+			continue;
+		fprintf(stderr, "FAIL %s %s: width: %d, offset: %d, pixel: %d, "
+				"expected: %08x, got: %08x\n", kernel, row, width, offset,
+				x - GUARD, expected[x], actual[x]);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static int blend_test_exhaustive(const struct BlendTestKernels *k) {
+	uint32_t expected[EXHAUSTIVE_WIDTH + 2 * GUARD];
+	uint32_t actual[EXHAUSTIVE_WIDTH + 2 * GUARD];
+	uint32_t src[EXHAUSTIVE_WIDTH];
+	uint8_t mask[EXHAUSTIVE_WIDTH];
+	int a, s, x;
+
+	for (a = 0; a < 256; ++a) {
+		for (s = 0; s < 256; ++s) {
+			uint32_t color = blend_test_random() & 0xffffff;
+
+			// rgba: alpha a, source s, every destination
+			for (x = 0; x < EXHAUSTIVE_WIDTH + 2 * GUARD; ++x)
+				expected[x] = blend_test_dst_pixel((x - GUARD) & 0xff);
+			memcpy(actual, expected, sizeof(actual));
+			for (x = 0; x < EXHAUSTIVE_WIDTH; ++x)
+				src[x] = (a << 24) | (s << 16) | ((0xff - s) << 8) | (s ^ 0x5a);
+			blend_row_rgba_c(expected + GUARD, src, EXHAUSTIVE_WIDTH);
+			k->row_rgba(actual + GUARD, src, EXHAUSTIVE_WIDTH);
+			if (!blend_test_compare(k->name, "rgba", expected, actual,
+					EXHAUSTIVE_WIDTH, 0))
+				return FALSE;
+
+			// mask: alpha a, destination s, every mask value
+			for (x = 0; x < EXHAUSTIVE_WIDTH + 2 * GUARD; ++x)
+				expected[x] = blend_test_dst_pixel(s);
+			memcpy(actual, expected, sizeof(actual));
+			for (x = 0; x < EXHAUSTIVE_WIDTH; ++x)
+				mask[x] = x;
+			blend_row_mask_c(expected + GUARD, mask, EXHAUSTIVE_WIDTH, color,
+					a);
+			k->row_mask(actual + GUARD, mask, EXHAUSTIVE_WIDTH, color, a);
+			if (!blend_test_compare(k->name, "mask", expected, actual,
+					EXHAUSTIVE_WIDTH, 0))
+				return FALSE;
+
+			// premul: alpha a, premultiplied source up to a
+			if (s > a)
+				continue;
+			for (x = 0; x < EXHAUSTIVE_WIDTH + 2 * GUARD; ++x)
+				expected[x] = blend_test_dst_pixel((x - GUARD) & 0xff);
+			memcpy(actual, expected, sizeof(actual));
+			for (x = 0; x < EXHAUSTIVE_WIDTH; ++x)
+				src[x] = (a << 24) | (s << 16) | ((a - s) << 8)
+						| (s * a / 255);
+			blend_row_premul_c(expected + GUARD, src, EXHAUSTIVE_WIDTH);
+			k->row_premul(actual + GUARD, src, EXHAUSTIVE_WIDTH);
+			if (!blend_test_compare(k->name, "premul", expected, actual,
+					EXHAUSTIVE_WIDTH, 0))
+				return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * Random premultiplied pixel, transparent ones are zero
+ */
+static uint32_t blend_test_premul_pixel() {
+	uint32_t a = blend_test_random() % 257;
+	if (a == 256)
+		return 0;
+	uint32_t r = blend_test_random();
+	return (a << 24) | ((r & 0xff) * a / 255 << 16)
+			| (((r >> 8) & 0xff) * a / 255 << 8) | ((r >> 16) & 0xff) * a / 255;
+}
+
+static int blend_test_random_rows(const struct BlendTestKernels *k) {
+	// offsets up to 3 pixels (rows) and 15 bytes (mask) break alignment
+	uint32_t expected[RANDOM_MAX_WIDTH + 2 * GUARD + 3];
+	uint32_t actual[RANDOM_MAX_WIDTH + 2 * GUARD + 3];
+	uint32_t src_buffer[RANDOM_MAX_WIDTH + 3];
+	uint8_t mask_buffer[RANDOM_MAX_WIDTH + 15];
+	int row, x;
+
+	for (row = 0; row < RANDOM_ROWS; ++row) {
+		int width = blend_test_random() % (RANDOM_MAX_WIDTH + 1);
+		int offset = blend_test_random() % 4;
+		uint32_t *exp = expected + offset;
+		uint32_t *act = actual + offset;
+		uint32_t *src = src_buffer + blend_test_random() % 4;
+		uint8_t *mask = mask_buffer + blend_test_random() % 16;
+		uint32_t color = blend_test_random() & 0xffffff;
+		uint8_t alpha = blend_test_random();
+		// some rows are mostly opaque or transparent like subtitles
+		int kind = row % 3;
+
+		for (x = 0; x < width + 2 * GUARD; ++x)
+			exp[x] = blend_test_random();
+		for (x = 0; x < width; ++x) {
+			uint32_t r = blend_test_random();
+			if (kind == 1)
+				r |= 0xff000000;
+			else if (kind == 2)
+				r &= 0x00ffffff;
+			src[x] = r;
+			mask[x] = kind == 0 ? r >> 8 : kind == 1 ? 0xff : 0;
+		}
+		memcpy(act, exp, (width + 2 * GUARD) * sizeof(*exp));
+		blend_row_rgba_c(exp + GUARD, src, width);
+		k->row_rgba(act + GUARD, src, width);
+		if (!blend_test_compare(k->name, "rgba", exp, act, width, offset))
+			return FALSE;
+
+		blend_row_mask_c(exp + GUARD, mask, width, color, alpha);
+		k->row_mask(act + GUARD, mask, width, color, alpha);
+		if (!blend_test_compare(k->name, "mask", exp, act, width, offset))
+			return FALSE;
+
+		for (x = 0; x < width; ++x)
+			src[x] = kind == 2 ? 0 : blend_test_premul_pixel();
+		blend_row_premul_c(exp + GUARD, src, width);
+		k->row_premul(act + GUARD, src, width);
+		if (!blend_test_compare(k->name, "premul", exp, act, width, offset))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+	unsigned int i;
+
+	if (BLEND_TEST_KERNELS_NB == 0) {
+		printf("no vectorized blend kernels on this host\n");
+		return 0;
+	}
+	for (i = 0; i < BLEND_TEST_KERNELS_NB; ++i) {
+		const struct BlendTestKernels *k = &blend_test_kernels[i];
+		if (!blend_test_exhaustive(k) || !blend_test_random_rows(k))
+			return 1;
+		printf("ok %s\n", k->name);
+	}
+	return 0;
+}
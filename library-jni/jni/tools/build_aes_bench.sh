@@ -0,0 +1,20 @@
+#!/bin/sh
+# Builds aes-bench for the host machine.
+# usage: ./build_aes_bench.sh && ./aes-bench [size_in_kb]
+
+set -e
+cd "$(dirname "$0")"
+
+CC=${CC:-gcc}
+CFLAGS="-O3 -std=gnu99 -I.. -I../tropicssl/include"
+SOURCES="aes-bench.c ../aes-cipher.c ../tropicssl/library/aes.c ../tropicssl/library/padlock.c"
+
+case "$(uname -m)" in
+	x86_64|i?86)
+		$CC $CFLAGS -msse2 -maes -c ../aes-cipher-x86.c -o aes-cipher-x86.o
+		CFLAGS="$CFLAGS -DFEATURE_AES_NI"
+		SOURCES="$SOURCES aes-cipher-x86.o"
+		;;
+esac
+
+$CC $CFLAGS $SOURCES -o aes-bench -lrt
@@ -0,0 +1,97 @@
+#!/bin/sh
+# Builds native player for the host machine as libplayer-host.a together
+# with player_bench, microbench, blend_test, executor_test, log_test and
+# gen_media. jni, AudioTrack and ANativeWindow are replaced by host/ shims
+# (host/jni-host.c, host/native-window.c) so player.c itself is built.
+# ffmpeg is built from the ffmpeg submodule into ffmpeg-build/host first.
+# usage: ./build_host.sh && ./player_bench file.mp4
+# player_bench -o key=value passes data source options, e.g. -o free_run=0
+# MODULE_ENCRYPT=1 adds aes protocol (needs tropicssl submodule)
+# player.c (player_bench), microbench and blend_test need libass
+# (pkg-config libass) for subtitles and blend.c
+# test assets: ./gen_media -s 1280x720 -t 30 -sub ass test.mkv
+# writes test.mkv.sum with checksums of decoded frames
+# regression check: ./microbench > baseline.json, then after a change
+# ./microbench --baseline baseline.json (exits with 2 on regression)
+# blend kernels check: ./blend_test (exits with 1 on mismatch with C)
+# executor check: ./executor_test (exits with 1 when delayed task is late)
+# log levels check: ./log_test (exits with 1 on unexpected level)
+
+set -e
+cd "$(dirname "$0")"
+
+JNI=..
+PREFIX=$(pwd)/$JNI/ffmpeg-build/host
+OBJ=host-obj
+CC=${CC:-gcc}
+CXX=${CXX:-g++}
+JOBS=${JOBS:-$(getconf _NPROCESSORS_ONLN)}
+
+if [ ! -f "$PREFIX/lib/libavformat.a" ]; then
+	mkdir -p "$PREFIX/obj"
+	(cd "$PREFIX/obj" && \
+		../../../ffmpeg/configure --prefix="$PREFIX" --enable-static \
+			--disable-shared --disable-doc --disable-ffmpeg \
+			--disable-ffplay --disable-ffprobe --disable-ffserver && \
+		make -j"$JOBS" && make install)
+fi
+
+# host/ shadows NDK only headers (android/*.h, jni.h, pthread.h)
+CFLAGS="-O2 -g -std=gnu99 -I$JNI/host -I$JNI -I$PREFIX/include -DLIBYUV"
+CXXFLAGS="-O2 -g -I$JNI/host -I$JNI -I$JNI/libyuv/include -DLIBYUV"
+LIBS="-L$PREFIX/lib -lavformat -lavcodec -lswscale -lswresample -lavutil -lz -lm -lpthread -lrt"
+
+rm -rf $OBJ
+mkdir -p $OBJ
+
+SOURCES="queue.c metrics.c trace.c render.c checksum.c log.c executor.c governor.c frame_cache.c extract.c"
+if pkg-config --exists libass; then
+	CFLAGS="$CFLAGS $(pkg-config --cflags libass)"
+	SOURCES="$SOURCES blend.c overlay.c helpers.c jni-protocol.c player.c host/jni-host.c host/native-window.c"
+	LIBS="$LIBS $(pkg-config --libs libass)"
+fi
+if [ -n "$MODULE_ENCRYPT" ]; then
+	CFLAGS="$CFLAGS -DMODULE_ENCRYPT -I$JNI/tropicssl/include"
+	SOURCES="$SOURCES aes-protocol.c aes-pool.c aes-cipher.c tropicssl/library/aes.c tropicssl/library/base64.c tropicssl/library/havege.c tropicssl/library/padlock.c tropicssl/library/sha2.c tropicssl/library/timing.c"
+	case "$(uname -m)" in
+		x86_64|i?86)
+			$CC $CFLAGS -msse2 -maes -c $JNI/aes-cipher-x86.c -o $OBJ/aes-cipher-x86.o
+			CFLAGS="$CFLAGS -DFEATURE_AES_NI"
+			;;
+	esac
+fi
+
+for source in $SOURCES; do
+	$CC $CFLAGS -c $JNI/$source -o $OBJ/$(basename $source .c).o
+done
+$CXX $CXXFLAGS -c $JNI/convert.cpp -o $OBJ/convert.o
+for source in $JNI/libyuv/source/*.cc; do
+	$CXX $CXXFLAGS -c $source -o $OBJ/libyuv-$(basename $source .cc).o
+done
+
+rm -f libplayer-host.a
+ar rcs libplayer-host.a $OBJ/*.o
+
+$CC $CFLAGS gen_media.c libplayer-host.a $LIBS -lstdc++ -o gen_media
+$CC $CFLAGS executor_test.c libplayer-host.a $LIBS -lstdc++ -o executor_test
+$CC $CFLAGS log_test.c libplayer-host.a $LIBS -lstdc++ -o log_test
+if pkg-config --exists libass; then
+	$CC $CFLAGS player_bench.c libplayer-host.a $LIBS -lstdc++ -o player_bench
+	$CC $CFLAGS microbench.c libplayer-host.a $LIBS -lstdc++ -o microbench
+	# neon kernels are selected only on android, blend_test calls them
+	case "$(uname -m)" in
+		aarch64)
+			BLEND_NEON="-DFEATURE_NEON $JNI/blend-neon.c"
+			;;
+		armv7*)
+			BLEND_NEON="-DFEATURE_NEON -mfpu=neon $JNI/blend-neon.c"
+			;;
+		*)
+			BLEND_NEON=""
+			;;
+	esac
+	$CC $CFLAGS $BLEND_NEON blend_test.c libplayer-host.a $LIBS -lstdc++ \
+		-o blend_test
+else
+	echo "libass headers not found, skipping player_bench, microbench and blend_test" >&2
+fi
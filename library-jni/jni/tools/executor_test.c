@@ -0,0 +1,135 @@
+/*
+ * executor_test.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Checks that delayed tasks run on time also when the pool is saturated
+ * by tasks rescheduling themselves (like many players sharing workers):
+ * - 1 worker busy with one task, high priority task delayed by 10ms,
+ * - 4 workers busy with 16 tasks, a delayed task per worker.
+ *
+ * usage: executor_test
+ * Exits with 1 when a delayed task did not run within a second.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "executor.h"
+
+#define FALSE 0
+#define TRUE (!(FALSE))
+
+#define EXECUTOR_TEST_DELAY_US 10000ll
+#define EXECUTOR_TEST_TIMEOUT_US 1000000ll
+#define EXECUTOR_TEST_MAX_TASKS 16
+
+struct ExecutorTestBusy {
+	struct ExecutorTask task;
+	volatile int64_t runs;
+};
+
+struct ExecutorTestDelayed {
+	struct ExecutorTask task;
+	int64_t scheduled_at;
+	volatile int64_t ran_at;
+};
+
+static int64_t executor_test_now_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000ll + ts.tv_nsec / 1000;
+}
+
+static void executor_test_busy(void *data) {
+	struct ExecutorTestBusy *busy = data;
+	busy->runs++;
+	executor_task_schedule(&busy->task);
+}
+
+static void executor_test_delayed(void *data) {
+	struct ExecutorTestDelayed *delayed = data;
+	if (delayed->ran_at == 0)
+		delayed->ran_at = executor_test_now_us();
+}
+
+static int executor_test_saturated(int workers, int busy_nb, int delayed_nb,
+		enum ExecutorPriority delayed_priority) {
+	struct ExecutorTestBusy busy[EXECUTOR_TEST_MAX_TASKS];
+	struct ExecutorTestDelayed delayed[EXECUTOR_TEST_MAX_TASKS];
+	struct Executor *executor = executor_create("executor_test", workers,
+			NULL, NULL, NULL);
+	int64_t deadline;
+	int ok = TRUE;
+	int i;
+
+	if (executor == NULL) {
+		fprintf(stderr, "FAIL could not create executor\n");
+		return FALSE;
+	}
+	for (i = 0; i < busy_nb; ++i) {
+		busy[i].runs = 0;
+		executor_task_init(&busy[i].task, executor, executor_test_busy,
+				&busy[i], EXECUTOR_PRIORITY_NORMAL);
+		executor_task_schedule(&busy[i].task);
+	}
+	// every busy task is running or queued before delay starts
+	deadline = executor_test_now_us() + EXECUTOR_TEST_TIMEOUT_US;
+	for (i = 0; i < busy_nb; ++i) {
+		while (busy[i].runs == 0 && executor_test_now_us() < deadline)
+			;
+	}
+
+	for (i = 0; i < delayed_nb; ++i) {
+		delayed[i].ran_at = 0;
+		executor_task_init(&delayed[i].task, executor, executor_test_delayed,
+				&delayed[i], delayed_priority);
+		delayed[i].scheduled_at = executor_test_now_us();
+		executor_task_schedule_delayed(&delayed[i].task,
+				EXECUTOR_TEST_DELAY_US);
+	}
+	deadline = executor_test_now_us() + EXECUTOR_TEST_TIMEOUT_US;
+	for (i = 0; i < delayed_nb; ++i) {
+		while (delayed[i].ran_at == 0 && executor_test_now_us() < deadline)
+			;
+		if (delayed[i].ran_at == 0) {
+			fprintf(stderr, "FAIL %d workers, %d busy tasks: delayed task %d "
+					"did not run\n", workers, busy_nb, i);
+			ok = FALSE;
+		} else if (delayed[i].ran_at - delayed[i].scheduled_at
+				< EXECUTOR_TEST_DELAY_US) {
+			fprintf(stderr, "FAIL %d workers, %d busy tasks: delayed task %d "
+					"ran too early\n", workers, busy_nb, i);
+			ok = FALSE;
+		}
+	}
+
+	for (i = 0; i < delayed_nb; ++i)
+		executor_task_cancel(&delayed[i].task);
+	for (i = 0; i < busy_nb; ++i)
+		executor_task_cancel(&busy[i].task);
+	executor_free(executor);
+	if (ok)
+		printf("ok %d workers, %d busy tasks\n", workers, busy_nb);
+	return ok;
+}
+
+int main(int argc, char *argv[]) {
+	int ok = executor_test_saturated(1, 1, 1, EXECUTOR_PRIORITY_HIGH);
+	ok = executor_test_saturated(4, 16, 4, EXECUTOR_PRIORITY_NORMAL) && ok;
+	return ok ? 0 : 1;
+}
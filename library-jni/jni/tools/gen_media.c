@@ -0,0 +1,801 @@
+/*
+ * gen_media.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Generates deterministic synthetic media for performance tests: moving
+ * pattern video, triangle wave audio and one subtitle event per second.
+ * Next to the asset a "<output>.sum" sidecar is written with xxHash64 of
+ * every decoded video frame (see checksum.h), so decode throughput and
+ * seek benchmarks could verify their output on any machine.
+ *
+ * Encoded bytes may differ between ffmpeg builds, checksums in the
+ * sidecar are computed by decoding the written asset back and stay valid
+ * for that file.
+ *
+ * usage: gen_media [options] output.mkv
+ *   -s WxH          frame size (640x360)
+ *   -r fps          frame rate (25)
+ *   -t seconds      duration (10)
+ *   -g gop          key frame interval in frames (25)
+ *   -bf frames      max b-frames (0)
+ *   -b bitrate      video bitrate in bits/s (1000000)
+ *   -vcodec name    video encoder (mpeg4)
+ *   -acodec name    audio encoder or "none" (mp2)
+ *   -ar rate        audio sample rate (44100)
+ *   -ac channels    audio channels (2)
+ *   -sub type       subtitles: ass, dvbsub or none (none)
+ *   -aeskey key     encrypts output with aes protocol (needs MODULE_ENCRYPT)
+ *   -seed n         pattern noise seed (1)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/samplefmt.h>
+#include <libswscale/swscale.h>
+
+#include "checksum.h"
+#ifdef MODULE_ENCRYPT
+#include "aes-protocol.h"
+#endif
+
+#define FALSE 0
+#define TRUE (!(FALSE))
+
+#define SUBTITLE_BUFFER_SIZE (1024 * 1024)
+#define SUBTITLE_DURATION_MS 900
+#define DVBSUB_WIDTH 256
+#define DVBSUB_HEIGHT 32
+#define AUDIO_AMPLITUDE 8000
+#define URL_SIZE 1024
+
+static const char gen_media_ass_header[] =
+		"[Script Info]\r\n"
+		"ScriptType: v4.00+\r\n"
+		"PlayResX: 384\r\n"
+		"PlayResY: 288\r\n"
+		"\r\n"
+		"[V4+ Styles]\r\n"
+		"Format: Name, Fontname, Fontsize, PrimaryColour, SecondaryColour, "
+		"OutlineColour, BackColour, Bold, Italic, Underline, StrikeOut, "
+		"ScaleX, ScaleY, Spacing, Angle, BorderStyle, Outline, Shadow, "
+		"Alignment, MarginL, MarginR, MarginV, Encoding\r\n"
+		"Style: Default,Arial,16,&Hffffff,&Hffffff,&H0,&H0,0,0,0,0,100,100,"
+		"0,0,1,1,0,2,10,10,10,0\r\n"
+		"\r\n"
+		"[Events]\r\n"
+		"Format: Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, "
+		"Effect, Text\r\n";
+
+enum GenMediaSubtitles {
+	GEN_MEDIA_SUB_NONE = 0,
+	GEN_MEDIA_SUB_ASS,
+	GEN_MEDIA_SUB_DVB,
+};
+
+struct GenMediaOptions {
+	int width;
+	int height;
+	int fps;
+	int duration;
+	int gop;
+	int bframes;
+	int bitrate;
+	const char *vcodec;
+	const char *acodec;
+	int sample_rate;
+	int channels;
+	enum GenMediaSubtitles subtitles;
+	const char *aeskey;
+	uint32_t seed;
+	const char *output;
+};
+
+struct GenMedia {
+	struct GenMediaOptions options;
+	char url[URL_SIZE];
+	AVFormatContext *format_ctx;
+	AVStream *video_stream;
+	AVStream *audio_stream;
+	AVStream *subtitle_stream;
+	AVFrame *video_frame;
+	AVPicture pattern;
+	struct SwsContext *sws_context;
+	AVFrame *audio_frame;
+	uint8_t *audio_buf;
+	int audio_buf_size;
+	int64_t audio_samples;
+	uint8_t *subtitle_buf;
+	uint8_t *video_buf;
+	int video_buf_size;
+};
+
+static void gen_media_open_options(struct GenMedia *gen,
+		AVDictionary **options) {
+	if (gen->options.aeskey != NULL)
+		av_dict_set(options, "aeskey", gen->options.aeskey, 0);
+}
+
+/*
+ * xorshift32, same sequence on every platform
+ */
+static inline uint32_t gen_media_rand(uint32_t *state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static void gen_media_fill_pattern(struct GenMedia *gen, int frame_no) {
+	AVPicture *p = &gen->pattern;
+	int width = gen->options.width;
+	int height = gen->options.height;
+	int box_size = height / 4;
+	int box_x = (frame_no * 8) % FFMAX(width - box_size, 1);
+	int box_y = height / 2 - box_size / 2;
+	uint32_t state = gen->options.seed * 2654435761u + frame_no + 1;
+	int x, y;
+
+	for (y = 0; y < height; ++y) {
+		uint8_t *line = p->data[0] + y * p->linesize[0];
+		for (x = 0; x < width; ++x) {
+			int value = x + y + frame_no * 4;
+			if (x >= box_x && x < box_x + box_size && y >= box_y
+					&& y < box_y + box_size)
+				value = 235;
+			// noise band gives encoder some real work
+			else if (y < height / 8)
+				value += gen_media_rand(&state) & 0x1f;
+			line[x] = value;
+		}
+	}
+	for (y = 0; y < (height + 1) / 2; ++y) {
+		uint8_t *u = p->data[1] + y * p->linesize[1];
+		uint8_t *v = p->data[2] + y * p->linesize[2];
+		for (x = 0; x < (width + 1) / 2; ++x) {
+			u[x] = 128 + ((x + frame_no) & 0x3f) - 0x20;
+			v[x] = 128 + ((y - frame_no) & 0x3f) - 0x20;
+		}
+	}
+}
+
+static int gen_media_write_packet(struct GenMedia *gen, AVStream *stream,
+		AVPacket *packet) {
+	AVRational time_base = stream->codec->time_base;
+	if (packet->pts != AV_NOPTS_VALUE)
+		packet->pts = av_rescale_q(packet->pts, time_base, stream->time_base);
+	if (packet->dts != AV_NOPTS_VALUE)
+		packet->dts = av_rescale_q(packet->dts, time_base, stream->time_base);
+	if (packet->duration > 0)
+		packet->duration = av_rescale_q(packet->duration, time_base,
+				stream->time_base);
+	packet->stream_index = stream->index;
+	return av_interleaved_write_frame(gen->format_ctx, packet);
+}
+
+static AVStream *gen_media_add_stream(struct GenMedia *gen,
+		const char *codec_name, AVCodec **codec) {
+	AVStream *stream;
+	*codec = avcodec_find_encoder_by_name(codec_name);
+	if (*codec == NULL) {
+		fprintf(stderr, "encoder %s not found\n", codec_name);
+		return NULL;
+	}
+	stream = avformat_new_stream(gen->format_ctx, *codec);
+	if (stream == NULL)
+		return NULL;
+	avcodec_get_context_defaults3(stream->codec, *codec);
+	// deterministic output, no threads and no random ids in muxer
+	stream->codec->flags |= CODEC_FLAG_BITEXACT;
+	stream->codec->thread_count = 1;
+	if (gen->format_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+		stream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+	return stream;
+}
+
+static int gen_media_open_video(struct GenMedia *gen) {
+	struct GenMediaOptions *o = &gen->options;
+	AVCodecContext *ctx;
+	AVCodec *codec;
+
+	gen->video_stream = gen_media_add_stream(gen, o->vcodec, &codec);
+	if (gen->video_stream == NULL)
+		return -1;
+	ctx = gen->video_stream->codec;
+	ctx->width = o->width;
+	ctx->height = o->height;
+	ctx->time_base = (AVRational) {1, o->fps};
+	ctx->gop_size = o->gop;
+	ctx->max_b_frames = o->bframes;
+	ctx->bit_rate = o->bitrate;
+	ctx->pix_fmt = PIX_FMT_YUV420P;
+	if (codec->pix_fmts != NULL) {
+		const enum PixelFormat *fmt = codec->pix_fmts;
+		while (*fmt != PIX_FMT_NONE && *fmt != PIX_FMT_YUV420P)
+			fmt++;
+		if (*fmt == PIX_FMT_NONE)
+			ctx->pix_fmt = codec->pix_fmts[0];
+	}
+	if (avcodec_open2(ctx, codec, NULL) < 0) {
+		fprintf(stderr, "could not open video encoder %s\n", o->vcodec);
+		return -1;
+	}
+
+	if (avpicture_alloc(&gen->pattern, PIX_FMT_YUV420P, o->width, o->height)
+			< 0)
+		return -1;
+	gen->video_frame = avcodec_alloc_frame();
+	if (gen->video_frame == NULL)
+		return -1;
+	if (avpicture_alloc((AVPicture *) gen->video_frame, ctx->pix_fmt,
+			o->width, o->height) < 0)
+		return -1;
+	gen->video_buf_size = FFMAX(o->width * o->height * 8, FF_MIN_BUFFER_SIZE);
+	gen->video_buf = av_malloc(gen->video_buf_size);
+	if (gen->video_buf == NULL)
+		return -1;
+	return 0;
+}
+
+static int gen_media_open_audio(struct GenMedia *gen) {
+	struct GenMediaOptions *o = &gen->options;
+	AVCodecContext *ctx;
+	AVCodec *codec;
+
+	gen->audio_stream = gen_media_add_stream(gen, o->acodec, &codec);
+	if (gen->audio_stream == NULL)
+		return -1;
+	ctx = gen->audio_stream->codec;
+	ctx->sample_rate = o->sample_rate;
+	ctx->channels = o->channels;
+	ctx->channel_layout = av_get_default_channel_layout(o->channels);
+	ctx->sample_fmt = codec->sample_fmts != NULL ?
+			codec->sample_fmts[0] : AV_SAMPLE_FMT_S16;
+	ctx->bit_rate = 64000 * o->channels;
+	ctx->time_base = (AVRational) {1, o->sample_rate};
+	// native aac encoder is still experimental
+	ctx->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+	if (avcodec_open2(ctx, codec, NULL) < 0) {
+		fprintf(stderr, "could not open audio encoder %s\n", o->acodec);
+		return -1;
+	}
+	if (ctx->frame_size <= 0)
+		ctx->frame_size = 1024;
+
+	gen->audio_frame = avcodec_alloc_frame();
+	if (gen->audio_frame == NULL)
+		return -1;
+	gen->audio_buf_size = av_samples_get_buffer_size(NULL, ctx->channels,
+			ctx->frame_size, ctx->sample_fmt, 1);
+	gen->audio_buf = av_malloc(gen->audio_buf_size);
+	if (gen->audio_buf == NULL)
+		return -1;
+	return 0;
+}
+
+static int gen_media_open_subtitles(struct GenMedia *gen) {
+	struct GenMediaOptions *o = &gen->options;
+	AVCodecContext *ctx;
+	AVCodec *codec;
+	const char *name = o->subtitles == GEN_MEDIA_SUB_ASS ? "ass" : "dvbsub";
+
+	gen->subtitle_stream = gen_media_add_stream(gen, name, &codec);
+	if (gen->subtitle_stream == NULL)
+		return -1;
+	ctx = gen->subtitle_stream->codec;
+	ctx->time_base = (AVRational) {1, 1000};
+	ctx->width = o->width;
+	ctx->height = o->height;
+	if (o->subtitles == GEN_MEDIA_SUB_ASS) {
+		ctx->subtitle_header = (uint8_t *) av_strdup(gen_media_ass_header);
+		if (ctx->subtitle_header == NULL)
+			return -1;
+		ctx->subtitle_header_size = strlen(gen_media_ass_header);
+	}
+	if (avcodec_open2(ctx, codec, NULL) < 0) {
+		fprintf(stderr, "could not open subtitle encoder %s\n", name);
+		return -1;
+	}
+	gen->subtitle_buf = av_malloc(SUBTITLE_BUFFER_SIZE);
+	if (gen->subtitle_buf == NULL)
+		return -1;
+	return 0;
+}
+
+static int gen_media_encode_video(struct GenMedia *gen, int frame_no) {
+	AVCodecContext *ctx = gen->video_stream->codec;
+	AVFrame *frame = NULL;
+	AVPacket packet;
+	int got_packet = 0;
+
+	if (frame_no >= 0) {
+		frame = gen->video_frame;
+		gen_media_fill_pattern(gen, frame_no);
+		if (ctx->pix_fmt == PIX_FMT_YUV420P) {
+			av_picture_copy((AVPicture *) frame, &gen->pattern,
+					PIX_FMT_YUV420P, ctx->width, ctx->height);
+		} else {
+			gen->sws_context = sws_getCachedContext(gen->sws_context,
+					ctx->width, ctx->height, PIX_FMT_YUV420P, ctx->width,
+					ctx->height, ctx->pix_fmt, SWS_BILINEAR | SWS_BITEXACT,
+					NULL, NULL, NULL);
+			if (gen->sws_context == NULL)
+				return -1;
+			sws_scale(gen->sws_context,
+					(const uint8_t * const *) gen->pattern.data,
+					gen->pattern.linesize, 0, ctx->height, frame->data,
+					frame->linesize);
+		}
+		frame->pts = frame_no;
+	}
+
+	av_init_packet(&packet);
+	packet.data = gen->video_buf;
+	packet.size = gen->video_buf_size;
+	if (avcodec_encode_video2(ctx, &packet, frame, &got_packet) < 0) {
+		fprintf(stderr, "could not encode video frame %d\n", frame_no);
+		return -1;
+	}
+	if (!got_packet)
+		return 0;
+	if (gen_media_write_packet(gen, gen->video_stream, &packet) < 0)
+		return -1;
+	return 1;
+}
+
+static void gen_media_fill_audio(struct GenMedia *gen, int samples) {
+	AVCodecContext *ctx = gen->audio_stream->codec;
+	int planar = av_sample_fmt_is_planar(ctx->sample_fmt);
+	int i, ch;
+
+	for (i = 0; i < samples; ++i) {
+		int64_t n = gen->audio_samples + i;
+		// tone changes every second so seeks land on different signal
+		int freq = 220 + 110 * ((n / ctx->sample_rate) % 4);
+		int period = FFMAX(ctx->sample_rate / freq, 2);
+		int phase = n % period;
+		int value = AUDIO_AMPLITUDE * 4 * phase / period;
+		if (value > AUDIO_AMPLITUDE * 2)
+			value = AUDIO_AMPLITUDE * 4 - value;
+		value -= AUDIO_AMPLITUDE;
+		for (ch = 0; ch < ctx->channels; ++ch) {
+			int index = planar ? ch * samples + i : i * ctx->channels + ch;
+			int sample = value >> ch;
+			switch (av_get_packed_sample_fmt(ctx->sample_fmt)) {
+			case AV_SAMPLE_FMT_FLT:
+				((float *) gen->audio_buf)[index] = sample / 32768.0f;
+				break;
+			case AV_SAMPLE_FMT_S32:
+				((int32_t *) gen->audio_buf)[index] = sample << 16;
+				break;
+			default:
+				((int16_t *) gen->audio_buf)[index] = sample;
+				break;
+			}
+		}
+	}
+}
+
+static int gen_media_encode_audio(struct GenMedia *gen, int flush) {
+	AVCodecContext *ctx = gen->audio_stream->codec;
+	AVFrame *frame = NULL;
+	AVPacket packet;
+	int got_packet = 0;
+
+	if (!flush) {
+		frame = gen->audio_frame;
+		avcodec_get_frame_defaults(frame);
+		frame->nb_samples = ctx->frame_size;
+		frame->pts = gen->audio_samples;
+		gen_media_fill_audio(gen, ctx->frame_size);
+		if (avcodec_fill_audio_frame(frame, ctx->channels, ctx->sample_fmt,
+				gen->audio_buf, gen->audio_buf_size, 1) < 0)
+			return -1;
+		gen->audio_samples += ctx->frame_size;
+	}
+
+	av_init_packet(&packet);
+	packet.data = NULL;
+	packet.size = 0;
+	if (avcodec_encode_audio2(ctx, &packet, frame, &got_packet) < 0) {
+		fprintf(stderr, "could not encode audio frame\n");
+		return -1;
+	}
+	if (!got_packet)
+		return 0;
+	if (gen_media_write_packet(gen, gen->audio_stream, &packet) < 0) {
+		av_free_packet(&packet);
+		return -1;
+	}
+	av_free_packet(&packet);
+	return 1;
+}
+
+static int gen_media_encode_subtitle(struct GenMedia *gen, int second) {
+	AVCodecContext *ctx = gen->subtitle_stream->codec;
+	AVSubtitle sub;
+	AVSubtitleRect rect;
+	AVSubtitleRect *rects[1] = { &rect };
+	AVPacket packet;
+	char text[256];
+	uint32_t palette[4] = { 0x00000000, 0xffffffff, 0xff000000, 0xffff0000 };
+	uint8_t bitmap[DVBSUB_WIDTH * DVBSUB_HEIGHT];
+	int size;
+
+	memset(&sub, 0, sizeof(sub));
+	memset(&rect, 0, sizeof(rect));
+	sub.num_rects = 1;
+	sub.rects = rects;
+	sub.pts = (int64_t) second * AV_TIME_BASE;
+	sub.end_display_time = SUBTITLE_DURATION_MS;
+
+	if (gen->options.subtitles == GEN_MEDIA_SUB_ASS) {
+		snprintf(text, sizeof(text), "Dialogue: 0,0:%02d:%02d.00,"
+				"0:%02d:%02d.%02d,Default,,0,0,0,,Second %d\r\n",
+				second / 60, second % 60, second / 60, second % 60,
+				SUBTITLE_DURATION_MS / 10, second);
+		rect.type = SUBTITLE_ASS;
+		rect.ass = text;
+	} else {
+		int x, y;
+		// frame with a bar growing every second
+		for (y = 0; y < DVBSUB_HEIGHT; ++y) {
+			for (x = 0; x < DVBSUB_WIDTH; ++x) {
+				uint8_t color = 0;
+				if (y < 2 || y >= DVBSUB_HEIGHT - 2 || x < 2
+						|| x >= DVBSUB_WIDTH - 2)
+					color = 1;
+				else if (x < (second * 16) % DVBSUB_WIDTH)
+					color = 3;
+				bitmap[y * DVBSUB_WIDTH + x] = color;
+			}
+		}
+		rect.type = SUBTITLE_BITMAP;
+		rect.x = (ctx->width - DVBSUB_WIDTH) / 2;
+		rect.y = ctx->height - DVBSUB_HEIGHT * 2;
+		rect.w = DVBSUB_WIDTH;
+		rect.h = DVBSUB_HEIGHT;
+		rect.nb_colors = 4;
+		rect.pict.data[0] = bitmap;
+		rect.pict.linesize[0] = DVBSUB_WIDTH;
+		rect.pict.data[1] = (uint8_t *) palette;
+	}
+
+	size = avcodec_encode_subtitle(ctx, gen->subtitle_buf,
+			SUBTITLE_BUFFER_SIZE, &sub);
+	if (size < 0) {
+		fprintf(stderr, "could not encode subtitle %d\n", second);
+		return -1;
+	}
+	av_init_packet(&packet);
+	packet.data = gen->subtitle_buf;
+	packet.size = size;
+	packet.pts = packet.dts = (int64_t) second * 1000;
+	packet.duration = SUBTITLE_DURATION_MS;
+	return gen_media_write_packet(gen, gen->subtitle_stream, &packet);
+}
+
+static int gen_media_open(struct GenMedia *gen) {
+	struct GenMediaOptions *o = &gen->options;
+	AVDictionary *options = NULL;
+	int ret;
+
+	if (o->aeskey != NULL)
+		snprintf(gen->url, sizeof(gen->url), "aes:file:%s", o->output);
+	else
+		snprintf(gen->url, sizeof(gen->url), "file:%s", o->output);
+
+	ret = avformat_alloc_output_context2(&gen->format_ctx, NULL, NULL,
+			o->output);
+	if (ret < 0 || gen->format_ctx == NULL) {
+		fprintf(stderr, "unknown output format for %s\n", o->output);
+		return -1;
+	}
+	if (gen_media_open_video(gen) < 0)
+		return -1;
+	if (strcmp(o->acodec, "none") != 0 && gen_media_open_audio(gen) < 0)
+		return -1;
+	if (o->subtitles != GEN_MEDIA_SUB_NONE
+			&& gen_media_open_subtitles(gen) < 0)
+		return -1;
+
+	gen_media_open_options(gen, &options);
+	ret = avio_open2(&gen->format_ctx->pb, gen->url, AVIO_FLAG_WRITE, NULL,
+			&options);
+	av_dict_free(&options);
+	if (ret < 0) {
+		fprintf(stderr, "could not open %s\n", gen->url);
+		return -1;
+	}
+	if (avformat_write_header(gen->format_ctx, NULL) < 0) {
+		fprintf(stderr, "could not write header\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int gen_media_encode(struct GenMedia *gen) {
+	struct GenMediaOptions *o = &gen->options;
+	int frames = o->duration * o->fps;
+	int frame_no, ret;
+
+	for (frame_no = 0; frame_no < frames; ++frame_no) {
+		if (o->subtitles != GEN_MEDIA_SUB_NONE && frame_no % o->fps == 0
+				&& gen_media_encode_subtitle(gen, frame_no / o->fps) < 0)
+			return -1;
+		if (gen_media_encode_video(gen, frame_no) < 0)
+			return -1;
+		// audio catches up with video
+		while (gen->audio_stream != NULL
+				&& gen->audio_samples * o->fps
+						< (int64_t) (frame_no + 1) * o->sample_rate)
+			if (gen_media_encode_audio(gen, FALSE) < 0)
+				return -1;
+	}
+
+	// drain delayed frames
+	do {
+		ret = gen_media_encode_video(gen, -1);
+	} while (ret > 0);
+	if (ret < 0)
+		return -1;
+	if (gen->audio_stream != NULL
+			&& (gen->audio_stream->codec->codec->capabilities
+					& CODEC_CAP_DELAY)) {
+		do {
+			ret = gen_media_encode_audio(gen, TRUE);
+		} while (ret > 0);
+		if (ret < 0)
+			return -1;
+	}
+	if (av_write_trailer(gen->format_ctx) < 0)
+		return -1;
+	return 0;
+}
+
+static void gen_media_close(struct GenMedia *gen) {
+	int i;
+	if (gen->format_ctx == NULL)
+		return;
+	for (i = 0; i < gen->format_ctx->nb_streams; ++i)
+		avcodec_close(gen->format_ctx->streams[i]->codec);
+	if (gen->format_ctx->pb != NULL)
+		avio_close(gen->format_ctx->pb);
+	avformat_free_context(gen->format_ctx);
+	gen->format_ctx = NULL;
+	if (gen->video_frame != NULL) {
+		avpicture_free((AVPicture *) gen->video_frame);
+		av_free(gen->video_frame);
+	}
+	avpicture_free(&gen->pattern);
+	av_free(gen->audio_frame);
+	av_free(gen->audio_buf);
+	av_free(gen->video_buf);
+	av_free(gen->subtitle_buf);
+	sws_freeContext(gen->sws_context);
+}
+
+/*
+ * Decodes written asset single threaded and stores checksum of every
+ * video frame: "video <pts_us> <xxhash64>"
+ */
+static int gen_media_write_sums(struct GenMedia *gen) {
+	struct GenMediaOptions *o = &gen->options;
+	AVFormatContext *format_ctx = NULL;
+	AVDictionary *options = NULL;
+	AVCodecContext *ctx;
+	AVCodec *codec;
+	AVFrame *frame = NULL;
+	AVPacket packet;
+	char path[URL_SIZE];
+	FILE *file = NULL;
+	int stream_no, got_frame;
+	int frames = 0;
+	int err = -1;
+
+	snprintf(path, sizeof(path), "%s.sum", o->output);
+	file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "could not open %s\n", path);
+		return -1;
+	}
+	fprintf(file, "# gen_media size=%dx%d fps=%d duration=%d gop=%d bf=%d "
+			"bitrate=%d vcodec=%s acodec=%s sub=%s encrypted=%d seed=%u\n",
+			o->width, o->height, o->fps, o->duration, o->gop, o->bframes,
+			o->bitrate, o->vcodec, o->acodec,
+			o->subtitles == GEN_MEDIA_SUB_ASS ? "ass" :
+			o->subtitles == GEN_MEDIA_SUB_DVB ? "dvbsub" : "none",
+			o->aeskey != NULL, o->seed);
+
+	gen_media_open_options(gen, &options);
+	if (avformat_open_input(&format_ctx, gen->url, NULL, &options) < 0) {
+		fprintf(stderr, "could not reopen %s\n", gen->url);
+		goto end;
+	}
+	if (avformat_find_stream_info(format_ctx, NULL) < 0)
+		goto end;
+	stream_no = av_find_best_stream(format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1,
+			&codec, 0);
+	if (stream_no < 0)
+		goto end;
+	ctx = format_ctx->streams[stream_no]->codec;
+	ctx->thread_count = 1;
+	if (avcodec_open2(ctx, codec, NULL) < 0)
+		goto end;
+	frame = avcodec_alloc_frame();
+	if (frame == NULL)
+		goto close_codec;
+
+	av_init_packet(&packet);
+	for (;;) {
+		int ret = av_read_frame(format_ctx, &packet);
+		if (ret < 0) {
+			// flush decoder
+			packet.data = NULL;
+			packet.size = 0;
+			packet.stream_index = stream_no;
+		} else if (packet.stream_index != stream_no) {
+			av_free_packet(&packet);
+			continue;
+		}
+		got_frame = 0;
+		if (avcodec_decode_video2(ctx, frame, &got_frame, &packet) < 0)
+			got_frame = 0;
+		if (got_frame) {
+			int64_t pts = av_frame_get_best_effort_timestamp(frame);
+			if (pts == AV_NOPTS_VALUE)
+				pts = 0;
+			checksum_log(file, "video",
+					av_rescale_q(pts, format_ctx->streams[stream_no]->time_base,
+							AV_TIME_BASE_Q),
+					checksum_picture((AVPicture *) frame, ctx->pix_fmt,
+							ctx->width, ctx->height));
+			frames++;
+		}
+		if (ret >= 0)
+			av_free_packet(&packet);
+		else if (!got_frame)
+			break;
+	}
+	err = 0;
+	fprintf(stderr, "%s: %d video frames checksummed\n", path, frames);
+
+	av_free(frame);
+	close_codec:
+	avcodec_close(ctx);
+	end:
+	av_dict_free(&options);
+	if (format_ctx != NULL)
+		avformat_close_input(&format_ctx);
+	fclose(file);
+	return err;
+}
+
+static int gen_media_parse_args(struct GenMediaOptions *o, int argc,
+		char *argv[]) {
+	int i;
+	for (i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (arg[0] != '-') {
+			o->output = arg;
+			continue;
+		}
+		if (value == NULL)
+			return -1;
+		i++;
+		if (strcmp(arg, "-s") == 0) {
+			if (sscanf(value, "%dx%d", &o->width, &o->height) != 2)
+				return -1;
+		} else if (strcmp(arg, "-r") == 0) {
+			o->fps = atoi(value);
+		} else if (strcmp(arg, "-t") == 0) {
+			o->duration = atoi(value);
+		} else if (strcmp(arg, "-g") == 0) {
+			o->gop = atoi(value);
+		} else if (strcmp(arg, "-bf") == 0) {
+			o->bframes = atoi(value);
+		} else if (strcmp(arg, "-b") == 0) {
+			o->bitrate = atoi(value);
+		} else if (strcmp(arg, "-vcodec") == 0) {
+			o->vcodec = value;
+		} else if (strcmp(arg, "-acodec") == 0) {
+			o->acodec = value;
+		} else if (strcmp(arg, "-ar") == 0) {
+			o->sample_rate = atoi(value);
+		} else if (strcmp(arg, "-ac") == 0) {
+			o->channels = atoi(value);
+		} else if (strcmp(arg, "-sub") == 0) {
+			if (strcmp(value, "ass") == 0)
+				o->subtitles = GEN_MEDIA_SUB_ASS;
+			else if (strcmp(value, "dvbsub") == 0)
+				o->subtitles = GEN_MEDIA_SUB_DVB;
+			else if (strcmp(value, "none") == 0)
+				o->subtitles = GEN_MEDIA_SUB_NONE;
+			else
+				return -1;
+		} else if (strcmp(arg, "-aeskey") == 0) {
+			o->aeskey = value;
+		} else if (strcmp(arg, "-seed") == 0) {
+			o->seed = strtoul(value, NULL, 10);
+		} else {
+			return -1;
+		}
+	}
+	if (o->output == NULL || o->width <= 0 || o->height <= 0 || o->fps <= 0
+			|| o->duration <= 0 || o->gop <= 0 || o->sample_rate <= 0
+			|| o->channels <= 0)
+		return -1;
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	struct GenMedia gen;
+	struct GenMediaOptions *o = &gen.options;
+	int err = 1;
+
+	memset(&gen, 0, sizeof(gen));
+	o->width = 640;
+	o->height = 360;
+	o->fps = 25;
+	o->duration = 10;
+	o->gop = 25;
+	o->bitrate = 1000000;
+	o->vcodec = "mpeg4";
+	o->acodec = "mp2";
+	o->sample_rate = 44100;
+	o->channels = 2;
+	o->seed = 1;
+	if (gen_media_parse_args(o, argc, argv) < 0) {
+		fprintf(stderr, "usage: %s [-s WxH] [-r fps] [-t seconds] [-g gop] "
+				"[-bf frames] [-b bitrate] [-vcodec name] "
+				"[-acodec name|none] [-ar rate] [-ac channels] "
+				"[-sub ass|dvbsub|none] [-aeskey key] [-seed n] output\n",
+				argv[0]);
+		return 1;
+	}
+
+	av_register_all();
+#ifdef MODULE_ENCRYPT
+	register_aes_protocol();
+#else
+	if (o->aeskey != NULL) {
+		fprintf(stderr, "-aeskey needs build with MODULE_ENCRYPT=1\n");
+		return 1;
+	}
+#endif
+
+	if (gen_media_open(&gen) < 0)
+		goto end;
+	if (gen_media_encode(&gen) < 0)
+		goto end;
+	gen_media_close(&gen);
+	if (gen_media_write_sums(&gen) < 0)
+		goto end;
+	err = 0;
+
+	end:
+	gen_media_close(&gen);
+	return err;
+}
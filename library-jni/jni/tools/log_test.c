@@ -0,0 +1,80 @@
+/*
+ * log_test.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Checks log_set_level as called by FFmpegPlayer.setLogLevel:
+ * - LOG_ALL (-1) sets every subsystem except ffmpeg,
+ * - a single subsystem is set alone,
+ * - subsystems out of range are ignored.
+ *
+ * usage: log_test
+ * Exits with 1 on first unexpected level.
+ */
+
+#include <stdio.h>
+
+#include "log.h"
+
+#define FALSE 0
+#define TRUE (!(FALSE))
+
+// FFmpegPlayer.LOG_ALL
+#define LOG_TEST_JAVA_LOG_ALL -1
+
+static int log_test_expect(const char *step, const int *expected) {
+	int i;
+	for (i = 0; i < LOG_SUBSYSTEMS_NB; ++i) {
+		if (log_levels[i] == expected[i])
+			continue;
+		fprintf(stderr, "FAIL %s: subsystem: %d, expected: %d, got: %d\n",
+				step, i, expected[i], log_levels[i]);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+	int expected[LOG_SUBSYSTEMS_NB];
+	int i;
+
+	for (i = 0; i < LOG_SUBSYSTEMS_NB; ++i)
+		expected[i] = log_levels[i];
+
+	// jint from java as in jni_player_set_log_level
+	log_set_level(LOG_TEST_JAVA_LOG_ALL, 9);
+	for (i = 0; i < LOG_SUBSYSTEMS_NB; ++i)
+		if (i != LOG_SUBSYSTEM_FFMPEG)
+			expected[i] = 9;
+	if (!log_test_expect("all", expected))
+		return 1;
+
+	log_set_level(LOG_SUBSYSTEM_RENDER, 3);
+	expected[LOG_SUBSYSTEM_RENDER] = 3;
+	log_set_level(LOG_SUBSYSTEM_FFMPEG, 48);
+	expected[LOG_SUBSYSTEM_FFMPEG] = 48;
+	if (!log_test_expect("single", expected))
+		return 1;
+
+	log_set_level(LOG_SUBSYSTEMS_NB, 1);
+	log_set_level(-2, 1);
+	if (!log_test_expect("out of range", expected))
+		return 1;
+
+	printf("ok\n");
+	return 0;
+}
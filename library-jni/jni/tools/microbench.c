@@ -0,0 +1,606 @@
+/*
+ * microbench.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Microbenchmarks of native hot paths: convert.cpp wrappers, blend.c,
+ * Queue and aes protocol reads. Every result is printed as one JSON line
+ * so output of a previous run could be used as a baseline.
+ *
+ * usage: microbench [--filter prefix] [--baseline file] [--threshold 0.1]
+ * Exits with 2 if any result is slower than baseline by more than
+ * threshold.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <libavcodec/avcodec.h>
+#include <ass/ass.h>
+
+#include "blend.h"
+#include "convert.h"
+#include "metrics.h"
+#include "queue.h"
+#ifdef MODULE_ENCRYPT
+#include <libavformat/avformat.h>
+#include "ffmpeg/libavformat/url.h"
+#include "aes-protocol.h"
+#endif
+
+#define FALSE 0
+#define TRUE (!(FALSE))
+
+#define MIN_TIME_US 300000ll
+#define MIN_ITERATIONS 3
+#define MAX_BASELINE 256
+#define NAME_SIZE 96
+
+struct Resolution {
+	const char *name;
+	int width;
+	int height;
+};
+
+static const struct Resolution resolutions[] = {
+	{ "480p", 854, 480 },
+	{ "720p", 1280, 720 },
+	{ "1080p", 1920, 1080 },
+	{ "2160p", 3840, 2160 },
+};
+
+#define RESOLUTIONS_NB (sizeof(resolutions) / sizeof(*resolutions))
+
+struct BaselineEntry {
+	char name[NAME_SIZE];
+	double value;
+};
+
+static const char *filter = NULL;
+static struct BaselineEntry baseline[MAX_BASELINE];
+static int baseline_nb = 0;
+static double threshold = 0.1;
+static int regressions = 0;
+static int results = 0;
+
+static int microbench_enabled(const char *name) {
+	return filter == NULL || strncmp(name, filter, strlen(filter)) == 0;
+}
+
+static int microbench_load_baseline(const char *path) {
+	char line[512];
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), file) != NULL
+			&& baseline_nb < MAX_BASELINE) {
+		struct BaselineEntry *entry = &baseline[baseline_nb];
+		char *name = strstr(line, "\"name\": \"");
+		char *value = strstr(line, "\"value\": ");
+		char *end;
+		if (name == NULL || value == NULL)
+			continue;
+		name += strlen("\"name\": \"");
+		end = strchr(name, '"');
+		if (end == NULL || end - name >= NAME_SIZE)
+			continue;
+		memcpy(entry->name, name, end - name);
+		entry->name[end - name] = '\0';
+		entry->value = atof(value + strlen("\"value\": "));
+		baseline_nb++;
+	}
+	fclose(file);
+	return 0;
+}
+
+/*
+ * All values are throughputs, higher is better
+ */
+static void microbench_report(const char *name, const char *unit,
+		double value) {
+	int i;
+	printf("%s  { \"name\": \"%s\", \"unit\": \"%s\", \"value\": %.2f",
+			results++ ? ",\n" : "", name, unit, value);
+	for (i = 0; i < baseline_nb; ++i) {
+		if (strcmp(baseline[i].name, name) != 0)
+			continue;
+		double ratio = baseline[i].value > 0 ? value / baseline[i].value : 1.0;
+		int regression = ratio < 1.0 - threshold;
+		printf(", \"baseline\": %.2f, \"ratio\": %.3f, \"regression\": %s",
+				baseline[i].value, ratio, regression ? "true" : "false");
+		if (regression) {
+			fprintf(stderr, "regression: %s %.2f -> %.2f %s\n", name,
+					baseline[i].value, value, unit);
+			regressions++;
+		}
+		break;
+	}
+	printf(" }");
+	fflush(stdout);
+}
+
+typedef void (*microbench_func)(void *data);
+
+/*
+ * Returns iterations per second of func
+ */
+static double microbench_run(microbench_func func, void *data) {
+	int64_t start = metrics_now_us();
+	int64_t elapsed;
+	int iterations = 0;
+	// warm up caches
+	func(data);
+	do {
+		func(data);
+		iterations++;
+		elapsed = metrics_now_us() - start;
+	} while (elapsed < MIN_TIME_US || iterations < MIN_ITERATIONS);
+	return iterations * 1000000.0 / elapsed;
+}
+
+static uint8_t *microbench_alloc(int size) {
+	uint8_t *data = av_malloc(size);
+	int i;
+	if (data == NULL) {
+		fprintf(stderr, "could not allocate %d bytes\n", size);
+		exit(1);
+	}
+	for (i = 0; i < size; ++i)
+		data[i] = rand();
+	return data;
+}
+
+/* convert.cpp */
+
+struct ConvertData {
+	int width;
+	int height;
+	uint8_t *src;
+	uint8_t *dst;
+};
+
+static void convert_i420(void *data) {
+	struct ConvertData *d = data;
+	int w = d->width, h = d->height;
+	uint8_t *u = d->src + w * h;
+	uint8_t *v = u + (w / 2) * (h / 2);
+	__I420ToARGB(d->src, w, u, w / 2, v, w / 2, d->dst, w * 4, w, h);
+}
+
+static void convert_nv12(void *data) {
+	struct ConvertData *d = data;
+	int w = d->width, h = d->height;
+	__NV12ToARGB(d->src, w, d->src + w * h, w, d->dst, w * 4, w, h);
+}
+
+static void convert_nv21(void *data) {
+	struct ConvertData *d = data;
+	int w = d->width, h = d->height;
+	__NV21ToARGB(d->src, w, d->src + w * h, w, d->dst, w * 4, w, h);
+}
+
+static void convert_bgra(void *data) {
+	struct ConvertData *d = data;
+	__BGRAToARGB(d->src, d->width * 4, d->dst, d->width * 4, d->width,
+			d->height);
+}
+
+static void convert_copy(void *data) {
+	struct ConvertData *d = data;
+	__ARGBCopy(d->src, d->width * 4, d->dst, d->width * 4, d->width,
+			d->height);
+}
+
+static void convert_rgba(void *data) {
+	struct ConvertData *d = data;
+	__ARGBToRGBA(d->src, d->width * 4, d->dst, d->width * 4, d->width,
+			d->height);
+}
+
+// scaling to 720p like to a typical phone surface
+static void convert_scale_none(void *data) {
+	struct ConvertData *d = data;
+	__ARGBScale(d->src, d->width * 4, d->width, d->height, d->dst, 1280 * 4,
+			1280, 720, __kFilterNone);
+}
+
+static void convert_scale_bilinear(void *data) {
+	struct ConvertData *d = data;
+	__ARGBScale(d->src, d->width * 4, d->width, d->height, d->dst, 1280 * 4,
+			1280, 720, __kFilterBilinear);
+}
+
+static void microbench_convert() {
+	static const struct {
+		const char *name;
+		microbench_func func;
+	} funcs[] = {
+		{ "I420ToARGB", convert_i420 },
+		{ "NV12ToARGB", convert_nv12 },
+		{ "NV21ToARGB", convert_nv21 },
+		{ "BGRAToARGB", convert_bgra },
+		{ "ARGBCopy", convert_copy },
+		{ "ARGBToRGBA", convert_rgba },
+		{ "ARGBScale_none_to_720p", convert_scale_none },
+		{ "ARGBScale_bilinear_to_720p", convert_scale_bilinear },
+	};
+	char name[NAME_SIZE];
+	int r, f;
+	for (r = 0; r < RESOLUTIONS_NB; ++r) {
+		const struct Resolution *res = &resolutions[r];
+		int pixels = res->width * res->height;
+		struct ConvertData data = { res->width, res->height, NULL, NULL };
+		for (f = 0; f < sizeof(funcs) / sizeof(*funcs); ++f) {
+			snprintf(name, sizeof(name), "convert/%s/%s", funcs[f].name,
+					res->name);
+			if (!microbench_enabled(name))
+				continue;
+			if (data.src == NULL) {
+				data.src = microbench_alloc(pixels * 4);
+				data.dst = microbench_alloc(
+						FFMAX(pixels, 1280 * 720) * 4);
+			}
+			microbench_report(name, "mpix_per_s",
+					microbench_run(funcs[f].func, &data) * pixels / 1e6);
+		}
+		av_free(data.src);
+		av_free(data.dst);
+	}
+}
+
+/* blend.c */
+
+#define BLEND_WIDTH 1280
+#define BLEND_HEIGHT 720
+
+struct BlendData {
+	AVPicture picture;
+	ASS_Image image;
+	AVSubtitleRect rect;
+	const struct BlendKernels *kernels;
+	uint8_t *mask;
+	uint32_t *src;
+};
+
+static void blend_ass(void *data) {
+	struct BlendData *d = data;
+	blend_ass_image(&d->picture, &d->image, BLEND_WIDTH, BLEND_HEIGHT,
+			PIX_FMT_RGBA);
+}
+
+static void blend_subrect(void *data) {
+	struct BlendData *d = data;
+	blend_subrect_rgba(&d->picture, &d->rect, BLEND_WIDTH, BLEND_HEIGHT,
+			PIX_FMT_RGBA);
+}
+
+static void blend_rows_mask(void *data) {
+	struct BlendData *d = data;
+	int y;
+	for (y = 0; y < BLEND_HEIGHT; ++y)
+		d->kernels->row_mask(
+				(uint32_t *) (d->picture.data[0]
+						+ y * d->picture.linesize[0]),
+				d->mask + y * BLEND_WIDTH, BLEND_WIDTH, 0x00ffffff, 0xff);
+}
+
+static void blend_rows_rgba(void *data) {
+	struct BlendData *d = data;
+	int y;
+	for (y = 0; y < BLEND_HEIGHT; ++y)
+		d->kernels->row_rgba(
+				(uint32_t *) (d->picture.data[0]
+						+ y * d->picture.linesize[0]), d->src, BLEND_WIDTH);
+}
+
+static void blend_rows_premul(void *data) {
+	struct BlendData *d = data;
+	int y;
+	for (y = 0; y < BLEND_HEIGHT; ++y)
+		d->kernels->row_premul(
+				(uint32_t *) (d->picture.data[0]
+						+ y * d->picture.linesize[0]), d->src, BLEND_WIDTH);
+}
+
+static void microbench_blend() {
+	static const int coverages[] = { 10, 50, 100 };
+	const struct BlendKernels *kernels[] = { blend_get_c_kernels(),
+			blend_get_kernels() };
+	struct BlendData data;
+	char name[NAME_SIZE];
+	int pixels = BLEND_WIDTH * BLEND_HEIGHT;
+	int i;
+
+	memset(&data, 0, sizeof(data));
+	data.picture.data[0] = microbench_alloc(pixels * 4);
+	data.picture.linesize[0] = BLEND_WIDTH * 4;
+	data.mask = microbench_alloc(pixels);
+	data.src = (uint32_t *) microbench_alloc(pixels * 4);
+
+	// subtitle covering bottom part of the frame
+	for (i = 0; i < sizeof(coverages) / sizeof(*coverages); ++i) {
+		int h = BLEND_HEIGHT * coverages[i] / 100;
+
+		data.image.w = BLEND_WIDTH;
+		data.image.h = h;
+		data.image.stride = BLEND_WIDTH;
+		data.image.bitmap = data.mask;
+		data.image.color = 0xffff0000;
+		data.image.dst_x = 0;
+		data.image.dst_y = BLEND_HEIGHT - h;
+		snprintf(name, sizeof(name), "blend/ass_image/%d%%", coverages[i]);
+		if (microbench_enabled(name))
+			microbench_report(name, "mpix_per_s",
+					microbench_run(blend_ass, &data) * BLEND_WIDTH * h / 1e6);
+
+		data.rect.x = 0;
+		data.rect.y = BLEND_HEIGHT - h;
+		data.rect.w = BLEND_WIDTH;
+		data.rect.h = h;
+		data.rect.nb_colors = 256;
+		data.rect.pict.data[0] = data.mask;
+		data.rect.pict.linesize[0] = BLEND_WIDTH;
+		data.rect.pict.data[1] = (uint8_t *) data.src;
+		snprintf(name, sizeof(name), "blend/subrect_rgba/%d%%", coverages[i]);
+		if (microbench_enabled(name))
+			microbench_report(name, "mpix_per_s",
+					microbench_run(blend_subrect, &data) * BLEND_WIDTH * h
+							/ 1e6);
+	}
+
+	// vectorized kernels against the scalar reference
+	for (i = 0; i < sizeof(kernels) / sizeof(*kernels); ++i) {
+		if (i > 0 && kernels[i] == kernels[0])
+			break;
+		data.kernels = kernels[i];
+		snprintf(name, sizeof(name), "blend/row_mask/%s", kernels[i]->name);
+		if (microbench_enabled(name))
+			microbench_report(name, "mpix_per_s",
+					microbench_run(blend_rows_mask, &data) * pixels / 1e6);
+		snprintf(name, sizeof(name), "blend/row_rgba/%s", kernels[i]->name);
+		if (microbench_enabled(name))
+			microbench_report(name, "mpix_per_s",
+					microbench_run(blend_rows_rgba, &data) * pixels / 1e6);
+		snprintf(name, sizeof(name), "blend/row_premul/%s", kernels[i]->name);
+		if (microbench_enabled(name))
+			microbench_report(name, "mpix_per_s",
+					microbench_run(blend_rows_premul, &data) * pixels / 1e6);
+	}
+
+	av_free(data.picture.data[0]);
+	av_free(data.mask);
+	av_free(data.src);
+}
+
+/* queue.c */
+
+#define QUEUE_SIZE 50
+#define QUEUE_MAX_PRODUCERS 4
+
+struct QueueBench {
+	Queue *queue;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int stop;
+	int producers_running;
+	int64_t popped;
+};
+
+static void *queue_bench_fill(void *obj) {
+	return malloc(sizeof(int64_t));
+}
+
+static void queue_bench_free(void *obj, void *elem) {
+	free(elem);
+}
+
+static void *queue_bench_producer(void *data) {
+	struct QueueBench *bench = data;
+	int64_t value = 0;
+	int to_write;
+	pthread_mutex_lock(&bench->mutex);
+	while (!bench->stop) {
+		int64_t *elem = queue_push_start_already_locked(bench->queue,
+				&bench->mutex, &bench->cond, &to_write, NULL, NULL, NULL);
+		*elem = value++;
+		queue_push_finish_already_locked(bench->queue, &bench->mutex,
+				&bench->cond, to_write);
+	}
+	bench->producers_running--;
+	pthread_cond_broadcast(&bench->cond);
+	pthread_mutex_unlock(&bench->mutex);
+	return NULL;
+}
+
+static QueueCheckFuncRet queue_bench_check(Queue *queue,
+		struct QueueBench *bench, int *ret) {
+	if (bench->producers_running == 0
+			&& queue_get_count_already_locked(queue) == 0)
+		return QUEUE_CHECK_FUNC_RET_SKIP;
+	return QUEUE_CHECK_FUNC_RET_TEST;
+}
+
+/*
+ * Returns elements per second passed from producers to one consumer
+ */
+static double queue_bench_run(int producers) {
+	struct QueueBench bench;
+	pthread_t threads[QUEUE_MAX_PRODUCERS];
+	int64_t start, elapsed;
+	int i;
+
+	memset(&bench, 0, sizeof(bench));
+	pthread_mutex_init(&bench.mutex, NULL);
+	pthread_cond_init(&bench.cond, NULL);
+	bench.queue = queue_init_with_custom_lock(QUEUE_SIZE, queue_bench_fill,
+			queue_bench_free, NULL, NULL, &bench.mutex, &bench.cond);
+	if (bench.queue == NULL) {
+		fprintf(stderr, "could not allocate queue\n");
+		exit(1);
+	}
+
+	bench.producers_running = producers;
+	start = metrics_now_us();
+	for (i = 0; i < producers; ++i)
+		pthread_create(&threads[i], NULL, queue_bench_producer, &bench);
+
+	pthread_mutex_lock(&bench.mutex);
+	for (;;) {
+		int ret;
+		if (!bench.stop && metrics_now_us() - start >= MIN_TIME_US) {
+			bench.stop = TRUE;
+			pthread_cond_broadcast(&bench.cond);
+		}
+		if (queue_pop_start_already_locked(&bench.queue, &bench.mutex,
+				&bench.cond, (QueueCheckFunc) queue_bench_check, &bench,
+				&ret) == NULL)
+			break;
+		queue_pop_finish_already_locked(bench.queue, &bench.mutex,
+				&bench.cond);
+		bench.popped++;
+	}
+	pthread_mutex_unlock(&bench.mutex);
+	elapsed = metrics_now_us() - start;
+
+	for (i = 0; i < producers; ++i)
+		pthread_join(threads[i], NULL);
+	queue_free(bench.queue, &bench.mutex, &bench.cond, NULL);
+	pthread_cond_destroy(&bench.cond);
+	pthread_mutex_destroy(&bench.mutex);
+	return bench.popped * 1000000.0 / elapsed;
+}
+
+static void microbench_queue() {
+	char name[NAME_SIZE];
+	int producers;
+	for (producers = 1; producers <= QUEUE_MAX_PRODUCERS; producers *= 2) {
+		snprintf(name, sizeof(name), "queue/push_pop/%d_producers",
+				producers);
+		if (microbench_enabled(name))
+			microbench_report(name, "kelems_per_s",
+					queue_bench_run(producers) / 1e3);
+	}
+}
+
+/* aes-protocol.c */
+
+#ifdef MODULE_ENCRYPT
+
+#define AES_BENCH_SIZE (16 * 1024 * 1024)
+#define AES_BENCH_READ 65536
+#define AES_BENCH_KEY "bWljcm9iZW5jaG1pY3JvYmVuY2htaWNy"
+
+static int aes_bench_open(URLContext **h, const char *url, int flags,
+		const char *readahead) {
+	AVDictionary *options = NULL;
+	int ret;
+	av_dict_set(&options, "aeskey", AES_BENCH_KEY, 0);
+	if (readahead != NULL)
+		av_dict_set(&options, "aes_readahead", readahead, 0);
+	ret = ffurl_open(h, url, flags, NULL, &options);
+	av_dict_free(&options);
+	return ret;
+}
+
+static void microbench_aes() {
+	static const char *readaheads[] = { "0", "4" };
+	char path[] = "/tmp/microbench-aes-XXXXXX";
+	char url[64];
+	char name[NAME_SIZE];
+	uint8_t *data;
+	URLContext *h;
+	int fd, i, written;
+
+	if (!microbench_enabled("aes/"))
+		return;
+	av_register_all();
+	register_aes_protocol();
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return;
+	close(fd);
+	snprintf(url, sizeof(url), "aes:file:%s", path);
+
+	data = microbench_alloc(AES_BENCH_READ);
+	if (aes_bench_open(&h, url, AVIO_FLAG_WRITE, NULL) < 0) {
+		fprintf(stderr, "could not open %s for writing\n", url);
+		goto remove;
+	}
+	for (written = 0; written < AES_BENCH_SIZE; written += AES_BENCH_READ)
+		ffurl_write(h, data, AES_BENCH_READ);
+	ffurl_close(h);
+
+	for (i = 0; i < sizeof(readaheads) / sizeof(*readaheads); ++i) {
+		int64_t start, elapsed;
+		int64_t total = 0;
+		int ret;
+		snprintf(name, sizeof(name), "aes/read/readahead_%s", readaheads[i]);
+		if (!microbench_enabled(name))
+			continue;
+		if (aes_bench_open(&h, url, AVIO_FLAG_READ, readaheads[i]) < 0) {
+			fprintf(stderr, "could not open %s for reading\n", url);
+			continue;
+		}
+		start = metrics_now_us();
+		while ((ret = ffurl_read(h, data, AES_BENCH_READ)) > 0)
+			total += ret;
+		elapsed = metrics_now_us() - start;
+		ffurl_close(h);
+		microbench_report(name, "mb_per_s",
+				total / (1024.0 * 1024.0) * 1000000.0 / elapsed);
+	}
+
+	remove:
+	av_free(data);
+	unlink(path);
+}
+
+#endif // MODULE_ENCRYPT
+
+int main(int argc, char *argv[]) {
+	int i;
+	for (i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+			filter = argv[++i];
+		} else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+			if (microbench_load_baseline(argv[++i]) < 0) {
+				fprintf(stderr, "could not read baseline %s\n", argv[i]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+			threshold = atof(argv[++i]);
+		} else {
+			fprintf(stderr, "usage: %s [--filter prefix] [--baseline file]"
+					" [--threshold 0.1]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	printf("{ \"results\": [\n");
+	microbench_convert();
+	microbench_blend();
+	microbench_queue();
+#ifdef MODULE_ENCRYPT
+	microbench_aes();
+#endif
+	printf("\n], \"regressions\": %d }\n", regressions);
+	return regressions > 0 ? 2 : 0;
+}
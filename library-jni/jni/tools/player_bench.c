@@ -0,0 +1,312 @@
+/*
+ * player_bench.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Plays a file on the host through player.c as fast as possible
+ * ("free_run" option): video goes to a host window (null video sink) and
+ * audio to the host AudioTrack (null audio sink) from host/jni-host.c.
+ * Prints decoded fps, per stage times from player stats and peak RSS as
+ * JSON.
+ *
+ * With -c the player writes a checksum log ("checksum_log" option) with
+ * frames rendered into the headless frame instead of the window, "video"
+ * lines could be diffed with gen_media sidecar.
+ * With -o other data source options are passed, they override defaults,
+ * e.g. -o free_run=0 plays in real time.
+ *
+ * usage: player_bench [-c checksum_log] [-o key=value]... file
+ *            [max_video_frames]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <jni.h>
+#include <android/native_window.h>
+
+#include "helpers.h"
+#include "metrics.h"
+#include "player.h"
+#include "jni-host.h"
+
+#define FALSE 0
+#define TRUE (!(FALSE))
+
+#define PLAYER_BENCH_MAX_OPTIONS 32
+// progress is checked this often while waiting for end of streams
+#define PLAYER_BENCH_POLL_US 100000ll
+// playback without any frame or audio written for this long is an error
+#define PLAYER_BENCH_STALL_US 10000000ll
+
+static const char *player_bench_stage_names[METRICS_STAGES_NB] = {
+	"demux", "decode", "convert", "blend", "window_lock", "window_post",
+	"audio_write", "wait", "queue_lock",
+};
+
+struct PlayerBenchOption {
+	const char *key;
+	const char *value;
+};
+
+/*
+ * Reads player stats into metrics, returns number of captured streams or
+ * -1 if stats could not be read
+ */
+static int player_bench_get_stats(JNIEnv *env, jobject thiz,
+		struct Metrics *metrics) {
+	jlongArray array = jni_player_get_stats(env, thiz);
+	jlong *stats;
+	int stage, i, streams = -1;
+	jlong *in;
+
+	if (array == NULL)
+		return -1;
+	if ((*env)->GetArrayLength(env, array) <= METRICS_SNAPSHOT_SIZE)
+		goto free_array;
+	stats = (*env)->GetLongArrayElements(env, array, NULL);
+	if (stats == NULL)
+		goto free_array;
+	in = stats + 4;
+	for (stage = 0; stage < METRICS_STAGES_NB; ++stage) {
+		struct MetricsHistogram *histogram = &metrics->stages[stage];
+		histogram->count = *in++;
+		histogram->sum_us = *in++;
+		histogram->max_us = *in++;
+		for (i = 0; i < METRICS_BUCKETS; ++i)
+			histogram->buckets[i] = *in++;
+	}
+	for (i = 0; i < METRICS_COUNTERS_NB; ++i)
+		metrics->counters[i] = *in++;
+	streams = *in;
+	(*env)->ReleaseLongArrayElements(env, array, stats, JNI_ABORT);
+
+	free_array:
+	(*env)->DeleteLocalRef(env, array);
+	return streams;
+}
+
+/*
+ * Returns local reference to HashMap with data source options
+ */
+static jobject player_bench_new_dictionary(JNIEnv *env,
+		const struct PlayerBenchOption *options, int options_nb) {
+	jclass hash_map_class = (*env)->FindClass(env, hash_map_class_path_name);
+	jclass map_class = (*env)->FindClass(env, map_class_path_name);
+	jmethodID put_method = java_get_method(env, map_class, map_put);
+	jobject dictionary = (*env)->NewObject(env, hash_map_class,
+			java_get_method(env, hash_map_class, empty_constructor));
+	int i;
+
+	for (i = 0; i < options_nb; ++i) {
+		jstring key = (*env)->NewStringUTF(env, options[i].key);
+		jstring value = (*env)->NewStringUTF(env, options[i].value);
+		jobject previous = (*env)->CallObjectMethod(env, dictionary,
+				put_method, key, value);
+		if (previous != NULL)
+			(*env)->DeleteLocalRef(env, previous);
+		(*env)->DeleteLocalRef(env, key);
+		(*env)->DeleteLocalRef(env, value);
+	}
+	(*env)->DeleteLocalRef(env, hash_map_class);
+	(*env)->DeleteLocalRef(env, map_class);
+	return dictionary;
+}
+
+/*
+ * Upper bound of bucket containing given fraction of measurements
+ */
+static int64_t player_bench_percentile(struct MetricsHistogram *histogram,
+		double fraction) {
+	int64_t threshold = histogram->count * fraction;
+	int64_t sum = 0;
+	int i;
+	for (i = 0; i < METRICS_BUCKETS - 1; ++i) {
+		sum += histogram->buckets[i];
+		if (sum > threshold)
+			return 1ll << (i + 6);
+	}
+	return histogram->max_us;
+}
+
+static void player_bench_print(struct Metrics *metrics,
+		struct JniHostPlayerState *state, int64_t posted_frames,
+		const char *file, double wall_s) {
+	int64_t video_frames = metrics->stages[METRICS_STAGE_CONVERT].count;
+	struct rusage usage;
+	int stage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	printf("{\n  \"file\": \"%s\",\n", file);
+	printf("  \"video_frames\": %lld,\n", (long long) video_frames);
+	printf("  \"posted_frames\": %lld,\n", (long long) posted_frames);
+	printf("  \"audio_frames\": %lld,\n",
+			(long long) metrics->stages[METRICS_STAGE_AUDIO_WRITE].count);
+	printf("  \"audio_bytes\": %lld,\n", (long long) state->audio_bytes);
+	printf("  \"dropped_frames\": %lld,\n", (long long)
+			metrics->counters[METRICS_COUNTER_DROPPED_FRAMES]);
+	printf("  \"late_frames\": %lld,\n",
+			(long long) metrics->counters[METRICS_COUNTER_LATE_FRAMES]);
+	printf("  \"wall_s\": %.3f,\n", wall_s);
+	printf("  \"decoded_fps\": %.1f,\n",
+			wall_s > 0 ? video_frames / wall_s : 0.0);
+	printf("  \"bytes_read\": %lld,\n",
+			(long long) metrics->counters[METRICS_COUNTER_BYTES_READ]);
+	printf("  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+	printf("  \"stages\": {\n");
+	for (stage = 0; stage < METRICS_STAGES_NB; ++stage) {
+		struct MetricsHistogram *histogram = &metrics->stages[stage];
+		printf("    \"%s\": { \"count\": %lld, \"total_ms\": %.1f, "
+				"\"avg_us\": %lld, \"p50_us\": %lld, \"p99_us\": %lld, "
+				"\"max_us\": %lld }%s\n", player_bench_stage_names[stage],
+				(long long) histogram->count, histogram->sum_us / 1000.0,
+				(long long) (histogram->count ?
+						histogram->sum_us / histogram->count : 0),
+				(long long) player_bench_percentile(histogram, 0.5),
+				(long long) player_bench_percentile(histogram, 0.99),
+				(long long) histogram->max_us,
+				stage == METRICS_STAGES_NB - 1 ? "" : ",");
+	}
+	printf("  }\n}\n");
+}
+
+static void player_bench_usage(const char *name) {
+	fprintf(stderr, "usage: %s [-c checksum_log] [-o key=value]... file "
+			"[max_video_frames]\n", name);
+}
+
+int main(int argc, char *argv[]) {
+	struct PlayerBenchOption options[PLAYER_BENCH_MAX_OPTIONS];
+	struct Metrics metrics;
+	struct JniHostPlayerState state;
+	JNIEnv *env;
+	jobject thiz;
+	jobject dictionary;
+	jobject surface;
+	jstring url;
+	ANativeWindow *window;
+	int64_t max_frames = -1;
+	int64_t start, stop, progress_time, progress = -1;
+	int options_nb = 0;
+	int streams;
+	const char *file;
+	int arg = 1;
+	int ret = 0;
+
+	// defaults first, later options with the same key replace them
+	options[options_nb++] = (struct PlayerBenchOption) { "free_run", "1" };
+	for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+		if (options_nb + 2 > PLAYER_BENCH_MAX_OPTIONS) {
+			fprintf(stderr, "too many options\n");
+			return 1;
+		}
+		if (strcmp(argv[arg], "-c") == 0) {
+			options[options_nb++] = (struct PlayerBenchOption) {
+				"checksum_log", argv[arg + 1] };
+			options[options_nb++] = (struct PlayerBenchOption) {
+				"checksum_present", "0" };
+		} else if (strcmp(argv[arg], "-o") == 0) {
+			char *value = strchr(argv[arg + 1], '=');
+			if (value == NULL) {
+				player_bench_usage(argv[0]);
+				return 1;
+			}
+			*value++ = '\0';
+			options[options_nb++] = (struct PlayerBenchOption) {
+				argv[arg + 1], value };
+		} else {
+			player_bench_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (argc <= arg) {
+		player_bench_usage(argv[0]);
+		return 1;
+	}
+	file = argv[arg];
+	if (argc > arg + 1)
+		max_frames = atoll(argv[arg + 1]);
+
+	env = jni_host_attach();
+	thiz = jni_host_new_player(env);
+	if (jni_player_init(env, thiz) < 0) {
+		fprintf(stderr, "could not initialize player\n");
+		(*env)->DeleteLocalRef(env, thiz);
+		return 1;
+	}
+
+	// window gets its size from setBuffersGeometry
+	window = host_window_new(0, 0);
+	surface = jni_host_new_surface(env, window);
+	jni_player_render(env, thiz, surface);
+
+	// dictionary reference is released by jni_player_set_data_source
+	dictionary = player_bench_new_dictionary(env, options, options_nb);
+	url = (*env)->NewStringUTF(env, file);
+	if (jni_player_set_data_source(env, thiz, url, dictionary,
+			UNKNOWN_STREAM, UNKNOWN_STREAM, UNKNOWN_STREAM) < 0) {
+		fprintf(stderr, "could not open %s\n", file);
+		ret = 1;
+		goto release;
+	}
+
+	memset(&metrics, 0, sizeof(metrics));
+	streams = player_bench_get_stats(env, thiz, &metrics);
+	start = progress_time = metrics_now_us();
+	jni_player_resume(env, thiz);
+	for (;;) {
+		int finished = jni_host_player_wait_finished(thiz, streams,
+				PLAYER_BENCH_POLL_US);
+		int64_t now = metrics_now_us();
+		int64_t current;
+
+		player_bench_get_stats(env, thiz, &metrics);
+		if (finished >= streams)
+			break;
+		if (max_frames >= 0 && metrics.stages[METRICS_STAGE_CONVERT].count
+				>= max_frames)
+			break;
+		current = metrics.stages[METRICS_STAGE_CONVERT].count
+				+ metrics.stages[METRICS_STAGE_AUDIO_WRITE].count;
+		if (current != progress) {
+			progress = current;
+			progress_time = now;
+		} else if (now - progress_time > PLAYER_BENCH_STALL_US) {
+			fprintf(stderr, "playback stalled\n");
+			ret = 1;
+			break;
+		}
+	}
+	stop = metrics_now_us();
+	player_bench_get_stats(env, thiz, &metrics);
+	jni_host_player_get_state(thiz, &state);
+
+	jni_player_stop(env, thiz);
+	player_bench_print(&metrics, &state, host_window_get_posted(window), file,
+			(stop - start) / 1000000.0);
+
+	release:
+	jni_player_render_frame_stop(env, thiz);
+	jni_player_dealloc(env, thiz);
+	(*env)->DeleteLocalRef(env, url);
+	(*env)->DeleteLocalRef(env, surface);
+	(*env)->DeleteLocalRef(env, thiz);
+	ANativeWindow_release(window);
+	return ret;
+}
@@ -0,0 +1,241 @@
+/*
+ * trace.c
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "metrics.h"
+#include "trace.h"
+#include "log.h"
+
+#include <android/log.h>
+#define LOG_SUBSYSTEM LOG_SUBSYSTEM_TRACE
+#define LOG_TAG "trace.c"
+#define LOGI(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);}
+#define LOGE(level, ...) if (LOG_ENABLED(LOG_SUBSYSTEM, level)) {log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);}
+
+// power of two, about 1.5MB allocated on first trace_start
+#define TRACE_EVENTS (1 << 15)
+#define TRACE_MAX_THREADS 64
+
+struct TraceEvent {
+	// index + 1 of event stored in slot, 0 while slot is written
+	volatile uint32_t seq;
+	char phase;
+	int tid;
+	int stream_no;
+	int64_t ts_us;
+	int64_t pts;
+	const char *name;
+};
+
+struct TraceThread {
+	int tid;
+	const char *name;
+	int stream_no;
+};
+
+volatile int trace_enabled = 0;
+
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct TraceEvent *trace_events = NULL;
+static volatile uint32_t trace_next = 0;
+// trace_event calls between their trace_enabled check and the written slot,
+// counted per generation so trace_start waits only for writers that
+// started before it and busy threads could not keep it waiting
+static volatile uint32_t trace_generation = 0;
+static volatile int trace_writers[2] = { 0, 0 };
+
+// guarded by trace_mutex
+static struct TraceThread trace_threads[TRACE_MAX_THREADS];
+static int trace_threads_next = 0;
+
+static int trace_get_tid() {
+	return (int) syscall(__NR_gettid);
+}
+
+void trace_event(enum TracePhase phase, const char *name, int stream_no,
+		int64_t pts) {
+	uint32_t generation = trace_generation;
+	volatile int *writers = &trace_writers[generation & 1];
+	uint32_t index;
+	struct TraceEvent *event;
+
+	// checked again after joining writers, trace_start could be clearing
+	// the ring since the check in TRACE_* macros
+	__sync_fetch_and_add(writers, 1);
+	if (!trace_enabled || trace_generation != generation) {
+		__sync_fetch_and_sub(writers, 1);
+		return;
+	}
+	index = __sync_fetch_and_add(&trace_next, 1);
+	event = &trace_events[index & (TRACE_EVENTS - 1)];
+
+	event->seq = 0;
+	__sync_synchronize();
+	event->phase = phase;
+	event->tid = trace_get_tid();
+	event->stream_no = stream_no;
+	event->ts_us = metrics_now_us();
+	event->pts = pts;
+	event->name = name;
+	__sync_synchronize();
+	event->seq = index + 1;
+	__sync_fetch_and_sub(writers, 1);
+}
+
+void trace_set_thread_name(const char *name, int stream_no) {
+	int tid = trace_get_tid();
+	int i;
+	pthread_mutex_lock(&trace_mutex);
+	for (i = 0; i < TRACE_MAX_THREADS; ++i) {
+		if (trace_threads[i].tid == tid)
+			break;
+	}
+	if (i == TRACE_MAX_THREADS) {
+		// oldest entry is forgotten
+		i = trace_threads_next;
+		trace_threads_next = (trace_threads_next + 1) % TRACE_MAX_THREADS;
+	}
+	trace_threads[i].tid = tid;
+	trace_threads[i].name = name;
+	trace_threads[i].stream_no = stream_no;
+	pthread_mutex_unlock(&trace_mutex);
+}
+
+int trace_start() {
+	uint32_t generation;
+	int err = 0;
+
+	pthread_mutex_lock(&trace_mutex);
+	trace_enabled = 0;
+	generation = __sync_fetch_and_add(&trace_generation, 1);
+	// writers that saw tracing enabled finish before the ring is cleared,
+	// later ones see it disabled or count in the new generation
+	while (trace_writers[generation & 1] > 0)
+		sched_yield();
+	if (trace_events == NULL) {
+		// never freed, threads could still be writing after trace_stop
+		trace_events = malloc(sizeof(*trace_events) * TRACE_EVENTS);
+		if (trace_events == NULL) {
+			err = -1;
+			goto end;
+		}
+	}
+	memset(trace_events, 0, sizeof(*trace_events) * TRACE_EVENTS);
+	trace_next = 0;
+	__sync_synchronize();
+	trace_enabled = 1;
+	LOGI(2, "trace_start: recording up to %d events", TRACE_EVENTS);
+
+	end:
+	pthread_mutex_unlock(&trace_mutex);
+	return err;
+}
+
+void trace_stop() {
+	trace_enabled = 0;
+	__sync_synchronize();
+}
+
+static void trace_write_args(FILE *file, int stream_no, int64_t pts) {
+	if (stream_no == TRACE_NO_STREAM && pts == TRACE_NO_PTS)
+		return;
+	fprintf(file, ",\"args\":{");
+	if (stream_no != TRACE_NO_STREAM)
+		fprintf(file, "\"stream\":%d%s", stream_no,
+				pts != TRACE_NO_PTS ? "," : "");
+	if (pts != TRACE_NO_PTS)
+		fprintf(file, "\"pts\":%lld", (long long) pts);
+	fprintf(file, "}");
+}
+
+int trace_dump(const char *path) {
+	FILE *file;
+	struct TraceEvent event;
+	uint32_t next, index;
+	int pid = getpid();
+	int written = 0;
+	int i;
+
+	pthread_mutex_lock(&trace_mutex);
+	if (trace_events == NULL) {
+		written = -1;
+		goto end;
+	}
+	file = fopen(path, "w");
+	if (file == NULL) {
+		LOGE(1, "trace_dump: could not open %s", path);
+		written = -1;
+		goto end;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+			"\"args\":{\"name\":\"ffmpeg-player\"}}", pid);
+	for (i = 0; i < TRACE_MAX_THREADS; ++i) {
+		struct TraceThread *thread = &trace_threads[i];
+		if (thread->name == NULL)
+			continue;
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+				"\"tid\":%d,\"args\":{\"name\":\"%s", pid, thread->tid,
+				thread->name);
+		if (thread->stream_no != TRACE_NO_STREAM)
+			fprintf(file, "[%d]", thread->stream_no);
+		fprintf(file, "\"}}");
+	}
+
+	// recording could continue while dumping, overwritten events are skipped
+	next = trace_next;
+	index = next > TRACE_EVENTS ? next - TRACE_EVENTS : 0;
+	for (; index != next; ++index) {
+		struct TraceEvent *slot = &trace_events[index & (TRACE_EVENTS - 1)];
+		if (slot->seq != index + 1)
+			continue;
+		event = *slot;
+		__sync_synchronize();
+		if (slot->seq != index + 1)
+			continue;
+
+		fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld,"
+				"\"pid\":%d,\"tid\":%d", event.name, event.phase,
+				(long long) event.ts_us, pid, event.tid);
+		if (event.phase == TRACE_PHASE_INSTANT)
+			fprintf(file, ",\"s\":\"t\"");
+		trace_write_args(file, event.stream_no, event.pts);
+		fprintf(file, "}");
+		written++;
+	}
+	fprintf(file, "\n]}\n");
+
+	if (fclose(file)) {
+		LOGE(1, "trace_dump: could not write %s", path);
+		written = -1;
+		goto end;
+	}
+	LOGI(2, "trace_dump: %d events written to %s", written, path);
+
+	end:
+	pthread_mutex_unlock(&trace_mutex);
+	return written;
+}
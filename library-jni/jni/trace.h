@@ -0,0 +1,71 @@
+/*
+ * trace.h
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+enum TracePhase {
+	TRACE_PHASE_BEGIN = 'B',
+	TRACE_PHASE_END = 'E',
+	TRACE_PHASE_INSTANT = 'i',
+};
+
+#define TRACE_NO_STREAM -1
+#define TRACE_NO_PTS INT64_MIN
+
+// checked before every event so disabled tracing costs one load
+extern volatile int trace_enabled;
+
+#define TRACE_BEGIN(name, stream_no, pts) \
+	if (trace_enabled) {trace_event(TRACE_PHASE_BEGIN, name, stream_no, pts);}
+#define TRACE_END(name, stream_no, pts) \
+	if (trace_enabled) {trace_event(TRACE_PHASE_END, name, stream_no, pts);}
+#define TRACE_INSTANT(name, stream_no, pts) \
+	if (trace_enabled) {trace_event(TRACE_PHASE_INSTANT, name, stream_no, pts);}
+
+/*
+ * Records event in process wide ring buffer, older events are overwritten.
+ * name has to be a static string, it is not copied.
+ */
+void trace_event(enum TracePhase phase, const char *name, int stream_no,
+		int64_t pts);
+
+/*
+ * Names calling thread in dumped traces, could be called before tracing is
+ * started. name has to be a static string.
+ */
+void trace_set_thread_name(const char *name, int stream_no);
+
+/*
+ * Clears recorded events and starts recording, returns negative value if
+ * buffer could not be allocated. Events being written when it is called
+ * are finished before clearing, they never show up in the new trace.
+ */
+int trace_start();
+void trace_stop();
+
+/*
+ * Writes recorded events as Chrome Trace Event JSON (loadable by
+ * chrome://tracing and Perfetto), returns number of written events or
+ * negative value on error
+ */
+int trace_dump(const char *path);
+
+#endif /* TRACE_H_ */
@@ -18,6 +18,7 @@
 
 package com.appunite.ffmpeg;
 
+import java.nio.ByteBuffer;
 import java.util.Map;
 
 import android.app.Activity;
@@ -126,6 +127,33 @@ public class FFmpegPlayer {
 
 	}
 
+	private static class TrickPlayTask extends
+			AsyncTask<Integer, Void, NotPlayingException> {
+
+		private final FFmpegPlayer player;
+
+		public TrickPlayTask(FFmpegPlayer player) {
+			this.player = player;
+		}
+
+		@Override
+		protected NotPlayingException doInBackground(Integer... params) {
+			try {
+				player.setTrickPlayNative(params[0].intValue());
+			} catch (NotPlayingException e) {
+				return e;
+			}
+			return null;
+		}
+
+		@Override
+		protected void onPostExecute(NotPlayingException result) {
+			if (player.mpegListener != null)
+				player.mpegListener.onFFSeeked(result);
+		}
+
+	}
+
 	private static class PauseTask extends
 			AsyncTask<Void, Void, NotPlayingException> {
 
@@ -196,7 +224,7 @@ public class FFmpegPlayer {
 	private FFmpegListener mpegListener = null;
 	private final RenderedFrame mRenderedFrame = new RenderedFrame();
 
-	private int mNativePlayer;
+	private long mNativePlayer;
 	private final Activity activity;
 
 	private Runnable updateTimeRunnable = new Runnable() {
@@ -253,10 +281,198 @@ public class FFmpegPlayer {
 
 	private native void seekNative(long positionUs) throws NotPlayingException;
 
+	private native void setTrickPlayNative(int rate)
+			throws NotPlayingException;
+
 	private native long getVideoDurationNative();
 	
 	public native void render(Surface surface);
 
+	private native long[] getStatsNative();
+
+	/**
+	 * Statistics of current playback, cheap enough to be polled while
+	 * playing
+	 * 
+	 * @return snapshot of player statistics or null if it could not be
+	 *         allocated
+	 */
+	public FFmpegStats getStats() {
+		long[] snapshot = getStatsNative();
+		if (snapshot == null)
+			return null;
+		return new FFmpegStats(snapshot);
+	}
+
+	/** Priorities of players sharing cpu */
+	public static final int PRIORITY_HIGH = 0;
+	public static final int PRIORITY_NORMAL = 1;
+	public static final int PRIORITY_LOW = 2;
+
+	private native void setPriorityNative(int priority);
+
+	/**
+	 * Players with higher priority (i.e. the focused tile of a video wall)
+	 * are decoded first when shared workers are busy ("executor" =
+	 * "shared"). When a player is late decode governor lowers quality of
+	 * players with lower priority (see {@link FFmpegStats#getGovernorLevel()}),
+	 * players with PRIORITY_HIGH are never degraded. Could be changed while
+	 * playing.
+	 * 
+	 * @param priority
+	 *            one of PRIORITY_* constants
+	 */
+	public void setPriority(int priority) {
+		setPriorityNative(priority);
+	}
+
+	private static native long[] extractFramesNative(String url,
+			long[] timestampsUs, int width, int height, ByteBuffer buffer);
+
+	/**
+	 * Grabs frames without starting playback (no audio track, threads nor
+	 * surface). For every timestamp key frame at or before it is decoded,
+	 * scaled to width x height and written as RGBA (like
+	 * {@link Bitmap#copyPixelsFromBuffer(java.nio.Buffer)} expects for
+	 * ARGB_8888) to buffer, frame i at i * width * height * 4. Frames are
+	 * extracted in parallel on all cores. Blocks, should not be called on
+	 * the main thread.
+	 * 
+	 * @param url
+	 *            url of the video
+	 * @param timestampsUs
+	 *            times of frames in microseconds
+	 * @param buffer
+	 *            direct buffer for all frames
+	 * @return times of extracted frames in microseconds, -1 for frames that
+	 *         could not be extracted, or null when video could not be opened
+	 */
+	public static long[] extractFrames(String url, long[] timestampsUs,
+			int width, int height, ByteBuffer buffer) {
+		if (!buffer.isDirect())
+			throw new IllegalArgumentException("Buffer has to be direct");
+		if (buffer.capacity() < (long) timestampsUs.length * width * height * 4)
+			throw new IllegalArgumentException("Buffer is too small");
+		return extractFramesNative(url, timestampsUs, width, height, buffer);
+	}
+
+	/**
+	 * {@link #extractFrames(String, long[], int, int, ByteBuffer)} returning
+	 * bitmaps, i.e. for a filmstrip in {@link SeekerView}
+	 * 
+	 * @return bitmaps, null for frames that could not be extracted, or null
+	 *         when video could not be opened
+	 */
+	public static Bitmap[] extractThumbnails(String url, long[] timestampsUs,
+			int width, int height) {
+		int frameSize = width * height * 4;
+		ByteBuffer buffer = ByteBuffer.allocateDirect(timestampsUs.length
+				* frameSize);
+		long[] times = extractFrames(url, timestampsUs, width, height, buffer);
+		if (times == null)
+			return null;
+		Bitmap[] bitmaps = new Bitmap[times.length];
+		for (int i = 0; i < times.length; ++i) {
+			if (times[i] < 0)
+				continue;
+			buffer.position(i * frameSize);
+			bitmaps[i] = Bitmap.createBitmap(width, height,
+					Bitmap.Config.ARGB_8888);
+			bitmaps[i].copyPixelsFromBuffer(buffer);
+		}
+		return bitmaps;
+	}
+
+	private static native long benchmarkJniReadNative(String url,
+			int readSize, int reads);
+
+	/**
+	 * Measures overhead of reading through jni protocol ({@link JniReader})
+	 * 
+	 * @param url
+	 *            url passed to JniReader, i.e. "jni:test"
+	 * @param readSize
+	 *            size of a single read in bytes
+	 * @param reads
+	 *            number of reads to measure
+	 * @return average time of a single read in nanoseconds or -1 on error
+	 */
+	public static long benchmarkJniRead(String url, int readSize, int reads) {
+		return benchmarkJniReadNative(url, readSize, reads);
+	}
+
+	private static native int startTraceNative();
+
+	private static native void stopTraceNative();
+
+	private static native int dumpTraceNative(String path);
+
+	/**
+	 * Starts recording of playback pipeline events (demuxing, decoding,
+	 * waiting, rendering) of all players. Previously recorded events are
+	 * cleared, only the newest events are kept.
+	 * 
+	 * @return true if recording started
+	 */
+	public static boolean startTrace() {
+		return startTraceNative() >= 0;
+	}
+
+	public static void stopTrace() {
+		stopTraceNative();
+	}
+
+	/**
+	 * Writes recorded events as Chrome Trace Event JSON which could be opened
+	 * in chrome://tracing or ui.perfetto.dev
+	 * 
+	 * @param path
+	 *            output file path
+	 * @return number of written events or -1 on error
+	 */
+	public static int dumpTrace(String path) {
+		return dumpTraceNative(path);
+	}
+
+	/** All subsystems except {@link #LOG_FFMPEG} */
+	public static final int LOG_ALL = -1;
+	public static final int LOG_PLAYER = 0;
+	/** Level in ffmpeg units, e.g. 24 - warnings, 32 - info, 48 - debug */
+	public static final int LOG_FFMPEG = 1;
+	public static final int LOG_AES = 2;
+	public static final int LOG_JNI = 3;
+	public static final int LOG_RENDER = 4;
+	public static final int LOG_TRACE = 5;
+
+	private static native void setLogLevelNative(int subsystem, int level);
+
+	private static native int setLogAsyncNative(boolean async);
+
+	/**
+	 * Changes verbosity of native logs at runtime, 1 - errors and important
+	 * events only, 10 - everything (per frame and per packet messages).
+	 * Messages above level compiled in (LOG_MAX_LEVEL) are never printed.
+	 * 
+	 * @param subsystem
+	 *            one of LOG_* constants
+	 * @param level
+	 *            verbosity level
+	 */
+	public static void setLogLevel(int subsystem, int level) {
+		setLogLevelNative(subsystem, level);
+	}
+
+	/**
+	 * When enabled native threads only queue messages and a background
+	 * thread writes them to logcat, so verbose logs do not stall decoding.
+	 * Messages are dropped when the queue is full.
+	 * 
+	 * @return true on success
+	 */
+	public static boolean setLogAsync(boolean async) {
+		return setLogAsyncNative(async) >= 0;
+	}
+
 	/**
 	 * 
 	 * @param streamsInfos
@@ -295,6 +511,36 @@ public class FFmpegPlayer {
 		new ResumeTask(this).execute();
 	}
 
+	/** Largest rate accepted by {@link #setTrickPlay(int)} */
+	public static final int TRICK_PLAY_MAX_RATE = 64;
+
+	/** Rate of smooth reverse playback for {@link #setTrickPlay(int)} */
+	public static final int TRICK_PLAY_REVERSE = -1;
+
+	/**
+	 * Fast forward (rate 2, 4, 8, 16...) or rewind (rate -2, -4, -8, -16...)
+	 * showing only key frames, audio is muted. Only key frames are read so
+	 * it is cheap even for long recordings. {@link #TRICK_PLAY_REVERSE}
+	 * plays backward at normal speed showing every frame: whole GOPs are
+	 * decoded into memory bounded by "reverse_cache_mb" data source option
+	 * and presented from their end, previous GOP is decoded meanwhile.
+	 * Rate 0 or 1 returns to normal playback from the current position.
+	 * Like {@link #seek(long)} it is
+	 * finished with {@link FFmpegListener#onFFSeeked(NotPlayingException)}.
+	 * Rewind ends at the first key frame with isFinished in
+	 * {@link FFmpegListener#onFFUpdateTime(long, long, boolean)}.
+	 * 
+	 * @param rate
+	 *            playback rate, negative for rewind
+	 */
+	public void setTrickPlay(int rate) {
+		if (rate < -TRICK_PLAY_MAX_RATE
+				|| rate > TRICK_PLAY_MAX_RATE)
+			throw new IllegalArgumentException("Unsupported trick play rate: "
+					+ rate);
+		new TrickPlayTask(this).execute(Integer.valueOf(rate));
+	}
+
 	private Bitmap prepareFrame(int width, int height) {
 		// Bitmap bitmap =
 		// Bitmap.createBitmap(width, height, Bitmap.Config.ARGB_8888);
@@ -366,6 +612,22 @@ public class FFmpegPlayer {
 		setDataSource(url, null, UNKNOWN_STREAM, UNKNOWN_STREAM, NO_STREAM);
 	}
 
+	/**
+	 * Besides ffmpeg options dictionary could contain "checksum_log" - path
+	 * of a file where per frame hashes of decoded, converted and subtitle
+	 * blended video are written, and "checksum_present" - "0" to render
+	 * frames into memory instead of the surface while checksumming.
+	 * "executor" - "shared" runs demuxing and video decoding on workers
+	 * shared by all players (one per core) instead of own threads, useful
+	 * for many players on one screen, and "executor_priority" - initial
+	 * priority, see {@link #setPriority(int)}. "governor" - "0" disables
+	 * quality degradation of this player. "reverse_cache_mb" - memory for
+	 * decoded frames in reverse playback (default 64) and
+	 * "reverse_cache_scale" - "1" or "2" keeps those frames downscaled 2 or
+	 * 4 times, see {@link #setTrickPlay(int)}. "free_run" - "1" presents
+	 * frames and audio as soon as they are decoded instead of at their
+	 * time, for benchmarks.
+	 */
 	public void setDataSource(String url, Map<String, String> dictionary,
 			int videoStream, int audioStream, int subtitlesStream) {
 		new SetDataSourceTask(this).execute(url, dictionary,
@@ -0,0 +1,216 @@
+/*
+ * FFmpegStats.java
+ * Copyright (c) 2012 Jacek Marchwicki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+package com.appunite.ffmpeg;
+
+/**
+ * Snapshot of native player statistics returned by
+ * {@link FFmpegPlayer#getStats()}
+ */
+public class FFmpegStats {
+
+	// order of stages in native metrics.h
+	public static final int STAGE_DEMUX = 0;
+	public static final int STAGE_DECODE = 1;
+	public static final int STAGE_CONVERT = 2;
+	public static final int STAGE_BLEND = 3;
+	public static final int STAGE_WINDOW_LOCK = 4;
+	public static final int STAGE_WINDOW_POST = 5;
+	public static final int STAGE_AUDIO_WRITE = 6;
+	public static final int STAGE_WAIT = 7;
+	public static final int STAGE_QUEUE_LOCK = 8;
+
+	private static final int COUNTER_DROPPED_FRAMES = 0;
+	private static final int COUNTER_LATE_FRAMES = 1;
+	private static final int COUNTER_BYTES_READ = 2;
+	private static final int COUNTER_DECIMATED_FRAMES = 3;
+	private static final int COUNTER_GOVERNOR_CHANGES = 4;
+	private static final int COUNTER_GOVERNOR_LEVEL = 5;
+
+	private static final int SUPPORTED_VERSION = 1;
+
+	public static class Histogram {
+		private final long count;
+		private final long sumUs;
+		private final long maxUs;
+		private final long[] buckets;
+
+		Histogram(long count, long sumUs, long maxUs, long[] buckets) {
+			this.count = count;
+			this.sumUs = sumUs;
+			this.maxUs = maxUs;
+			this.buckets = buckets;
+		}
+
+		public long getCount() {
+			return count;
+		}
+
+		public long getSumUs() {
+			return sumUs;
+		}
+
+		public long getMaxUs() {
+			return maxUs;
+		}
+
+		public long getAverageUs() {
+			return count == 0 ? 0 : sumUs / count;
+		}
+
+		/**
+		 * Bucket 0 counts times below 64us, bucket i counts times in
+		 * [2^(i+5), 2^(i+6)) us, last bucket counts all longer times
+		 */
+		public long[] getBuckets() {
+			return buckets;
+		}
+
+		/**
+		 * Upper bound of time in microseconds below which given fraction of
+		 * measurements fall, estimated from buckets
+		 */
+		public long getPercentileUs(double fraction) {
+			long threshold = (long) Math.ceil(count * fraction);
+			long sum = 0;
+			for (int i = 0; i < buckets.length; ++i) {
+				sum += buckets[i];
+				if (sum >= threshold)
+					return i == buckets.length - 1 ? maxUs : 1l << (i + 6);
+			}
+			return maxUs;
+		}
+	}
+
+	private final Histogram[] stages;
+	private final long[] counters;
+	private final int[] queueDepths;
+	private final long aesCacheHits;
+	private final long aesCacheMisses;
+	private final long aesCacheEvictions;
+
+	FFmpegStats(long[] snapshot) {
+		int i = 0;
+		int version = (int) snapshot[i++];
+		if (version != SUPPORTED_VERSION)
+			throw new IllegalArgumentException(String.format(
+					"Unsupported stats version: %d", version));
+		int stagesNb = (int) snapshot[i++];
+		int bucketsNb = (int) snapshot[i++];
+		int countersNb = (int) snapshot[i++];
+
+		stages = new Histogram[stagesNb];
+		for (int stage = 0; stage < stagesNb; ++stage) {
+			long count = snapshot[i++];
+			long sumUs = snapshot[i++];
+			long maxUs = snapshot[i++];
+			long[] buckets = new long[bucketsNb];
+			System.arraycopy(snapshot, i, buckets, 0, bucketsNb);
+			i += bucketsNb;
+			stages[stage] = new Histogram(count, sumUs, maxUs, buckets);
+		}
+
+		counters = new long[countersNb];
+		System.arraycopy(snapshot, i, counters, 0, countersNb);
+		i += countersNb;
+
+		int streamsNb = (int) snapshot[i++];
+		queueDepths = new int[streamsNb];
+		for (int stream = 0; stream < streamsNb; ++stream)
+			queueDepths[stream] = (int) snapshot[i++];
+
+		aesCacheHits = snapshot[i++];
+		aesCacheMisses = snapshot[i++];
+		aesCacheEvictions = snapshot[i++];
+	}
+
+	/**
+	 * @param stage
+	 *            one of STAGE_* constants
+	 */
+	public Histogram getStage(int stage) {
+		return stages[stage];
+	}
+
+	public long getDroppedFrames() {
+		return counters[COUNTER_DROPPED_FRAMES];
+	}
+
+	public long getLateFrames() {
+		return counters[COUNTER_LATE_FRAMES];
+	}
+
+	public long getBytesRead() {
+		return counters[COUNTER_BYTES_READ];
+	}
+
+	/**
+	 * @return frames decoded but not shown because decode governor
+	 *         decimates frame rate of this player
+	 */
+	public long getDecimatedFrames() {
+		return counters[COUNTER_DECIMATED_FRAMES];
+	}
+
+	/**
+	 * @return how many times decode governor changed quality of this player
+	 */
+	public long getGovernorChanges() {
+		return counters[COUNTER_GOVERNOR_CHANGES];
+	}
+
+	/**
+	 * @return current degradation applied by decode governor: 0 - none,
+	 *         1 - no loop filter, 2 - non reference frames skipped and every
+	 *         second frame dropped, 3 - half resolution, 4 - key frames only
+	 */
+	public int getGovernorLevel() {
+		return (int) counters[COUNTER_GOVERNOR_LEVEL];
+	}
+
+	/**
+	 * @return number of packets waiting for decoding in every stream
+	 */
+	public int[] getQueueDepths() {
+		return queueDepths;
+	}
+
+	/**
+	 * @return aes windows already decrypted when they were read, counted
+	 *         for all aes streams of the process
+	 */
+	public long getAesCacheHits() {
+		return aesCacheHits;
+	}
+
+	/**
+	 * @return aes windows that reading had to wait for, counted for all aes
+	 *         streams of the process
+	 */
+	public long getAesCacheMisses() {
+		return aesCacheMisses;
+	}
+
+	/**
+	 * @return decrypted aes windows dropped from cache to read new ones,
+	 *         counted for all aes streams of the process
+	 */
+	public long getAesCacheEvictions() {
+		return aesCacheEvictions;
+	}
+}
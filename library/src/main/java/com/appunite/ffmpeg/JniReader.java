@@ -19,6 +19,7 @@
 package com.appunite.ffmpeg;
 
 import java.io.UnsupportedEncodingException;
+import java.nio.ByteBuffer;
 import java.security.MessageDigest;
 import java.security.NoSuchAlgorithmException;
 
@@ -28,6 +29,13 @@ public class JniReader {
 	
 	private static final String TAG = JniReader.class.getCanonicalName();
 	
+	// values of whence passed to seek
+	public static final int SEEK_SET = 0;
+	public static final int SEEK_CUR = 1;
+	public static final int SEEK_END = 2;
+	// return size of stream instead of seeking
+	public static final int AVSEEK_SIZE = 0x10000;
+
 	private byte[] value = new byte[16];
 	private int position;
 
@@ -59,6 +67,34 @@ public class JniReader {
 		
 		return length;
 	}
+
+	/**
+	 * Read data directly to native memory
+	 * 
+	 * Buffer is reused between calls so position and limit of buffer are not
+	 * meaningful - data have to be put at absolute positions starting from
+	 * offset.
+	 * 
+	 * @param buffer
+	 *            direct buffer wrapping native memory
+	 * @param offset
+	 *            index in buffer where data should be stored
+	 * @param size
+	 *            maximal number of bytes to read
+	 * @return number of bytes read, could be less than size, or -1 at end of
+	 *         stream
+	 */
+	public int read(ByteBuffer buffer, int offset, int size) {
+		int length = Math.min(size, value.length - position);
+		if (length <= 0)
+			return -1;
+		buffer.clear();
+		buffer.position(offset);
+		buffer.put(value, position, length);
+		position += length;
+
+		return length;
+	}
 	
 	public int write(byte[] buffer) {
 		return 0;
@@ -69,6 +105,25 @@ public class JniReader {
 	}
 	
 	public long seek(long pos, int whence) {
-		return -1;
+		long newPosition;
+		switch (whence) {
+		case SEEK_SET:
+			newPosition = pos;
+			break;
+		case SEEK_CUR:
+			newPosition = position + pos;
+			break;
+		case SEEK_END:
+			newPosition = value.length + pos;
+			break;
+		case AVSEEK_SIZE:
+			return value.length;
+		default:
+			return -1;
+		}
+		if (newPosition < 0 || newPosition > value.length)
+			return -1;
+		position = (int) newPosition;
+		return position;
 	}
 }
@@ -20,6 +20,7 @@ package com.appunite.ffmpeg;
 
 import android.content.Context;
 import android.content.res.TypedArray;
+import android.graphics.Bitmap;
 import android.graphics.Canvas;
 import android.graphics.Color;
 import android.graphics.Paint;
@@ -48,6 +49,8 @@ public class SeekerView extends View {
 	
 	private Rect mBorderRect = new Rect();
 	private Rect mBarRect = new Rect();
+	private Rect mThumbnailRect = new Rect();
+	private Bitmap[] mThumbnails = null;
 	private OnProgressChangeListener mOnProgressChangeListener = null;
 	
 	private int mMaxValue = 100;
@@ -119,10 +122,36 @@ public class SeekerView extends View {
 		return this.mCurrentValue;
 	}
 
+	/**
+	 * Thumbnails drawn evenly under the bar, i.e. from
+	 * {@link FFmpegPlayer#extractThumbnails(String, long[], int, int)}
+	 * 
+	 * @param thumbnails
+	 *            thumbnails, null entries are skipped
+	 */
+	public void setThumbnails(Bitmap[] thumbnails) {
+		this.mThumbnails = thumbnails;
+		this.invalidate();
+	}
+
 	@Override
 	protected void onDraw(Canvas canvas) {
 		super.onDraw(canvas);
 		canvas.drawRect(mBorderRect, mBorderPaint);
+		if (mThumbnails != null && mThumbnails.length > 0) {
+			int padding = mBorderWidth + mBorderPadding;
+			int width = getWidth() - 2 * padding;
+			for (int i = 0; i < mThumbnails.length; ++i) {
+				if (mThumbnails[i] == null)
+					continue;
+				mThumbnailRect.set(
+						padding + width * i / mThumbnails.length,
+						padding,
+						padding + width * (i + 1) / mThumbnails.length,
+						getHeight() - padding);
+				canvas.drawBitmap(mThumbnails[i], null, mThumbnailRect, null);
+			}
+		}
 		canvas.drawRect(mBarRect, mBarPaint);
 	}
 	